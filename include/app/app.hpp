@@ -1,10 +1,23 @@
 #pragma once
 
 #include "app/glgeom.hpp"
+#include "app/glpacer.hpp"
+#include "app/glpool.hpp"
+#include "app/glupload.hpp"
+#include "app/meshbvh.hpp"
+#include "app/meshsampler.hpp"
+#include "app/particlecache.hpp"
+#include "app/pointcloud.hpp"
+#include "app/pointoctree.hpp"
+#include "app/recorder.hpp"
+#include "app/sdfbaker.hpp"
+#include "app/threadpool.hpp"
 #include "app/util.hpp"
+#include "app/vectorfield.hpp"
 #include "gtc/quaternion.hpp"
 
 #include <array>
+#include <functional>
 #include <string>
 #include <string_view>
 
@@ -26,7 +39,103 @@ struct CommonShaderUniforms {
   GLfloat time_delta;
   GLint frame;
 
-  GLfloat _pad[3]; // Required to make the struct size a multiple of 16 bytes.
+  GLint addressing_mode;
+  GLint stable_ids_enabled;
+  GLint layer_count;
+
+  gl::vec4 sdf_bounds_min;
+  gl::vec4 sdf_bounds_size; // w is 1 when a signed distance field is set
+
+  gl::vec4 vector_field_bounds_min;
+  gl::vec4 vector_field_bounds_size; // w is 1 when a vector field is loaded
+
+  GLint mesh_bvh_node_count;
+  GLint _pad[3]; // Required to make the struct size a multiple of 16 bytes.
+};
+
+static_assert(sizeof(CommonShaderUniforms) % 16 == 0, "CommonShaderUniforms is uploaded as a std140 block");
+
+// Per-frame input written by the host into persistent memory and consumed by `App::frame`. The layout
+// is fixed (see the static asserts in app.cpp) so that JavaScript can write it through typed arrays.
+enum FrameInputFlags {
+  FRAME_INPUT_SIMULATE = 1 << 0 // Run update and simulate. Leave unset to only draw, e.g. while paused.
+};
+
+struct FrameInputView {
+  GLfloat view_matrix[16];
+  GLfloat projection_matrix[16];
+  GLint viewport[4]; // x, y, width, height
+};
+
+struct FrameInputController {
+  GLfloat position[4];    // xyz
+  GLfloat velocity[4];    // xyz
+  GLfloat orientation[4]; // Quaternion xyzw
+  GLfloat buttons[4];
+};
+
+struct FrameInput {
+  static constexpr int MAX_VIEWS{ 2 };
+  static constexpr int MAX_CONTROLLERS{ 2 };
+
+  GLdouble time_seconds;
+  GLdouble time_delta_seconds;
+
+  GLint frame_id;
+  GLint flags;
+  GLint display_width;
+  GLint display_height;
+  GLint view_count;
+  GLint controller_mask; // Bit i set if controller i was updated
+
+  FrameInputView views[MAX_VIEWS];
+  FrameInputController controllers[MAX_CONTROLLERS];
+
+  // Written last by the host and applied after simulation, right before the views are rendered, so
+  // `#pragma lateLatch` particles follow these instead of `controllers`
+  GLint latched_controller_mask; // Bit i set if latched controller i was updated
+  GLint _pad[3];
+  FrameInputController latched_controllers[MAX_CONTROLLERS];
+};
+
+// Declared in user shaders with `#pragma param name default min max`
+struct UserParam {
+  std::string name;
+
+  GLfloat value;
+  GLfloat default_value;
+  GLfloat min_value;
+  GLfloat max_value;
+};
+
+// Declared in user shaders with `#pragma variant NAME value...`. The selected value is injected as a `#define`.
+struct ShaderVariant {
+  std::string name;
+  std::vector<std::string> values;
+
+  size_t selected = 0;
+};
+
+// Delivered to `App::requestParticleReadback` callbacks. The texels are only valid during the callback.
+struct ParticleReadbackData {
+  static constexpr int MAX_ATTACHMENTS{ 6 };
+
+  int width;
+  int height;
+
+  GLfloat time; // Of the update that produced the state
+  GLint frame;
+
+  uint32_t attachment_mask;
+  const GLfloat *texels;                       // All requested attachments back to back, RGBA rows tightly packed
+  const GLfloat *attachments[MAX_ATTACHMENTS]; // Into `texels`, or null if the attachment wasn't requested
+};
+
+using ParticleReadbackCallback = std::function<void(const ParticleReadbackData &data)>;
+
+enum ParticleAddressingMode {
+  PARTICLE_ADDRESSING_LINEAR = 0,
+  PARTICLE_ADDRESSING_MORTON = 1
 };
 
 class App {
@@ -34,11 +143,57 @@ class App {
   static constexpr size_t ASSEMBLED_SHADER_SOURCE_COUNT{ 3 };
   static constexpr size_t TEMPLATE_SHADER_SOURCE_COUNT{ 3 };
 
+  static constexpr int PARTICLE_TILE_SIZE{ 16 };
+  static constexpr size_t MAX_SLEEP_WAKE_REGIONS{ 4 };
+  static constexpr int MAX_UPDATE_FRACTION{ 16 };
+  static constexpr size_t MAX_CACHED_PROGRAM_VARIANTS{ 16 };
+
   gl::ivec2 m_default_particle_framebuffer_resolution{ 128, 128 };
   gl::ivec2 m_particle_framebuffer_resolution = m_default_particle_framebuffer_resolution;
 
+  ParticleAddressingMode m_particle_addressing_mode{ PARTICLE_ADDRESSING_LINEAR };
+
+  // With layers enabled particle state lives in texture arrays, `m_particle_layer_count` layers of
+  // `m_particle_framebuffer_resolution` each, and every layer is simulated with its own draw.
+  bool m_particle_layers_enabled{ false };
+  int m_particle_layer_count{ 1 };
+
+  gl::ResourcePool m_resource_pool;
+
   std::unique_ptr<gl::Framebuffer> m_particle_fbs[2];
 
+  int m_reorder_interval{ 0 };
+  float m_default_reorder_cell_size{ 0.1f };
+  float m_reorder_cell_size = m_default_reorder_cell_size;
+
+  gl::Program m_reorder_key_program;
+  gl::Program m_reorder_sort_program;
+  gl::Program m_reorder_permute_program;
+  gl::Program m_stable_id_program;
+
+  std::unique_ptr<gl::Framebuffer> m_reorder_key_fbs[2];
+  std::unique_ptr<gl::Framebuffer> m_stable_id_fbs[2];
+  bool m_stable_ids_valid{ false };
+
+  // Particles flag themselves asleep by writing w > 0.5 to their last attachment.
+  bool m_sleep_enabled{ false };
+  float m_sleep_wake_radius{ 0.0f };
+  std::vector<gl::vec4> m_sleep_wake_regions; // (center, radius)
+
+  gl::Program m_sleep_mark_program;
+  gl::Program m_copy_particles_program;
+  gl::Program m_copy_particles_layered_program;
+
+  // With `#pragma lateLatch <count>` the first <count> particles only depend on the controller poses, and are
+  // simulated again with the latched poses right before rendering.
+  int m_late_latch_particle_count{ 0 };
+  bool m_view_pose_dirty{ false };
+  bool m_controller_pose_dirty{ false };
+
+  int m_update_fraction{ 1 };
+  int m_update_band{ 0 };
+  std::vector<float> m_update_band_times; // Time each band of rows was last simulated, or < 0 if never.
+
   gl::VertexBuffer m_fullscreen_triangle_vb;
 
   GLsizei m_default_instance_vertex_count{ 6 };
@@ -55,11 +210,73 @@ class App {
   GLenum m_default_depth_func{ GL_LESS };
   GLenum m_depth_func = m_default_depth_func;
 
+  bool m_tile_culling_enabled{ false };
+  float m_tile_culling_margin{ 0.0f };
+
+  struct TileBoundsReadback {
+    gl::PixelBuffer buffer;
+    gl::Fence fence;
+    bool pending = false;
+  };
+
+  gl::Program m_tile_bounds_program;
+  gl::Framebuffer m_tile_bounds_fb;
+  TileBoundsReadback m_tile_bounds_readbacks[2];
+  size_t m_tile_bounds_readback_index{ 0 };
+
+  std::vector<gl::vec4> m_tile_bounds; // Bounding sphere of each particle tile from the latest finished readback.
+  std::vector<gl::ivec2> m_visible_tile_spans;
+  std::vector<GLint> m_visible_draw_firsts;
+  std::vector<GLsizei> m_visible_draw_counts;
+
+  static constexpr size_t MAX_PARTICLE_READBACKS{ 4 };
+
+  struct ParticleReadback {
+    gl::PixelBuffer buffer;
+    gl::Fence fence;
+    ParticleReadbackCallback callback;
+
+    uint32_t attachment_mask = 0;
+    int width = 0;
+    int height = 0;
+    float time = 0.0f;
+    int frame = 0;
+
+    uint64_t sequence = 0;
+    bool pending = false;
+
+#if defined(PLATFORM_EMSCRIPTEN)
+    std::vector<GLfloat> staging; // WebGL can't map buffers
+#endif
+  };
+
+  ParticleReadback m_particle_readbacks[MAX_PARTICLE_READBACKS]; // Pooled, buffers are kept between requests
+  uint64_t m_particle_readback_sequence{ 0 };
+
   CommonShaderUniforms m_common_uniforms;
   gl::UniformBuffer m_common_uniforms_buffer;
 
+  std::vector<UserParam> m_user_params;         // Layout of the compiled programs' UserParams block
+  std::vector<UserParam> m_pending_user_params; // Declared in the current sources, applied on successful compile
+  std::string m_user_params_shader_source;
+  std::vector<GLfloat> m_user_params_data;
+  gl::UniformBuffer m_user_params_buffer;
+  bool m_user_params_dirty{ false };
+
   gl::Program m_programs[2];
 
+  struct CachedProgramVariant {
+    uint64_t source_hash;
+    uint64_t defines_hash;
+
+    gl::Program programs[2];
+  };
+
+  std::vector<ShaderVariant> m_shader_variants;
+  std::vector<CachedProgramVariant> m_program_cache; // Least recently used first
+  uint64_t m_program_source_hash{ 0 };
+  uint64_t m_program_defines_hash{ 0 };
+
   gl::vec4 m_controller_position[2];
   gl::quat m_controller_orientation[2];
 
@@ -73,22 +290,93 @@ class App {
   std::string_view m_simulate_shader_vs_source;
 
   FrameClock m_clock;
+  FrameInput m_frame_input{};
+  gl::FramePacer m_frame_pacer;
+
+  InputRecorder m_input_recorder;
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+  std::unique_ptr<ParticleCacheWriter> m_particle_cache_writer;
+  std::unique_ptr<ParticleCacheReader> m_particle_cache_reader;
+#endif
+
+  std::unique_ptr<ThreadPool> m_thread_pool; // Created by getThreadPool on first use
+  std::unique_ptr<PointCloudLoader> m_point_cloud_loader;
+  gl::TextureUploader m_texture_uploader;
+
+  gl::Texture m_sdf_texture;
+  gl::Texture m_mesh_bvh_textures[2]; // Nodes, triangles
+  gl::Texture m_vector_field_texture;
+
+  std::unique_ptr<PointOctreeStreamer> m_point_octree;
+  gl::Program m_point_octree_program;
+  float m_point_octree_error_threshold{ 1.5f };
+  bool m_point_octree_updated{ false }; // Nodes are selected once per frame, when the first view is rendered
+
+  // The views `frame` is rendering, so node selection covers all of them. None when hosts call `render` directly.
+  gl::mat4 m_frame_view_projections[FrameInput::MAX_VIEWS];
+  int m_frame_view_count{ 0 };
+
+  // Once a point cloud is imported the particle count follows it instead of `#pragma size`
+  gl::ivec2 m_imported_particle_resolution{ 0 };
 
   void updateViewAndProjectionTransforms();
   void updateControllerTransforms();
 
+  bool createUtilityProgram(gl::Program &prog, std::string_view fragment_shader_template, std::string_view defines = {});
+
+  void createParticleFramebuffers(); // (Re)creates them if the resolution or sleep mode changed
+  void markSleepingParticles();
+  void reorderParticles();
+  void updateTileBounds();
+  void collectParticleReadbacks();
+  ThreadPool &getThreadPool();
+  bool resizeParticlesForImport(size_t particle_count, const char *import_name);
+  bool startPointCloudImport(std::unique_ptr<PointCloudLoader> loader);
+  void uploadMeshSamples(const gl::vec4 *const (&attachments)[3]);
+  void uploadPointCloudChunks();
+  void drawParticles();
+  void drawPointOctree(int displayHeight);
+  void resimulateLateLatchedParticles();
+
+  bool wantsParticleLayers() const;
+  void splitParticleResolutionIntoLayers(int requested_layer_count);
+
+  size_t estimateParticleMemoryBytes(const gl::ivec2 &resolution) const;
+  void fitParticleResolutionToMemoryBudget();
+  void trimResourcePoolToMemoryBudget();
+
   std::string assembleShaderSourceAtIndex(int index);
 
+  std::vector<ShaderVariant> parseShaderVariantPragmas() const;
+  uint64_t hashAssembledShaderSources() const;
+  bool compileShaderPrograms(gl::Program (&programs)[2], std::string_view defines);
+  void setupShaderPrograms(gl::Program (&programs)[2]);
+  void stashShaderPrograms();
+  bool selectShaderVariantPrograms();
+
+  bool parseUserParamPragmas();
+  void applyPendingUserParams();
+  void uploadUserParams();
+
   void parseSimulationShaderPragmas();
   void parseRenderShaderPragmas();
 
 public:
   bool init();
   void cleanup();
+  void beginFrame();
+  void endFrame();
+
+  // Runs a whole frame from the FrameInput: controllers, update and simulate (if flagged), latched
+  // controllers, then clears and renders each view into its viewport.
+  void frame();
+  FrameInput *getFrameInput();
   void update(int frame_id, double time_seconds, double time_delta_seconds);
   void simulate(int displayWidth, int displayHeight);
   void render(int displayWidth, int displayHeight);
 
+  size_t getUserShaderSourceCount() const;
   std::string_view getUserShaderSourceAtIndex(int index);
   std::string_view getAssembledShaderSourceAtIndex(int index);
   void setUserShaderSourceAtIndex(int index, std::string_view shader_src);
@@ -98,5 +386,122 @@ public:
   void setViewAndProjectionMatrices(const float *view_matrix_values, const float *projection_matrix_values);
   void setControllerAtIndex(int index, const float *position_values, const float *velocity_values, const float *orientation_values, const float *buttons_values);
 
+  // Streams the common uniforms into a fresh buffer if poses were set since the last upload, then resimulates
+  // `#pragma lateLatch` particles if a controller moved. `frame` calls it after applying the latched
+  // controllers, and `render` calls it for hosts driving `simulate` and `render` themselves.
+  void latchPoses();
+
   double getAverageFramesPerSecond() const;
+
+  bool setShaderVariant(std::string_view name, std::string_view value);
+  size_t getShaderVariantCount() const;
+  const ShaderVariant &getShaderVariantAtIndex(int index) const;
+
+  bool setUserParam(std::string_view name, float value);
+  size_t getUserParamCount() const;
+  const UserParam &getUserParamAtIndex(int index) const;
+
+  // Records calls made through this API until stopped. Replay the data with an InputReplayer.
+  void startInputRecording();
+  void stopInputRecording();
+  const InputRecorder &getInputRecorder() const;
+
+  // Snapshots hold both particle framebuffers and the time and frame of the last update. A snapshot only
+  // restores into the scene (shaders) it was taken from.
+  bool saveParticleSnapshot(std::vector<uint8_t> &out_data);
+  bool restoreParticleSnapshot(const uint8_t *data, size_t size_bytes);
+#if !defined(PLATFORM_EMSCRIPTEN)
+  bool saveParticleSnapshot(const char *path);
+  bool restoreParticleSnapshot(const char *path); // Uploads from a memory mapping of the file
+#endif
+#if !defined(PLATFORM_EMSCRIPTEN)
+  // Bakes every simulated frame into a particle cache until stopped
+  bool startParticleCacheBake(const char *path);
+  bool stopParticleCacheBake();
+
+  // Streams a baked cache into the particle framebuffers in place of simulating. The cache must match the
+  // current particle layout.
+  bool startParticleCachePlayback(const char *path, bool loop);
+  void stopParticleCachePlayback();
+  bool isPlayingParticleCache() const;
+#endif
+
+  // Replaces the particle state with the points of a PLY or XYZ file. Positions go to attachment 0 as
+  // (x, y, z, 1) and colors to attachment 1, and the particle count is resized to fit the points. Parsing
+  // runs on worker threads and finished chunks are uploaded over the following frames, so this returns
+  // right after reading the header.
+  bool importPointCloud(const uint8_t *data, size_t size_bytes);
+#if !defined(PLATFORM_EMSCRIPTEN)
+  bool importPointCloud(const char *path);
+#endif
+  float getPointCloudImportProgress() const; // 1 when no import is running
+
+  // Replaces the particle state with points spread evenly by area over the surface of `mesh`: positions go to
+  // attachment 0 as (x, y, z, 1), texcoords to attachment 1 as (u, v, 0, 1) and normals to attachment 2 as
+  // (x, y, z, 0). The particle count is resized to fit `particle_count`, rounded up to whole rows. The same
+  // mesh, count and seed always give the same points.
+  bool emitFromMesh(const gl::DefaultTriangleMesh &mesh, size_t particle_count, uint32_t seed = 0);
+#if !defined(PLATFORM_EMSCRIPTEN)
+  // Loads the points from `cache_path` when it was written for the same mesh, count and seed. Otherwise
+  // samples the mesh and writes the cache.
+  bool emitFromMesh(const gl::DefaultTriangleMesh &mesh, size_t particle_count, uint32_t seed, const char *cache_path);
+#endif
+
+  // Uploads a signed distance volume for simulation and render shaders to read through iSDF, sdfDistance()
+  // and sdfNormal(), replacing the previous one. A collision then costs one texture fetch instead of a full
+  // evaluation of the scene's distance function.
+  bool setSignedDistanceField(const SignedDistanceVolume &volume);
+  void clearSignedDistanceField();
+
+  // Bake on the thread pool, then upload. `max_resolution` is the voxel count along the longest side.
+  bool bakeSignedDistanceField(const gl::DefaultTriangleMesh &mesh, int max_resolution = 64, float padding = 0.1f);
+  bool bakeSignedDistanceField(const std::function<float(const gl::vec3 &)> &distance,
+                               const gl::vec3 &bounds_min,
+                               const gl::vec3 &bounds_max,
+                               int max_resolution = 64);
+
+  // Uploads a triangle mesh BVH for shaders to raycast with meshIntersectSegment(), replacing the previous
+  // one. The mesh overload builds the BVH on the thread pool first.
+  bool setCollisionMesh(const MeshBvh &bvh);
+  bool setCollisionMesh(const gl::DefaultTriangleMesh &mesh);
+  void clearCollisionMesh();
+
+  // Loads a vector field baked by an external tool, FGA text or the binary format from `writeVectorField`,
+  // for shaders to advect particles with vectorFieldSample(). Files are memory mapped. Text is parsed on the
+  // thread pool, while binary fields upload straight from the file data.
+#if !defined(PLATFORM_EMSCRIPTEN)
+  bool loadVectorField(const char *path);
+#endif
+  bool loadVectorField(const uint8_t *data, size_t size_bytes);
+  bool setVectorField(const VectorField &field);
+  void clearVectorField();
+
+  // Draws a point octree file alongside the particles, streaming in only the nodes the view needs. Build the
+  // file from a PLY or XYZ point cloud with `buildPointOctree`. `pool_page_count` nodes of
+  // PointOctreeStreamer::NODE_CAPACITY points stay resident on the GPU, which also caps the points drawn.
+#if !defined(PLATFORM_EMSCRIPTEN)
+  bool buildPointOctree(const char *input_path, const char *output_path); // Blocks until written
+  bool openPointOctree(const char *path, int pool_page_count = PointOctreeStreamer::DEFAULT_POOL_PAGE_COUNT);
+#endif
+  bool openPointOctree(const uint8_t *data, size_t size_bytes, int pool_page_count = PointOctreeStreamer::DEFAULT_POOL_PAGE_COUNT);
+  void closePointOctree();
+  void setPointOctreeErrorThreshold(float pixels); // Nodes refine while their point spacing is bigger on screen
+  const PointOctreeStats &getPointOctreeStats() const;
+
+  // Copies the attachments in `attachment_mask` (bit i for attachment i) of the latest particle state into a
+  // pixel buffer. `callback` runs from a later `beginFrame` once the copy has finished on the GPU, so this
+  // never blocks. Returns false if nothing has been simulated yet or all readbacks are still in flight.
+  bool requestParticleReadback(uint32_t attachment_mask, ParticleReadbackCallback callback);
+
+  float getSimulationTime() const;
+  int getSimulationFrame() const;
+
+  void setMaxFramesInFlight(int count);
+  const gl::FramePacerStats &getFramePacerStats() const;
+
+  void setResourcePoolBudget(size_t budget_bytes);
+  const gl::ResourcePoolStats &getResourcePoolStats() const;
+
+  void setMemoryBudget(size_t budget_bytes);
+  const gl::MemoryStats &getMemoryStats() const;
 };
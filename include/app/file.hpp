@@ -0,0 +1,49 @@
+#pragma once
+
+#include "app/platform.hpp"
+
+// Web builds have no filesystem. Hosts there pass data through memory instead.
+#if !defined(PLATFORM_EMSCRIPTEN)
+
+#include <cstddef>
+#include <cstdint>
+
+// Read-only view of a whole file mapped into memory. Pages are loaded on first access, so data can be
+// handed straight to the GPU without reading it into an intermediate buffer.
+class MappedFile {
+  const uint8_t *m_data = nullptr;
+  std::size_t m_size_bytes = 0;
+
+#if defined(PLATFORM_WINDOWS)
+  void *m_file_handle = nullptr;
+  void *m_mapping_handle = nullptr;
+#else
+  int m_fd = -1;
+#endif
+
+public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool open(const char *path);
+  void close();
+
+  bool isOpen() const {
+    return m_data != nullptr;
+  }
+
+  const uint8_t *data() const {
+    return m_data;
+  }
+
+  std::size_t size() const {
+    return m_size_bytes;
+  }
+};
+
+bool writeFile(const char *path, const void *data, std::size_t size_bytes);
+
+#endif
@@ -38,6 +38,8 @@ struct VertexBuffer {
   GLenum primitive;
   GLsizei count;
 
+  std::size_t size_bytes = 0; // Vertex and element data combined
+
   std::vector<VertexAttribute> attribs;
 
   GL_UTIL_MOVE_ONLY_CLASS(VertexBuffer)
@@ -58,6 +60,12 @@ DefaultTriangleMesh createQuad(const vec2 &min = vec2(-1.0f),
 BoundingBox calcBoundingBox(const DefaultTriangleMesh &mesh);
 vec3 calcCenter(const BoundingBox &box);
 
+// Normalized planes (xyz normal pointing inside, w distance) from the rows of a model-view-projection matrix
+void calcFrustumPlanes(const mat4 &model_view_projection, vec4 (&out_planes)[6]);
+
+// True unless the sphere (xyz center, w radius) is fully outside one of the planes
+bool isSphereInFrustum(const vec4 (&planes)[6], const vec4 &sphere);
+
 void createVertexBuffer(VertexBuffer &vb,
                         GLenum primitive,
                         std::size_t vertex_data_size_bytes,
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "glutil.hpp"
+
+#include <chrono>
+#include <cstdint>
+
+namespace gl {
+
+struct FramePacerStats {
+  int max_frames_in_flight = 0;
+  int frames_in_flight = 0;
+
+  // Latest frame, in milliseconds
+  double cpu_time_ms = 0.0;      // From beginFrame to endFrame, not counting time spent waiting on fences
+  double fence_wait_ms = 0.0;    // Time beginFrame spent blocked on the GPU
+  double frame_latency_ms = 0.0; // From endFrame until the frame's fence was seen signaled (an upper bound on GPU time)
+
+  // Exponential moving averages of the above
+  double average_cpu_time_ms = 0.0;
+  double average_fence_wait_ms = 0.0;
+  double average_frame_latency_ms = 0.0;
+
+  // A frame is GPU bound when the frame cap was hit and the CPU had to wait (or on WebGL, would have waited).
+  // Frames that never wait are CPU bound.
+  bool gpu_bound = false;
+
+  uint64_t frame_count = 0;
+  uint64_t gpu_bound_frame_count = 0;
+};
+
+// Bounds how many frames the CPU can queue ahead of the GPU by fencing each frame and waiting on the
+// oldest fence once the cap is reached. WebGL can't block on fences, so there the pacer only measures.
+class FramePacer {
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr int MAX_FRAMES_IN_FLIGHT{ 3 };
+
+  struct FrameFence {
+    Fence fence;
+    Clock::time_point submit_time;
+  };
+
+  FrameFence m_frames[MAX_FRAMES_IN_FLIGHT];
+  int m_oldest_frame{ 0 };
+
+  int m_max_frames_in_flight{ 2 };
+  bool m_frame_open{ false };
+
+  Clock::time_point m_frame_begin_time;
+  double m_frame_wait_ms{ 0.0 };
+
+  FramePacerStats m_stats;
+
+  void retireOldestFrame(Clock::time_point now);
+
+public:
+  FramePacer() = default;
+
+  FramePacer(const FramePacer &) = delete;
+  FramePacer &operator=(const FramePacer &) = delete;
+
+  // Clamped to [1, 3]
+  void setMaxFramesInFlight(int count);
+  int getMaxFramesInFlight() const {
+    return m_max_frames_in_flight;
+  }
+
+  // Call before issuing a frame's GL commands. Blocks natively while the cap is reached.
+  void beginFrame();
+  // Call after the last GL command of the frame.
+  void endFrame();
+
+  const FramePacerStats &getStats() const {
+    return m_stats;
+  }
+};
+
+} // gl
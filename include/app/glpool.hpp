@@ -0,0 +1,86 @@
+#pragma once
+
+#include "glutil.hpp"
+
+#include <cstdint>
+
+namespace gl {
+
+struct ResourcePoolStats {
+  std::size_t hits = 0;
+  std::size_t misses = 0;
+  std::size_t evictions = 0;
+
+  std::size_t pooled_count = 0;
+  std::size_t pooled_bytes = 0;
+};
+
+// Keeps released framebuffers (and their attachments) around so that switching back to a previously
+// used size or format reuses the existing storage instead of reallocating it. Unused framebuffers are
+// evicted least-recently-released first once the pooled total exceeds the budget.
+class ResourcePool {
+  struct Key {
+    int width = 0;
+    int height = 0;
+    int layer_count = 0; // 0 for 2D attachments
+
+    std::vector<GLenum> attachments; // Flattened attachment points and opts
+
+    bool operator==(const Key &other) const;
+  };
+
+  struct Entry {
+    Key key;
+    std::size_t size_bytes = 0;
+    uint64_t last_use = 0;
+
+    std::unique_ptr<Framebuffer> fb;
+  };
+
+  std::size_t m_budget_bytes;
+  uint64_t m_use_counter{ 0 };
+
+  std::vector<Entry> m_free_entries;
+  std::vector<std::pair<GLuint, Key>> m_acquired_keys;
+
+  ResourcePoolStats m_stats;
+
+  static Key makeKey(int width, int height, int layer_count, const std::vector<FramebufferTextureAttachment> &texture_attachments, const std::vector<FramebufferRenderbufferAttachment> &renderbuffer_attachments);
+
+  std::unique_ptr<Framebuffer> takeFreeFramebuffer(const Key &key);
+
+  void evictToBudget(std::size_t budget_bytes);
+
+public:
+  static constexpr std::size_t DEFAULT_BUDGET_BYTES{ 256 * 1024 * 1024 };
+
+  explicit ResourcePool(std::size_t budget_bytes = DEFAULT_BUDGET_BYTES);
+
+  ResourcePool(const ResourcePool &) = delete;
+  ResourcePool &operator=(const ResourcePool &) = delete;
+
+  // Returns a pooled framebuffer matching the size and attachments if one is available, or creates a
+  // new one. The contents of a reused framebuffer are whatever was last rendered into it.
+  std::unique_ptr<Framebuffer> acquireFramebuffer(int width, int height, const std::vector<FramebufferTextureAttachment> &texture_attachments, const std::vector<FramebufferRenderbufferAttachment> &renderbuffer_attachments = {});
+
+  // Same for framebuffers with `layer_count` layers of array attachments, see `createLayeredFramebuffer`.
+  std::unique_ptr<Framebuffer> acquireLayeredFramebuffer(int width, int height, int layer_count, const std::vector<FramebufferTextureAttachment> &texture_attachments);
+
+  // Hands a framebuffer back to the pool. Framebuffers that weren't acquired from this pool are deleted.
+  void releaseFramebuffer(std::unique_ptr<Framebuffer> fb);
+
+  void setBudget(std::size_t budget_bytes);
+  std::size_t getBudget() const {
+    return m_budget_bytes;
+  }
+
+  // Evicts pooled framebuffers until at most `max_pooled_bytes` remain, without changing the budget.
+  void trim(std::size_t max_pooled_bytes);
+  void clear();
+
+  const ResourcePoolStats &getStats() const {
+    return m_stats;
+  }
+};
+
+} // gl
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "glutil.hpp"
+
+namespace gl {
+
+// Streams data into textures through a small ring of pixel unpack buffers. Each buffer is fenced after its
+// copies are issued and only reused once the GPU is done with it, so uploads never stall the driver and
+// `begin` never blocks: it fails instead, and the caller tries again next frame.
+class TextureUploader {
+  static constexpr std::size_t RING_SIZE{ 3 };
+
+  struct Slot {
+    PixelBuffer buffer;
+    Fence fence;
+  };
+
+  std::size_t m_slot_size_bytes;
+
+  Slot m_slots[RING_SIZE];
+  std::size_t m_slot_index{ 0 };
+  bool m_staging{ false };
+
+public:
+  static constexpr std::size_t DEFAULT_SLOT_SIZE_BYTES{ 4 * 1024 * 1024 };
+
+  explicit TextureUploader(std::size_t slot_size_bytes = DEFAULT_SLOT_SIZE_BYTES);
+  ~TextureUploader();
+
+  TextureUploader(const TextureUploader &) = delete;
+  TextureUploader &operator=(const TextureUploader &) = delete;
+
+  std::size_t getSlotSizeBytes() const {
+    return m_slot_size_bytes;
+  }
+
+  // Claims the next buffer in the ring. Returns false if the GPU is still reading it.
+  bool begin();
+
+  // Copies into the claimed buffer
+  void write(std::size_t offset_bytes, const void *data, std::size_t size_bytes);
+
+  // Copies `texel_count` texels, starting at `offset_bytes` in the claimed buffer, into the texels of `tex`
+  // starting at `first_texel` in row-major order. Ranges may start and end mid-row.
+  void copyToTexture(const Texture &tex, std::size_t first_texel, std::size_t texel_count, std::size_t offset_bytes);
+
+  // Copies a `width` by `height` rectangle of texels, rows tightly packed from `offset_bytes`, to (x, y) in `tex`.
+  void copyToTextureRegion(const Texture &tex, int x, int y, int width, int height, std::size_t offset_bytes);
+
+  // Fences the claimed buffer and moves on to the next one.
+  void end();
+
+  void clear();
+};
+
+} // namespace gl
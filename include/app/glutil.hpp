@@ -94,6 +94,8 @@ struct Program {
 struct UniformBuffer {
   GLuint id = 0;
 
+  std::size_t size_bytes = 0;
+
   GL_UTIL_MOVE_ONLY_CLASS(UniformBuffer)
 };
 
@@ -116,6 +118,9 @@ struct TextureOpts {
 
   GLenum wrapS = GL_CLAMP_TO_EDGE;
   GLenum wrapT = GL_CLAMP_TO_EDGE;
+  GLenum wrapR = GL_CLAMP_TO_EDGE; // 3D textures only
+
+  bool immutable = false; // Allocate with `glTexStorage2D`. Storage can't be respecified, but drivers skip revalidation.
 };
 
 struct Texture {
@@ -123,6 +128,7 @@ struct Texture {
 
   int width = 0;
   int height = 0;
+  int depth = 1; // Layers of a GL_TEXTURE_2D_ARRAY
 
   TextureOpts opts;
 
@@ -140,6 +146,8 @@ struct Renderbuffer {
   int width = 0;
   int height = 0;
 
+  RenderbufferOpts opts;
+
   GL_UTIL_MOVE_ONLY_CLASS(Renderbuffer)
 };
 
@@ -164,15 +172,60 @@ struct Framebuffer {
 
   std::vector<GLenum> buffers;
 
+  // Array attachments get one framebuffer per layer since GLES 3.0 can't render to several layers at once.
+  // `id` renders to layer 0, `layer_ids[i]` to layer i + 1.
+  int layer_count = 1;
+  std::vector<GLuint> layer_ids;
+
   GL_UTIL_MOVE_ONLY_CLASS(Framebuffer)
 };
 
+struct PixelBuffer {
+  GLuint id = 0;
+
+  std::size_t size_bytes = 0;
+
+  GL_UTIL_MOVE_ONLY_CLASS(PixelBuffer)
+};
+
+struct Fence {
+  GLsync sync = nullptr;
+
+  GL_UTIL_MOVE_ONLY_CLASS(Fence)
+};
+
+enum MemoryCategory {
+  MEMORY_CATEGORY_TEXTURE = 0,
+  MEMORY_CATEGORY_RENDERBUFFER,
+  MEMORY_CATEGORY_UNIFORM_BUFFER,
+  MEMORY_CATEGORY_VERTEX_BUFFER,
+  MEMORY_CATEGORY_PIXEL_BUFFER,
+  MEMORY_CATEGORY_COUNT
+};
+
+// Estimated from formats and sizes. Drivers pad and align, so real usage is somewhat higher.
+struct MemoryStats {
+  std::size_t live_bytes[MEMORY_CATEGORY_COUNT] = {};
+  std::size_t live_count[MEMORY_CATEGORY_COUNT] = {};
+
+  std::size_t total_bytes = 0;
+  std::size_t peak_total_bytes = 0;
+};
+
 void checkError();
 void clearErrorLog();
 const std::vector<std::string> &getErrorLog();
 
 void printStats();
 
+void trackMemoryAllocation(MemoryCategory category, std::size_t size_bytes);
+void trackMemoryDeallocation(MemoryCategory category, std::size_t size_bytes);
+const MemoryStats &getMemoryStats();
+
+// A budget of 0 means unlimited. The budget is advisory; callers check it before allocating.
+void setMemoryBudget(std::size_t budget_bytes);
+std::size_t getMemoryBudget();
+
 GLuint createShader(std::string_view shader_src, GLenum type, ShaderError *error = nullptr);
 
 Program createProgram(std::string_view vert_shader_src, std::string_view frag_shader_src, ProgramError *error = nullptr, bool *success = nullptr);
@@ -202,10 +255,18 @@ void updateUniformBuffer(UniformBuffer &ub, const UniformData &uniform_data) {
   updateUniformBuffer(ub, sizeof(UniformData), &uniform_data);
 }
 
+std::size_t getBytesPerPixel(GLenum internal_format);
+std::size_t getTextureSizeBytes(const Texture &tex);
+std::size_t getRenderbufferSizeBytes(const Renderbuffer &rb);
+std::size_t getFramebufferSizeBytes(const Framebuffer &fb);
+
 Texture createTexture(int width, int height, const TextureOpts &opts = {});
 Texture createTexture(const TextureData &data, const TextureOpts &opts = {});
 void createTexture(Texture &tex, int width, int height, const TextureOpts &opts = {});
 void createTexture(Texture &tex, const TextureData &data, const TextureOpts &opts = {});
+void createTextureArray(Texture &tex, int width, int height, int depth, const TextureOpts &opts); // `opts.target` must be GL_TEXTURE_2D_ARRAY
+void createTexture3D(Texture &tex, int width, int height, int depth, const TextureOpts &opts); // `opts.target` must be GL_TEXTURE_3D
+void updateTexture(const Texture &tex, const void *pixels); // Replaces the whole image (every layer or slice), rows tightly packed
 void deleteTexture(Texture &tex) noexcept;
 
 Renderbuffer createRenderbuffer(int width, int height, const RenderbufferOpts &opts = {});
@@ -214,7 +275,57 @@ void deleteRenderbuffer(Renderbuffer &rb) noexcept;
 
 Framebuffer createFramebuffer(int width, int height, const std::vector<FramebufferTextureAttachment> &texture_attachments, const std::vector<FramebufferRenderbufferAttachment> &renderbuffer_attachments = {});
 void createFramebuffer(Framebuffer &fb, int width, int height, const std::vector<FramebufferTextureAttachment> &texture_attachments, const std::vector<FramebufferRenderbufferAttachment> &renderbuffer_attachments = {});
+void createLayeredFramebuffer(Framebuffer &fb, int width, int height, int layer_count, const std::vector<FramebufferTextureAttachment> &texture_attachments);
 void deleteFramebuffer(Framebuffer &fb) noexcept;
+void readFramebufferTexture(const Framebuffer &fb, std::size_t index, void *pixels); // Reads the whole image, rows tightly packed
+
+void createPixelBuffer(PixelBuffer &pb, std::size_t size_bytes, GLenum usage = GL_STREAM_READ);
+void deletePixelBuffer(PixelBuffer &pb) noexcept;
+void readPixelsToBuffer(PixelBuffer &pb, std::size_t offset_bytes, int x, int y, int width, int height, GLenum format = GL_RGBA, GLenum type = GL_FLOAT);
+void getPixelBufferData(PixelBuffer &pb, std::size_t offset_bytes, std::size_t size_bytes, void *data);
+void setPixelBufferData(PixelBuffer &pb, std::size_t offset_bytes, std::size_t size_bytes, const void *data);
+void updateTextureFromBuffer(const Texture &tex, PixelBuffer &pb, std::size_t offset_bytes, int x, int y, int width, int height);
+#if !defined(PLATFORM_EMSCRIPTEN)
+// WebGL can't map buffers. Use `getPixelBufferData` there.
+const void *mapPixelBuffer(PixelBuffer &pb, std::size_t offset_bytes, std::size_t size_bytes);
+void unmapPixelBuffer(PixelBuffer &pb);
+#endif
+
+void createFence(Fence &fence);
+bool isFenceSignaled(const Fence &fence);
+// Returns GL_ALREADY_SIGNALED, GL_CONDITION_SATISFIED, GL_TIMEOUT_EXPIRED, or GL_WAIT_FAILED (e.g. after
+// losing the context). WebGL can't block, so there it only polls.
+GLenum waitFence(const Fence &fence, GLuint64 timeout_ns);
+void deleteFence(Fence &fence) noexcept;
+
+// Deferred deletion: objects the GPU may still be reading are queued, then deleted once a fence
+// inserted after their last use has signaled. Call `fenceDeferredDeletions` once per frame after
+// the last draw and `collectDeferredDeletions` whenever convenient. Re-creating an object with
+// `create*` and move-assigning over one retire the previous object this way too.
+void deleteProgramDeferred(Program &prog) noexcept;
+void deleteTextureDeferred(Texture &tex) noexcept;
+void deleteRenderbufferDeferred(Renderbuffer &rb) noexcept;
+void deleteFramebufferDeferred(Framebuffer &fb) noexcept;
+void deleteUniformBufferDeferred(UniformBuffer &ub) noexcept;
+void deletePixelBufferDeferred(PixelBuffer &pb) noexcept;
+
+// Uploads into a fresh (or recycled, already retired) buffer instead of overwriting one in flight.
+void streamUniformBuffer(UniformBuffer &ub, std::size_t uniform_data_size_bytes, const void *data);
+
+template <typename UniformData>
+void streamUniformBuffer(UniformBuffer &ub, const UniformData &uniform_data) {
+  streamUniformBuffer(ub, sizeof(UniformData), &uniform_data);
+}
+
+void fenceDeferredDeletions();
+void collectDeferredDeletions();
+void flushDeferredDeletions();
+
+bool hasExtension(std::string_view name);
+
+// One call with WEBGL_multi_draw on the web. Native builds load GLES 3.0, which has no multi-draw, so there
+// it's one `glDrawArrays` per range.
+void multiDrawArrays(GLenum mode, const GLint *firsts, const GLsizei *counts, GLsizei draw_count);
 
 inline void uniform(GLint loc, GLint x) {
   glUniform1i(loc, x);
@@ -312,6 +423,7 @@ inline void bindTexture(const Texture &tex, GLenum tex_unit) {
 }
 
 void bindFramebuffer(const Framebuffer &fb);
+void bindFramebuffer(const Framebuffer &fb, int layer);
 
 inline void unbindFramebuffer() {
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
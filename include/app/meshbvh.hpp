@@ -0,0 +1,29 @@
+#pragma once
+
+#include "app/glgeom.hpp"
+#include "app/threadpool.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Width of the node and triangle textures, in texels. Must match `meshBVHTexelCoord` in common_uniforms.glsl.
+static constexpr int MESH_BVH_TEXTURE_WIDTH{ 1024 };
+
+// A bounding volume hierarchy over a triangle mesh, flattened into the float texels the shader traversal reads.
+// Nodes are depth-first, so an inner node's first child directly follows it, and every node stores the index
+// of the node after its subtree. Traversal then needs no stack: step to the next node when its box is hit,
+// jump past the subtree when it's missed.
+struct MeshBvh {
+  // 2 texels per node: (min xyz, index past the subtree), (max xyz, first triangle or -1 for inner nodes)
+  std::vector<gl::vec4> nodes;
+  // 3 texels per triangle, in leaf order: (v0 xyz, 1 if last in its leaf), (v1 - v0, 0), (v2 - v0, 0)
+  std::vector<gl::vec4> triangles;
+
+  uint32_t node_count = 0;
+  uint32_t triangle_count = 0;
+};
+
+// Splits by the surface area heuristic over binned centroids. The top levels bin in parallel, then the
+// subtrees below are built as separate tasks on `pool`. Both texel arrays are padded to whole rows of
+// MESH_BVH_TEXTURE_WIDTH. Fails for empty meshes and ones too big to index with floats.
+bool buildMeshBvh(const gl::DefaultTriangleMesh &mesh, ThreadPool &pool, MeshBvh &out_bvh);
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "app/file.hpp"
+#include "app/glgeom.hpp"
+#include "app/threadpool.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Points on a mesh surface laid out as particle attachments, one vec4 per point each
+struct MeshSurfaceSamples {
+  std::vector<gl::vec4> positions; // (x, y, z, 1)
+  std::vector<gl::vec4> texcoords; // (u, v, 0, 1)
+  std::vector<gl::vec4> normals;   // (x, y, z, 0)
+};
+
+// Picks points uniformly by area over the surface of a triangle mesh. Triangles are chosen in constant time
+// from an alias table (Vose's method) over their areas, then a point is placed in the triangle with uniform
+// barycentric coordinates and the vertex normals and texcoords are interpolated there.
+class MeshSurfaceSampler {
+  static constexpr std::size_t TASK_SIZE{ 65536 }; // Triangles or samples per pool task
+
+  const gl::DefaultTriangleMesh *m_mesh = nullptr;
+
+  std::vector<float> m_alias_probabilities; // Chance that a bucket keeps its own triangle
+  std::vector<uint32_t> m_alias_indices;    // Triangle a bucket falls back to otherwise
+  double m_surface_area = 0.0;
+
+public:
+  // Areas are computed on `pool`. The mesh must outlive the sampler. Fails if the mesh has no area.
+  bool build(const gl::DefaultTriangleMesh &mesh, ThreadPool &pool);
+
+  // Samples are a function of `seed` and their index only, so results don't depend on the thread count.
+  void sample(std::size_t count, uint32_t seed, ThreadPool &pool, MeshSurfaceSamples &out_samples) const;
+
+  double getSurfaceArea() const {
+    return m_surface_area;
+  }
+};
+
+// Hashes the vertex data of every triangle, in parallel on `pool`
+uint64_t hashTriangleMesh(const gl::DefaultTriangleMesh &mesh, ThreadPool &pool);
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+// What a mesh sample cache was made from. Caches only load for an identical key.
+struct MeshSampleCacheKey {
+  uint64_t mesh_hash = 0;
+  uint64_t sample_count = 0;
+  uint32_t seed = 0;
+};
+
+bool writeMeshSampleCache(const char *path, const MeshSampleCacheKey &key, const MeshSurfaceSamples &samples);
+
+// Maps a cache and points `out_attachments` at its positions, texcoords and normals. Returns false if the file
+// is missing or was made from a different key.
+bool openMeshSampleCache(MappedFile &file, const char *path, const MeshSampleCacheKey &key, const gl::vec4 *(&out_attachments)[3]);
+#endif
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "app/platform.hpp"
+
+// Caches live on disk, so they're native only.
+#if !defined(PLATFORM_EMSCRIPTEN)
+
+#include "app/file.hpp"
+#include "app/glutil.hpp"
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Particle cache files hold one record per simulated frame. Texels are quantized to half floats and, between
+// keyframes, stored as the difference from the previous frame with runs of unchanged values collapsed.
+struct ParticleCacheFrame {
+  float time = 0.0f;
+  int frame = 0;
+
+  std::vector<float> texels; // Every texture of the particle framebuffer in order, rows tightly packed
+};
+
+// Bakes the particle framebuffer every frame. Readbacks go through two pixel buffers so the GPU is never
+// waited on for the frame just submitted, and encoding and writing happen on a background I/O thread.
+class ParticleCacheWriter {
+  static constexpr size_t READBACK_COUNT{ 2 };
+  static constexpr size_t MAX_QUEUED_FRAMES{ 4 };
+
+  struct Readback {
+    gl::PixelBuffer buffer;
+    gl::Fence fence;
+    float time = 0.0f;
+    int frame = 0;
+    bool pending = false;
+  };
+
+  std::FILE *m_file = nullptr;
+
+  int m_width = 0;
+  int m_height = 0;
+  size_t m_texture_count = 0;
+  uint32_t m_keyframe_interval = 0;
+
+  Readback m_readbacks[READBACK_COUNT];
+  size_t m_readback_index = 0;
+
+  std::thread m_thread;
+  std::mutex m_mutex;
+  std::condition_variable m_queue_changed;
+  std::deque<ParticleCacheFrame> m_queued_frames;
+  std::vector<std::vector<float>> m_free_texels;
+  bool m_closing = false;
+
+  // I/O thread only
+  std::vector<uint16_t> m_previous_quantized;
+  std::vector<uint16_t> m_deltas;
+  std::vector<uint16_t> m_encoded;
+  uint32_t m_frame_count = 0;
+  bool m_write_failed = false;
+
+  size_t getFrameTexelCount() const;
+
+  void finishReadback(Readback &readback);
+  void run();
+  void writeFrame(const ParticleCacheFrame &frame);
+
+public:
+  ParticleCacheWriter() = default;
+  ~ParticleCacheWriter();
+
+  ParticleCacheWriter(const ParticleCacheWriter &) = delete;
+  ParticleCacheWriter &operator=(const ParticleCacheWriter &) = delete;
+
+  // Every `keyframe_interval` frames is stored whole so playback can start over without the previous frames.
+  bool open(const char *path, int width, int height, size_t texture_count, uint32_t keyframe_interval = 60);
+
+  // Waits for outstanding readbacks and writes, then finalizes the file. Returns false if any write failed.
+  bool close();
+
+  bool isOpen() const {
+    return m_file != nullptr;
+  }
+
+  // Queues a readback of every texture of `fb`. Returns false if `fb` no longer matches the size and texture
+  // count the cache was opened with.
+  bool capture(const gl::Framebuffer &fb, float time, int frame);
+};
+
+// Plays a particle cache back into a particle framebuffer. A prefetch thread decodes frames ahead of playback
+// straight out of a memory mapping of the file.
+class ParticleCacheReader {
+  static constexpr size_t PREFETCH_FRAME_COUNT{ 3 };
+
+  MappedFile m_file;
+
+  int m_width = 0;
+  int m_height = 0;
+  size_t m_texture_count = 0;
+  uint32_t m_frame_count = 0;
+  bool m_loop = false;
+
+  std::thread m_thread;
+  std::mutex m_mutex;
+  std::condition_variable m_frames_changed;
+  std::deque<ParticleCacheFrame> m_ready_frames;
+  std::vector<ParticleCacheFrame> m_free_frames;
+  bool m_closing = false;
+  bool m_finished = false;
+
+  // Prefetch thread only
+  size_t m_offset = 0;
+  std::vector<uint16_t> m_quantized;
+
+  size_t getFrameTexelCount() const;
+
+  void run();
+  bool decodeNextFrame(ParticleCacheFrame &frame);
+
+public:
+  ParticleCacheReader() = default;
+  ~ParticleCacheReader();
+
+  ParticleCacheReader(const ParticleCacheReader &) = delete;
+  ParticleCacheReader &operator=(const ParticleCacheReader &) = delete;
+
+  bool open(const char *path, bool loop);
+  void close();
+
+  bool isOpen() const {
+    return m_file.isOpen();
+  }
+
+  int getWidth() const {
+    return m_width;
+  }
+
+  int getHeight() const {
+    return m_height;
+  }
+
+  size_t getTextureCount() const {
+    return m_texture_count;
+  }
+
+  // Uploads the next frame into the textures of `fb`, waiting for the prefetch thread if it has fallen
+  // behind. Returns false once a non-looping cache has run out of frames, or if `fb` doesn't match the cache.
+  bool uploadNextFrame(gl::Framebuffer &fb, float *out_time = nullptr, int *out_frame = nullptr);
+};
+
+#endif
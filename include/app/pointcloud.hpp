@@ -0,0 +1,136 @@
+#pragma once
+
+#include "app/file.hpp"
+#include "app/glutil.hpp"
+#include "app/threadpool.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+enum PointCloudFormat {
+  POINT_CLOUD_FORMAT_XYZ,             // Whitespace separated "x y z [... r g b]" per line
+  POINT_CLOUD_FORMAT_PLY_ASCII,
+  POINT_CLOUD_FORMAT_PLY_BINARY_LE,
+  POINT_CLOUD_FORMAT_PLY_BINARY_BE
+};
+
+// A run of parsed points, in file order. Positions are (x, y, z, 1) and colors are RGBA in 0-1.
+struct PointCloudPiece {
+  std::size_t first_point = 0;
+  std::size_t count = 0;
+
+  const gl::vec4 *positions = nullptr;
+  const gl::vec4 *colors = nullptr;
+};
+
+// Parses PLY and XYZ point clouds in fixed size chunks on a thread pool. `open` only reads the header and
+// finds the chunk boundaries. Chunks are parsed in parallel but handed out strictly in file order, so the
+// caller can upload each as soon as it's ready while later chunks are still being parsed.
+class PointCloudLoader {
+public:
+  static constexpr std::size_t CHUNK_POINT_COUNT{ 65536 };
+
+private:
+  enum PropertyType : uint8_t {
+    PROPERTY_INT8,
+    PROPERTY_UINT8,
+    PROPERTY_INT16,
+    PROPERTY_UINT16,
+    PROPERTY_INT32,
+    PROPERTY_UINT32,
+    PROPERTY_FLOAT32,
+    PROPERTY_FLOAT64
+  };
+
+  struct Property {
+    PropertyType type;
+    std::size_t offset; // In bytes for binary files, in fields for ASCII ones
+  };
+
+  struct Chunk {
+    std::size_t begin = 0; // Byte range of the chunk's points
+    std::size_t end = 0;
+    std::size_t first_point = 0;
+    std::size_t point_count = 0;
+
+    std::vector<gl::vec4> positions;
+    std::vector<gl::vec4> colors;
+
+    std::atomic<bool> parsed{ false };
+  };
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+  MappedFile m_file;
+#endif
+  std::vector<uint8_t> m_owned_data;
+
+  const uint8_t *m_data = nullptr;
+  std::size_t m_size_bytes = 0;
+
+  PointCloudFormat m_format = POINT_CLOUD_FORMAT_XYZ;
+  std::size_t m_point_count = 0;
+
+  std::vector<Property> m_properties;
+  std::size_t m_stride = 0;                         // Binary only
+  int m_position_properties[3]{ -1, -1, -1 };       // Into m_properties
+  int m_color_properties[3]{ -1, -1, -1 };          // Into m_properties, or -1 if the file has no colors
+  float m_color_scale = 1.0f;                       // Maps stored colors to 0-1
+
+  std::unique_ptr<Chunk[]> m_chunks;
+  std::size_t m_chunk_count = 0;
+
+  std::size_t m_consumed_chunk = 0;
+  std::size_t m_consumed_in_chunk = 0;
+  std::size_t m_consumed_point_count = 0;
+
+  ThreadPool *m_pool = nullptr;
+  std::atomic<bool> m_cancelled{ false };
+
+  bool parseHeader();
+  bool parsePlyHeader(std::size_t &body_offset);
+  bool findChunks(std::size_t body_offset);
+  void sampleXyzColorScale(std::size_t body_offset);
+
+  void parseChunk(Chunk &chunk) const;
+  void parseAsciiChunk(Chunk &chunk) const;
+  void parseBinaryChunk(Chunk &chunk) const;
+
+public:
+  PointCloudLoader() = default;
+  ~PointCloudLoader();
+
+  PointCloudLoader(const PointCloudLoader &) = delete;
+  PointCloudLoader &operator=(const PointCloudLoader &) = delete;
+
+  // Format is detected from the content: files starting with "ply" are PLY, anything else is XYZ.
+  bool open(const uint8_t *data, std::size_t size_bytes); // Copies the data
+#if !defined(PLATFORM_EMSCRIPTEN)
+  bool open(const char *path); // Parses straight out of a memory mapping of the file
+#endif
+
+  PointCloudFormat getFormat() const {
+    return m_format;
+  }
+
+  std::size_t getPointCount() const {
+    return m_point_count;
+  }
+
+  // Queues every chunk on `pool`. Points past `max_point_count` are dropped. The pool must outlive the loader.
+  void start(ThreadPool &pool, std::size_t max_point_count);
+
+  // Returns up to `max_count` of the next points in order, or false if the next chunk isn't parsed yet. The
+  // piece stays valid until it's consumed.
+  bool peekParsedPoints(std::size_t max_count, PointCloudPiece &out_piece);
+  void consumeParsedPoints(std::size_t count);
+
+  bool isFinished() const {
+    return m_consumed_chunk >= m_chunk_count;
+  }
+
+  // Fraction of points consumed so far
+  float getProgress() const;
+};
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "app/file.hpp"
+#include "app/glupload.hpp"
+#include "app/glutil.hpp"
+#include "app/threadpool.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+// Preprocesses a PLY or XYZ point cloud into a point octree file. Each node holds a spatially even subsample
+// of at most PointOctreeStreamer::NODE_CAPACITY points and its children hold the rest, so every level adds
+// detail to the ones above it. Parses on `pool` and blocks until the file is written.
+bool buildPointOctree(const char *input_path, const char *output_path, ThreadPool &pool);
+#endif
+
+struct PointOctreeStats {
+  std::size_t node_count = 0;
+  std::size_t resident_node_count = 0;
+  std::size_t drawn_node_count = 0;
+  std::size_t drawn_point_count = 0;
+  std::size_t pending_load_count = 0;
+};
+
+// Streams a point octree file that's bigger than GPU memory. Every update picks the visible nodes whose points
+// are spaced further apart on screen than the error threshold, coarse ones first, up to the pool size. Missing
+// nodes are read on a thread pool and uploaded into pages of a fixed size pool texture, evicting the least
+// recently drawn ones. The node table texture lists the resident pages to draw, so the draw size is capped by
+// the pool no matter how big the file is.
+class PointOctreeStreamer {
+public:
+  static constexpr int PAGE_SIDE{ 64 };
+  static constexpr std::size_t NODE_CAPACITY{ PAGE_SIDE * PAGE_SIDE }; // Points per node and per pool page
+  static constexpr int DEFAULT_POOL_PAGE_COUNT{ 256 };
+  static constexpr int NODE_TABLE_WIDTH{ 256 };
+  static constexpr int MAX_VIEWS{ 2 };
+
+private:
+  static constexpr std::size_t MAX_PENDING_LOADS{ 16 };
+  static constexpr uint32_t NO_NODE{ 0xffffffffu };
+
+  struct Node {
+    gl::vec4 sphere; // xyz center, w radius
+    float spacing = 0.0f;
+    uint32_t point_count = 0;
+    uint32_t first_child = 0;
+    uint32_t child_count = 0;
+    uint64_t data_offset = 0;
+  };
+
+  struct LoadedNode {
+    uint32_t node = NO_NODE;
+    int row_count = 0;
+
+    std::vector<gl::vec4> positions; // Padded to whole page rows
+    std::vector<uint32_t> colors;    // RGBA8
+  };
+
+  // Shared with loads still running on the pool
+#if !defined(PLATFORM_EMSCRIPTEN)
+  MappedFile m_file;
+#endif
+  std::vector<uint8_t> m_owned_data;
+  const uint8_t *m_data = nullptr;
+  std::size_t m_size_bytes = 0;
+
+  std::vector<Node> m_nodes;
+
+  std::mutex m_mutex;
+  std::deque<LoadedNode> m_loaded_nodes;
+  std::atomic<std::size_t> m_pending_load_count{ 0 };
+  std::atomic<bool> m_cancelled{ false };
+  ThreadPool *m_pool = nullptr;
+
+  // Residency
+  std::vector<int> m_node_pages;   // Pool page per node, or -1
+  std::vector<uint8_t> m_node_loading;
+  std::vector<uint32_t> m_page_nodes; // Node per pool page, or NO_NODE
+  std::vector<uint32_t> m_page_last_used;
+  std::vector<int> m_free_pages;
+
+  int m_pool_page_count = 0;
+  int m_pool_pages_x = 0;
+
+  gl::Texture m_position_texture;
+  gl::Texture m_color_texture;
+  gl::Texture m_node_table_texture;
+  std::vector<gl::ivec4> m_node_table; // (page x, page y, point count, spacing as float bits)
+  gl::TextureUploader m_uploader{ 8 * NODE_CAPACITY * (sizeof(gl::vec4) + sizeof(uint32_t)) };
+
+  float m_error_threshold = 1.5f;
+  uint32_t m_update_index = 0;
+
+  std::vector<uint32_t> m_selected_nodes;
+  std::vector<std::pair<float, uint32_t>> m_candidates; // Max-heap on projected spacing
+
+  PointOctreeStats m_stats;
+
+  bool parse();
+  bool createPool(int pool_page_count);
+
+  void requestLoad(uint32_t node);
+  void loadNode(uint32_t node, LoadedNode &out) const;
+  int claimPage();
+  void uploadLoadedNodes();
+
+public:
+  PointOctreeStreamer() = default;
+  ~PointOctreeStreamer();
+
+  PointOctreeStreamer(const PointOctreeStreamer &) = delete;
+  PointOctreeStreamer &operator=(const PointOctreeStreamer &) = delete;
+
+  // The pool must outlive the streamer. `pool_page_count` is clamped to what fits in one texture.
+  bool open(const uint8_t *data, std::size_t size_bytes, ThreadPool &pool, int pool_page_count = DEFAULT_POOL_PAGE_COUNT); // Copies the data
+#if !defined(PLATFORM_EMSCRIPTEN)
+  bool open(const char *path, ThreadPool &pool, int pool_page_count = DEFAULT_POOL_PAGE_COUNT); // Reads nodes out of a memory mapping of the file
+#endif
+
+  // Nodes are refined while their point spacing projects to more than this many pixels
+  void setErrorThreshold(float pixels) {
+    m_error_threshold = pixels;
+  }
+
+  // Selects nodes visible in any of the views, queues missing ones and uploads finished loads. Detail follows
+  // the distance to `eye_position` alone, so every view draws the same nodes. `pixels_per_unit` is the size
+  // in pixels of one unit at distance one, i.e. projection[1][1] * viewport height / 2.
+  void update(const gl::mat4 *model_view_projections, int view_count, const gl::vec3 &eye_position, float pixels_per_unit);
+
+  const gl::Texture &getPositionTexture() const {
+    return m_position_texture;
+  }
+
+  const gl::Texture &getColorTexture() const {
+    return m_color_texture;
+  }
+
+  const gl::Texture &getNodeTableTexture() const {
+    return m_node_table_texture;
+  }
+
+  // Draw NODE_CAPACITY points per drawn node. Points past a node's count fall outside the clip volume.
+  std::size_t getDrawnNodeCount() const {
+    return m_stats.drawn_node_count;
+  }
+
+  const PointOctreeStats &getStats() const {
+    return m_stats;
+  }
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Bounded single-producer/single-consumer queue. One thread may push and one other thread may pop
+// without locking. Slots are reused, so popped values are moved out rather than destroyed.
+template <typename T, size_t Capacity>
+class SpscQueue {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+  static constexpr size_t CACHE_LINE_SIZE{ 64 };
+
+  std::array<T, Capacity> m_slots;
+
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_head{ 0 }; // Next slot to pop, written by the consumer
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_tail{ 0 }; // Next slot to push, written by the producer
+
+public:
+  // Producer only. Returns false if the queue is full.
+  bool push(T &&value) {
+    const size_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == Capacity) {
+      return false;
+    }
+    m_slots[tail & (Capacity - 1)] = std::move(value);
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only. Returns false if the queue is empty.
+  bool pop(T &value) {
+    const size_t head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = std::move(m_slots[head & (Capacity - 1)]);
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const {
+    return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+  }
+
+  static constexpr size_t capacity() {
+    return Capacity;
+  }
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "app/platform.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+class App;
+struct FrameInput;
+
+// Calls at the App API boundary, in the order they are logged. Each event is stored as a one byte type,
+// a four byte payload size, and the payload. Replayers skip event types they don't know.
+enum InputEventType : uint8_t {
+  INPUT_EVENT_FRAME = 0, // FrameInput
+  INPUT_EVENT_BEGIN_FRAME,
+  INPUT_EVENT_END_FRAME,
+  INPUT_EVENT_UPDATE,                  // frame_id, time_seconds, time_delta_seconds
+  INPUT_EVENT_SIMULATE,                // display width, height
+  INPUT_EVENT_RENDER,                  // display width, height
+  INPUT_EVENT_VIEW_AND_PROJECTION,     // 2 x mat4
+  INPUT_EVENT_CONTROLLER,              // index, position, velocity, orientation, buttons
+  INPUT_EVENT_USER_SHADER_SOURCE,      // index, source
+  INPUT_EVENT_COMPILE_SHADER_PROGRAMS,
+  INPUT_EVENT_USER_PARAM,              // name, value
+  INPUT_EVENT_SHADER_VARIANT           // name, value
+};
+
+// Appends a compact binary log of the inputs the App is driven with. Combined with the recorded time
+// values, replaying the log reproduces the same frame sequence on native and web builds.
+class InputRecorder {
+  std::vector<uint8_t> m_data;
+
+  bool m_recording{ false };
+  int m_pause_depth{ 0 };
+  uint32_t m_frame_count{ 0 };
+
+  void beginEvent(InputEventType type, size_t payload_size_bytes);
+  void write(const void *data, size_t size_bytes);
+  void writeString(std::string_view str);
+
+  template <typename T>
+  void write(const T &value) {
+    write(&value, sizeof(T));
+  }
+
+public:
+  void start();
+  void stop();
+
+  // Nested calls made by an already recorded call (e.g. `update` from `frame`) are paused so they replay once.
+  void pause();
+  void resume();
+
+  bool isRecording() const {
+    return m_recording && m_pause_depth == 0;
+  }
+
+  const std::vector<uint8_t> &getData() const {
+    return m_data;
+  }
+
+  uint32_t getFrameCount() const {
+    return m_frame_count;
+  }
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+  bool save(const char *path) const;
+#endif
+
+  void recordFrame(const FrameInput &input);
+  void recordBeginFrame();
+  void recordEndFrame();
+  void recordUpdate(int frame_id, double time_seconds, double time_delta_seconds);
+  void recordSimulate(int display_width, int display_height);
+  void recordRender(int display_width, int display_height);
+  void recordViewAndProjectionMatrices(const float *view_matrix_values, const float *projection_matrix_values);
+  void recordController(int index, const float *position_values, const float *velocity_values, const float *orientation_values, const float *buttons_values);
+  void recordUserShaderSource(int index, std::string_view shader_src);
+  void recordCompileShaderPrograms();
+  void recordUserParam(std::string_view name, float value);
+  void recordShaderVariant(std::string_view name, std::string_view value);
+};
+
+// Drives an App from a log written by InputRecorder, one recorded frame per `step`.
+class InputReplayer {
+  std::vector<uint8_t> m_data;
+
+  size_t m_offset{ 0 };
+  uint32_t m_frame_index{ 0 };
+  bool m_failed{ false };
+
+  bool replayEvent(App &app, InputEventType type, const uint8_t *payload, uint32_t payload_size_bytes);
+
+public:
+  // Returns false (and replays nothing) if the data isn't an input log of a known version.
+  bool load(const uint8_t *data, size_t size_bytes);
+#if !defined(PLATFORM_EMSCRIPTEN)
+  bool load(const char *path);
+#endif
+
+  void rewind();
+
+  // Replays events up to and including the end of the next recorded frame. Returns false once the log is
+  // exhausted or a malformed event is hit.
+  bool step(App &app);
+
+  bool isFinished() const;
+
+  uint32_t getFrameIndex() const {
+    return m_frame_index;
+  }
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "app/platform.hpp"
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+
+#include "app/app.hpp"
+#include "app/queue.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct RenderCommand {
+  enum Type {
+    SET_VIEW_AND_PROJECTION,
+    SET_CONTROLLER,
+    SET_SHADER_SOURCE,
+    COMPILE_SHADERS,
+    SET_USER_PARAM,
+    FRAME
+  };
+
+  Type type = FRAME;
+
+  int index = 0;
+
+  float values[32] = {};
+  std::string text;
+
+  FrameInput frame_input{};
+};
+
+// Optional native threading model. The host thread records commands, and a render thread that owns the
+// GL context (and the App) replays them, running `App::frame` for every `pushFrame`. While the thread is
+// running the App must not be touched from any other thread.
+class RenderThread {
+  static constexpr size_t COMMAND_QUEUE_CAPACITY{ 256 };
+
+  App &m_app;
+
+  SpscQueue<RenderCommand, COMMAND_QUEUE_CAPACITY> m_commands;
+
+  std::thread m_thread;
+  std::atomic<bool> m_running{ false };
+
+  // Only used to sleep while the queue is empty. Commands never wait on it.
+  std::mutex m_wake_mutex;
+  std::condition_variable m_wake;
+
+  std::atomic<int> m_frames_queued{ 0 };
+  std::atomic<int> m_compile_count{ 0 };
+  std::atomic<bool> m_last_compile_succeeded{ false };
+
+  std::function<void()> m_make_context_current;
+  std::function<void()> m_present;
+
+  bool push(RenderCommand &&command);
+  void run();
+  void execute(RenderCommand &command);
+
+public:
+  explicit RenderThread(App &app);
+  ~RenderThread();
+
+  RenderThread(const RenderThread &) = delete;
+  RenderThread &operator=(const RenderThread &) = delete;
+
+  // `make_context_current` runs once on the render thread before `App::init`. `present` runs after each frame.
+  bool start(std::function<void()> make_context_current, std::function<void()> present);
+  void stop();
+
+  bool isRunning() const {
+    return m_running.load(std::memory_order_acquire);
+  }
+
+  // Host thread only. Each returns false if the queue is full and the command was dropped.
+  bool setViewAndProjectionMatrices(const float *view_matrix_values, const float *projection_matrix_values);
+  bool setControllerAtIndex(int index, const float *position_values, const float *velocity_values, const float *orientation_values, const float *buttons_values);
+  bool setUserShaderSourceAtIndex(int index, std::string_view shader_src);
+  bool tryCompileShaderPrograms();
+  bool setUserParam(std::string_view name, float value);
+  bool pushFrame(const FrameInput &input);
+
+  // Frames pushed but not yet finished. Hosts can use this to avoid running ahead.
+  int getFramesQueued() const {
+    return m_frames_queued.load(std::memory_order_acquire);
+  }
+
+  int getCompileCount() const {
+    return m_compile_count.load(std::memory_order_acquire);
+  }
+  bool getLastCompileSucceeded() const {
+    return m_last_compile_succeeded.load(std::memory_order_acquire);
+  }
+};
+
+#endif
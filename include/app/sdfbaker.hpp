@@ -0,0 +1,36 @@
+#pragma once
+
+#include "app/glgeom.hpp"
+#include "app/threadpool.hpp"
+
+#include <functional>
+#include <vector>
+
+// Signed distances sampled at voxel centers, negative inside. Voxels are cubes and the volume spans exactly
+// `bounds_min` to `bounds_max`, so a 3D texture of it maps those bounds to texture coords 0-1.
+struct SignedDistanceVolume {
+  gl::ivec3 resolution{ 0 };
+  gl::vec3 bounds_min{ 0.0f };
+  gl::vec3 bounds_max{ 0.0f };
+
+  std::vector<gl::vec4> texels; // (normalized gradient xyz, distance) per voxel, x then y then z
+};
+
+// Bakes the distance to the closest triangle of `mesh` over its bounds grown by `padding` on each side, with
+// `max_resolution` voxels along the longest axis. Closest triangles are found through a bounding volume
+// hierarchy, seeded with the previous voxel's distance. The sign comes from counting crossings along one ray
+// per row of voxels, so the mesh should be closed. Runs one slice per task on `pool`.
+bool bakeMeshSignedDistance(const gl::DefaultTriangleMesh &mesh,
+                            int max_resolution,
+                            float padding,
+                            ThreadPool &pool,
+                            SignedDistanceVolume &out_volume);
+
+// Bakes an analytic distance function, e.g. a port of a shader's `map()`. `distance` is called from several
+// threads at once.
+void bakeFunctionSignedDistance(const std::function<float(const gl::vec3 &)> &distance,
+                                const gl::vec3 &bounds_min,
+                                const gl::vec3 &bounds_max,
+                                int max_resolution,
+                                ThreadPool &pool,
+                                SignedDistanceVolume &out_volume);
@@ -21,10 +21,414 @@ const char *shader_source_common_uniforms = R"GLSL(layout(std140) uniform Common
   float iTime;
   float iTimeDelta;
   int iFrame;
+
+  int iAddressingMode; // 0: Linear, 1: Morton
+  int iStableIdsEnabled;
+  int iLayerCount;
+
+  vec4 iSDFBoundsMin;  // xyz
+  vec4 iSDFBoundsSize; // xyz, w is 1 when a signed distance field is set
+
+  vec4 iVectorFieldBoundsMin;  // xyz
+  vec4 iVectorFieldBoundsSize; // xyz, w is 1 when a vector field is loaded
+
+  int iMeshBVHNodeCount; // 0 without a collision mesh
 };
 
+// PARTICLE_LAYERS is defined when particle state lives in texture arrays, with `#pragma layers <count>` or
+// when `#pragma size` is bigger than the GPU supports. iSize is then the size of one layer.
+#ifdef PARTICLE_LAYERS
+uniform highp sampler2DArray iFragData[6];
+#else
 uniform sampler2D iFragData[6];
+#endif
+uniform highp isampler2D iStableIds;
 uniform ivec2 iResolution;
+
+// Baked signed distance field, normalized gradient in rgb and distance in a. Use the sdf helpers below.
+uniform highp sampler3D iSDF;
+
+// Vector field loaded from an external tool, read through vectorFieldSample() below.
+uniform highp sampler3D iVectorField;
+
+// Collision mesh BVH, read through meshIntersectSegment() below.
+uniform highp sampler2D iMeshBVHNodes;
+uniform highp sampler2D iMeshBVHTriangles;
+
+// Simulation only. The layer being simulated, always 0 without PARTICLE_LAYERS.
+uniform int iLayer;
+
+// Simulation only. With `#pragma updateFraction 1/N` each texel is updated every N frames, so integrate
+// with iUpdateTimeDelta (time since this texel was last updated) instead of iTimeDelta.
+uniform float iUpdateTimeDelta;
+uniform float iLastUpdateTime;
+
+// Particle addressing. Ids map to texels row by row, or along a Morton (Z-order) curve with
+// `#pragma addressing morton` so that particles with nearby ids share texture cache lines.
+
+uint mortonSpreadBits(uint x) {
+  x &= 0x0000ffffu;
+  x = (x | (x << 8u)) & 0x00ff00ffu;
+  x = (x | (x << 4u)) & 0x0f0f0f0fu;
+  x = (x | (x << 2u)) & 0x33333333u;
+  x = (x | (x << 1u)) & 0x55555555u;
+  return x;
+}
+
+uint mortonCompactBits(uint x) {
+  x &= 0x55555555u;
+  x = (x | (x >> 1u)) & 0x33333333u;
+  x = (x | (x >> 2u)) & 0x0f0f0f0fu;
+  x = (x | (x >> 4u)) & 0x00ff00ffu;
+  x = (x | (x >> 8u)) & 0x0000ffffu;
+  return x;
+}
+
+ivec2 idToCoord(int id) {
+  if (iAddressingMode == 1) {
+    return ivec2(mortonCompactBits(uint(id)), mortonCompactBits(uint(id) >> 1u));
+  }
+  return ivec2(id % iSize.x, id / iSize.x);
+}
+
+int coordToId(ivec2 coord) {
+  if (iAddressingMode == 1) {
+    return int(mortonSpreadBits(uint(coord.x)) | (mortonSpreadBits(uint(coord.y)) << 1u));
+  }
+  return coord.x + coord.y * iSize.x;
+}
+
+// Particle coords (x, y, layer) that work with and without PARTICLE_LAYERS. Ids fill each layer in turn,
+// following iAddressingMode within a layer.
+
+ivec3 idToParticleCoord(int id) {
+  int layerSize = iSize.x * iSize.y;
+  return ivec3(idToCoord(id % layerSize), id / layerSize);
+}
+
+int particleCoordToId(ivec3 coord) {
+  return coordToId(coord.xy) + coord.z * iSize.x * iSize.y;
+}
+
+// Macros so they can index iFragData with a constant, and so vertex shaders never see gl_FragCoord
+#define particleFragCoord() ivec3(ivec2(gl_FragCoord.xy), iLayer)
+
+#ifdef PARTICLE_LAYERS
+#define fetchParticleData(index, coord) texelFetch(iFragData[index], ivec3(coord), 0)
+#else
+#define fetchParticleData(index, coord) texelFetch(iFragData[index], ivec3(coord).xy, 0)
+#endif
+
+// Id that stays with a particle when `#pragma reorder` moves it to another texel. Use it in place of
+// coordToId() for anything that should stay deterministic per particle, such as hashing.
+int stableId(ivec2 coord) {
+  if (iStableIdsEnabled != 0) {
+    return texelFetch(iStableIds, coord, 0).x;
+  }
+  return coordToId(coord);
+}
+
+int stableId(ivec3 coord) {
+  if (iStableIdsEnabled != 0) {
+    return texelFetch(iStableIds, coord.xy, 0).x;
+  }
+  return particleCoordToId(coord);
+}
+
+// Signed distance field lookups, one texture fetch each. Distance is negative inside. Outside the baked
+// volume the distance to the volume is added, so particles there still head the right way. Without a field
+// everything is far away.
+
+vec4 sdfSample(vec3 p) {
+  if (iSDFBoundsSize.w == 0.0) {
+    return vec4(0.0, 1.0, 0.0, 1e10);
+  }
+  vec3 uvw = (p - iSDFBoundsMin.xyz) / iSDFBoundsSize.xyz;
+  vec3 clamped = clamp(uvw, 0.0, 1.0);
+  vec4 s = texture(iSDF, clamped);
+  s.w += length((uvw - clamped) * iSDFBoundsSize.xyz);
+  return s;
+}
+
+float sdfDistance(vec3 p) {
+  return sdfSample(p).w;
+}
+
+vec3 sdfNormal(vec3 p) {
+  return sdfSample(p).xyz;
+}
+
+// Velocity from the vector field loaded with App::loadVectorField, in one trilinear fetch. Outside the field
+// the nearest edge value is used, and without a field it's zero.
+vec3 vectorFieldSample(vec3 p) {
+  if (iVectorFieldBoundsSize.w == 0.0) {
+    return vec3(0.0);
+  }
+  return texture(iVectorField, (p - iVectorFieldBoundsMin.xyz) / iVectorFieldBoundsSize.xyz).xyz;
+}
+
+// Exact collisions against the mesh set with App::setCollisionMesh. Nodes are stored depth-first and each one
+// links past its own subtree, so traversal keeps no stack: a hit box steps to the next node, a missed one skips
+// its subtree. Every fetch is a texelFetch from one of two textures, 1024 texels wide.
+
+ivec2 meshBVHTexelCoord(int index) {
+  return ivec2(index & 1023, index >> 10);
+}
+
+// Finds the first triangle crossed going from `a` to `b`. `t` is the fraction of the way to `b`, and `normal`
+// is the triangle's normal turned to face `a`.
+bool meshIntersectSegment(vec3 a, vec3 b, out float t, out vec3 normal) {
+  vec3 delta = b - a;
+  vec3 inv_delta = 1.0 / mix(delta, vec3(1e-30), equal(delta, vec3(0.0)));
+  bool hit = false;
+  t = 1.0;
+  normal = vec3(0.0);
+
+  int node = 0;
+  while (node < iMeshBVHNodeCount) {
+    vec4 box_min = texelFetch(iMeshBVHNodes, meshBVHTexelCoord(node * 2), 0);
+    vec4 box_max = texelFetch(iMeshBVHNodes, meshBVHTexelCoord(node * 2 + 1), 0);
+
+    // Boxes are only tested up to the closest hit so far
+    vec3 t0 = (box_min.xyz - a) * inv_delta;
+    vec3 t1 = (box_max.xyz - a) * inv_delta;
+    vec3 t_near = min(t0, t1);
+    vec3 t_far = max(t0, t1);
+    float t_enter = max(max(t_near.x, t_near.y), max(t_near.z, 0.0));
+    float t_exit = min(min(t_far.x, t_far.y), min(t_far.z, t));
+
+    if (t_enter > t_exit) {
+      node = int(box_min.w);
+      continue;
+    }
+
+    // Leaves list their triangles in a run, the last one flagged in v0.w
+    if (box_max.w >= 0.0) {
+      int tri = int(box_max.w);
+      float last = 0.0;
+      do {
+        vec4 v0 = texelFetch(iMeshBVHTriangles, meshBVHTexelCoord(tri * 3), 0);
+        vec3 e1 = texelFetch(iMeshBVHTriangles, meshBVHTexelCoord(tri * 3 + 1), 0).xyz;
+        vec3 e2 = texelFetch(iMeshBVHTriangles, meshBVHTexelCoord(tri * 3 + 2), 0).xyz;
+
+        // Moller-Trumbore
+        vec3 p = cross(delta, e2);
+        float det = dot(e1, p);
+        if (det != 0.0) {
+          float inv_det = 1.0 / det;
+          vec3 s = a - v0.xyz;
+          vec3 q = cross(s, e1);
+          float u = dot(s, p) * inv_det;
+          float v = dot(delta, q) * inv_det;
+          float t_hit = dot(e2, q) * inv_det;
+          if (u >= 0.0 && v >= 0.0 && u + v <= 1.0 && t_hit >= 0.0 && t_hit < t) {
+            t = t_hit;
+            normal = cross(e1, e2);
+            hit = true;
+          }
+        }
+
+        last = v0.w;
+        tri += 1;
+      } while (last == 0.0);
+    }
+
+    node += 1;
+  }
+
+  if (hit) {
+    normal = normalize(normal);
+    normal = dot(normal, delta) > 0.0 ? -normal : normal;
+  }
+  return hit;
+}
+)GLSL";
+
+const char *shader_source_copy_particles_fs = R"GLSL(#version 300 es
+
+precision highp float;
+precision highp int;
+
+// {{common}}
+
+layout(location = 0) out vec4 oFragData0;
+layout(location = 1) out vec4 oFragData1;
+layout(location = 2) out vec4 oFragData2;
+layout(location = 3) out vec4 oFragData3;
+layout(location = 4) out vec4 oFragData4;
+layout(location = 5) out vec4 oFragData5;
+
+// Carries particle state over from the previous frame unchanged.
+void main() {
+  ivec3 coord = particleFragCoord();
+
+  oFragData0 = fetchParticleData(0, coord);
+  oFragData1 = fetchParticleData(1, coord);
+  oFragData2 = fetchParticleData(2, coord);
+  oFragData3 = fetchParticleData(3, coord);
+  oFragData4 = fetchParticleData(4, coord);
+  oFragData5 = fetchParticleData(5, coord);
+}
+)GLSL";
+
+const char *shader_source_point_octree_fs = R"GLSL(#version 300 es
+
+precision highp float;
+precision highp int;
+
+in vec4 vColor;
+
+out vec4 oFragColor;
+
+void main() {
+  vec2 offset = gl_PointCoord * 2.0 - 1.0;
+  if (dot(offset, offset) > 1.0) {
+    discard;
+  }
+  oFragColor = vColor;
+}
+)GLSL";
+
+const char *shader_source_point_octree_vs = R"GLSL(#version 300 es
+
+precision highp float;
+precision highp int;
+
+// {{common}}
+
+uniform highp sampler2D iPointPositions;
+uniform sampler2D iPointColors;
+uniform highp isampler2D iPointNodes; // Drawn nodes as (page x, page y, point count, spacing as float bits)
+uniform float iPointScale;           // Pixels per unit at distance 1
+
+out vec4 vColor;
+
+const int PAGE_SIDE = 64;
+const int PAGE_SIZE = PAGE_SIDE * PAGE_SIDE;
+
+// One point per vertex, PAGE_SIZE vertices per drawn node.
+void main() {
+  int slot = gl_VertexID / PAGE_SIZE;
+  int index = gl_VertexID % PAGE_SIZE;
+
+  int tableWidth = textureSize(iPointNodes, 0).x;
+  ivec4 node = texelFetch(iPointNodes, ivec2(slot % tableWidth, slot / tableWidth), 0);
+
+  if (index >= node.z) {
+    // Past the end of a partly filled page
+    gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+    gl_PointSize = 1.0;
+    vColor = vec4(0.0);
+    return;
+  }
+
+  ivec2 texel = node.xy * PAGE_SIDE + ivec2(index % PAGE_SIDE, index / PAGE_SIDE);
+  vec3 position = texelFetch(iPointPositions, texel, 0).xyz;
+
+  gl_Position = iModelViewProjection * vec4(position, 1.0);
+
+  // Sized to the node's point spacing so points cover the surface without holes at any level
+  float spacing = intBitsToFloat(node.w);
+  gl_PointSize = clamp(iPointScale * spacing / max(gl_Position.w, 1e-4), 1.0, 64.0);
+
+  vColor = texelFetch(iPointColors, texel, 0);
+}
+)GLSL";
+
+const char *shader_source_reorder_key_fs = R"GLSL(#version 300 es
+
+precision highp float;
+precision highp int;
+
+// {{common}}
+
+uniform float iCellSize;
+
+out uvec2 oKey;
+
+uint mortonSpreadBits3(uint x) {
+  x &= 0x000003ffu;
+  x = (x | (x << 16u)) & 0x030000ffu;
+  x = (x | (x << 8u)) & 0x0300f00fu;
+  x = (x | (x << 4u)) & 0x030c30c3u;
+  x = (x | (x << 2u)) & 0x09249249u;
+  return x;
+}
+
+// Writes (Morton code of the grid cell containing the particle, source texel index) for each particle.
+void main() {
+  ivec2 coord = ivec2(gl_FragCoord.xy);
+  vec3 position = texelFetch(iFragData[0], coord, 0).xyz;
+  uvec3 cell = uvec3(ivec3(floor(position / iCellSize)) & 1023);
+  uint code = mortonSpreadBits3(cell.x) | (mortonSpreadBits3(cell.y) << 1u) | (mortonSpreadBits3(cell.z) << 2u);
+  oKey = uvec2(code, uint(coord.x + coord.y * iSize.x));
+}
+)GLSL";
+
+const char *shader_source_reorder_permute_fs = R"GLSL(#version 300 es
+
+precision highp float;
+precision highp int;
+
+// {{common}}
+
+uniform highp usampler2D iKeys;
+
+layout(location = 0) out vec4 oFragData0;
+layout(location = 1) out vec4 oFragData1;
+layout(location = 2) out vec4 oFragData2;
+layout(location = 3) out vec4 oFragData3;
+layout(location = 4) out vec4 oFragData4;
+layout(location = 5) out vec4 oFragData5;
+
+// Gathers particle state into sorted order.
+void main() {
+  int source = int(texelFetch(iKeys, ivec2(gl_FragCoord.xy), 0).y);
+  ivec2 sourceCoord = ivec2(source % iSize.x, source / iSize.x);
+
+  oFragData0 = texelFetch(iFragData[0], sourceCoord, 0);
+  oFragData1 = texelFetch(iFragData[1], sourceCoord, 0);
+  oFragData2 = texelFetch(iFragData[2], sourceCoord, 0);
+  oFragData3 = texelFetch(iFragData[3], sourceCoord, 0);
+  oFragData4 = texelFetch(iFragData[4], sourceCoord, 0);
+  oFragData5 = texelFetch(iFragData[5], sourceCoord, 0);
+}
+)GLSL";
+
+const char *shader_source_reorder_sort_fs = R"GLSL(#version 300 es
+
+precision highp float;
+precision highp int;
+
+// {{common}}
+
+uniform highp usampler2D iKeys;
+uniform int iPartnerMask;
+uniform int iCount;
+
+out uvec2 oKey;
+
+bool keyLess(uvec2 a, uvec2 b) {
+  return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+// One compare-exchange step of a bitonic sort over particle ids. Every step sorts ascending (the first step
+// of each merge compares mirrored partners) so ids past `iCount` act as +infinity and never move.
+void main() {
+  ivec2 coord = ivec2(gl_FragCoord.xy);
+  int id = coordToId(coord);
+  int partnerId = id ^ iPartnerMask;
+
+  uvec2 key = texelFetch(iKeys, coord, 0).xy;
+  if (partnerId >= iCount) {
+    oKey = key;
+    return;
+  }
+
+  uvec2 partnerKey = texelFetch(iKeys, idToCoord(partnerId), 0).xy;
+  bool keepMin = id < partnerId;
+  oKey = keyLess(partnerKey, key) == keepMin ? partnerKey : key;
+}
 )GLSL";
 
 const char *shader_source_shade_fs = R"GLSL(#version 300 es
@@ -86,6 +490,96 @@ void main() {
 }
 )GLSL";
 
+const char *shader_source_sleep_mark_fs = R"GLSL(#version 300 es
+
+precision highp float;
+precision highp int;
+
+// {{common}}
+
+#define MAX_WAKE_REGIONS 4
+
+uniform float iWakeRadius;
+uniform vec4 iWakeRegions[MAX_WAKE_REGIONS]; // (center, radius)
+uniform int iWakeRegionCount;
+
+// Leaves a stencil mark for every particle that flagged itself asleep last frame, unless it is close to a
+// controller or inside a wake region. Writes no color.
+void main() {
+  ivec2 coord = ivec2(gl_FragCoord.xy);
+
+  if (texelFetch(iFragData[5], coord, 0).w <= 0.5) discard;
+
+  vec3 position = texelFetch(iFragData[0], coord, 0).xyz;
+
+  for (int i = 0; i < 2; ++i) {
+    if (distance(position, iControllerTransform[i][3].xyz) < iWakeRadius) discard;
+  }
+
+  for (int i = 0; i < MAX_WAKE_REGIONS; ++i) {
+    if (i >= iWakeRegionCount) break;
+    if (distance(position, iWakeRegions[i].xyz) < iWakeRegions[i].w) discard;
+  }
+}
+)GLSL";
+
+const char *shader_source_stable_id_fs = R"GLSL(#version 300 es
+
+precision highp float;
+precision highp int;
+
+// {{common}}
+
+uniform highp usampler2D iKeys;
+uniform bool iReset;
+
+out int oStableId;
+
+// Follows the same permutation as the particle state so each particle keeps the id it started with.
+void main() {
+  ivec2 coord = ivec2(gl_FragCoord.xy);
+  if (iReset) {
+    oStableId = coordToId(coord);
+    return;
+  }
+
+  int source = int(texelFetch(iKeys, coord, 0).y);
+  oStableId = texelFetch(iStableIds, ivec2(source % iSize.x, source / iSize.x), 0).x;
+}
+)GLSL";
+
+const char *shader_source_tile_bounds_fs = R"GLSL(#version 300 es
+
+precision highp float;
+precision highp int;
+
+uniform sampler2D iPosition;
+uniform int iTileSize;
+
+out vec4 oTileBounds;
+
+// Writes a bounding sphere (center, radius) for each `iTileSize`² tile of particle positions.
+void main() {
+  ivec2 size = textureSize(iPosition, 0);
+  ivec2 begin = ivec2(gl_FragCoord.xy) * iTileSize;
+  ivec2 end = min(begin + iTileSize, size);
+
+  vec3 boundsMin = vec3(3.402823e38);
+  vec3 boundsMax = vec3(-3.402823e38);
+
+  for (int y = begin.y; y < end.y; ++y) {
+    for (int x = begin.x; x < end.x; ++x) {
+      vec3 p = texelFetch(iPosition, ivec2(x, y), 0).xyz;
+      boundsMin = min(boundsMin, p);
+      boundsMax = max(boundsMax, p);
+    }
+  }
+
+  vec3 center = 0.5 * (boundsMin + boundsMax);
+  oTileBounds = vec4(center, distance(center, boundsMax));
+}
+)GLSL";
+
 const char *shader_source_user_default_common = R"GLSL(// The contents of this tab will be prefixed in all shaders.
 
 const vec3 cubeVertices[8] = vec3[8](
@@ -143,8 +637,8 @@ Contribute : https://github.com/notlion/pst-alpha
 #pragma size 64 64
 
 void mainSimulation(out vec4 oPosition, out vec4 oColor, out vec4 oData2, out vec4 oData3, out vec4 oData4, out vec4 oData5) {
-  ivec2 coord = ivec2(gl_FragCoord);
-  int id = iSize.x * coord.y + coord.x;
+  ivec3 coord = particleFragCoord();
+  int id = particleCoordToId(coord);
 
   float scale = 1.0 / float(max(iSize.x, iSize.y));
   vec2 pos = (gl_FragCoord.xy - vec2(iSize) * 0.5) * scale;
@@ -164,14 +658,14 @@ out vec4 vColor;
 
 void mainVertex(out vec4 oPosition) {
   int instanceID = gl_VertexID / 36;
-  ivec2 coord = ivec2(instanceID % iSize.x, instanceID / iSize.x);
+  ivec3 coord = idToParticleCoord(instanceID);
 
-  oPosition = texelFetch(iFragData[0], coord, 0);
+  oPosition = fetchParticleData(0, coord);
   oPosition.xyz += cubeVertices[cubeIndices[gl_VertexID % 36]] * 0.004;
 
   oPosition = iModelViewProjection * oPosition;
 
-  vColor = texelFetch(iFragData[1], coord, 0);
+  vColor = fetchParticleData(1, coord);
 
   vec3 normal = cubeNormals[gl_VertexID / 6 % 6];
   vec3 lightDir = normalize(vec3(0.6, 0.3, 1.0));
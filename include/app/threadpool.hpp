@@ -0,0 +1,49 @@
+#pragma once
+
+#include "app/platform.hpp"
+
+#include <cstddef>
+#include <functional>
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+  #include <condition_variable>
+  #include <deque>
+  #include <mutex>
+  #include <thread>
+  #include <vector>
+#endif
+
+// Fixed set of worker threads for CPU-heavy jobs like file parsing. Web builds have no threads, so there
+// tasks run inline in `submit`.
+class ThreadPool {
+#if !defined(PLATFORM_EMSCRIPTEN)
+  std::vector<std::thread> m_threads;
+
+  std::mutex m_mutex;
+  std::condition_variable m_task_available;
+  std::condition_variable m_tasks_done;
+  std::deque<std::function<void()>> m_tasks;
+  size_t m_running_count = 0;
+  bool m_stopping = false;
+
+  void run();
+#endif
+
+public:
+  // A thread count of 0 uses one thread per hardware thread, less one for the caller.
+  explicit ThreadPool(size_t thread_count = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void submit(std::function<void()> task);
+
+  // Blocks until every submitted task has finished.
+  void wait();
+
+  // Splits [0, count) into ranges of `task_size`, runs `task(begin, end)` on each, then waits.
+  void parallelFor(size_t count, size_t task_size, const std::function<void(size_t begin, size_t end)> &task);
+
+  size_t getThreadCount() const;
+};
@@ -137,6 +137,12 @@ constexpr size_t arraySize(const T (&)[n]) {
 }
 
 
+// Morton (Z-order) Curve
+
+uint32_t mortonEncode2(uint32_t x, uint32_t y);
+gl::uvec2 mortonDecode2(uint32_t code);
+
+
 // Color
 
 constexpr uint32_t packColor32(const gl::vec4 &color);
@@ -153,6 +159,19 @@ gl::vec3 unpackColor24(const uint8_t *packed);
 
 bool stringsEqualCaseInsensitive(std::string_view s1, std::string_view s2);
 
+// Parses the number at `p` and moves `p` past it, or leaves `p` alone and returns false if there isn't one.
+// Hand-rolled because `strtof` needs a terminated string, is locale dependent, and is much slower on large files.
+bool parseFloat(const uint8_t *&p, const uint8_t *end, float &out_value);
+
+
+
+// Hashing
+
+constexpr uint64_t FNV1A_64_OFFSET_BASIS{ 0xcbf29ce484222325ull };
+
+uint64_t hashFnv1a64(const void *data, size_t size_bytes, uint64_t hash = FNV1A_64_OFFSET_BASIS);
+uint64_t hashFnv1a64(std::string_view str, uint64_t hash = FNV1A_64_OFFSET_BASIS);
+
 
 // Formatting
 
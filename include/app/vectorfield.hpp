@@ -0,0 +1,36 @@
+#pragma once
+
+#include "app/glutil.hpp"
+#include "app/threadpool.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A grid of vectors baked by an external tool. The grid spans `bounds_min` to `bounds_max` with values at
+// voxel centers, so a 3D texture of it maps those bounds to texture coords 0-1.
+struct VectorField {
+  gl::ivec3 resolution{ 0 };
+  gl::vec3 bounds_min{ 0.0f };
+  gl::vec3 bounds_max{ 0.0f };
+
+  // RGBA per voxel, x then y then z, in components of `component_type` (GL_FLOAT or GL_HALF_FLOAT). Points
+  // into `parsed_texels` for text files, or straight into the file data for binary ones.
+  GLenum component_type = GL_FLOAT;
+  const void *texels = nullptr;
+
+  std::vector<gl::vec4> parsed_texels;
+};
+
+// Reads either format, told apart by the binary magic:
+//  - FGA text: resolution, bounds min and bounds max, then xyz for every voxel, all separated by commas or
+//    whitespace. Values are parsed in parallel on `pool`.
+//  - Binary: a small header then texels exactly as they're uploaded. Nothing is converted, so `data` must
+//    outlive `out_field`.
+bool parseVectorField(const uint8_t *data, std::size_t size_bytes, ThreadPool &pool, VectorField &out_field);
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+// Writes `field` in the binary format with texel components of `component_type`, converting if needed. Half
+// floats are half the size and upload to RGBA16F as is.
+bool writeVectorField(const char *path, const VectorField &field, GLenum component_type = GL_HALF_FLOAT);
+#endif
@@ -15,7 +15,224 @@ layout(std140) uniform CommonUniforms {
   float iTime;
   float iTimeDelta;
   int iFrame;
+
+  int iAddressingMode; // 0: Linear, 1: Morton
+  int iStableIdsEnabled;
+  int iLayerCount;
+
+  vec4 iSDFBoundsMin;  // xyz
+  vec4 iSDFBoundsSize; // xyz, w is 1 when a signed distance field is set
+
+  vec4 iVectorFieldBoundsMin;  // xyz
+  vec4 iVectorFieldBoundsSize; // xyz, w is 1 when a vector field is loaded
+
+  int iMeshBVHNodeCount; // 0 without a collision mesh
 };
 
+// PARTICLE_LAYERS is defined when particle state lives in texture arrays, with `#pragma layers <count>` or
+// when `#pragma size` is bigger than the GPU supports. iSize is then the size of one layer.
+#ifdef PARTICLE_LAYERS
+uniform highp sampler2DArray iFragData[6];
+#else
 uniform sampler2D iFragData[6];
+#endif
+uniform highp isampler2D iStableIds;
 uniform ivec2 iResolution;
+
+// Baked signed distance field, normalized gradient in rgb and distance in a. Use the sdf helpers below.
+uniform highp sampler3D iSDF;
+
+// Vector field loaded from an external tool, read through vectorFieldSample() below.
+uniform highp sampler3D iVectorField;
+
+// Collision mesh BVH, read through meshIntersectSegment() below.
+uniform highp sampler2D iMeshBVHNodes;
+uniform highp sampler2D iMeshBVHTriangles;
+
+// Simulation only. The layer being simulated, always 0 without PARTICLE_LAYERS.
+uniform int iLayer;
+
+// Simulation only. With `#pragma updateFraction 1/N` each texel is updated every N frames, so integrate
+// with iUpdateTimeDelta (time since this texel was last updated) instead of iTimeDelta.
+uniform float iUpdateTimeDelta;
+uniform float iLastUpdateTime;
+
+// Particle addressing. Ids map to texels row by row, or along a Morton (Z-order) curve with
+// `#pragma addressing morton` so that particles with nearby ids share texture cache lines.
+
+uint mortonSpreadBits(uint x) {
+  x &= 0x0000ffffu;
+  x = (x | (x << 8u)) & 0x00ff00ffu;
+  x = (x | (x << 4u)) & 0x0f0f0f0fu;
+  x = (x | (x << 2u)) & 0x33333333u;
+  x = (x | (x << 1u)) & 0x55555555u;
+  return x;
+}
+
+uint mortonCompactBits(uint x) {
+  x &= 0x55555555u;
+  x = (x | (x >> 1u)) & 0x33333333u;
+  x = (x | (x >> 2u)) & 0x0f0f0f0fu;
+  x = (x | (x >> 4u)) & 0x00ff00ffu;
+  x = (x | (x >> 8u)) & 0x0000ffffu;
+  return x;
+}
+
+ivec2 idToCoord(int id) {
+  if (iAddressingMode == 1) {
+    return ivec2(mortonCompactBits(uint(id)), mortonCompactBits(uint(id) >> 1u));
+  }
+  return ivec2(id % iSize.x, id / iSize.x);
+}
+
+int coordToId(ivec2 coord) {
+  if (iAddressingMode == 1) {
+    return int(mortonSpreadBits(uint(coord.x)) | (mortonSpreadBits(uint(coord.y)) << 1u));
+  }
+  return coord.x + coord.y * iSize.x;
+}
+
+// Particle coords (x, y, layer) that work with and without PARTICLE_LAYERS. Ids fill each layer in turn,
+// following iAddressingMode within a layer.
+
+ivec3 idToParticleCoord(int id) {
+  int layerSize = iSize.x * iSize.y;
+  return ivec3(idToCoord(id % layerSize), id / layerSize);
+}
+
+int particleCoordToId(ivec3 coord) {
+  return coordToId(coord.xy) + coord.z * iSize.x * iSize.y;
+}
+
+// Macros so they can index iFragData with a constant, and so vertex shaders never see gl_FragCoord
+#define particleFragCoord() ivec3(ivec2(gl_FragCoord.xy), iLayer)
+
+#ifdef PARTICLE_LAYERS
+#define fetchParticleData(index, coord) texelFetch(iFragData[index], ivec3(coord), 0)
+#else
+#define fetchParticleData(index, coord) texelFetch(iFragData[index], ivec3(coord).xy, 0)
+#endif
+
+// Id that stays with a particle when `#pragma reorder` moves it to another texel. Use it in place of
+// coordToId() for anything that should stay deterministic per particle, such as hashing.
+int stableId(ivec2 coord) {
+  if (iStableIdsEnabled != 0) {
+    return texelFetch(iStableIds, coord, 0).x;
+  }
+  return coordToId(coord);
+}
+
+int stableId(ivec3 coord) {
+  if (iStableIdsEnabled != 0) {
+    return texelFetch(iStableIds, coord.xy, 0).x;
+  }
+  return particleCoordToId(coord);
+}
+
+// Signed distance field lookups, one texture fetch each. Distance is negative inside. Outside the baked
+// volume the distance to the volume is added, so particles there still head the right way. Without a field
+// everything is far away.
+
+vec4 sdfSample(vec3 p) {
+  if (iSDFBoundsSize.w == 0.0) {
+    return vec4(0.0, 1.0, 0.0, 1e10);
+  }
+  vec3 uvw = (p - iSDFBoundsMin.xyz) / iSDFBoundsSize.xyz;
+  vec3 clamped = clamp(uvw, 0.0, 1.0);
+  vec4 s = texture(iSDF, clamped);
+  s.w += length((uvw - clamped) * iSDFBoundsSize.xyz);
+  return s;
+}
+
+float sdfDistance(vec3 p) {
+  return sdfSample(p).w;
+}
+
+vec3 sdfNormal(vec3 p) {
+  return sdfSample(p).xyz;
+}
+
+// Velocity from the vector field loaded with App::loadVectorField, in one trilinear fetch. Outside the field
+// the nearest edge value is used, and without a field it's zero.
+vec3 vectorFieldSample(vec3 p) {
+  if (iVectorFieldBoundsSize.w == 0.0) {
+    return vec3(0.0);
+  }
+  return texture(iVectorField, (p - iVectorFieldBoundsMin.xyz) / iVectorFieldBoundsSize.xyz).xyz;
+}
+
+// Exact collisions against the mesh set with App::setCollisionMesh. Nodes are stored depth-first and each one
+// links past its own subtree, so traversal keeps no stack: a hit box steps to the next node, a missed one skips
+// its subtree. Every fetch is a texelFetch from one of two textures, 1024 texels wide.
+
+ivec2 meshBVHTexelCoord(int index) {
+  return ivec2(index & 1023, index >> 10);
+}
+
+// Finds the first triangle crossed going from `a` to `b`. `t` is the fraction of the way to `b`, and `normal`
+// is the triangle's normal turned to face `a`.
+bool meshIntersectSegment(vec3 a, vec3 b, out float t, out vec3 normal) {
+  vec3 delta = b - a;
+  vec3 inv_delta = 1.0 / mix(delta, vec3(1e-30), equal(delta, vec3(0.0)));
+  bool hit = false;
+  t = 1.0;
+  normal = vec3(0.0);
+
+  int node = 0;
+  while (node < iMeshBVHNodeCount) {
+    vec4 box_min = texelFetch(iMeshBVHNodes, meshBVHTexelCoord(node * 2), 0);
+    vec4 box_max = texelFetch(iMeshBVHNodes, meshBVHTexelCoord(node * 2 + 1), 0);
+
+    // Boxes are only tested up to the closest hit so far
+    vec3 t0 = (box_min.xyz - a) * inv_delta;
+    vec3 t1 = (box_max.xyz - a) * inv_delta;
+    vec3 t_near = min(t0, t1);
+    vec3 t_far = max(t0, t1);
+    float t_enter = max(max(t_near.x, t_near.y), max(t_near.z, 0.0));
+    float t_exit = min(min(t_far.x, t_far.y), min(t_far.z, t));
+
+    if (t_enter > t_exit) {
+      node = int(box_min.w);
+      continue;
+    }
+
+    // Leaves list their triangles in a run, the last one flagged in v0.w
+    if (box_max.w >= 0.0) {
+      int tri = int(box_max.w);
+      float last = 0.0;
+      do {
+        vec4 v0 = texelFetch(iMeshBVHTriangles, meshBVHTexelCoord(tri * 3), 0);
+        vec3 e1 = texelFetch(iMeshBVHTriangles, meshBVHTexelCoord(tri * 3 + 1), 0).xyz;
+        vec3 e2 = texelFetch(iMeshBVHTriangles, meshBVHTexelCoord(tri * 3 + 2), 0).xyz;
+
+        // Moller-Trumbore
+        vec3 p = cross(delta, e2);
+        float det = dot(e1, p);
+        if (det != 0.0) {
+          float inv_det = 1.0 / det;
+          vec3 s = a - v0.xyz;
+          vec3 q = cross(s, e1);
+          float u = dot(s, p) * inv_det;
+          float v = dot(delta, q) * inv_det;
+          float t_hit = dot(e2, q) * inv_det;
+          if (u >= 0.0 && v >= 0.0 && u + v <= 1.0 && t_hit >= 0.0 && t_hit < t) {
+            t = t_hit;
+            normal = cross(e1, e2);
+            hit = true;
+          }
+        }
+
+        last = v0.w;
+        tri += 1;
+      } while (last == 0.0);
+    }
+
+    node += 1;
+  }
+
+  if (hit) {
+    normal = normalize(normal);
+    normal = dot(normal, delta) > 0.0 ? -normal : normal;
+  }
+  return hit;
+}
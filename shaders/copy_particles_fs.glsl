@@ -0,0 +1,25 @@
+#version 300 es
+
+precision highp float;
+precision highp int;
+
+// {{common}}
+
+layout(location = 0) out vec4 oFragData0;
+layout(location = 1) out vec4 oFragData1;
+layout(location = 2) out vec4 oFragData2;
+layout(location = 3) out vec4 oFragData3;
+layout(location = 4) out vec4 oFragData4;
+layout(location = 5) out vec4 oFragData5;
+
+// Carries particle state over from the previous frame unchanged.
+void main() {
+  ivec3 coord = particleFragCoord();
+
+  oFragData0 = fetchParticleData(0, coord);
+  oFragData1 = fetchParticleData(1, coord);
+  oFragData2 = fetchParticleData(2, coord);
+  oFragData3 = fetchParticleData(3, coord);
+  oFragData4 = fetchParticleData(4, coord);
+  oFragData5 = fetchParticleData(5, coord);
+}
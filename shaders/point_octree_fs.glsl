@@ -0,0 +1,16 @@
+#version 300 es
+
+precision highp float;
+precision highp int;
+
+in vec4 vColor;
+
+out vec4 oFragColor;
+
+void main() {
+  vec2 offset = gl_PointCoord * 2.0 - 1.0;
+  if (dot(offset, offset) > 1.0) {
+    discard;
+  }
+  oFragColor = vColor;
+}
@@ -0,0 +1,44 @@
+#version 300 es
+
+precision highp float;
+precision highp int;
+
+// {{common}}
+
+uniform highp sampler2D iPointPositions;
+uniform sampler2D iPointColors;
+uniform highp isampler2D iPointNodes; // Drawn nodes as (page x, page y, point count, spacing as float bits)
+uniform float iPointScale;           // Pixels per unit at distance 1
+
+out vec4 vColor;
+
+const int PAGE_SIDE = 64;
+const int PAGE_SIZE = PAGE_SIDE * PAGE_SIDE;
+
+// One point per vertex, PAGE_SIZE vertices per drawn node.
+void main() {
+  int slot = gl_VertexID / PAGE_SIZE;
+  int index = gl_VertexID % PAGE_SIZE;
+
+  int tableWidth = textureSize(iPointNodes, 0).x;
+  ivec4 node = texelFetch(iPointNodes, ivec2(slot % tableWidth, slot / tableWidth), 0);
+
+  if (index >= node.z) {
+    // Past the end of a partly filled page
+    gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+    gl_PointSize = 1.0;
+    vColor = vec4(0.0);
+    return;
+  }
+
+  ivec2 texel = node.xy * PAGE_SIDE + ivec2(index % PAGE_SIDE, index / PAGE_SIDE);
+  vec3 position = texelFetch(iPointPositions, texel, 0).xyz;
+
+  gl_Position = iModelViewProjection * vec4(position, 1.0);
+
+  // Sized to the node's point spacing so points cover the surface without holes at any level
+  float spacing = intBitsToFloat(node.w);
+  gl_PointSize = clamp(iPointScale * spacing / max(gl_Position.w, 1e-4), 1.0, 64.0);
+
+  vColor = texelFetch(iPointColors, texel, 0);
+}
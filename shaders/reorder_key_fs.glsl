@@ -0,0 +1,28 @@
+#version 300 es
+
+precision highp float;
+precision highp int;
+
+// {{common}}
+
+uniform float iCellSize;
+
+out uvec2 oKey;
+
+uint mortonSpreadBits3(uint x) {
+  x &= 0x000003ffu;
+  x = (x | (x << 16u)) & 0x030000ffu;
+  x = (x | (x << 8u)) & 0x0300f00fu;
+  x = (x | (x << 4u)) & 0x030c30c3u;
+  x = (x | (x << 2u)) & 0x09249249u;
+  return x;
+}
+
+// Writes (Morton code of the grid cell containing the particle, source texel index) for each particle.
+void main() {
+  ivec2 coord = ivec2(gl_FragCoord.xy);
+  vec3 position = texelFetch(iFragData[0], coord, 0).xyz;
+  uvec3 cell = uvec3(ivec3(floor(position / iCellSize)) & 1023);
+  uint code = mortonSpreadBits3(cell.x) | (mortonSpreadBits3(cell.y) << 1u) | (mortonSpreadBits3(cell.z) << 2u);
+  oKey = uvec2(code, uint(coord.x + coord.y * iSize.x));
+}
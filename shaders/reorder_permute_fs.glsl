@@ -0,0 +1,28 @@
+#version 300 es
+
+precision highp float;
+precision highp int;
+
+// {{common}}
+
+uniform highp usampler2D iKeys;
+
+layout(location = 0) out vec4 oFragData0;
+layout(location = 1) out vec4 oFragData1;
+layout(location = 2) out vec4 oFragData2;
+layout(location = 3) out vec4 oFragData3;
+layout(location = 4) out vec4 oFragData4;
+layout(location = 5) out vec4 oFragData5;
+
+// Gathers particle state into sorted order.
+void main() {
+  int source = int(texelFetch(iKeys, ivec2(gl_FragCoord.xy), 0).y);
+  ivec2 sourceCoord = ivec2(source % iSize.x, source / iSize.x);
+
+  oFragData0 = texelFetch(iFragData[0], sourceCoord, 0);
+  oFragData1 = texelFetch(iFragData[1], sourceCoord, 0);
+  oFragData2 = texelFetch(iFragData[2], sourceCoord, 0);
+  oFragData3 = texelFetch(iFragData[3], sourceCoord, 0);
+  oFragData4 = texelFetch(iFragData[4], sourceCoord, 0);
+  oFragData5 = texelFetch(iFragData[5], sourceCoord, 0);
+}
@@ -0,0 +1,34 @@
+#version 300 es
+
+precision highp float;
+precision highp int;
+
+// {{common}}
+
+uniform highp usampler2D iKeys;
+uniform int iPartnerMask;
+uniform int iCount;
+
+out uvec2 oKey;
+
+bool keyLess(uvec2 a, uvec2 b) {
+  return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+// One compare-exchange step of a bitonic sort over particle ids. Every step sorts ascending (the first step
+// of each merge compares mirrored partners) so ids past `iCount` act as +infinity and never move.
+void main() {
+  ivec2 coord = ivec2(gl_FragCoord.xy);
+  int id = coordToId(coord);
+  int partnerId = id ^ iPartnerMask;
+
+  uvec2 key = texelFetch(iKeys, coord, 0).xy;
+  if (partnerId >= iCount) {
+    oKey = key;
+    return;
+  }
+
+  uvec2 partnerKey = texelFetch(iKeys, idToCoord(partnerId), 0).xy;
+  bool keepMin = id < partnerId;
+  oKey = keyLess(partnerKey, key) == keepMin ? partnerKey : key;
+}
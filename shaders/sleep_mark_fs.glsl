@@ -0,0 +1,31 @@
+#version 300 es
+
+precision highp float;
+precision highp int;
+
+// {{common}}
+
+#define MAX_WAKE_REGIONS 4
+
+uniform float iWakeRadius;
+uniform vec4 iWakeRegions[MAX_WAKE_REGIONS]; // (center, radius)
+uniform int iWakeRegionCount;
+
+// Leaves a stencil mark for every particle that flagged itself asleep last frame, unless it is close to a
+// controller or inside a wake region. Writes no color.
+void main() {
+  ivec2 coord = ivec2(gl_FragCoord.xy);
+
+  if (texelFetch(iFragData[5], coord, 0).w <= 0.5) discard;
+
+  vec3 position = texelFetch(iFragData[0], coord, 0).xyz;
+
+  for (int i = 0; i < 2; ++i) {
+    if (distance(position, iControllerTransform[i][3].xyz) < iWakeRadius) discard;
+  }
+
+  for (int i = 0; i < MAX_WAKE_REGIONS; ++i) {
+    if (i >= iWakeRegionCount) break;
+    if (distance(position, iWakeRegions[i].xyz) < iWakeRegions[i].w) discard;
+  }
+}
@@ -0,0 +1,23 @@
+#version 300 es
+
+precision highp float;
+precision highp int;
+
+// {{common}}
+
+uniform highp usampler2D iKeys;
+uniform bool iReset;
+
+out int oStableId;
+
+// Follows the same permutation as the particle state so each particle keeps the id it started with.
+void main() {
+  ivec2 coord = ivec2(gl_FragCoord.xy);
+  if (iReset) {
+    oStableId = coordToId(coord);
+    return;
+  }
+
+  int source = int(texelFetch(iKeys, coord, 0).y);
+  oStableId = texelFetch(iStableIds, ivec2(source % iSize.x, source / iSize.x), 0).x;
+}
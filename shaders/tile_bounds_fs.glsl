@@ -0,0 +1,30 @@
+#version 300 es
+
+precision highp float;
+precision highp int;
+
+uniform sampler2D iPosition;
+uniform int iTileSize;
+
+out vec4 oTileBounds;
+
+// Writes a bounding sphere (center, radius) for each `iTileSize`² tile of particle positions.
+void main() {
+  ivec2 size = textureSize(iPosition, 0);
+  ivec2 begin = ivec2(gl_FragCoord.xy) * iTileSize;
+  ivec2 end = min(begin + iTileSize, size);
+
+  vec3 boundsMin = vec3(3.402823e38);
+  vec3 boundsMax = vec3(-3.402823e38);
+
+  for (int y = begin.y; y < end.y; ++y) {
+    for (int x = begin.x; x < end.x; ++x) {
+      vec3 p = texelFetch(iPosition, ivec2(x, y), 0).xyz;
+      boundsMin = min(boundsMin, p);
+      boundsMax = max(boundsMax, p);
+    }
+  }
+
+  vec3 center = 0.5 * (boundsMin + boundsMax);
+  oTileBounds = vec4(center, distance(center, boundsMax));
+}
@@ -10,8 +10,8 @@ Contribute : https://github.com/notlion/pst-alpha
 #pragma size 64 64
 
 void mainSimulation(out vec4 oPosition, out vec4 oColor, out vec4 oData2, out vec4 oData3, out vec4 oData4, out vec4 oData5) {
-  ivec2 coord = ivec2(gl_FragCoord);
-  int id = iSize.x * coord.y + coord.x;
+  ivec3 coord = particleFragCoord();
+  int id = particleCoordToId(coord);
 
   float scale = 1.0 / float(max(iSize.x, iSize.y));
   vec2 pos = (gl_FragCoord.xy - vec2(iSize) * 0.5) * scale;
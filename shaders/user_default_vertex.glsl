@@ -5,14 +5,14 @@ out vec4 vColor;
 
 void mainVertex(out vec4 oPosition) {
   int instanceID = gl_VertexID / 36;
-  ivec2 coord = ivec2(instanceID % iSize.x, instanceID / iSize.x);
+  ivec3 coord = idToParticleCoord(instanceID);
 
-  oPosition = texelFetch(iFragData[0], coord, 0);
+  oPosition = fetchParticleData(0, coord);
   oPosition.xyz += cubeVertices[cubeIndices[gl_VertexID % 36]] * 0.004;
 
   oPosition = iModelViewProjection * oPosition;
 
-  vColor = texelFetch(iFragData[1], coord, 0);
+  vColor = fetchParticleData(1, coord);
 
   vec3 normal = cubeNormals[gl_VertexID / 6 % 6];
   vec3 lightDir = normalize(vec3(0.6, 0.3, 1.0));
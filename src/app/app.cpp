@@ -1,5 +1,6 @@
 #include "app/app.hpp"
 
+#include "app/file.hpp"
 #include "app/log.hpp"
 #include "app/shaders.hpp"
 #include "app/util.hpp"
@@ -7,8 +8,54 @@
 #include "ext/matrix_clip_space.hpp"
 #include "ext/matrix_transform.hpp"
 
+#include <cmath>
+#include <cstring>
+
 using namespace std::string_literals;
 
+static const GLint PARTICLE_DATA_TEXTURE_UNITS[]{ 0, 1, 2, 3, 4, 5 };
+static constexpr GLint STABLE_ID_TEXTURE_UNIT{ 6 };
+static constexpr GLint REORDER_KEY_TEXTURE_UNIT{ 7 };
+static constexpr GLint POINT_OCTREE_TEXTURE_UNITS[]{ 8, 9, 10 }; // Positions, colors, node table
+static constexpr GLint SDF_TEXTURE_UNIT{ 11 };
+static constexpr GLint MESH_BVH_TEXTURE_UNITS[]{ 12, 13 }; // Nodes, triangles
+static constexpr GLint VECTOR_FIELD_TEXTURE_UNIT{ 14 };
+
+static constexpr GLuint COMMON_UNIFORMS_BLOCK_BINDING{ 0 };
+static constexpr GLuint USER_PARAMS_BLOCK_BINDING{ 1 };
+
+static_assert(offsetof(FrameInput, frame_id) == 16, "FrameInput layout is mirrored in web/renderer.js");
+static_assert(offsetof(FrameInput, views) == 40, "FrameInput layout is mirrored in web/renderer.js");
+static_assert(offsetof(FrameInput, controllers) == 328, "FrameInput layout is mirrored in web/renderer.js");
+static_assert(offsetof(FrameInput, latched_controller_mask) == 456, "FrameInput layout is mirrored in web/renderer.js");
+static_assert(offsetof(FrameInput, latched_controllers) == 472, "FrameInput layout is mirrored in web/renderer.js");
+static_assert(sizeof(FrameInput) == 600, "FrameInput layout is mirrored in web/renderer.js");
+static_assert(FrameInput::MAX_VIEWS <= PointOctreeStreamer::MAX_VIEWS, "Point octree nodes are selected for every view");
+
+// Particle snapshots are this header followed by the texels of every texture of m_particle_fbs[0] then
+// m_particle_fbs[1], rows tightly packed. The header keeps the texel data 16 byte aligned.
+struct ParticleSnapshotHeader {
+  char magic[4];
+  uint32_t version;
+
+  int32_t width;
+  int32_t height;
+  uint32_t framebuffer_count;
+  uint32_t texture_count;
+  uint32_t internal_format;
+  uint32_t texture_size_bytes;
+
+  GLfloat time;
+  GLint frame;
+
+  uint32_t _reserved[6];
+};
+
+static constexpr char PARTICLE_SNAPSHOT_MAGIC[4]{ 'P', 'S', 'T', 'S' };
+static constexpr uint32_t PARTICLE_SNAPSHOT_VERSION{ 1 };
+
+static_assert(sizeof(ParticleSnapshotHeader) == 64, "Snapshot texel data must stay aligned");
+
 struct PositionVertex {
   gl::vec4 position;
 };
@@ -27,6 +74,43 @@ static void splitShaderSource(std::string_view source,
   out_postfix = source.substr(pos, source.length() - pos);
 }
 
+static std::string insertCommonShaderSource(std::string_view shader_template, std::string_view common_source) {
+  std::string_view prefix, postfix;
+  splitShaderSource(shader_template, "{{common}}", prefix, postfix);
+
+  auto src = std::string(prefix);
+  src += '\n';
+  src += common_source;
+  src += postfix;
+  return src;
+}
+
+static std::string injectShaderDefines(std::string_view source, std::string_view defines) {
+  // `#version` has to stay on the first line
+  size_t pos = 0;
+  if (source.substr(0, 8) == "#version") {
+    pos = source.find('\n');
+    pos = pos == std::string_view::npos ? source.size() : pos + 1;
+  }
+
+  auto src = std::string();
+  src.reserve(source.size() + defines.size());
+  src += source.substr(0, pos);
+  src += defines;
+  src += source.substr(pos);
+  return src;
+}
+
+// Desktop GL always filters float textures. GLES and WebGL need an extension for it.
+static bool canFilterFloatTextures() {
+#if defined(PLATFORM_EMSCRIPTEN) || defined(PLATFORM_ANDROID) || defined(PLATFORM_IOS)
+  static const bool can_filter = gl::hasExtension("OES_texture_float_linear");
+  return can_filter;
+#else
+  return true;
+#endif
+}
+
 bool App::init() {
   DEBUG_PRINT_GL_STATS();
 
@@ -37,6 +121,15 @@ bool App::init() {
   splitShaderSource(shader_source_shade_vs, "{{vertex}}", m_template_shader_source_prefixes[1], m_template_shader_source_postfixes[1]);
   splitShaderSource(shader_source_shade_fs, "{{fragment}}", m_template_shader_source_prefixes[2], m_template_shader_source_postfixes[2]);
 
+  // Alloc particle data framebuffers. Compiling reads their sizes to check the memory budget.
+  {
+    for (size_t i = 0; i < arraySize(m_particle_fbs); ++i) {
+      m_particle_fbs[i] = std::make_unique<gl::Framebuffer>();
+      m_reorder_key_fbs[i] = std::make_unique<gl::Framebuffer>();
+      m_stable_id_fbs[i] = std::make_unique<gl::Framebuffer>();
+    }
+  }
+
   setUserShaderSourceAtIndex(0, shader_source_user_default_common);
   setUserShaderSourceAtIndex(1, shader_source_user_default_simulation);
   setUserShaderSourceAtIndex(2, shader_source_user_default_vertex);
@@ -44,6 +137,26 @@ bool App::init() {
 
   tryCompileShaderPrograms();
 
+  gl::createProgram(m_tile_bounds_program, m_simulate_shader_vs_source, shader_source_tile_bounds_fs);
+  gl::useProgram(m_tile_bounds_program);
+  gl::uniform(m_tile_bounds_program, "iPosition", 0);
+
+  createUtilityProgram(m_reorder_key_program, shader_source_reorder_key_fs);
+  createUtilityProgram(m_reorder_sort_program, shader_source_reorder_sort_fs);
+  createUtilityProgram(m_reorder_permute_program, shader_source_reorder_permute_fs);
+  createUtilityProgram(m_stable_id_program, shader_source_stable_id_fs);
+  createUtilityProgram(m_sleep_mark_program, shader_source_sleep_mark_fs);
+  createUtilityProgram(m_copy_particles_program, shader_source_copy_particles_fs);
+  createUtilityProgram(m_copy_particles_layered_program, shader_source_copy_particles_fs, "#define PARTICLE_LAYERS\n");
+
+  if (gl::createProgram(m_point_octree_program, insertCommonShaderSource(shader_source_point_octree_vs, m_common_uniforms_shader_source), shader_source_point_octree_fs)) {
+    gl::useProgram(m_point_octree_program);
+    gl::uniformBlockBinding(m_point_octree_program, "CommonUniforms", COMMON_UNIFORMS_BLOCK_BINDING);
+    gl::uniform(m_point_octree_program, "iPointPositions", POINT_OCTREE_TEXTURE_UNITS[0]);
+    gl::uniform(m_point_octree_program, "iPointColors", POINT_OCTREE_TEXTURE_UNITS[1]);
+    gl::uniform(m_point_octree_program, "iPointNodes", POINT_OCTREE_TEXTURE_UNITS[2]);
+  }
+
   // Create a triangle for rendering fullscreen
   {
     const PositionVertex vs[]{
@@ -64,13 +177,6 @@ bool App::init() {
     gl::createVertexBuffer(m_fullscreen_triangle_vb, fullscreen_triangle_mesh);
   }
 
-  // Alloc particle data framebuffers
-  {
-    for (size_t i = 0; i < arraySize(m_particle_fbs); ++i) {
-      m_particle_fbs[i] = std::make_unique<gl::Framebuffer>();
-    }
-  }
-
   // Init shader uniforms
   {
     m_common_uniforms.model_view = glm::lookAt(gl::vec3(0.0f, 0.0f, 3.0f), gl::vec3(0.0f), gl::vec3(0.0f, 1.0f, 0.0f));
@@ -88,6 +194,32 @@ bool App::init() {
 }
 
 void App::cleanup() {
+#if !defined(PLATFORM_EMSCRIPTEN)
+  stopParticleCacheBake();
+  stopParticleCachePlayback();
+#endif
+
+  m_point_cloud_loader.reset();
+  m_texture_uploader.clear();
+  m_point_octree.reset();
+
+  gl::flushDeferredDeletions();
+}
+
+bool App::createUtilityProgram(gl::Program &prog, std::string_view fragment_shader_template, std::string_view defines) {
+  const auto fragment_shader_src = insertCommonShaderSource(fragment_shader_template, m_common_uniforms_shader_source);
+
+  if (!gl::createProgram(prog, m_simulate_shader_vs_source, injectShaderDefines(fragment_shader_src, defines))) {
+    return false;
+  }
+
+  gl::useProgram(prog);
+  gl::uniformBlockBinding(prog, "CommonUniforms", COMMON_UNIFORMS_BLOCK_BINDING);
+  gl::uniform(prog, "iFragData[0]", PARTICLE_DATA_TEXTURE_UNITS);
+  gl::uniform(prog, "iStableIds", STABLE_ID_TEXTURE_UNIT);
+  gl::uniform(prog, "iKeys", REORDER_KEY_TEXTURE_UNIT);
+
+  return true;
 }
 
 void App::updateViewAndProjectionTransforms() {
@@ -103,7 +235,96 @@ void App::updateControllerTransforms() {
   }
 }
 
+void App::beginFrame() {
+  m_input_recorder.recordBeginFrame();
+
+  m_frame_pacer.beginFrame();
+
+  gl::collectDeferredDeletions();
+  collectParticleReadbacks();
+  uploadPointCloudChunks();
+
+  m_point_octree_updated = false;
+}
+
+void App::endFrame() {
+  m_input_recorder.recordEndFrame();
+
+  // Everything this frame submitted is behind these fences
+  gl::fenceDeferredDeletions();
+
+  m_frame_pacer.endFrame();
+}
+
+void App::frame() {
+  const auto &input = m_frame_input;
+
+  // Replaying the whole FrameInput reproduces the calls below
+  m_input_recorder.recordFrame(input);
+  m_input_recorder.pause();
+
+  beginFrame();
+
+  for (int i = 0; i < FrameInput::MAX_CONTROLLERS; ++i) {
+    if (input.controller_mask & (1 << i)) {
+      const auto &controller = input.controllers[i];
+      setControllerAtIndex(i, controller.position, controller.velocity, controller.orientation, controller.buttons);
+    }
+  }
+
+  const int view_count = clamp(input.view_count, 0, FrameInput::MAX_VIEWS);
+
+  if (input.flags & FRAME_INPUT_SIMULATE) {
+    if (view_count > 0) {
+      setViewAndProjectionMatrices(input.views[0].view_matrix, input.views[0].projection_matrix);
+    }
+
+    update(input.frame_id, input.time_seconds, input.time_delta_seconds);
+    simulate(input.display_width, input.display_height);
+  }
+
+  for (int i = 0; i < FrameInput::MAX_CONTROLLERS; ++i) {
+    if (input.latched_controller_mask & (1 << i)) {
+      const auto &controller = input.latched_controllers[i];
+      setControllerAtIndex(i, controller.position, controller.velocity, controller.orientation, controller.buttons);
+    }
+  }
+  latchPoses();
+
+  gl::unbindFramebuffer();
+  glViewport(0, 0, input.display_width, input.display_height);
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+  glDepthMask(GL_TRUE);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  m_frame_view_count = view_count;
+  for (int i = 0; i < view_count; ++i) {
+    gl::mat4 view_matrix, projection_matrix;
+    std::copy_n(input.views[i].view_matrix, 16, &view_matrix[0][0]);
+    std::copy_n(input.views[i].projection_matrix, 16, &projection_matrix[0][0]);
+    m_frame_view_projections[i] = projection_matrix * view_matrix;
+  }
+
+  for (int i = 0; i < view_count; ++i) {
+    const auto &view = input.views[i];
+    glViewport(view.viewport[0], view.viewport[1], view.viewport[2], view.viewport[3]);
+    setViewAndProjectionMatrices(view.view_matrix, view.projection_matrix);
+    render(view.viewport[2], view.viewport[3]);
+  }
+  m_frame_view_count = 0;
+
+  endFrame();
+
+  m_input_recorder.resume();
+}
+
+FrameInput *App::getFrameInput() {
+  return &m_frame_input;
+}
+
 void App::update(int frame_id, double time_seconds, double time_delta_seconds) {
+  m_input_recorder.recordUpdate(frame_id, time_seconds, time_delta_seconds);
+
   m_clock.tick(time_seconds);
 
   // Update common uniforms
@@ -111,46 +332,92 @@ void App::update(int frame_id, double time_seconds, double time_delta_seconds) {
     updateControllerTransforms();
 
     m_common_uniforms.size = m_particle_framebuffer_resolution;
+    m_common_uniforms.addressing_mode = m_particle_addressing_mode;
+    m_common_uniforms.stable_ids_enabled = m_reorder_interval > 0 && m_stable_ids_valid;
+    m_common_uniforms.layer_count = m_particle_layer_count;
 
     m_common_uniforms.time = float(time_seconds);
     m_common_uniforms.time_delta = float(time_delta_seconds);
     m_common_uniforms.frame = frame_id;
   }
+
+  uploadUserParams();
 }
 
-void App::simulate(int displayWidth, int displayHeight) {
-  // Create particle data framebuffers (if needed)
-  {
-    for (size_t i = 0; i < arraySize(m_particle_fbs); ++i) {
-      if (m_particle_fbs[i]->width != m_particle_framebuffer_resolution.x || m_particle_fbs[i]->height != m_particle_framebuffer_resolution.y) {
-        gl::TextureOpts particle_tex_opts{ GL_TEXTURE_2D, GL_RGBA32F, GL_RGBA, GL_FLOAT, GL_NEAREST, GL_NEAREST };
-        gl::createFramebuffer(*m_particle_fbs[i],
-                              m_particle_framebuffer_resolution.x,
-                              m_particle_framebuffer_resolution.y,
-                              {
-                                { GL_COLOR_ATTACHMENT0, particle_tex_opts },
-                                { GL_COLOR_ATTACHMENT1, particle_tex_opts },
-                                { GL_COLOR_ATTACHMENT2, particle_tex_opts },
-                                { GL_COLOR_ATTACHMENT3, particle_tex_opts },
-                                { GL_COLOR_ATTACHMENT4, particle_tex_opts },
-                                { GL_COLOR_ATTACHMENT5, particle_tex_opts },
-                              });
+void App::createParticleFramebuffers() {
+  for (size_t i = 0; i < arraySize(m_particle_fbs); ++i) {
+    auto &fb = m_particle_fbs[i];
+    const bool has_stencil = !fb->renderbuffers.empty();
+    const bool is_layered = !fb->textures.empty() && fb->textures[0].opts.target == GL_TEXTURE_2D_ARRAY;
+    if (fb->width != m_particle_framebuffer_resolution.x || fb->height != m_particle_framebuffer_resolution.y || has_stencil != m_sleep_enabled ||
+        is_layered != m_particle_layers_enabled || fb->layer_count != m_particle_layer_count) {
+      gl::TextureOpts particle_tex_opts{ m_particle_layers_enabled ? GLenum(GL_TEXTURE_2D_ARRAY) : GLenum(GL_TEXTURE_2D), GL_RGBA32F, GL_RGBA, GL_FLOAT, GL_NEAREST, GL_NEAREST };
+      particle_tex_opts.immutable = true;
+      const std::vector<gl::FramebufferTextureAttachment> texture_attachments{
+        { GL_COLOR_ATTACHMENT0, particle_tex_opts },
+        { GL_COLOR_ATTACHMENT1, particle_tex_opts },
+        { GL_COLOR_ATTACHMENT2, particle_tex_opts },
+        { GL_COLOR_ATTACHMENT3, particle_tex_opts },
+        { GL_COLOR_ATTACHMENT4, particle_tex_opts },
+        { GL_COLOR_ATTACHMENT5, particle_tex_opts },
+      };
+      std::vector<gl::FramebufferRenderbufferAttachment> renderbuffer_attachments;
+      if (m_sleep_enabled) {
+        renderbuffer_attachments.push_back({ GL_DEPTH_STENCIL_ATTACHMENT, { GL_RENDERBUFFER, GL_DEPTH24_STENCIL8 } });
+      }
+      m_resource_pool.releaseFramebuffer(std::move(fb));
+      if (m_particle_layers_enabled) {
+        fb = m_resource_pool.acquireLayeredFramebuffer(m_particle_framebuffer_resolution.x, m_particle_framebuffer_resolution.y, m_particle_layer_count, texture_attachments);
       }
+      else {
+        fb = m_resource_pool.acquireFramebuffer(m_particle_framebuffer_resolution.x, m_particle_framebuffer_resolution.y, texture_attachments, renderbuffer_attachments);
+      }
+
+      // Pooled framebuffers still hold old particle state. Start from zero like a fresh allocation.
+      glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+      for (int layer = 0; layer < fb->layer_count; ++layer) {
+        gl::bindFramebuffer(*fb, layer);
+        glClear(GL_COLOR_BUFFER_BIT);
+      }
+      gl::unbindFramebuffer();
+
+      m_stable_ids_valid = false;
+
+      trimResourcePoolToMemoryBudget();
     }
   }
+}
+
+void App::simulate(int displayWidth, int displayHeight) {
+  m_input_recorder.recordSimulate(displayWidth, displayHeight);
 
-  gl::updateUniformBuffer(m_common_uniforms_buffer, m_common_uniforms);
+  createParticleFramebuffers();
+
+  gl::streamUniformBuffer(m_common_uniforms_buffer, m_common_uniforms);
+  m_view_pose_dirty = false;
+  m_controller_pose_dirty = false;
 
   std::swap(m_particle_fbs[0], m_particle_fbs[1]);
 
-  gl::bindFramebuffer(*m_particle_fbs[0]);
+#if !defined(PLATFORM_EMSCRIPTEN)
+  // Cached frames replace the simulation entirely
+  if (m_particle_cache_reader) {
+    if (m_particle_layers_enabled || !m_particle_cache_reader->uploadNextFrame(*m_particle_fbs[0])) {
+      stopParticleCachePlayback();
+    }
+    if (m_tile_culling_enabled) {
+      updateTileBounds();
+    }
+    return;
+  }
+#endif
 
   gl::disableBlend();
   gl::disableDepth();
 
-  glViewport(0, 0, m_particle_framebuffer_resolution.x, m_particle_framebuffer_resolution.y);
-  glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-  glClear(GL_COLOR_BUFFER_BIT);
+  const auto &resolution = m_particle_framebuffer_resolution;
+
+  glViewport(0, 0, resolution.x, resolution.y);
 
   gl::bindTexture(m_particle_fbs[1]->textures[0], GL_TEXTURE0);
   gl::bindTexture(m_particle_fbs[1]->textures[1], GL_TEXTURE1);
@@ -159,351 +426,2108 @@ void App::simulate(int displayWidth, int displayHeight) {
   gl::bindTexture(m_particle_fbs[1]->textures[4], GL_TEXTURE4);
   gl::bindTexture(m_particle_fbs[1]->textures[5], GL_TEXTURE5);
 
-  gl::bindUniformBuffer(m_common_uniforms_buffer, 0);
+  if (m_common_uniforms.stable_ids_enabled) {
+    gl::bindTexture(m_stable_id_fbs[0]->textures[0], GL_TEXTURE0 + STABLE_ID_TEXTURE_UNIT);
+  }
+  if (m_sdf_texture.id) {
+    gl::bindTexture(m_sdf_texture, GL_TEXTURE0 + SDF_TEXTURE_UNIT);
+  }
+  if (m_mesh_bvh_textures[0].id) {
+    gl::bindTexture(m_mesh_bvh_textures[0], GL_TEXTURE0 + MESH_BVH_TEXTURE_UNITS[0]);
+    gl::bindTexture(m_mesh_bvh_textures[1], GL_TEXTURE0 + MESH_BVH_TEXTURE_UNITS[1]);
+  }
+  if (m_vector_field_texture.id) {
+    gl::bindTexture(m_vector_field_texture, GL_TEXTURE0 + VECTOR_FIELD_TEXTURE_UNIT);
+  }
+
+  gl::bindUniformBuffer(m_common_uniforms_buffer, COMMON_UNIFORMS_BLOCK_BINDING);
+  if (m_user_params_buffer.id) {
+    gl::bindUniformBuffer(m_user_params_buffer, USER_PARAMS_BLOCK_BINDING);
+  }
+
+  // Only one band of rows is simulated per frame with `#pragma updateFraction`. The rest is carried over.
+  float update_time_delta = m_common_uniforms.time_delta;
+  int band_y0 = 0;
+  int band_y1 = resolution.y;
+  if (m_update_fraction > 1) {
+    const int band = m_update_band;
+    m_update_band = (m_update_band + 1) % m_update_fraction;
+
+    band_y0 = resolution.y * band / m_update_fraction;
+    band_y1 = resolution.y * (band + 1) / m_update_fraction;
+
+    auto &last_update_time = m_update_band_times[band];
+    if (last_update_time >= 0.0f) {
+      update_time_delta = m_common_uniforms.time - last_update_time;
+    }
+    last_update_time = m_common_uniforms.time;
+  }
+
+  auto &copy_particles_program = m_particle_layers_enabled ? m_copy_particles_layered_program : m_copy_particles_program;
 
   gl::useProgram(m_programs[0]);
   gl::uniform(m_programs[0], "iResolution", gl::ivec2(displayWidth, displayHeight));
+  gl::uniform(m_programs[0], "iUpdateTimeDelta", update_time_delta);
+  gl::uniform(m_programs[0], "iLastUpdateTime", m_common_uniforms.time - update_time_delta);
+
+  // Layers are simulated one draw each. GLES 3.0 has no layered rendering.
+  for (int layer = 0; layer < m_particle_layer_count; ++layer) {
+    gl::bindFramebuffer(*m_particle_fbs[0], layer);
+
+    if (m_update_fraction > 1) {
+      glEnable(GL_SCISSOR_TEST);
+      gl::useProgram(copy_particles_program);
+      gl::uniform(copy_particles_program, "iLayer", layer);
+      if (band_y0 > 0) {
+        glScissor(0, 0, resolution.x, band_y0);
+        gl::drawVertexBuffer(m_fullscreen_triangle_vb);
+      }
+      if (band_y1 < resolution.y) {
+        glScissor(0, band_y1, resolution.x, resolution.y - band_y1);
+        gl::drawVertexBuffer(m_fullscreen_triangle_vb);
+      }
+      glScissor(0, band_y0, resolution.x, band_y1 - band_y0);
+    }
 
-  gl::drawVertexBuffer(m_fullscreen_triangle_vb);
-
-  gl::unbindFramebuffer();
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClearStencil(0);
+    glClear(m_sleep_enabled ? GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT : GL_COLOR_BUFFER_BIT);
 
-  CHECK_GL_ERROR();
-}
+    if (m_sleep_enabled) {
+      markSleepingParticles();
+    }
 
-void App::render(int displayWidth, int displayHeight) {
-  gl::updateUniformBuffer(m_common_uniforms_buffer, m_common_uniforms);
+    gl::useProgram(m_programs[0]);
+    gl::uniform(m_programs[0], "iLayer", layer);
 
-  gl::enableDepth();
-  glDepthFunc(m_depth_func);
+    gl::drawVertexBuffer(m_fullscreen_triangle_vb);
 
-  if (m_cull_mode != GL_NONE) {
-    glEnable(GL_CULL_FACE);
-    glCullFace(m_cull_mode);
+    glDisable(GL_SCISSOR_TEST);
+    glDisable(GL_STENCIL_TEST);
   }
 
-  if (m_blend_func_sfactor != m_default_blend_func_sfactor || m_blend_func_dfactor != m_default_blend_func_dfactor) {
-    glEnable(GL_BLEND);
-    glBlendFunc(m_blend_func_sfactor, m_blend_func_dfactor);
+  gl::unbindFramebuffer();
+
+  if (m_reorder_interval > 0 && m_common_uniforms.frame % m_reorder_interval == 0) {
+    reorderParticles();
   }
 
-  gl::bindTexture(m_particle_fbs[0]->textures[0], GL_TEXTURE0);
-  gl::bindTexture(m_particle_fbs[0]->textures[1], GL_TEXTURE1);
-  gl::bindTexture(m_particle_fbs[0]->textures[2], GL_TEXTURE2);
-  gl::bindTexture(m_particle_fbs[0]->textures[3], GL_TEXTURE3);
-  gl::bindTexture(m_particle_fbs[0]->textures[4], GL_TEXTURE4);
-  gl::bindTexture(m_particle_fbs[0]->textures[5], GL_TEXTURE5);
+  if (m_tile_culling_enabled) {
+    updateTileBounds();
+  }
 
-  gl::bindUniformBuffer(m_common_uniforms_buffer, 0);
+#if !defined(PLATFORM_EMSCRIPTEN)
+  if (m_particle_cache_writer && (m_particle_layers_enabled || !m_particle_cache_writer->capture(*m_particle_fbs[0], m_common_uniforms.time, m_common_uniforms.frame))) {
+    stopParticleCacheBake();
+  }
+#endif
 
-  gl::useProgram(m_programs[1]);
-  gl::uniform(m_programs[1], "iResolution", gl::ivec2(displayWidth, displayHeight));
+  CHECK_GL_ERROR();
+}
 
-  GLsizei instance_count = m_particle_framebuffer_resolution.x * m_particle_framebuffer_resolution.y;
-  glDrawArrays(GL_TRIANGLES, 0, m_instance_vertex_count * instance_count);
+void App::markSleepingParticles() {
+  glEnable(GL_STENCIL_TEST);
+  glStencilMask(0xff);
 
-  glDisable(GL_CULL_FACE);
-  glDisable(GL_BLEND);
+  // Mark sleeping particles in the stencil buffer
+  glStencilFunc(GL_ALWAYS, 1, 0xff);
+  glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
 
-  CHECK_GL_ERROR();
-}
+  gl::useProgram(m_sleep_mark_program);
+  gl::uniform(m_sleep_mark_program, "iWakeRadius", m_sleep_wake_radius);
+  gl::uniform(m_sleep_mark_program, "iWakeRegionCount", GLint(m_sleep_wake_regions.size()));
+  if (!m_sleep_wake_regions.empty()) {
+    glUniform4fv(gl::getUniformLocation(m_sleep_mark_program, "iWakeRegions[0]"), m_sleep_wake_regions.size(), &m_sleep_wake_regions[0].x);
+  }
+  gl::drawVertexBuffer(m_fullscreen_triangle_vb);
 
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+  glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
 
-static std::string concatenateShaderSource(std::string_view prefix,
-                                           std::string_view common_source,
-                                           std::string_view user_common_source,
-                                           std::string_view user_source,
-                                           std::string_view postfix) {
-  auto src = std::string();
-  auto src_size = prefix.size() + common_source.size() + user_common_source.size() + user_source.size() + postfix.size() + 3;
-  src.reserve(src_size + 1);
-  src += prefix;
-  src += '\n';
-  src += common_source;
-  src += '\n';
-  src += user_common_source;
-  src += '\n';
-  src += user_source;
-  src += postfix;
-  assert(src.size() == src_size);
-  return src;
-}
+  // Sleeping particles only carry their state over
+  glStencilFunc(GL_EQUAL, 1, 0xff);
+  gl::useProgram(m_copy_particles_program);
+  gl::drawVertexBuffer(m_fullscreen_triangle_vb);
 
-std::string App::assembleShaderSourceAtIndex(int index){
-  return concatenateShaderSource(m_template_shader_source_prefixes[index],
-                                 m_common_uniforms_shader_source,
-                                 m_user_shader_sources[0],
-                                 m_user_shader_sources[index + 1],
-                                 m_template_shader_source_postfixes[index]);
+  // Leave the stencil test set up so the simulation pass skips them
+  glStencilFunc(GL_NOTEQUAL, 1, 0xff);
 }
 
-std::string_view App::getUserShaderSourceAtIndex(int index) {
-  assert(index >= 0 && index < arraySize(m_user_shader_sources));
-  return m_user_shader_sources[index];
-}
+void App::reorderParticles() {
+  const auto &resolution = m_particle_framebuffer_resolution;
 
-std::string_view App::getAssembledShaderSourceAtIndex(int index) {
-  assert(index >= 0 && index < arraySize(m_assembled_shader_sources));
-  return m_assembled_shader_sources[index];
-}
+  for (size_t i = 0; i < arraySize(m_reorder_key_fbs); ++i) {
+    if (m_reorder_key_fbs[i]->width != resolution.x || m_reorder_key_fbs[i]->height != resolution.y) {
+      gl::TextureOpts key_tex_opts{ GL_TEXTURE_2D, GL_RG32UI, GL_RG_INTEGER, GL_UNSIGNED_INT, GL_NEAREST, GL_NEAREST };
+      key_tex_opts.immutable = true;
+      m_resource_pool.releaseFramebuffer(std::move(m_reorder_key_fbs[i]));
+      m_reorder_key_fbs[i] = m_resource_pool.acquireFramebuffer(resolution.x, resolution.y, { { GL_COLOR_ATTACHMENT0, key_tex_opts } });
 
-void App::setUserShaderSourceAtIndex(int index, std::string_view shader_src) {
-  assert(index >= 0 && index < arraySize(m_user_shader_sources));
+      gl::TextureOpts stable_id_tex_opts{ GL_TEXTURE_2D, GL_R32I, GL_RED_INTEGER, GL_INT, GL_NEAREST, GL_NEAREST };
+      stable_id_tex_opts.immutable = true;
+      m_resource_pool.releaseFramebuffer(std::move(m_stable_id_fbs[i]));
+      m_stable_id_fbs[i] = m_resource_pool.acquireFramebuffer(resolution.x, resolution.y, { { GL_COLOR_ATTACHMENT0, stable_id_tex_opts } });
 
-  m_user_shader_sources[index] = shader_src;
+      m_stable_ids_valid = false;
 
-  if (index == 0) {
-    // Assemble all shaders if the common source is changed
-    for (size_t i = 0; i < arraySize(m_assembled_shader_sources); ++i) {
-      m_assembled_shader_sources[i] = assembleShaderSourceAtIndex(i);
+      trimResourcePoolToMemoryBudget();
     }
   }
-  else {
-    m_assembled_shader_sources[index - 1] = assembleShaderSourceAtIndex(index - 1);
-  }
-}
 
+  glViewport(0, 0, resolution.x, resolution.y);
 
-struct ShaderPragma {
-  std::vector<std::string> args;
-};
-
-static const std::string SHADER_PRAGMA_PREFIX{ "#pragma" }; 
+  if (!m_stable_ids_valid) {
+    gl::bindFramebuffer(*m_stable_id_fbs[0]);
+    gl::useProgram(m_stable_id_program);
+    gl::uniform(m_stable_id_program, "iReset", 1);
+    gl::drawVertexBuffer(m_fullscreen_triangle_vb);
 
-static std::string_view findNextToken(std::string_view::iterator &begin, std::string_view::iterator end) {
-  begin = std::find_if(begin, end, [](auto c) { return !std::isspace(c); });
-  
-  std::string_view token;
-  
-  if (begin != end) {
-    auto tokenEnd = std::find_if(begin, end, [](auto c) { return std::isspace(c); });
-    token = std::string_view(begin, tokenEnd - begin);
-    begin = tokenEnd;
+    m_stable_ids_valid = true;
   }
 
-  return token;
-}
+  // Build sort keys from the cell each particle is in
+  {
+    gl::bindFramebuffer(*m_reorder_key_fbs[0]);
+    gl::bindTexture(m_particle_fbs[0]->textures[0], GL_TEXTURE0);
+    gl::useProgram(m_reorder_key_program);
+    gl::uniform(m_reorder_key_program, "iCellSize", m_reorder_cell_size);
+    gl::drawVertexBuffer(m_fullscreen_triangle_vb);
+  }
 
-static std::vector<ShaderPragma> parsePragmas(std::string_view source) {
-  std::vector<ShaderPragma> pragmas;
-  
-  for (auto lineBegin = source.begin(); lineBegin != source.end();) {
-    auto lineEnd = std::find(lineBegin, source.end(), '\n');
-    if (lineEnd != source.end()) lineEnd++;
+  // Bitonic sort the keys in particle id order
+  {
+    const int count = resolution.x * resolution.y;
+    int padded_count = 1;
+    while (padded_count < count) padded_count *= 2;
 
-    // Skip leading whitespace
-    lineBegin = std::find_if(lineBegin, lineEnd, [](auto c) { return !std::isspace(c); });
-    if (lineBegin == lineEnd) continue;
+    gl::useProgram(m_reorder_sort_program);
+    gl::uniform(m_reorder_sort_program, "iCount", count);
 
-    // Check if the line starts with "#pragma"
-    if (lineEnd - lineBegin >= SHADER_PRAGMA_PREFIX.size() && std::equal(SHADER_PRAGMA_PREFIX.begin(), SHADER_PRAGMA_PREFIX.end(), lineBegin)) {
-      pragmas.emplace_back();
-      
-      lineBegin += SHADER_PRAGMA_PREFIX.size();
+    for (int k = 2; k <= padded_count; k *= 2) {
+      for (int j = k / 2; j > 0; j /= 2) {
+        std::swap(m_reorder_key_fbs[0], m_reorder_key_fbs[1]);
 
-      // Find and append arguments
-      while (lineBegin != lineEnd) {
-        const auto arg = findNextToken(lineBegin, lineEnd);
-        if (!arg.empty()) {
-          pragmas.back().args.emplace_back(arg);
-        }
+        gl::bindFramebuffer(*m_reorder_key_fbs[0]);
+        gl::bindTexture(m_reorder_key_fbs[1]->textures[0], GL_TEXTURE0 + REORDER_KEY_TEXTURE_UNIT);
+        gl::uniform(m_reorder_sort_program, "iPartnerMask", j == k / 2 ? k - 1 : j);
+        gl::drawVertexBuffer(m_fullscreen_triangle_vb);
       }
     }
-    else {
-      lineBegin = lineEnd;
+  }
+
+  gl::bindTexture(m_reorder_key_fbs[0]->textures[0], GL_TEXTURE0 + REORDER_KEY_TEXTURE_UNIT);
+
+  // Permute all particle attachments into sorted order
+  {
+    gl::bindFramebuffer(*m_particle_fbs[1]);
+    for (size_t i = 0; i < m_particle_fbs[0]->textures.size(); ++i) {
+      gl::bindTexture(m_particle_fbs[0]->textures[i], GL_TEXTURE0 + PARTICLE_DATA_TEXTURE_UNITS[i]);
     }
+    gl::useProgram(m_reorder_permute_program);
+    gl::drawVertexBuffer(m_fullscreen_triangle_vb);
+
+    std::swap(m_particle_fbs[0], m_particle_fbs[1]);
   }
 
-  return pragmas;
+  // Carry stable ids along with the particles they belong to
+  {
+    gl::bindFramebuffer(*m_stable_id_fbs[1]);
+    gl::bindTexture(m_stable_id_fbs[0]->textures[0], GL_TEXTURE0 + STABLE_ID_TEXTURE_UNIT);
+    gl::useProgram(m_stable_id_program);
+    gl::uniform(m_stable_id_program, "iReset", 0);
+    gl::drawVertexBuffer(m_fullscreen_triangle_vb);
+
+    std::swap(m_stable_id_fbs[0], m_stable_id_fbs[1]);
+  }
+
+  gl::unbindFramebuffer();
 }
 
-void App::parseSimulationShaderPragmas() {
-  m_particle_framebuffer_resolution = m_default_particle_framebuffer_resolution;
+void App::updateTileBounds() {
+  const gl::ivec2 tile_count = (m_particle_framebuffer_resolution + (PARTICLE_TILE_SIZE - 1)) / PARTICLE_TILE_SIZE;
 
-  const auto pragmas = parsePragmas(m_user_shader_sources[1]);
-  for (const auto &pragma : pragmas) {
-    if (pragma.args.size() == 3 && stringsEqualCaseInsensitive(pragma.args[0], "size")) {
-      gl::ivec2 size{ std::atoi(pragma.args[1].c_str()), std::atoi(pragma.args[2].c_str()) };
-      if (size.x > 0 && size.y > 0) {
-        m_particle_framebuffer_resolution = size;
-      }
+  if (m_tile_bounds_fb.width != tile_count.x || m_tile_bounds_fb.height != tile_count.y) {
+    gl::TextureOpts tile_tex_opts{ GL_TEXTURE_2D, GL_RGBA32F, GL_RGBA, GL_FLOAT, GL_NEAREST, GL_NEAREST };
+    gl::createFramebuffer(m_tile_bounds_fb, tile_count.x, tile_count.y, { { GL_COLOR_ATTACHMENT0, tile_tex_opts } });
+
+    for (auto &readback : m_tile_bounds_readbacks) {
+      gl::createPixelBuffer(readback.buffer, tile_count.x * tile_count.y * sizeof(gl::vec4));
+      gl::deleteFence(readback.fence);
+      readback.pending = false;
     }
+
+    m_tile_bounds.clear();
   }
-}
 
-void App::parseRenderShaderPragmas() {
-  const auto findValueByNameCaseInsensitive = [](const auto &names, const auto &values, std::string_view name) -> const GLenum* {
-    const auto it = std::find_if(std::begin(names), std::end(names), [&name](const auto &n) {
-      return stringsEqualCaseInsensitive(name, n);
-    });
-    if (it == std::end(names)) return nullptr;
-    return &values[it - std::begin(names)];
+  gl::bindFramebuffer(m_tile_bounds_fb);
+  glViewport(0, 0, tile_count.x, tile_count.y);
+
+  gl::bindTexture(m_particle_fbs[0]->textures[0], GL_TEXTURE0);
+
+  gl::useProgram(m_tile_bounds_program);
+  gl::uniform(m_tile_bounds_program, "iTileSize", PARTICLE_TILE_SIZE);
+
+  gl::drawVertexBuffer(m_fullscreen_triangle_vb);
+
+  // Collect finished readbacks, oldest first. The bounds used for culling lag the simulation by a frame or
+  // two so we never wait on the GPU here; `#pragma tileCulling <margin>` should cover the difference.
+  const auto readback_count = arraySize(m_tile_bounds_readbacks);
+  for (size_t i = 0; i < readback_count; ++i) {
+    auto &readback = m_tile_bounds_readbacks[(m_tile_bounds_readback_index + i) % readback_count];
+    if (readback.pending && gl::isFenceSignaled(readback.fence)) {
+      m_tile_bounds.resize(tile_count.x * tile_count.y);
+      gl::getPixelBufferData(readback.buffer, 0, m_tile_bounds.size() * sizeof(gl::vec4), m_tile_bounds.data());
+      gl::deleteFence(readback.fence);
+      readback.pending = false;
+    }
+  }
+
+  auto &readback = m_tile_bounds_readbacks[m_tile_bounds_readback_index];
+  if (!readback.pending) {
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    gl::readPixelsToBuffer(readback.buffer, 0, 0, 0, tile_count.x, tile_count.y);
+    gl::createFence(readback.fence);
+    readback.pending = true;
+
+    m_tile_bounds_readback_index = (m_tile_bounds_readback_index + 1) % readback_count;
+  }
+
+  gl::unbindFramebuffer();
+}
+
+bool App::requestParticleReadback(uint32_t attachment_mask, ParticleReadbackCallback callback) {
+  if (m_particle_layers_enabled) {
+    PRINT_ERROR("Particle readbacks don't support layered particle storage\n");
+    return false;
+  }
+
+  const auto &fb = *m_particle_fbs[0];
+
+  attachment_mask &= (1u << std::min(fb.textures.size(), size_t(ParticleReadbackData::MAX_ATTACHMENTS))) - 1;
+  if (attachment_mask == 0 || !callback) {
+    return false;
+  }
+
+  const size_t texture_size_bytes = gl::getTextureSizeBytes(fb.textures[0]);
+  size_t size_bytes = 0;
+  for (size_t i = 0; i < fb.textures.size(); ++i) {
+    if (attachment_mask & (1u << i)) {
+      size_bytes += texture_size_bytes;
+    }
+  }
+
+  // Prefer a free readback whose buffer is already big enough
+  ParticleReadback *readback = nullptr;
+  for (auto &r : m_particle_readbacks) {
+    if (!r.pending && (readback == nullptr || (readback->buffer.size_bytes < size_bytes && r.buffer.size_bytes >= size_bytes))) {
+      readback = &r;
+    }
+  }
+  if (readback == nullptr) {
+    return false;
+  }
+
+  if (readback->buffer.size_bytes < size_bytes) {
+    gl::createPixelBuffer(readback->buffer, size_bytes);
+  }
+
+  gl::bindFramebuffer(fb);
+  size_t offset_bytes = 0;
+  for (size_t i = 0; i < fb.textures.size(); ++i) {
+    if (attachment_mask & (1u << i)) {
+      glReadBuffer(fb.buffers[i]);
+      gl::readPixelsToBuffer(readback->buffer, offset_bytes, 0, 0, fb.width, fb.height);
+      offset_bytes += texture_size_bytes;
+    }
+  }
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  gl::unbindFramebuffer();
+
+  gl::createFence(readback->fence);
+
+  readback->callback = std::move(callback);
+  readback->attachment_mask = attachment_mask;
+  readback->width = fb.width;
+  readback->height = fb.height;
+  readback->time = m_common_uniforms.time;
+  readback->frame = m_common_uniforms.frame;
+  readback->sequence = m_particle_readback_sequence++;
+  readback->pending = true;
+
+  return true;
+}
+
+void App::collectParticleReadbacks() {
+  // Deliver in request order, stopping at the first copy the GPU hasn't finished
+  for (;;) {
+    ParticleReadback *readback = nullptr;
+    for (auto &r : m_particle_readbacks) {
+      if (r.pending && (readback == nullptr || r.sequence < readback->sequence)) {
+        readback = &r;
+      }
+    }
+    if (readback == nullptr || !gl::isFenceSignaled(readback->fence)) {
+      break;
+    }
+
+    ParticleReadbackData data{};
+    data.width = readback->width;
+    data.height = readback->height;
+    data.time = readback->time;
+    data.frame = readback->frame;
+    data.attachment_mask = readback->attachment_mask;
+
+    const size_t texture_texel_count = size_t(data.width) * data.height * 4;
+    size_t size_bytes = 0;
+    for (int i = 0; i < ParticleReadbackData::MAX_ATTACHMENTS; ++i) {
+      if (data.attachment_mask & (1u << i)) {
+        size_bytes += texture_texel_count * sizeof(GLfloat);
+      }
+    }
+
+#if defined(PLATFORM_EMSCRIPTEN)
+    readback->staging.resize(size_bytes / sizeof(GLfloat));
+    gl::getPixelBufferData(readback->buffer, 0, size_bytes, readback->staging.data());
+    data.texels = readback->staging.data();
+#else
+    data.texels = static_cast<const GLfloat *>(gl::mapPixelBuffer(readback->buffer, 0, size_bytes));
+#endif
+
+    // The readback stays pending during the callback so a new request can't reuse its buffer
+    const auto callback = std::move(readback->callback);
+    if (data.texels != nullptr) {
+      auto texels = data.texels;
+      for (int i = 0; i < ParticleReadbackData::MAX_ATTACHMENTS; ++i) {
+        if (data.attachment_mask & (1u << i)) {
+          data.attachments[i] = texels;
+          texels += texture_texel_count;
+        }
+      }
+      callback(data);
+    }
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+    if (data.texels != nullptr) {
+      gl::unmapPixelBuffer(readback->buffer);
+    }
+#endif
+
+    gl::deleteFence(readback->fence);
+    readback->callback = nullptr;
+    readback->pending = false;
+  }
+}
+
+void App::latchPoses() {
+  if (!m_view_pose_dirty && !m_controller_pose_dirty) {
+    return;
+  }
+
+  updateControllerTransforms();
+
+  // Streamed rather than updated in place: this frame's simulation draws, and the previous view's draws when
+  // rendering each eye, still read the buffer the poses were in
+  gl::streamUniformBuffer(m_common_uniforms_buffer, m_common_uniforms);
+
+  if (m_controller_pose_dirty && m_late_latch_particle_count > 0) {
+    resimulateLateLatchedParticles();
+  }
+
+  m_view_pose_dirty = false;
+  m_controller_pose_dirty = false;
+}
+
+void App::resimulateLateLatchedParticles() {
+  // Texels no longer hold the same ids once reordered, and partial updates only copied most rows this frame
+  if (m_reorder_interval > 0 || m_update_fraction > 1 || !m_programs[0].id) {
+    return;
+  }
+
+  const auto &resolution = m_particle_framebuffer_resolution;
+  const int count = std::min(m_late_latch_particle_count, resolution.x * resolution.y);
+
+  // Bounds of the texels holding ids [0, count)
+  gl::ivec2 region;
+  if (m_particle_addressing_mode == PARTICLE_ADDRESSING_MORTON) {
+    int side = 1;
+    while (side * side < count) side *= 2;
+    region = gl::ivec2(side);
+  }
+  else {
+    region = gl::ivec2(count > resolution.x ? resolution.x : count, (count + resolution.x - 1) / resolution.x);
+  }
+
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+
+  gl::bindFramebuffer(*m_particle_fbs[0]);
+  glViewport(0, 0, resolution.x, resolution.y);
+
+  gl::disableBlend();
+  gl::disableDepth();
+
+  for (size_t i = 0; i < arraySize(PARTICLE_DATA_TEXTURE_UNITS); ++i) {
+    gl::bindTexture(m_particle_fbs[1]->textures[i], GL_TEXTURE0 + PARTICLE_DATA_TEXTURE_UNITS[i]);
+  }
+
+  gl::bindUniformBuffer(m_common_uniforms_buffer, COMMON_UNIFORMS_BLOCK_BINDING);
+  if (m_user_params_buffer.id) {
+    gl::bindUniformBuffer(m_user_params_buffer, USER_PARAMS_BLOCK_BINDING);
+  }
+
+  // Same inputs as this frame's simulation pass except for the poses. Its uniforms are still set.
+  glEnable(GL_SCISSOR_TEST);
+  glScissor(0, 0, region.x, region.y);
+
+  // The stencil still marks the particles that slept through this frame's simulation pass
+  if (m_sleep_enabled) {
+    glEnable(GL_STENCIL_TEST);
+    glStencilMask(0x00);
+    glStencilFunc(GL_NOTEQUAL, 1, 0xff);
+  }
+
+  gl::useProgram(m_programs[0]);
+  gl::drawVertexBuffer(m_fullscreen_triangle_vb);
+
+  glDisable(GL_SCISSOR_TEST);
+  glDisable(GL_STENCIL_TEST);
+  glStencilMask(0xff);
+
+  gl::unbindFramebuffer();
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void App::render(int displayWidth, int displayHeight) {
+  m_input_recorder.recordRender(displayWidth, displayHeight);
+
+  latchPoses();
+
+  gl::enableDepth();
+  glDepthFunc(m_depth_func);
+
+  if (m_cull_mode != GL_NONE) {
+    glEnable(GL_CULL_FACE);
+    glCullFace(m_cull_mode);
+  }
+
+  if (m_blend_func_sfactor != m_default_blend_func_sfactor || m_blend_func_dfactor != m_default_blend_func_dfactor) {
+    glEnable(GL_BLEND);
+    glBlendFunc(m_blend_func_sfactor, m_blend_func_dfactor);
+  }
+
+  gl::bindTexture(m_particle_fbs[0]->textures[0], GL_TEXTURE0);
+  gl::bindTexture(m_particle_fbs[0]->textures[1], GL_TEXTURE1);
+  gl::bindTexture(m_particle_fbs[0]->textures[2], GL_TEXTURE2);
+  gl::bindTexture(m_particle_fbs[0]->textures[3], GL_TEXTURE3);
+  gl::bindTexture(m_particle_fbs[0]->textures[4], GL_TEXTURE4);
+  gl::bindTexture(m_particle_fbs[0]->textures[5], GL_TEXTURE5);
+
+  if (m_common_uniforms.stable_ids_enabled) {
+    gl::bindTexture(m_stable_id_fbs[0]->textures[0], GL_TEXTURE0 + STABLE_ID_TEXTURE_UNIT);
+  }
+  if (m_sdf_texture.id) {
+    gl::bindTexture(m_sdf_texture, GL_TEXTURE0 + SDF_TEXTURE_UNIT);
+  }
+  if (m_mesh_bvh_textures[0].id) {
+    gl::bindTexture(m_mesh_bvh_textures[0], GL_TEXTURE0 + MESH_BVH_TEXTURE_UNITS[0]);
+    gl::bindTexture(m_mesh_bvh_textures[1], GL_TEXTURE0 + MESH_BVH_TEXTURE_UNITS[1]);
+  }
+  if (m_vector_field_texture.id) {
+    gl::bindTexture(m_vector_field_texture, GL_TEXTURE0 + VECTOR_FIELD_TEXTURE_UNIT);
+  }
+
+  gl::bindUniformBuffer(m_common_uniforms_buffer, COMMON_UNIFORMS_BLOCK_BINDING);
+  if (m_user_params_buffer.id) {
+    gl::bindUniformBuffer(m_user_params_buffer, USER_PARAMS_BLOCK_BINDING);
+  }
+
+  gl::useProgram(m_programs[1]);
+  gl::uniform(m_programs[1], "iResolution", gl::ivec2(displayWidth, displayHeight));
+
+  drawParticles();
+  drawPointOctree(displayHeight);
+
+  glDisable(GL_CULL_FACE);
+  glDisable(GL_BLEND);
+
+  CHECK_GL_ERROR();
+}
+
+void App::drawParticles() {
+  const auto &resolution = m_particle_framebuffer_resolution;
+  const gl::ivec2 tile_count = (resolution + (PARTICLE_TILE_SIZE - 1)) / PARTICLE_TILE_SIZE;
+
+  if (!m_tile_culling_enabled || m_tile_bounds.size() != size_t(tile_count.x * tile_count.y)) {
+    GLsizei instance_count = resolution.x * resolution.y * m_particle_layer_count;
+    glDrawArrays(GL_TRIANGLES, 0, m_instance_vertex_count * instance_count);
+    return;
+  }
+
+  gl::vec4 planes[6];
+  gl::calcFrustumPlanes(m_common_uniforms.model_view_projection, planes);
+
+  const auto isTileVisible = [&](const gl::vec4 &sphere) {
+    return gl::isSphereInFrustum(planes, gl::vec4(gl::vec3(sphere), sphere.w + m_tile_culling_margin));
+  };
+
+  m_visible_draw_firsts.clear();
+  m_visible_draw_counts.clear();
+
+  // Particle ranges are drawn as vertex ranges so `gl_VertexID / vertexCount` still yields the particle id.
+  const auto appendParticleRange = [&](GLint first, GLsizei count) {
+    first *= m_instance_vertex_count;
+    count *= m_instance_vertex_count;
+    if (!m_visible_draw_counts.empty() && m_visible_draw_firsts.back() + m_visible_draw_counts.back() == first) {
+      m_visible_draw_counts.back() += count;
+    }
+    else {
+      m_visible_draw_firsts.push_back(first);
+      m_visible_draw_counts.push_back(count);
+    }
   };
 
-  static const char *CULL_FACE_MODE_NAMES[]{
-    "none",
-    "back",
-    "front",
-  };
-  static const GLenum CULL_FACE_MODE_VALUES[]{
-    GL_NONE,
-    GL_BACK,
-    GL_FRONT,
-  };
-  assert(arraySize(CULL_FACE_MODE_NAMES) == arraySize(CULL_FACE_MODE_VALUES));
+  if (m_particle_addressing_mode == PARTICLE_ADDRESSING_MORTON) {
+    // The resolution is a square power of two so every tile holds one contiguous range of ids. Walking the
+    // tiles along the same curve visits those ranges in id order.
+    const GLsizei tile_particle_count = std::min(PARTICLE_TILE_SIZE, resolution.x) * std::min(PARTICLE_TILE_SIZE, resolution.y);
+    for (int t = 0; t < tile_count.x * tile_count.y; ++t) {
+      const auto tile = mortonDecode2(t);
+      if (isTileVisible(m_tile_bounds[tile.x + tile.y * tile_count.x])) {
+        appendParticleRange(t * tile_particle_count, tile_particle_count);
+      }
+    }
+  }
+  else {
+    for (int ty = 0; ty < tile_count.y; ++ty) {
+      // Merge horizontally adjacent visible tiles into spans of particle columns.
+      m_visible_tile_spans.clear();
+      for (int tx = 0; tx < tile_count.x; ++tx) {
+        if (!isTileVisible(m_tile_bounds[tx + ty * tile_count.x])) continue;
+
+        const int x0 = tx * PARTICLE_TILE_SIZE;
+        const int x1 = std::min(x0 + PARTICLE_TILE_SIZE, resolution.x);
+        if (!m_visible_tile_spans.empty() && m_visible_tile_spans.back().y == x0) {
+          m_visible_tile_spans.back().y = x1;
+        }
+        else {
+          m_visible_tile_spans.emplace_back(x0, x1);
+        }
+      }
+
+      const int y_end = std::min((ty + 1) * PARTICLE_TILE_SIZE, resolution.y);
+      for (int y = ty * PARTICLE_TILE_SIZE; y < y_end; ++y) {
+        for (const auto &span : m_visible_tile_spans) {
+          appendParticleRange(span.x + y * resolution.x, span.y - span.x);
+        }
+      }
+    }
+  }
+
+  if (!m_visible_draw_counts.empty()) {
+    gl::multiDrawArrays(GL_TRIANGLES, m_visible_draw_firsts.data(), m_visible_draw_counts.data(), m_visible_draw_counts.size());
+  }
+}
+
+void App::drawPointOctree(int displayHeight) {
+  if (!m_point_octree || !m_point_octree_program.id) {
+    return;
+  }
+
+  const float pixels_per_unit = m_common_uniforms.projection[1][1] * 0.5f * float(displayHeight);
+
+  // Stereo views draw the same nodes, so the eyes never disagree about detail. They're selected against every
+  // view so none of them is culled to the first one's frustum.
+  if (!m_point_octree_updated) {
+    const bool has_frame_views = m_frame_view_count > 0;
+    m_point_octree->update(has_frame_views ? m_frame_view_projections : &m_common_uniforms.model_view_projection,
+                           has_frame_views ? m_frame_view_count : 1,
+                           gl::vec3(m_common_uniforms.inverse_model_view[3]),
+                           pixels_per_unit);
+    m_point_octree_updated = true;
+  }
+
+  const GLsizei vertex_count = GLsizei(m_point_octree->getDrawnNodeCount() * PointOctreeStreamer::NODE_CAPACITY);
+  if (vertex_count == 0) {
+    return;
+  }
+
+  gl::bindTexture(m_point_octree->getPositionTexture(), GL_TEXTURE0 + POINT_OCTREE_TEXTURE_UNITS[0]);
+  gl::bindTexture(m_point_octree->getColorTexture(), GL_TEXTURE0 + POINT_OCTREE_TEXTURE_UNITS[1]);
+  gl::bindTexture(m_point_octree->getNodeTableTexture(), GL_TEXTURE0 + POINT_OCTREE_TEXTURE_UNITS[2]);
+
+  gl::useProgram(m_point_octree_program);
+  gl::uniform(m_point_octree_program, "iPointScale", pixels_per_unit);
+
+  glDrawArrays(GL_POINTS, 0, vertex_count);
+}
+
+static std::string concatenateShaderSource(std::string_view prefix,
+                                           std::string_view common_source,
+                                           std::string_view user_params_source,
+                                           std::string_view user_common_source,
+                                           std::string_view user_source,
+                                           std::string_view postfix) {
+  auto src = std::string();
+  auto src_size = prefix.size() + common_source.size() + user_params_source.size() + user_common_source.size() + user_source.size() + postfix.size() + 4;
+  src.reserve(src_size + 1);
+  src += prefix;
+  src += '\n';
+  src += common_source;
+  src += '\n';
+  src += user_params_source;
+  src += '\n';
+  src += user_common_source;
+  src += '\n';
+  src += user_source;
+  src += postfix;
+  assert(src.size() == src_size);
+  return src;
+}
+
+std::string App::assembleShaderSourceAtIndex(int index){
+  return concatenateShaderSource(m_template_shader_source_prefixes[index],
+                                 m_common_uniforms_shader_source,
+                                 m_user_params_shader_source,
+                                 m_user_shader_sources[0],
+                                 m_user_shader_sources[index + 1],
+                                 m_template_shader_source_postfixes[index]);
+}
+
+size_t App::getUserShaderSourceCount() const {
+  return USER_SHADER_SOURCE_COUNT;
+}
+
+std::string_view App::getUserShaderSourceAtIndex(int index) {
+  assert(index >= 0 && index < arraySize(m_user_shader_sources));
+  return m_user_shader_sources[index];
+}
+
+std::string_view App::getAssembledShaderSourceAtIndex(int index) {
+  assert(index >= 0 && index < arraySize(m_assembled_shader_sources));
+  return m_assembled_shader_sources[index];
+}
+
+void App::setUserShaderSourceAtIndex(int index, std::string_view shader_src) {
+  assert(index >= 0 && index < arraySize(m_user_shader_sources));
+
+  m_input_recorder.recordUserShaderSource(index, shader_src);
+
+  m_user_shader_sources[index] = shader_src;
+
+  // Params can be declared in any source, and their block goes into all of them
+  const bool user_params_changed = parseUserParamPragmas();
+
+  if (index == 0 || user_params_changed) {
+    // Assemble all shaders if the common source or the params are changed
+    for (size_t i = 0; i < arraySize(m_assembled_shader_sources); ++i) {
+      m_assembled_shader_sources[i] = assembleShaderSourceAtIndex(i);
+    }
+  }
+  else {
+    m_assembled_shader_sources[index - 1] = assembleShaderSourceAtIndex(index - 1);
+  }
+}
+
+
+struct ShaderPragma {
+  std::vector<std::string> args;
+};
+
+static const std::string SHADER_PRAGMA_PREFIX{ "#pragma" }; 
+
+static std::string_view findNextToken(std::string_view::iterator &begin, std::string_view::iterator end) {
+  begin = std::find_if(begin, end, [](auto c) { return !std::isspace(c); });
+  
+  std::string_view token;
+  
+  if (begin != end) {
+    auto tokenEnd = std::find_if(begin, end, [](auto c) { return std::isspace(c); });
+    token = std::string_view(begin, tokenEnd - begin);
+    begin = tokenEnd;
+  }
+
+  return token;
+}
+
+static std::vector<ShaderPragma> parsePragmas(std::string_view source) {
+  std::vector<ShaderPragma> pragmas;
+  
+  for (auto lineBegin = source.begin(); lineBegin != source.end();) {
+    auto lineEnd = std::find(lineBegin, source.end(), '\n');
+    if (lineEnd != source.end()) lineEnd++;
+
+    // Skip leading whitespace
+    lineBegin = std::find_if(lineBegin, lineEnd, [](auto c) { return !std::isspace(c); });
+    if (lineBegin == lineEnd) continue;
+
+    // Check if the line starts with "#pragma"
+    if (lineEnd - lineBegin >= SHADER_PRAGMA_PREFIX.size() && std::equal(SHADER_PRAGMA_PREFIX.begin(), SHADER_PRAGMA_PREFIX.end(), lineBegin)) {
+      pragmas.emplace_back();
+      
+      lineBegin += SHADER_PRAGMA_PREFIX.size();
+
+      // Find and append arguments
+      while (lineBegin != lineEnd) {
+        const auto arg = findNextToken(lineBegin, lineEnd);
+        if (!arg.empty()) {
+          pragmas.back().args.emplace_back(arg);
+        }
+      }
+    }
+    else {
+      lineBegin = lineEnd;
+    }
+  }
+
+  return pragmas;
+}
+
+static bool isShaderIdentifier(std::string_view name) {
+  if (name.empty() || std::isdigit(name[0])) {
+    return false;
+  }
+  return std::all_of(name.begin(), name.end(), [](auto c) { return std::isalnum(c) || c == '_'; });
+}
+
+bool App::parseUserParamPragmas() {
+  std::vector<UserParam> params;
+
+  for (const auto &source : m_user_shader_sources) {
+    for (const auto &pragma : parsePragmas(source)) {
+      if (pragma.args.size() == 5 && stringsEqualCaseInsensitive(pragma.args[0], "param") && isShaderIdentifier(pragma.args[1])) {
+        const auto &name = pragma.args[1];
+        if (std::any_of(params.begin(), params.end(), [&](const auto &p) { return p.name == name; })) {
+          continue;
+        }
+
+        UserParam param;
+        param.name = name;
+        param.default_value = std::atof(pragma.args[2].c_str());
+        param.min_value = std::atof(pragma.args[3].c_str());
+        param.max_value = std::atof(pragma.args[4].c_str());
+        param.value = param.default_value;
+        params.push_back(std::move(param));
+      }
+    }
+  }
+
+  const auto sameDeclaration = [](const UserParam &a, const UserParam &b) {
+    return a.name == b.name && a.default_value == b.default_value && a.min_value == b.min_value && a.max_value == b.max_value;
+  };
+  if (std::equal(params.begin(), params.end(), m_pending_user_params.begin(), m_pending_user_params.end(), sameDeclaration)) {
+    return false;
+  }
+
+  m_pending_user_params = std::move(params);
+
+  m_user_params_shader_source.clear();
+  if (!m_pending_user_params.empty()) {
+    m_user_params_shader_source += "layout(std140) uniform UserParams {\n";
+    for (const auto &param : m_pending_user_params) {
+      m_user_params_shader_source += "  float " + param.name + ";\n";
+    }
+    m_user_params_shader_source += "};\n";
+  }
+
+  return true;
+}
+
+void App::applyPendingUserParams() {
+  auto params = m_pending_user_params;
+
+  // Keep values that were tweaked live, unless the declaration's default changed
+  for (auto &param : params) {
+    const auto it = std::find_if(m_user_params.begin(), m_user_params.end(), [&](const auto &p) { return p.name == param.name; });
+    if (it != m_user_params.end() && it->default_value == param.default_value) {
+      param.value = clamp(it->value, param.min_value, param.max_value);
+    }
+  }
+
+  m_user_params = std::move(params);
+  m_user_params_dirty = true;
+}
+
+void App::uploadUserParams() {
+  if (!m_user_params_dirty) {
+    return;
+  }
+  m_user_params_dirty = false;
+
+  if (m_user_params.empty()) {
+    gl::deleteUniformBufferDeferred(m_user_params_buffer);
+    return;
+  }
+
+  // std140 packs a block of floats tightly. Round the buffer up to a whole vec4.
+  m_user_params_data.assign((m_user_params.size() + 3) / 4 * 4, 0.0f);
+  for (size_t i = 0; i < m_user_params.size(); ++i) {
+    m_user_params_data[i] = m_user_params[i].value;
+  }
+
+  const size_t size_bytes = m_user_params_data.size() * sizeof(GLfloat);
+  if (m_user_params_buffer.id == 0 || m_user_params_buffer.size_bytes != size_bytes) {
+    gl::deleteUniformBufferDeferred(m_user_params_buffer);
+    gl::createUniformBuffer(m_user_params_buffer, size_bytes, m_user_params_data.data(), GL_DYNAMIC_DRAW);
+  }
+  else {
+    gl::updateUniformBuffer(m_user_params_buffer, size_bytes, m_user_params_data.data());
+  }
+}
+
+void App::parseSimulationShaderPragmas() {
+  m_particle_framebuffer_resolution = m_default_particle_framebuffer_resolution;
+  m_particle_addressing_mode = PARTICLE_ADDRESSING_LINEAR;
+  m_reorder_interval = 0;
+  m_reorder_cell_size = m_default_reorder_cell_size;
+  m_sleep_enabled = false;
+  m_sleep_wake_radius = 0.0f;
+  m_sleep_wake_regions.clear();
+  m_late_latch_particle_count = 0;
+
+  const int prev_update_fraction = m_update_fraction;
+  m_update_fraction = 1;
+
+  int requested_layer_count = 0;
+
+  const auto pragmas = parsePragmas(m_user_shader_sources[1]);
+  for (const auto &pragma : pragmas) {
+    if (pragma.args.size() == 3 && stringsEqualCaseInsensitive(pragma.args[0], "size")) {
+      gl::ivec2 size{ std::atoi(pragma.args[1].c_str()), std::atoi(pragma.args[2].c_str()) };
+      if (size.x > 0 && size.y > 0) {
+        m_particle_framebuffer_resolution = size;
+      }
+    }
+    else if (pragma.args.size() == 2 && stringsEqualCaseInsensitive(pragma.args[0], "layers")) {
+      requested_layer_count = std::max(1, std::atoi(pragma.args[1].c_str()));
+    }
+    else if (pragma.args.size() == 2 && stringsEqualCaseInsensitive(pragma.args[0], "addressing")) {
+      if (stringsEqualCaseInsensitive(pragma.args[1], "morton")) {
+        m_particle_addressing_mode = PARTICLE_ADDRESSING_MORTON;
+      }
+      else if (stringsEqualCaseInsensitive(pragma.args[1], "linear")) {
+        m_particle_addressing_mode = PARTICLE_ADDRESSING_LINEAR;
+      }
+    }
+    else if ((pragma.args.size() == 2 || pragma.args.size() == 3) && stringsEqualCaseInsensitive(pragma.args[0], "reorder")) {
+      m_reorder_interval = std::max(0, std::atoi(pragma.args[1].c_str()));
+      if (pragma.args.size() == 3) {
+        const float cell_size = std::atof(pragma.args[2].c_str());
+        if (cell_size > 0.0f) {
+          m_reorder_cell_size = cell_size;
+        }
+      }
+    }
+    else if ((pragma.args.size() == 1 || pragma.args.size() == 2) && stringsEqualCaseInsensitive(pragma.args[0], "sleep")) {
+      m_sleep_enabled = true;
+      m_sleep_wake_radius = pragma.args.size() == 2 ? float(std::atof(pragma.args[1].c_str())) : 0.0f;
+    }
+    else if (pragma.args.size() == 2 && (stringsEqualCaseInsensitive(pragma.args[0], "updateFraction") || stringsEqualCaseInsensitive(pragma.args[0], "update-fraction"))) {
+      // Accepts "1/N" or "N"
+      const auto &arg = pragma.args[1];
+      const auto slash = arg.find('/');
+      const int denom = std::atoi(arg.c_str() + (slash == std::string::npos ? 0 : slash + 1));
+      m_update_fraction = clamp(denom, 1, MAX_UPDATE_FRACTION);
+    }
+    else if (pragma.args.size() == 2 && stringsEqualCaseInsensitive(pragma.args[0], "lateLatch")) {
+      m_late_latch_particle_count = std::max(0, std::atoi(pragma.args[1].c_str()));
+    }
+    else if (pragma.args.size() == 5 && stringsEqualCaseInsensitive(pragma.args[0], "wakeRegion")) {
+      if (m_sleep_wake_regions.size() < MAX_SLEEP_WAKE_REGIONS) {
+        m_sleep_wake_regions.emplace_back(std::atof(pragma.args[1].c_str()),
+                                          std::atof(pragma.args[2].c_str()),
+                                          std::atof(pragma.args[3].c_str()),
+                                          std::atof(pragma.args[4].c_str()));
+      }
+    }
+  }
+
+  if (m_imported_particle_resolution.x > 0 && m_imported_particle_resolution.y > 0) {
+    m_particle_framebuffer_resolution = m_imported_particle_resolution;
+  }
+
+  m_particle_layers_enabled = wantsParticleLayers();
+  m_particle_layer_count = 1;
+  if (m_particle_layers_enabled) {
+    splitParticleResolutionIntoLayers(requested_layer_count);
+
+    // These all treat particle state as a single 2D texture
+    if (m_reorder_interval > 0 || m_sleep_enabled || m_late_latch_particle_count > 0) {
+      PRINT_ERROR("#pragma reorder, sleep and lateLatch are ignored with layered particle storage\n");
+      m_reorder_interval = 0;
+      m_sleep_enabled = false;
+      m_sleep_wake_regions.clear();
+      m_late_latch_particle_count = 0;
+    }
+  }
+
+  // Reordering moves particles between update bands, so their band's last update time would no longer be theirs
+  if (m_reorder_interval > 0 && m_update_fraction > 1) {
+    PRINT_ERROR("#pragma reorder is ignored with #pragma updateFraction\n");
+    m_reorder_interval = 0;
+  }
+
+  if (m_update_fraction != prev_update_fraction) {
+    m_update_band = 0;
+    m_update_band_times.assign(m_update_fraction, -1.0f);
+  }
+
+  // A Morton curve only covers a square power of two without gaps, so round the resolution up to one.
+  // Layers are already split that way.
+  if (m_particle_addressing_mode == PARTICLE_ADDRESSING_MORTON && !m_particle_layers_enabled) {
+    int side = 1;
+    while (side < m_particle_framebuffer_resolution.x || side < m_particle_framebuffer_resolution.y) side *= 2;
+    m_particle_framebuffer_resolution = gl::ivec2(side);
+  }
+
+  fitParticleResolutionToMemoryBudget();
+}
+
+bool App::wantsParticleLayers() const {
+  GLint max_texture_size = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+
+  // Decided from the source alone since programs have to be compiled for it before the pragmas are applied
+  const bool has_imported_resolution = m_imported_particle_resolution.x > 0 && m_imported_particle_resolution.y > 0;
+  for (const auto &pragma : parsePragmas(m_user_shader_sources[1])) {
+    if (pragma.args.size() == 2 && stringsEqualCaseInsensitive(pragma.args[0], "layers")) {
+      return true;
+    }
+    if (pragma.args.size() == 3 && stringsEqualCaseInsensitive(pragma.args[0], "size") && !has_imported_resolution) {
+      if (std::atoi(pragma.args[1].c_str()) > max_texture_size || std::atoi(pragma.args[2].c_str()) > max_texture_size) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void App::splitParticleResolutionIntoLayers(int requested_layer_count) {
+  GLint max_texture_size = 0;
+  GLint max_layer_count = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+  glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layer_count);
+
+  const auto requested_resolution = m_particle_framebuffer_resolution;
+  const size_t particle_count = size_t(requested_resolution.x) * requested_resolution.y;
+  requested_layer_count = std::max(requested_layer_count, 1);
+
+  gl::ivec2 layer_resolution;
+  size_t layer_count;
+  if (m_particle_addressing_mode == PARTICLE_ADDRESSING_MORTON) {
+    // Morton addressing needs square power of two layers
+    int side = 1;
+    while (side * 2 <= max_texture_size && size_t(side) * side * requested_layer_count < particle_count) side *= 2;
+    layer_resolution = gl::ivec2(side);
+    layer_count = (particle_count + size_t(side) * side - 1) / (size_t(side) * side);
+  }
+  else {
+    // Keep rows as long as requested and spread them evenly over the layers
+    const int width = std::min(requested_resolution.x, max_texture_size);
+    const size_t row_count = (particle_count + width - 1) / width;
+    layer_count = std::max(size_t(requested_layer_count), (row_count + max_texture_size - 1) / max_texture_size);
+    const size_t height = (row_count + layer_count - 1) / layer_count;
+    layer_count = (row_count + height - 1) / height;
+    layer_resolution = gl::ivec2(width, int(height));
+  }
+
+  if (layer_count > size_t(max_layer_count)) {
+    PRINT_ERROR("Particle size %dx%d needs %zu layers of %dx%d but the GPU supports %d\n",
+                requested_resolution.x, requested_resolution.y, layer_count, layer_resolution.x, layer_resolution.y, max_layer_count);
+    layer_count = max_layer_count;
+  }
+
+  m_particle_framebuffer_resolution = layer_resolution;
+  m_particle_layer_count = int(std::max(layer_count, size_t(1)));
+}
+
+size_t App::estimateParticleMemoryBytes(const gl::ivec2 &resolution) const {
+  size_t texel_bytes = arraySize(m_particle_fbs) * arraySize(PARTICLE_DATA_TEXTURE_UNITS) * gl::getBytesPerPixel(GL_RGBA32F);
+  if (m_sleep_enabled) {
+    texel_bytes += arraySize(m_particle_fbs) * gl::getBytesPerPixel(GL_DEPTH24_STENCIL8);
+  }
+  if (m_reorder_interval > 0) {
+    texel_bytes += arraySize(m_reorder_key_fbs) * (gl::getBytesPerPixel(GL_RG32UI) + gl::getBytesPerPixel(GL_R32I));
+  }
+  return size_t(resolution.x) * resolution.y * m_particle_layer_count * texel_bytes;
+}
+
+void App::fitParticleResolutionToMemoryBudget() {
+  const size_t budget_bytes = gl::getMemoryBudget();
+  if (budget_bytes == 0) {
+    return;
+  }
+
+  // The current particle buffers and anything pooled can be given back before the new size is allocated
+  size_t reclaimable_bytes = m_resource_pool.getStats().pooled_bytes;
+  for (size_t i = 0; i < arraySize(m_particle_fbs); ++i) {
+    reclaimable_bytes += gl::getFramebufferSizeBytes(*m_particle_fbs[i]);
+    reclaimable_bytes += gl::getFramebufferSizeBytes(*m_reorder_key_fbs[i]);
+    reclaimable_bytes += gl::getFramebufferSizeBytes(*m_stable_id_fbs[i]);
+  }
+
+  const size_t total_bytes = gl::getMemoryStats().total_bytes;
+  const size_t other_bytes = total_bytes > reclaimable_bytes ? total_bytes - reclaimable_bytes : 0;
+  const size_t available_bytes = budget_bytes > other_bytes ? budget_bytes - other_bytes : 0;
+
+  const auto requested_resolution = m_particle_framebuffer_resolution;
+  const size_t requested_bytes = estimateParticleMemoryBytes(requested_resolution);
+  if (requested_bytes <= available_bytes) {
+    return;
+  }
+
+  if (available_bytes < estimateParticleMemoryBytes(gl::ivec2(1))) {
+    // Nothing fits, so keep whatever is allocated now
+    if (m_particle_fbs[0]->width > 0 && m_particle_fbs[0]->height > 0) {
+      m_particle_framebuffer_resolution = gl::ivec2(m_particle_fbs[0]->width, m_particle_fbs[0]->height);
+      m_particle_layer_count = m_particle_layers_enabled ? m_particle_fbs[0]->layer_count : 1;
+    }
+    PRINT_ERROR("Particle size %dx%d rejected: %zu bytes requested but only %zu of the %zu byte budget are available\n",
+                requested_resolution.x, requested_resolution.y, requested_bytes, available_bytes, budget_bytes);
+    return;
+  }
+
+  if (m_particle_addressing_mode == PARTICLE_ADDRESSING_MORTON) {
+    // Stay on a square power of two
+    while (m_particle_framebuffer_resolution.x > 1 && estimateParticleMemoryBytes(m_particle_framebuffer_resolution) > available_bytes) {
+      m_particle_framebuffer_resolution /= 2;
+    }
+  }
+  else {
+    const float scale = std::sqrt(float(available_bytes) / float(requested_bytes));
+    m_particle_framebuffer_resolution = gl::max(gl::ivec2(gl::vec2(requested_resolution) * scale), gl::ivec2(1));
+    while (estimateParticleMemoryBytes(m_particle_framebuffer_resolution) > available_bytes) {
+      m_particle_framebuffer_resolution = gl::max(m_particle_framebuffer_resolution - 1, gl::ivec2(1));
+    }
+  }
+
+  PRINT_ERROR("Particle size %dx%d exceeds the GPU memory budget, downsized to %dx%d\n",
+              requested_resolution.x, requested_resolution.y, m_particle_framebuffer_resolution.x, m_particle_framebuffer_resolution.y);
+}
+
+void App::trimResourcePoolToMemoryBudget() {
+  const size_t budget_bytes = gl::getMemoryBudget();
+  const size_t total_bytes = gl::getMemoryStats().total_bytes;
+  if (budget_bytes > 0 && total_bytes > budget_bytes) {
+    const size_t pooled_bytes = m_resource_pool.getStats().pooled_bytes;
+    const size_t excess_bytes = total_bytes - budget_bytes;
+    m_resource_pool.trim(pooled_bytes > excess_bytes ? pooled_bytes - excess_bytes : 0);
+  }
+}
+
+void App::parseRenderShaderPragmas() {
+  const auto findValueByNameCaseInsensitive = [](const auto &names, const auto &values, std::string_view name) -> const GLenum* {
+    const auto it = std::find_if(std::begin(names), std::end(names), [&name](const auto &n) {
+      return stringsEqualCaseInsensitive(name, n);
+    });
+    if (it == std::end(names)) return nullptr;
+    return &values[it - std::begin(names)];
+  };
+
+  static const char *CULL_FACE_MODE_NAMES[]{
+    "none",
+    "back",
+    "front",
+  };
+  static const GLenum CULL_FACE_MODE_VALUES[]{
+    GL_NONE,
+    GL_BACK,
+    GL_FRONT,
+  };
+  assert(arraySize(CULL_FACE_MODE_NAMES) == arraySize(CULL_FACE_MODE_VALUES));
+
+  static const char *BLEND_FUNC_NAMES[]{
+    "zero",
+    "one",
+    "srcColor",
+    "oneMinusSrcColor",
+    "dstColor",
+    "oneMinusDstColor",
+    "srcAlpha",
+    "oneMinusSrcAlpha",
+    "dstAlpha",
+    "oneMinusDstAlpha",
+    "constantColor",
+    "oneMinusConstantColor",
+    "constantAlpha",
+    "oneMinusConstantAlpha",
+    "srcAlphaSaturate",
+  };
+  static const GLenum BLEND_FUNC_VALUES[]{
+    GL_ZERO,
+    GL_ONE,
+    GL_SRC_COLOR,
+    GL_ONE_MINUS_SRC_COLOR,
+    GL_DST_COLOR,
+    GL_ONE_MINUS_DST_COLOR,
+    GL_SRC_ALPHA,
+    GL_ONE_MINUS_SRC_ALPHA,
+    GL_DST_ALPHA,
+    GL_ONE_MINUS_DST_ALPHA,
+    GL_CONSTANT_COLOR,
+    GL_ONE_MINUS_CONSTANT_COLOR,
+    GL_CONSTANT_ALPHA,
+    GL_ONE_MINUS_CONSTANT_ALPHA,
+    GL_SRC_ALPHA_SATURATE,
+  };
+  assert(arraySize(BLEND_FUNC_NAMES) == arraySize(BLEND_FUNC_VALUES));
+
+  static const char *DEPTH_FUNC_NAMES[]{
+    "never",
+    "less",
+    "equal",
+    "lequal",
+    "greater",
+    "notequal",
+    "gequal",
+    "always",
+  };
+  static const GLenum DEPTH_FUNC_VALUES[]{
+    GL_NEVER,
+    GL_LESS,
+    GL_EQUAL,
+    GL_LEQUAL,
+    GL_GREATER,
+    GL_NOTEQUAL,
+    GL_GEQUAL,
+    GL_ALWAYS,
+  };
+  assert(arraySize(DEPTH_FUNC_NAMES) == arraySize(DEPTH_FUNC_VALUES));
+
+  m_instance_vertex_count = m_default_instance_vertex_count;
+  m_cull_mode = m_default_cull_mode;
+
+  m_tile_culling_enabled = false;
+  m_tile_culling_margin = 0.0f;
+  m_tile_bounds.clear();
+
+  const auto vertexPragmas = parsePragmas(m_user_shader_sources[2]);
+  for (const auto &pragma : vertexPragmas) {
+    if (pragma.args.size() == 2 && stringsEqualCaseInsensitive(pragma.args[0], "vertexCount")) {
+      int count = std::atoi(pragma.args[1].c_str());
+      if (count > 0) {
+        m_instance_vertex_count = count;
+      }
+    }
+    else if (pragma.args.size() == 2 && (stringsEqualCaseInsensitive(pragma.args[0], "cullFace") || stringsEqualCaseInsensitive(pragma.args[0], "cull"))) {
+      const auto cullMode = findValueByNameCaseInsensitive(CULL_FACE_MODE_NAMES, CULL_FACE_MODE_VALUES, pragma.args[1]);
+      if (cullMode) {
+        m_cull_mode = *cullMode;
+      }
+    }
+    else if ((pragma.args.size() == 1 || pragma.args.size() == 2) && stringsEqualCaseInsensitive(pragma.args[0], "tileCulling")) {
+      m_tile_culling_enabled = true;
+      m_tile_culling_margin = pragma.args.size() == 2 ? float(std::atof(pragma.args[1].c_str())) : 0.0f;
+    }
+  }
+
+  if (m_tile_culling_enabled && m_particle_layers_enabled) {
+    PRINT_ERROR("#pragma tileCulling is ignored with layered particle storage\n");
+    m_tile_culling_enabled = false;
+  }
+
+  m_blend_func_sfactor = m_default_blend_func_sfactor;
+  m_blend_func_dfactor = m_default_blend_func_dfactor;
+
+  m_depth_func = m_default_depth_func;
+
+  const auto fragmentPragmas = parsePragmas(m_user_shader_sources[3]);
+  for (const auto &pragma : fragmentPragmas) {
+    if (pragma.args.size() == 3 && stringsEqualCaseInsensitive(pragma.args[0], "blendFunc")) {
+      const auto sfactor = findValueByNameCaseInsensitive(BLEND_FUNC_NAMES, BLEND_FUNC_VALUES, pragma.args[1]);
+      if (sfactor) {
+        m_blend_func_sfactor = *sfactor;
+      }
+
+      const auto dfactor = findValueByNameCaseInsensitive(BLEND_FUNC_NAMES, BLEND_FUNC_VALUES, pragma.args[2]);
+      if (dfactor) {
+        m_blend_func_dfactor = *dfactor;
+      }
+    }
+    else if (pragma.args.size() == 2 && stringsEqualCaseInsensitive(pragma.args[0], "depthFunc")) {
+      const auto func = findValueByNameCaseInsensitive(DEPTH_FUNC_NAMES, DEPTH_FUNC_VALUES, pragma.args[1]);
+      if (func) {
+        m_depth_func = *func;
+      }
+    }
+  }
+}
+
+static std::string getShaderDefines(const std::vector<ShaderVariant> &variants, bool particle_layers) {
+  auto defines = std::string(particle_layers ? "#define PARTICLE_LAYERS\n" : "");
+  for (const auto &variant : variants) {
+    defines += "#define " + variant.name + " " + variant.values[variant.selected] + "\n";
+  }
+  return defines;
+}
+
+std::vector<ShaderVariant> App::parseShaderVariantPragmas() const {
+  std::vector<ShaderVariant> variants;
+
+  for (const auto &source : m_user_shader_sources) {
+    for (const auto &pragma : parsePragmas(source)) {
+      if (pragma.args.size() >= 3 && stringsEqualCaseInsensitive(pragma.args[0], "variant") && isShaderIdentifier(pragma.args[1])) {
+        const auto &name = pragma.args[1];
+        if (std::any_of(variants.begin(), variants.end(), [&](const auto &v) { return v.name == name; })) {
+          continue;
+        }
+
+        ShaderVariant variant;
+        variant.name = name;
+        variant.values.assign(pragma.args.begin() + 2, pragma.args.end());
+
+        // Keep the current selection across recompiles if it's still declared
+        const auto prev = std::find_if(m_shader_variants.begin(), m_shader_variants.end(), [&](const auto &v) { return v.name == name; });
+        if (prev != m_shader_variants.end()) {
+          const auto value = std::find(variant.values.begin(), variant.values.end(), prev->values[prev->selected]);
+          if (value != variant.values.end()) {
+            variant.selected = value - variant.values.begin();
+          }
+        }
+
+        variants.push_back(std::move(variant));
+      }
+    }
+  }
+
+  return variants;
+}
+
+uint64_t App::hashAssembledShaderSources() const {
+  uint64_t hash = FNV1A_64_OFFSET_BASIS;
+  for (const auto &source : m_assembled_shader_sources) {
+    hash = hashFnv1a64(source, hash);
+  }
+  return hash;
+}
+
+bool App::compileShaderPrograms(gl::Program (&programs)[2], std::string_view defines) {
+  gl::ProgramError programError;
+
+  if (!gl::createProgram(programs[0], m_simulate_shader_vs_source, injectShaderDefines(m_assembled_shader_sources[0], defines), &programError)) {
+    return false;
+  }
+
+  if (!gl::createProgram(programs[1], injectShaderDefines(m_assembled_shader_sources[1], defines), injectShaderDefines(m_assembled_shader_sources[2], defines), &programError)) {
+    return false;
+  }
+
+  setupShaderPrograms(programs);
+
+  return true;
+}
+
+void App::setupShaderPrograms(gl::Program (&programs)[2]) {
+  for (size_t i = 0; i < arraySize(programs); ++i) {
+    gl::useProgram(programs[i]);
+    gl::uniformBlockBinding(programs[i], "CommonUniforms", COMMON_UNIFORMS_BLOCK_BINDING);
+    gl::uniformBlockBinding(programs[i], "UserParams", USER_PARAMS_BLOCK_BINDING);
+    gl::uniform(programs[i], "iFragData[0]", PARTICLE_DATA_TEXTURE_UNITS);
+    gl::uniform(programs[i], "iStableIds", STABLE_ID_TEXTURE_UNIT);
+    gl::uniform(programs[i], "iSDF", SDF_TEXTURE_UNIT);
+    gl::uniform(programs[i], "iMeshBVHNodes", MESH_BVH_TEXTURE_UNITS[0]);
+    gl::uniform(programs[i], "iMeshBVHTriangles", MESH_BVH_TEXTURE_UNITS[1]);
+    gl::uniform(programs[i], "iVectorField", VECTOR_FIELD_TEXTURE_UNIT);
+  }
+}
+
+void App::stashShaderPrograms() {
+  if (!m_programs[0].id) {
+    return;
+  }
+
+  m_program_cache.emplace_back();
+  auto &cached = m_program_cache.back();
+  cached.source_hash = m_program_source_hash;
+  cached.defines_hash = m_program_defines_hash;
+  for (size_t i = 0; i < arraySize(m_programs); ++i) {
+    cached.programs[i] = std::move(m_programs[i]);
+  }
+
+  while (m_program_cache.size() > MAX_CACHED_PROGRAM_VARIANTS) {
+    for (auto &prog : m_program_cache.front().programs) {
+      gl::deleteProgramDeferred(prog);
+    }
+    m_program_cache.erase(m_program_cache.begin());
+  }
+}
+
+bool App::tryCompileShaderPrograms() {
+  m_input_recorder.recordCompileShaderPrograms();
+
+  auto variants = parseShaderVariantPragmas();
+  const auto defines = getShaderDefines(variants, wantsParticleLayers());
+
+  gl::Program programs[2];
+  if (!compileShaderPrograms(programs, defines)) {
+    return false;
+  }
+
+  // Both programs have to compile first: they were built for the particle storage these pragmas select
+  parseSimulationShaderPragmas();
+  parseRenderShaderPragmas();
+
+  // Variants of other sources can never be selected again
+  const uint64_t source_hash = hashAssembledShaderSources();
+  if (source_hash != m_program_source_hash) {
+    for (auto &cached : m_program_cache) {
+      for (auto &prog : cached.programs) {
+        gl::deleteProgramDeferred(prog);
+      }
+    }
+    m_program_cache.clear();
+
+    for (auto &prog : m_programs) {
+      gl::deleteProgramDeferred(prog);
+    }
+  }
+  else {
+    stashShaderPrograms();
+  }
+
+  for (size_t i = 0; i < arraySize(programs); ++i) {
+    m_programs[i] = std::move(programs[i]);
+  }
+
+  m_shader_variants = std::move(variants);
+  m_program_source_hash = source_hash;
+  m_program_defines_hash = hashFnv1a64(defines);
+
+  // Drop a stale cached copy of the variant that was just compiled
+  m_program_cache.erase(std::remove_if(m_program_cache.begin(), m_program_cache.end(), [&](auto &cached) {
+    const bool stale = cached.source_hash == m_program_source_hash && cached.defines_hash == m_program_defines_hash;
+    if (stale) {
+      for (auto &prog : cached.programs) {
+        gl::deleteProgramDeferred(prog);
+      }
+    }
+    return stale;
+  }), m_program_cache.end());
+
+  applyPendingUserParams();
+
+  return true;
+}
+
+bool App::selectShaderVariantPrograms() {
+  const auto defines = getShaderDefines(m_shader_variants, m_particle_layers_enabled);
+  const uint64_t defines_hash = hashFnv1a64(defines);
+  if (defines_hash == m_program_defines_hash) {
+    return true;
+  }
+
+  gl::Program programs[2];
+
+  const auto cached = std::find_if(m_program_cache.begin(), m_program_cache.end(), [&](const auto &c) {
+    return c.source_hash == m_program_source_hash && c.defines_hash == defines_hash;
+  });
+  if (cached != m_program_cache.end()) {
+    for (size_t i = 0; i < arraySize(programs); ++i) {
+      programs[i] = std::move(cached->programs[i]);
+    }
+    m_program_cache.erase(cached);
+  }
+  else if (!compileShaderPrograms(programs, defines)) {
+    return false;
+  }
+
+  stashShaderPrograms();
+
+  for (size_t i = 0; i < arraySize(programs); ++i) {
+    m_programs[i] = std::move(programs[i]);
+  }
+  m_program_defines_hash = defines_hash;
+
+  return true;
+}
+
+bool App::setShaderVariant(std::string_view name, std::string_view value) {
+  m_input_recorder.recordShaderVariant(name, value);
+
+  const auto variant = std::find_if(m_shader_variants.begin(), m_shader_variants.end(), [&](const auto &v) { return v.name == name; });
+  if (variant == m_shader_variants.end()) {
+    return false;
+  }
+
+  const auto selected = std::find(variant->values.begin(), variant->values.end(), value);
+  if (selected == variant->values.end()) {
+    return false;
+  }
+
+  const size_t prev_selected = variant->selected;
+  variant->selected = selected - variant->values.begin();
+
+  if (!selectShaderVariantPrograms()) {
+    variant->selected = prev_selected;
+    return false;
+  }
+
+  return true;
+}
+
+size_t App::getShaderVariantCount() const {
+  return m_shader_variants.size();
+}
+
+const ShaderVariant &App::getShaderVariantAtIndex(int index) const {
+  assert(index >= 0 && index < m_shader_variants.size());
+  return m_shader_variants[index];
+}
+
+void App::setViewAndProjectionMatrices(const float *view_matrix_values, const float *projection_matrix_values) {
+  m_input_recorder.recordViewAndProjectionMatrices(view_matrix_values, projection_matrix_values);
+
+  std::copy_n(view_matrix_values, 16, &m_common_uniforms.model_view[0][0]);
+  std::copy_n(projection_matrix_values, 16, &m_common_uniforms.projection[0][0]);
+
+  updateViewAndProjectionTransforms();
+
+  m_view_pose_dirty = true;
+}
+
+void App::setControllerAtIndex(int index,
+                               const float *position_values,
+                               const float *velocity_values,
+                               const float *orientation_values,
+                               const float *buttons_values) {
+  assert(index >= 0 && index < arraySize(m_controller_position));
+
+  m_input_recorder.recordController(index, position_values, velocity_values, orientation_values, buttons_values);
+
+  std::copy_n(position_values, 3, &m_controller_position[index][0]);
+  std::copy_n(velocity_values, 3, &m_common_uniforms.controller_velocity[index][0]);
+  std::copy_n(orientation_values, 4, &m_controller_orientation[index][0]);
+  std::copy_n(buttons_values, 4, &m_common_uniforms.controller_buttons[index][0]);
+
+  m_controller_pose_dirty = true;
+}
+
+bool App::setUserParam(std::string_view name, float value) {
+  m_input_recorder.recordUserParam(name, value);
+
+  const auto it = std::find_if(m_user_params.begin(), m_user_params.end(), [&](const auto &p) { return p.name == name; });
+  if (it == m_user_params.end()) {
+    return false;
+  }
+
+  it->value = clamp(value, it->min_value, it->max_value);
+  m_user_params_dirty = true;
+
+  return true;
+}
+
+size_t App::getUserParamCount() const {
+  return m_user_params.size();
+}
+
+const UserParam &App::getUserParamAtIndex(int index) const {
+  assert(index >= 0 && index < m_user_params.size());
+  return m_user_params[index];
+}
+
+void App::startInputRecording() {
+  m_input_recorder.start();
+
+  // Start the log from the current shaders so replays don't depend on what was loaded before recording
+  for (size_t i = 0; i < arraySize(m_user_shader_sources); ++i) {
+    m_input_recorder.recordUserShaderSource(i, m_user_shader_sources[i]);
+  }
+  m_input_recorder.recordCompileShaderPrograms();
+  for (const auto &variant : m_shader_variants) {
+    m_input_recorder.recordShaderVariant(variant.name, variant.values[variant.selected]);
+  }
+  for (const auto &param : m_user_params) {
+    m_input_recorder.recordUserParam(param.name, param.value);
+  }
+}
+
+void App::stopInputRecording() {
+  m_input_recorder.stop();
+}
+
+const InputRecorder &App::getInputRecorder() const {
+  return m_input_recorder;
+}
+
+bool App::saveParticleSnapshot(std::vector<uint8_t> &out_data) {
+  if (m_particle_layers_enabled) {
+    PRINT_ERROR("Particle snapshots don't support layered particle storage\n");
+    return false;
+  }
+
+  if (m_particle_fbs[0]->textures.empty() || m_particle_fbs[1]->textures.empty()) {
+    PRINT_ERROR("Nothing to snapshot before the first simulation step\n");
+    return false;
+  }
+
+  const auto &tex = m_particle_fbs[0]->textures[0];
+  const size_t texture_size_bytes = gl::getTextureSizeBytes(tex);
+
+  ParticleSnapshotHeader header{};
+  std::copy_n(PARTICLE_SNAPSHOT_MAGIC, sizeof(header.magic), header.magic);
+  header.version = PARTICLE_SNAPSHOT_VERSION;
+  header.width = tex.width;
+  header.height = tex.height;
+  header.framebuffer_count = arraySize(m_particle_fbs);
+  header.texture_count = m_particle_fbs[0]->textures.size();
+  header.internal_format = tex.opts.internal_format;
+  header.texture_size_bytes = texture_size_bytes;
+  header.time = m_common_uniforms.time;
+  header.frame = m_common_uniforms.frame;
+
+  out_data.resize(sizeof(header) + header.framebuffer_count * header.texture_count * texture_size_bytes);
+  std::memcpy(out_data.data(), &header, sizeof(header));
+
+  // Read back straight into the snapshot
+  auto texels = out_data.data() + sizeof(header);
+  for (const auto &fb : m_particle_fbs) {
+    for (size_t i = 0; i < fb->textures.size(); ++i) {
+      gl::readFramebufferTexture(*fb, i, texels);
+      texels += texture_size_bytes;
+    }
+  }
+
+  return true;
+}
+
+bool App::restoreParticleSnapshot(const uint8_t *data, size_t size_bytes) {
+  if (m_particle_layers_enabled) {
+    PRINT_ERROR("Particle snapshots don't support layered particle storage\n");
+    return false;
+  }
+
+  ParticleSnapshotHeader header;
+  if (size_bytes < sizeof(header)) {
+    PRINT_ERROR("Particle snapshot is truncated\n");
+    return false;
+  }
+  std::memcpy(&header, data, sizeof(header));
+
+  if (std::memcmp(header.magic, PARTICLE_SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.version != PARTICLE_SNAPSHOT_VERSION) {
+    PRINT_ERROR("Particle snapshot has an unsupported format\n");
+    return false;
+  }
+
+  // The particle layout comes from the shaders, so a snapshot only fits the scene it was taken from
+  if (header.width != m_particle_framebuffer_resolution.x || header.height != m_particle_framebuffer_resolution.y) {
+    PRINT_ERROR("Particle snapshot size %dx%d doesn't match the current size %dx%d\n",
+                header.width, header.height, m_particle_framebuffer_resolution.x, m_particle_framebuffer_resolution.y);
+    return false;
+  }
+
+  createParticleFramebuffers();
+
+  const auto &tex = m_particle_fbs[0]->textures[0];
+  const size_t texture_size_bytes = gl::getTextureSizeBytes(tex);
+  if (header.framebuffer_count != arraySize(m_particle_fbs) ||
+      header.texture_count != m_particle_fbs[0]->textures.size() ||
+      header.internal_format != tex.opts.internal_format ||
+      header.texture_size_bytes != texture_size_bytes ||
+      size_bytes < sizeof(header) + header.framebuffer_count * header.texture_count * texture_size_bytes) {
+    PRINT_ERROR("Particle snapshot doesn't match the current particle framebuffers\n");
+    return false;
+  }
+
+  // Upload straight from the snapshot (and, for mapped files, straight from the page cache)
+  auto texels = data + sizeof(header);
+  for (const auto &fb : m_particle_fbs) {
+    for (const auto &fb_tex : fb->textures) {
+      gl::updateTexture(fb_tex, texels);
+      texels += texture_size_bytes;
+    }
+  }
+
+  m_common_uniforms.time = header.time;
+  m_common_uniforms.frame = header.frame;
+
+  m_stable_ids_valid = false;
+  m_update_band_times.assign(m_update_fraction, -1.0f);
+
+  return true;
+}
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+bool App::saveParticleSnapshot(const char *path) {
+  std::vector<uint8_t> data;
+  return saveParticleSnapshot(data) && writeFile(path, data.data(), data.size());
+}
+
+bool App::restoreParticleSnapshot(const char *path) {
+  MappedFile file;
+  return file.open(path) && restoreParticleSnapshot(file.data(), file.size());
+}
+#endif
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+bool App::startParticleCacheBake(const char *path) {
+  stopParticleCacheBake();
+
+  if (m_particle_layers_enabled) {
+    PRINT_ERROR("Particle caches don't support layered particle storage\n");
+    return false;
+  }
+
+  createParticleFramebuffers();
+
+  const auto &fb = *m_particle_fbs[0];
+  auto writer = std::make_unique<ParticleCacheWriter>();
+  if (!writer->open(path, fb.width, fb.height, fb.textures.size())) {
+    return false;
+  }
+  m_particle_cache_writer = std::move(writer);
+
+  return true;
+}
+
+bool App::stopParticleCacheBake() {
+  if (!m_particle_cache_writer) {
+    return true;
+  }
+  const bool succeeded = m_particle_cache_writer->close();
+  m_particle_cache_writer.reset();
+  return succeeded;
+}
+
+bool App::startParticleCachePlayback(const char *path, bool loop) {
+  stopParticleCachePlayback();
+
+  if (m_particle_layers_enabled) {
+    PRINT_ERROR("Particle caches don't support layered particle storage\n");
+    return false;
+  }
+
+  auto reader = std::make_unique<ParticleCacheReader>();
+  if (!reader->open(path, loop)) {
+    return false;
+  }
+
+  createParticleFramebuffers();
+
+  const auto &resolution = m_particle_framebuffer_resolution;
+  if (reader->getWidth() != resolution.x || reader->getHeight() != resolution.y || reader->getTextureCount() != m_particle_fbs[0]->textures.size()) {
+    PRINT_ERROR("Particle cache size %dx%d doesn't match the current size %dx%d\n", reader->getWidth(), reader->getHeight(), resolution.x, resolution.y);
+    return false;
+  }
+  m_particle_cache_reader = std::move(reader);
+
+  m_stable_ids_valid = false;
+
+  return true;
+}
+
+void App::stopParticleCachePlayback() {
+  m_particle_cache_reader.reset();
+}
+
+bool App::isPlayingParticleCache() const {
+  return m_particle_cache_reader != nullptr;
+}
+#endif
+
+bool App::importPointCloud(const uint8_t *data, size_t size_bytes) {
+  auto loader = std::make_unique<PointCloudLoader>();
+  return loader->open(data, size_bytes) && startPointCloudImport(std::move(loader));
+}
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+bool App::importPointCloud(const char *path) {
+  auto loader = std::make_unique<PointCloudLoader>();
+  return loader->open(path) && startPointCloudImport(std::move(loader));
+}
+#endif
+
+ThreadPool &App::getThreadPool() {
+  if (!m_thread_pool) {
+    m_thread_pool = std::make_unique<ThreadPool>();
+  }
+  return *m_thread_pool;
+}
+
+bool App::resizeParticlesForImport(size_t particle_count, const char *import_name) {
+  if (particle_count == 0) {
+    PRINT_ERROR("%s need at least one particle\n", import_name);
+    return false;
+  }
 
-  static const char *BLEND_FUNC_NAMES[]{
-    "zero",
-    "one",
-    "srcColor",
-    "oneMinusSrcColor",
-    "dstColor",
-    "oneMinusDstColor",
-    "srcAlpha",
-    "oneMinusSrcAlpha",
-    "dstAlpha",
-    "oneMinusDstAlpha",
-    "constantColor",
-    "oneMinusConstantColor",
-    "constantAlpha",
-    "oneMinusConstantAlpha",
-    "srcAlphaSaturate",
-  };
-  static const GLenum BLEND_FUNC_VALUES[]{
-    GL_ZERO,
-    GL_ONE,
-    GL_SRC_COLOR,
-    GL_ONE_MINUS_SRC_COLOR,
-    GL_DST_COLOR,
-    GL_ONE_MINUS_DST_COLOR,
-    GL_SRC_ALPHA,
-    GL_ONE_MINUS_SRC_ALPHA,
-    GL_DST_ALPHA,
-    GL_ONE_MINUS_DST_ALPHA,
-    GL_CONSTANT_COLOR,
-    GL_ONE_MINUS_CONSTANT_COLOR,
-    GL_CONSTANT_ALPHA,
-    GL_ONE_MINUS_CONSTANT_ALPHA,
-    GL_SRC_ALPHA_SATURATE,
-  };
-  assert(arraySize(BLEND_FUNC_NAMES) == arraySize(BLEND_FUNC_VALUES));
+  // Roughly square, as wide as the GPU allows
+  GLint max_texture_size = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+  const size_t width = std::min(size_t(std::ceil(std::sqrt(double(particle_count)))), size_t(max_texture_size));
+  const size_t height = std::min((particle_count + width - 1) / width, size_t(max_texture_size));
+  m_imported_particle_resolution = gl::ivec2(int(width), int(height));
 
-  static const char *DEPTH_FUNC_NAMES[]{
-    "never",
-    "less",
-    "equal",
-    "lequal",
-    "greater",
-    "notequal",
-    "gequal",
-    "always",
-  };
-  static const GLenum DEPTH_FUNC_VALUES[]{
-    GL_NEVER,
-    GL_LESS,
-    GL_EQUAL,
-    GL_LEQUAL,
-    GL_GREATER,
-    GL_NOTEQUAL,
-    GL_GEQUAL,
-    GL_ALWAYS,
-  };
-  assert(arraySize(DEPTH_FUNC_NAMES) == arraySize(DEPTH_FUNC_VALUES));
+  parseSimulationShaderPragmas();
+  if (m_particle_layers_enabled) {
+    PRINT_ERROR("%s don't support layered particle storage\n", import_name);
+    m_imported_particle_resolution = gl::ivec2(0);
+    parseSimulationShaderPragmas();
+    return false;
+  }
 
-  m_instance_vertex_count = m_default_instance_vertex_count;
-  m_cull_mode = m_default_cull_mode;
+  // A `#pragma size` past the texture limit compiled the programs for layers, which the import just turned off
+  if (!selectShaderVariantPrograms()) {
+    PRINT_ERROR("%s failed to recompile the shaders for 2D particle storage\n", import_name);
+    m_imported_particle_resolution = gl::ivec2(0);
+    parseSimulationShaderPragmas();
+    return false;
+  }
+  createParticleFramebuffers();
 
-  const auto vertexPragmas = parsePragmas(m_user_shader_sources[2]);
-  for (const auto &pragma : vertexPragmas) {
-    if (pragma.args.size() == 2 && stringsEqualCaseInsensitive(pragma.args[0], "vertexCount")) {
-      int count = std::atoi(pragma.args[1].c_str());
-      if (count > 0) {
-        m_instance_vertex_count = count;
-      }
+  // Texels past the last point stay zero, as do the attachments the import has no data for
+  for (const auto &fb : m_particle_fbs) {
+    gl::bindFramebuffer(*fb);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+  }
+  gl::unbindFramebuffer();
+
+  m_stable_ids_valid = false;
+  m_update_band_times.assign(m_update_fraction, -1.0f);
+
+  return true;
+}
+
+bool App::startPointCloudImport(std::unique_ptr<PointCloudLoader> loader) {
+  m_point_cloud_loader.reset();
+
+  const size_t point_count = loader->getPointCount();
+  if (!resizeParticlesForImport(point_count, "Point cloud imports")) {
+    return false;
+  }
+
+  const auto &resolution = m_particle_framebuffer_resolution;
+  if (size_t(resolution.x) * resolution.y < point_count) {
+    PRINT_ERROR("Only %d of %zu points fit in the particle memory budget\n", resolution.x * resolution.y, point_count);
+  }
+  loader->start(getThreadPool(), size_t(resolution.x) * resolution.y);
+  m_point_cloud_loader = std::move(loader);
+
+  return true;
+}
+
+void App::uploadPointCloudChunks() {
+  if (!m_point_cloud_loader) {
+    return;
+  }
+
+  // Each upload holds the positions then the colors of a run of points
+  const size_t max_piece_point_count = m_texture_uploader.getSlotSizeBytes() / (2 * sizeof(gl::vec4));
+  const auto &position_tex = m_particle_fbs[0]->textures[0];
+  const size_t texel_count = size_t(position_tex.width) * position_tex.height;
+
+  PointCloudPiece piece;
+  while (m_point_cloud_loader->peekParsedPoints(max_piece_point_count, piece)) {
+    if (piece.first_point + piece.count > texel_count || m_particle_layers_enabled) {
+      // The particle framebuffers changed under the import, e.g. shrank to fit a smaller memory budget
+      PRINT_ERROR("Point cloud import stopped: particle framebuffers no longer fit the points\n");
+      m_point_cloud_loader.reset();
+      return;
     }
-    else if (pragma.args.size() == 2 && (stringsEqualCaseInsensitive(pragma.args[0], "cullFace") || stringsEqualCaseInsensitive(pragma.args[0], "cull"))) {
-      const auto cullMode = findValueByNameCaseInsensitive(CULL_FACE_MODE_NAMES, CULL_FACE_MODE_VALUES, pragma.args[1]);
-      if (cullMode) {
-        m_cull_mode = *cullMode;
-      }
+    if (!m_texture_uploader.begin()) {
+      break; // The GPU is still reading every staging buffer. Carry on next frame.
     }
+
+    const size_t piece_size_bytes = piece.count * sizeof(gl::vec4);
+    m_texture_uploader.write(0, piece.positions, piece_size_bytes);
+    m_texture_uploader.write(piece_size_bytes, piece.colors, piece_size_bytes);
+
+    // Both framebuffers, so the points survive whichever one the next simulate reads
+    for (const auto &fb : m_particle_fbs) {
+      m_texture_uploader.copyToTexture(fb->textures[0], piece.first_point, piece.count, 0);
+      m_texture_uploader.copyToTexture(fb->textures[1], piece.first_point, piece.count, piece_size_bytes);
+    }
+
+    m_texture_uploader.end();
+    m_point_cloud_loader->consumeParsedPoints(piece.count);
   }
 
-  m_blend_func_sfactor = m_default_blend_func_sfactor;
-  m_blend_func_dfactor = m_default_blend_func_dfactor;
+  if (m_point_cloud_loader->isFinished()) {
+    m_point_cloud_loader.reset();
+  }
+}
 
-  m_depth_func = m_default_depth_func;
+float App::getPointCloudImportProgress() const {
+  return m_point_cloud_loader ? m_point_cloud_loader->getProgress() : 1.0f;
+}
 
-  const auto fragmentPragmas = parsePragmas(m_user_shader_sources[3]);
-  for (const auto &pragma : fragmentPragmas) {
-    if (pragma.args.size() == 3 && stringsEqualCaseInsensitive(pragma.args[0], "blendFunc")) {
-      const auto sfactor = findValueByNameCaseInsensitive(BLEND_FUNC_NAMES, BLEND_FUNC_VALUES, pragma.args[1]);
-      if (sfactor) {
-        m_blend_func_sfactor = *sfactor;
-      }
+bool App::emitFromMesh(const gl::DefaultTriangleMesh &mesh, size_t particle_count, uint32_t seed) {
+  m_point_cloud_loader.reset();
 
-      const auto dfactor = findValueByNameCaseInsensitive(BLEND_FUNC_NAMES, BLEND_FUNC_VALUES, pragma.args[2]);
-      if (dfactor) {
-        m_blend_func_dfactor = *dfactor;
-      }
+  if (!resizeParticlesForImport(particle_count, "Mesh emitters")) {
+    return false;
+  }
+
+  MeshSurfaceSampler sampler;
+  if (!sampler.build(mesh, getThreadPool())) {
+    return false;
+  }
+
+  const auto &resolution = m_particle_framebuffer_resolution;
+  MeshSurfaceSamples samples;
+  sampler.sample(size_t(resolution.x) * resolution.y, seed, getThreadPool(), samples);
+
+  uploadMeshSamples({ samples.positions.data(), samples.texcoords.data(), samples.normals.data() });
+
+  return true;
+}
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+bool App::emitFromMesh(const gl::DefaultTriangleMesh &mesh, size_t particle_count, uint32_t seed, const char *cache_path) {
+  m_point_cloud_loader.reset();
+
+  if (!resizeParticlesForImport(particle_count, "Mesh emitters")) {
+    return false;
+  }
+
+  const auto &resolution = m_particle_framebuffer_resolution;
+  const MeshSampleCacheKey key{ hashTriangleMesh(mesh, getThreadPool()), size_t(resolution.x) * resolution.y, seed };
+
+  MappedFile file;
+  const gl::vec4 *attachments[3];
+  if (openMeshSampleCache(file, cache_path, key, attachments)) {
+    uploadMeshSamples(attachments);
+    return true;
+  }
+
+  MeshSurfaceSampler sampler;
+  if (!sampler.build(mesh, getThreadPool())) {
+    return false;
+  }
+
+  MeshSurfaceSamples samples;
+  sampler.sample(key.sample_count, seed, getThreadPool(), samples);
+
+  uploadMeshSamples({ samples.positions.data(), samples.texcoords.data(), samples.normals.data() });
+
+  // The particles are already in place, so a failed write only costs the next load
+  writeMeshSampleCache(cache_path, key, samples);
+
+  return true;
+}
+#endif
+
+void App::uploadMeshSamples(const gl::vec4 *const (&attachments)[3]) {
+  for (const auto &fb : m_particle_fbs) {
+    for (size_t i = 0; i < arraySize(attachments); ++i) {
+      gl::updateTexture(fb->textures[i], attachments[i]);
     }
-    else if (pragma.args.size() == 2 && stringsEqualCaseInsensitive(pragma.args[0], "depthFunc")) {
-      const auto func = findValueByNameCaseInsensitive(DEPTH_FUNC_NAMES, DEPTH_FUNC_VALUES, pragma.args[1]);
-      if (func) {
-        m_depth_func = *func;
-      }
+  }
+}
+
+bool App::setSignedDistanceField(const SignedDistanceVolume &volume) {
+  const auto &res = volume.resolution;
+  if (res.x <= 0 || res.y <= 0 || res.z <= 0 || volume.texels.size() != size_t(res.x) * res.y * res.z) {
+    PRINT_ERROR("Signed distance volume is empty or its texels don't match its resolution\n");
+    return false;
+  }
+
+  GLint max_size;
+  glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &max_size);
+  if (res.x > max_size || res.y > max_size || res.z > max_size) {
+    PRINT_ERROR("Signed distance volume of %dx%dx%d is over the 3D texture size limit of %d\n", res.x, res.y, res.z, max_size);
+    return false;
+  }
+
+  // Half floats keep the volume small and can be filtered everywhere, unlike 32 bit floats on WebGL
+  gl::createTexture3D(m_sdf_texture, res.x, res.y, res.z, { GL_TEXTURE_3D, GL_RGBA16F, GL_RGBA, GL_FLOAT, GL_LINEAR, GL_LINEAR });
+  gl::updateTexture(m_sdf_texture, volume.texels.data());
+
+  m_common_uniforms.sdf_bounds_min = gl::vec4(volume.bounds_min, 0.0f);
+  m_common_uniforms.sdf_bounds_size = gl::vec4(volume.bounds_max - volume.bounds_min, 1.0f);
+
+  return true;
+}
+
+void App::clearSignedDistanceField() {
+  gl::deleteTextureDeferred(m_sdf_texture);
+  m_common_uniforms.sdf_bounds_min = gl::vec4(0.0f);
+  m_common_uniforms.sdf_bounds_size = gl::vec4(0.0f);
+}
+
+bool App::bakeSignedDistanceField(const gl::DefaultTriangleMesh &mesh, int max_resolution, float padding) {
+  SignedDistanceVolume volume;
+  if (!bakeMeshSignedDistance(mesh, max_resolution, padding, getThreadPool(), volume)) {
+    return false;
+  }
+  return setSignedDistanceField(volume);
+}
+
+bool App::bakeSignedDistanceField(const std::function<float(const gl::vec3 &)> &distance,
+                                  const gl::vec3 &bounds_min,
+                                  const gl::vec3 &bounds_max,
+                                  int max_resolution) {
+  SignedDistanceVolume volume;
+  bakeFunctionSignedDistance(distance, bounds_min, bounds_max, max_resolution, getThreadPool(), volume);
+  return setSignedDistanceField(volume);
+}
+
+bool App::setCollisionMesh(const MeshBvh &bvh) {
+  const std::vector<gl::vec4> *texels[]{ &bvh.nodes, &bvh.triangles };
+
+  GLint max_texture_size;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+  for (const auto *t : texels) {
+    if (t->size() / MESH_BVH_TEXTURE_WIDTH > size_t(max_texture_size)) {
+      PRINT_ERROR("Collision mesh BVH needs %zu texture rows, the limit is %d\n", t->size() / MESH_BVH_TEXTURE_WIDTH, max_texture_size);
+      return false;
     }
   }
+
+  // Full floats, as vertex positions and node links need every bit. Nothing is filtered.
+  for (size_t i = 0; i < arraySize(texels); ++i) {
+    const int height = int(texels[i]->size() / MESH_BVH_TEXTURE_WIDTH);
+    gl::createTexture(m_mesh_bvh_textures[i], MESH_BVH_TEXTURE_WIDTH, height, { GL_TEXTURE_2D, GL_RGBA32F, GL_RGBA, GL_FLOAT, GL_NEAREST, GL_NEAREST });
+    gl::updateTexture(m_mesh_bvh_textures[i], texels[i]->data());
+  }
+
+  m_common_uniforms.mesh_bvh_node_count = GLint(bvh.node_count);
+
+  return true;
 }
 
-bool App::tryCompileShaderPrograms() {
-  gl::Program programs[2];
+bool App::setCollisionMesh(const gl::DefaultTriangleMesh &mesh) {
+  MeshBvh bvh;
+  if (!buildMeshBvh(mesh, getThreadPool(), bvh)) {
+    return false;
+  }
+  return setCollisionMesh(bvh);
+}
 
-  gl::ProgramError programError;
+void App::clearCollisionMesh() {
+  for (auto &tex : m_mesh_bvh_textures) {
+    gl::deleteTextureDeferred(tex);
+  }
+  m_common_uniforms.mesh_bvh_node_count = 0;
+}
 
-  if (!gl::createProgram(programs[0], m_simulate_shader_vs_source, m_assembled_shader_sources[0], &programError)) {
+#if !defined(PLATFORM_EMSCRIPTEN)
+bool App::loadVectorField(const char *path) {
+  MappedFile file;
+  if (!file.open(path)) {
     return false;
   }
-  parseSimulationShaderPragmas();
+  return loadVectorField(file.data(), file.size());
+}
+#endif
 
-  if (!gl::createProgram(programs[1], m_assembled_shader_sources[1], m_assembled_shader_sources[2], &programError)) {
+bool App::loadVectorField(const uint8_t *data, size_t size_bytes) {
+  VectorField field;
+  if (!parseVectorField(data, size_bytes, getThreadPool(), field)) {
     return false;
   }
-  parseRenderShaderPragmas();
+  return setVectorField(field);
+}
 
-  const GLint uniformSamplerLocations[] = { 0, 1, 2, 3, 4, 5 };
+bool App::setVectorField(const VectorField &field) {
+  const auto &res = field.resolution;
+  if (res.x <= 0 || res.y <= 0 || res.z <= 0 || field.texels == nullptr) {
+    PRINT_ERROR("Vector field is empty or has no texels\n");
+    return false;
+  }
 
-  for (size_t i = 0; i < arraySize(programs); ++i) {
-    if (programs[i].id) {
-      gl::useProgram(programs[i]);
-      gl::uniformBlockBinding(programs[i], "CommonUniforms", 0);
-      gl::uniform(programs[i], "iFragData[0]", uniformSamplerLocations);
+  GLint max_size;
+  glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &max_size);
+  if (res.x > max_size || res.y > max_size || res.z > max_size) {
+    PRINT_ERROR("Vector field of %dx%dx%d is over the 3D texture size limit of %d\n", res.x, res.y, res.z, max_size);
+    return false;
+  }
 
-      m_programs[i] = std::move(programs[i]);
-    }
+  // Full float fields keep their precision where float textures can be filtered. Elsewhere the driver
+  // converts them to half floats on upload.
+  const GLenum internal_format = field.component_type == GL_FLOAT && canFilterFloatTextures() ? GL_RGBA32F : GL_RGBA16F;
+  gl::createTexture3D(m_vector_field_texture, res.x, res.y, res.z, { GL_TEXTURE_3D, internal_format, GL_RGBA, field.component_type, GL_LINEAR, GL_LINEAR });
+  gl::updateTexture(m_vector_field_texture, field.texels);
+
+  m_common_uniforms.vector_field_bounds_min = gl::vec4(field.bounds_min, 0.0f);
+  m_common_uniforms.vector_field_bounds_size = gl::vec4(field.bounds_max - field.bounds_min, 1.0f);
+
+  return true;
+}
+
+void App::clearVectorField() {
+  gl::deleteTextureDeferred(m_vector_field_texture);
+  m_common_uniforms.vector_field_bounds_min = gl::vec4(0.0f);
+  m_common_uniforms.vector_field_bounds_size = gl::vec4(0.0f);
+}
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+bool App::buildPointOctree(const char *input_path, const char *output_path) {
+  return ::buildPointOctree(input_path, output_path, getThreadPool());
+}
+
+bool App::openPointOctree(const char *path, int pool_page_count) {
+  closePointOctree();
+
+  auto streamer = std::make_unique<PointOctreeStreamer>();
+  if (!streamer->open(path, getThreadPool(), pool_page_count)) {
+    return false;
   }
+  streamer->setErrorThreshold(m_point_octree_error_threshold);
+  m_point_octree = std::move(streamer);
 
   return true;
 }
+#endif
 
-void App::setViewAndProjectionMatrices(const float *view_matrix_values, const float *projection_matrix_values) {
-  std::copy_n(view_matrix_values, 16, &m_common_uniforms.model_view[0][0]);
-  std::copy_n(projection_matrix_values, 16, &m_common_uniforms.projection[0][0]);
+bool App::openPointOctree(const uint8_t *data, size_t size_bytes, int pool_page_count) {
+  closePointOctree();
 
-  updateViewAndProjectionTransforms();
+  auto streamer = std::make_unique<PointOctreeStreamer>();
+  if (!streamer->open(data, size_bytes, getThreadPool(), pool_page_count)) {
+    return false;
+  }
+  streamer->setErrorThreshold(m_point_octree_error_threshold);
+  m_point_octree = std::move(streamer);
+
+  return true;
 }
 
-void App::setControllerAtIndex(int index,
-                               const float *position_values,
-                               const float *velocity_values,
-                               const float *orientation_values,
-                               const float *buttons_values) {
-  assert(index >= 0 && index < arraySize(m_controller_position));
+void App::closePointOctree() {
+  m_point_octree.reset();
+}
 
-  std::copy_n(position_values, 3, &m_controller_position[index][0]);
-  std::copy_n(velocity_values, 3, &m_common_uniforms.controller_velocity[index][0]);
-  std::copy_n(orientation_values, 4, &m_controller_orientation[index][0]);
-  std::copy_n(buttons_values, 4, &m_common_uniforms.controller_buttons[index][0]);
+void App::setPointOctreeErrorThreshold(float pixels) {
+  m_point_octree_error_threshold = pixels;
+  if (m_point_octree) {
+    m_point_octree->setErrorThreshold(pixels);
+  }
+}
+
+const PointOctreeStats &App::getPointOctreeStats() const {
+  static const PointOctreeStats empty_stats;
+  return m_point_octree ? m_point_octree->getStats() : empty_stats;
+}
+
+float App::getSimulationTime() const {
+  return m_common_uniforms.time;
+}
+
+int App::getSimulationFrame() const {
+  return m_common_uniforms.frame;
+}
+
+void App::setMaxFramesInFlight(int count) {
+  m_frame_pacer.setMaxFramesInFlight(count);
+}
+
+const gl::FramePacerStats &App::getFramePacerStats() const {
+  return m_frame_pacer.getStats();
+}
+
+void App::setResourcePoolBudget(size_t budget_bytes) {
+  m_resource_pool.setBudget(budget_bytes);
+}
+
+const gl::ResourcePoolStats &App::getResourcePoolStats() const {
+  return m_resource_pool.getStats();
+}
+
+void App::setMemoryBudget(size_t budget_bytes) {
+  gl::setMemoryBudget(budget_bytes);
+}
+
+const gl::MemoryStats &App::getMemoryStats() const {
+  return gl::getMemoryStats();
 }
 
 double App::getAverageFramesPerSecond() const {
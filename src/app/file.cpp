@@ -0,0 +1,129 @@
+#include "app/file.hpp"
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+
+#include "app/log.hpp"
+
+#include <cstdio>
+
+#if defined(PLATFORM_WINDOWS)
+  #include <Windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+#if defined(PLATFORM_WINDOWS)
+
+bool MappedFile::open(const char *path) {
+  close();
+
+  m_file_handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (m_file_handle == INVALID_HANDLE_VALUE) {
+    m_file_handle = nullptr;
+    PRINT_ERROR("Failed to open '%s'\n", path);
+    return false;
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(m_file_handle, &size) || size.QuadPart == 0) {
+    close();
+    return false;
+  }
+
+  m_mapping_handle = CreateFileMappingA(m_file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (m_mapping_handle == nullptr) {
+    close();
+    PRINT_ERROR("Failed to map '%s'\n", path);
+    return false;
+  }
+
+  m_data = static_cast<const uint8_t *>(MapViewOfFile(m_mapping_handle, FILE_MAP_READ, 0, 0, 0));
+  if (m_data == nullptr) {
+    close();
+    PRINT_ERROR("Failed to map '%s'\n", path);
+    return false;
+  }
+  m_size_bytes = std::size_t(size.QuadPart);
+
+  return true;
+}
+
+void MappedFile::close() {
+  if (m_data != nullptr) {
+    UnmapViewOfFile(m_data);
+    m_data = nullptr;
+  }
+  if (m_mapping_handle != nullptr) {
+    CloseHandle(m_mapping_handle);
+    m_mapping_handle = nullptr;
+  }
+  if (m_file_handle != nullptr) {
+    CloseHandle(m_file_handle);
+    m_file_handle = nullptr;
+  }
+  m_size_bytes = 0;
+}
+
+#else
+
+bool MappedFile::open(const char *path) {
+  close();
+
+  m_fd = ::open(path, O_RDONLY);
+  if (m_fd < 0) {
+    PRINT_ERROR("Failed to open '%s'\n", path);
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(m_fd, &st) != 0 || st.st_size == 0) {
+    close();
+    return false;
+  }
+
+  void *data = mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_PRIVATE, m_fd, 0);
+  if (data == MAP_FAILED) {
+    close();
+    PRINT_ERROR("Failed to map '%s'\n", path);
+    return false;
+  }
+
+  m_data = static_cast<const uint8_t *>(data);
+  m_size_bytes = std::size_t(st.st_size);
+
+  return true;
+}
+
+void MappedFile::close() {
+  if (m_data != nullptr) {
+    munmap(const_cast<uint8_t *>(m_data), m_size_bytes);
+    m_data = nullptr;
+  }
+  if (m_fd >= 0) {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+  m_size_bytes = 0;
+}
+
+#endif
+
+bool writeFile(const char *path, const void *data, std::size_t size_bytes) {
+  auto file = std::fopen(path, "wb");
+  if (file == nullptr) {
+    PRINT_ERROR("Failed to open '%s' for writing\n", path);
+    return false;
+  }
+  const bool succeeded = std::fwrite(data, 1, size_bytes, file) == size_bytes;
+  std::fclose(file);
+  return succeeded;
+}
+
+#endif
@@ -46,6 +46,29 @@ vec3 calcCenter(const BoundingBox &box) {
   return 0.5f * box.min + 0.5f * box.max;
 }
 
+void calcFrustumPlanes(const mat4 &model_view_projection, vec4 (&out_planes)[6]) {
+  const auto &mvp = model_view_projection;
+  const auto row = [&mvp](int i) { return vec4(mvp[0][i], mvp[1][i], mvp[2][i], mvp[3][i]); };
+
+  out_planes[0] = row(3) + row(0);
+  out_planes[1] = row(3) - row(0);
+  out_planes[2] = row(3) + row(1);
+  out_planes[3] = row(3) - row(1);
+  out_planes[4] = row(3) + row(2);
+  out_planes[5] = row(3) - row(2);
+
+  for (auto &plane : out_planes) {
+    plane /= length(vec3(plane));
+  }
+}
+
+bool isSphereInFrustum(const vec4 (&planes)[6], const vec4 &sphere) {
+  for (const auto &plane : planes) {
+    if (dot(vec3(plane), vec3(sphere)) + plane.w < -sphere.w) return false;
+  }
+  return true;
+}
+
 
 void createVertexBuffer(VertexBuffer &vb,
                         GLenum primitive,
@@ -61,6 +84,9 @@ void createVertexBuffer(VertexBuffer &vb,
   glBufferData(GL_ARRAY_BUFFER, vertex_data_size_bytes, data, usage);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
 
+  vb.size_bytes = vertex_data_size_bytes;
+  trackMemoryAllocation(MEMORY_CATEGORY_VERTEX_BUFFER, vb.size_bytes);
+
   vb.primitive = primitive;
   vb.count = vertex_count;
   vb.attribs = attribs;
@@ -86,6 +112,9 @@ void createIndexedVertexBuffer(VertexBuffer &vb,
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_count * sizeof(GLushort), index_data, GL_STATIC_DRAW);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
+  vb.size_bytes = vertex_data_size_bytes + index_count * sizeof(GLushort);
+  trackMemoryAllocation(MEMORY_CATEGORY_VERTEX_BUFFER, vb.size_bytes);
+
   vb.primitive = primitive;
   vb.count = index_count;
   vb.attribs = attribs;
@@ -93,6 +122,7 @@ void createIndexedVertexBuffer(VertexBuffer &vb,
 
 void deleteVertexBuffer(VertexBuffer &vb) noexcept {
   if (vb.buffer > 0) {
+    trackMemoryDeallocation(MEMORY_CATEGORY_VERTEX_BUFFER, vb.size_bytes);
     glDeleteBuffers(1, &vb.buffer);
     vb.buffer = 0;
   }
@@ -101,6 +131,7 @@ void deleteVertexBuffer(VertexBuffer &vb) noexcept {
     vb.element_buffer = 0;
   }
   vb.count = 0;
+  vb.size_bytes = 0;
 }
 
 
@@ -177,22 +208,27 @@ void assignVertexBufferAttributeLocations(VertexBuffer &vb, const Program &prog,
 VertexBuffer::VertexBuffer(VertexBuffer &&vb) noexcept
 : primitive(std::move(vb.primitive)),
   count(std::move(vb.count)),
+  size_bytes(std::move(vb.size_bytes)),
   attribs(std::move(vb.attribs)) {
-  deleteVertexBuffer(*this);
   buffer = vb.buffer;
+  element_buffer = vb.element_buffer;
   vb.buffer = 0;
+  vb.element_buffer = 0;
 }
 
 VertexBuffer &VertexBuffer::operator=(VertexBuffer &&vb) noexcept {
   if (this != &vb) {
     deleteVertexBuffer(*this);
     buffer = vb.buffer;
-    
+    element_buffer = vb.element_buffer;
+
     primitive = std::move(vb.primitive);
     count = std::move(vb.count);
     attribs = std::move(vb.attribs);
+    size_bytes = std::move(vb.size_bytes);
 
     vb.buffer = 0;
+    vb.element_buffer = 0;
   }
   return *this;
 }
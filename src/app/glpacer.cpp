@@ -0,0 +1,94 @@
+#include "app/glpacer.hpp"
+
+#include "app/util.hpp"
+
+namespace gl {
+
+static constexpr double STATS_SMOOTHING{ 0.1 };
+static constexpr GLuint64 FENCE_WAIT_TIMEOUT_NS{ 100000000 };
+
+static double millisecondsBetween(std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end) {
+  return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+static void updateAverage(double &average, double value, uint64_t count) {
+  average = count <= 1 ? value : ::mix(average, value, STATS_SMOOTHING);
+}
+
+void FramePacer::setMaxFramesInFlight(int count) {
+  m_max_frames_in_flight = ::clamp(count, 1, MAX_FRAMES_IN_FLIGHT);
+}
+
+void FramePacer::retireOldestFrame(Clock::time_point now) {
+  auto &frame = m_frames[m_oldest_frame];
+
+  m_stats.frame_latency_ms = millisecondsBetween(frame.submit_time, now);
+  updateAverage(m_stats.average_frame_latency_ms, m_stats.frame_latency_ms, m_stats.frame_count);
+
+  deleteFence(frame.fence);
+
+  m_oldest_frame = (m_oldest_frame + 1) % MAX_FRAMES_IN_FLIGHT;
+  m_stats.frames_in_flight -= 1;
+}
+
+void FramePacer::beginFrame() {
+  if (m_frame_open) {
+    endFrame();
+  }
+
+  const auto wait_begin_time = Clock::now();
+
+  // Retire whatever already finished without waiting
+  while (m_stats.frames_in_flight > 0 && isFenceSignaled(m_frames[m_oldest_frame].fence)) {
+    retireOldestFrame(Clock::now());
+  }
+
+  m_stats.gpu_bound = m_stats.frames_in_flight >= m_max_frames_in_flight;
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+  while (m_stats.frames_in_flight >= m_max_frames_in_flight) {
+    // A failed wait (lost context) will never succeed, so the frame is dropped rather than waited on again
+    if (waitFence(m_frames[m_oldest_frame].fence, FENCE_WAIT_TIMEOUT_NS) != GL_TIMEOUT_EXPIRED) {
+      retireOldestFrame(Clock::now());
+    }
+  }
+#endif
+
+  m_frame_begin_time = Clock::now();
+  m_frame_wait_ms = millisecondsBetween(wait_begin_time, m_frame_begin_time);
+  m_frame_open = true;
+}
+
+void FramePacer::endFrame() {
+  if (!m_frame_open) {
+    return;
+  }
+  m_frame_open = false;
+
+  const auto now = Clock::now();
+
+  // Without a free slot (only possible on WebGL) the oldest frame stops being tracked
+  if (m_stats.frames_in_flight == MAX_FRAMES_IN_FLIGHT) {
+    deleteFence(m_frames[m_oldest_frame].fence);
+    m_oldest_frame = (m_oldest_frame + 1) % MAX_FRAMES_IN_FLIGHT;
+    m_stats.frames_in_flight -= 1;
+  }
+
+  auto &frame = m_frames[(m_oldest_frame + m_stats.frames_in_flight) % MAX_FRAMES_IN_FLIGHT];
+  createFence(frame.fence);
+  frame.submit_time = now;
+  m_stats.frames_in_flight += 1;
+
+  m_stats.frame_count += 1;
+  if (m_stats.gpu_bound) {
+    m_stats.gpu_bound_frame_count += 1;
+  }
+
+  m_stats.max_frames_in_flight = m_max_frames_in_flight;
+  m_stats.cpu_time_ms = millisecondsBetween(m_frame_begin_time, now);
+  m_stats.fence_wait_ms = m_frame_wait_ms;
+  updateAverage(m_stats.average_cpu_time_ms, m_stats.cpu_time_ms, m_stats.frame_count);
+  updateAverage(m_stats.average_fence_wait_ms, m_stats.fence_wait_ms, m_stats.frame_count);
+}
+
+} // gl
@@ -0,0 +1,140 @@
+#include "app/glpool.hpp"
+
+#include <algorithm>
+
+namespace gl {
+
+bool ResourcePool::Key::operator==(const Key &other) const {
+  return width == other.width && height == other.height && layer_count == other.layer_count && attachments == other.attachments;
+}
+
+ResourcePool::Key ResourcePool::makeKey(int width, int height, int layer_count, const std::vector<FramebufferTextureAttachment> &texture_attachments, const std::vector<FramebufferRenderbufferAttachment> &renderbuffer_attachments) {
+  Key key;
+  key.width = width;
+  key.height = height;
+  key.layer_count = layer_count;
+
+  key.attachments.reserve(texture_attachments.size() * 10 + renderbuffer_attachments.size() * 3);
+  for (const auto &ta : texture_attachments) {
+    const auto &opts = ta.opts;
+    key.attachments.insert(key.attachments.end(), {
+      ta.attachment, opts.target, opts.internal_format, opts.format, opts.component_type,
+      opts.min_filter, opts.mag_filter, opts.wrapS, opts.wrapT, GLenum(opts.immutable)
+    });
+  }
+  for (const auto &ra : renderbuffer_attachments) {
+    key.attachments.insert(key.attachments.end(), { ra.attachment, ra.opts.target, ra.opts.format });
+  }
+
+  return key;
+}
+
+ResourcePool::ResourcePool(std::size_t budget_bytes)
+: m_budget_bytes(budget_bytes) {
+}
+
+std::unique_ptr<Framebuffer> ResourcePool::takeFreeFramebuffer(const Key &key) {
+  // Prefer the most recently released match, its storage is the most likely to still be resident
+  auto best = m_free_entries.end();
+  for (auto it = m_free_entries.begin(); it != m_free_entries.end(); ++it) {
+    if (it->key == key && (best == m_free_entries.end() || it->last_use > best->last_use)) {
+      best = it;
+    }
+  }
+
+  if (best == m_free_entries.end()) {
+    m_stats.misses += 1;
+    return nullptr;
+  }
+
+  auto fb = std::move(best->fb);
+  m_stats.pooled_count -= 1;
+  m_stats.pooled_bytes -= best->size_bytes;
+  m_free_entries.erase(best);
+  m_stats.hits += 1;
+
+  return fb;
+}
+
+std::unique_ptr<Framebuffer> ResourcePool::acquireFramebuffer(int width, int height, const std::vector<FramebufferTextureAttachment> &texture_attachments, const std::vector<FramebufferRenderbufferAttachment> &renderbuffer_attachments) {
+  auto key = makeKey(width, height, 0, texture_attachments, renderbuffer_attachments);
+
+  auto fb = takeFreeFramebuffer(key);
+  if (!fb) {
+    fb = std::make_unique<Framebuffer>();
+    createFramebuffer(*fb, width, height, texture_attachments, renderbuffer_attachments);
+  }
+
+  m_acquired_keys.emplace_back(fb->id, std::move(key));
+
+  return fb;
+}
+
+std::unique_ptr<Framebuffer> ResourcePool::acquireLayeredFramebuffer(int width, int height, int layer_count, const std::vector<FramebufferTextureAttachment> &texture_attachments) {
+  auto key = makeKey(width, height, layer_count, texture_attachments, {});
+
+  auto fb = takeFreeFramebuffer(key);
+  if (!fb) {
+    fb = std::make_unique<Framebuffer>();
+    createLayeredFramebuffer(*fb, width, height, layer_count, texture_attachments);
+  }
+
+  m_acquired_keys.emplace_back(fb->id, std::move(key));
+
+  return fb;
+}
+
+void ResourcePool::releaseFramebuffer(std::unique_ptr<Framebuffer> fb) {
+  if (!fb || fb->id == 0) {
+    return;
+  }
+
+  auto it = std::find_if(m_acquired_keys.begin(), m_acquired_keys.end(), [&](const auto &ak) { return ak.first == fb->id; });
+  if (it == m_acquired_keys.end()) {
+    deleteFramebufferDeferred(*fb);
+    return;
+  }
+
+  Entry entry;
+  entry.key = std::move(it->second);
+  entry.size_bytes = getFramebufferSizeBytes(*fb);
+  entry.last_use = ++m_use_counter;
+  entry.fb = std::move(fb);
+
+  m_acquired_keys.erase(it);
+
+  m_stats.pooled_count += 1;
+  m_stats.pooled_bytes += entry.size_bytes;
+  m_free_entries.push_back(std::move(entry));
+
+  evictToBudget(m_budget_bytes);
+}
+
+void ResourcePool::evictToBudget(std::size_t budget_bytes) {
+  while (m_stats.pooled_bytes > budget_bytes && !m_free_entries.empty()) {
+    auto lru = std::min_element(m_free_entries.begin(), m_free_entries.end(), [](const Entry &a, const Entry &b) { return a.last_use < b.last_use; });
+
+    m_stats.pooled_count -= 1;
+    m_stats.pooled_bytes -= lru->size_bytes;
+    m_stats.evictions += 1;
+
+    deleteFramebufferDeferred(*lru->fb);
+    m_free_entries.erase(lru);
+  }
+}
+
+void ResourcePool::setBudget(std::size_t budget_bytes) {
+  m_budget_bytes = budget_bytes;
+  evictToBudget(m_budget_bytes);
+}
+
+void ResourcePool::trim(std::size_t max_pooled_bytes) {
+  evictToBudget(max_pooled_bytes);
+}
+
+void ResourcePool::clear() {
+  evictToBudget(0);
+}
+
+
+} // gl
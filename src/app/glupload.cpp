@@ -0,0 +1,99 @@
+#include "app/glupload.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace gl {
+
+TextureUploader::TextureUploader(std::size_t slot_size_bytes)
+    : m_slot_size_bytes(slot_size_bytes) {}
+
+TextureUploader::~TextureUploader() {
+  clear();
+}
+
+bool TextureUploader::begin() {
+  assert(!m_staging);
+
+  auto &slot = m_slots[m_slot_index];
+  if (!isFenceSignaled(slot.fence)) {
+    return false;
+  }
+  deleteFence(slot.fence);
+
+  if (slot.buffer.size_bytes != m_slot_size_bytes) {
+    createPixelBuffer(slot.buffer, m_slot_size_bytes, GL_STREAM_DRAW);
+  }
+
+  m_staging = true;
+  return true;
+}
+
+void TextureUploader::write(std::size_t offset_bytes, const void *data, std::size_t size_bytes) {
+  assert(m_staging);
+  setPixelBufferData(m_slots[m_slot_index].buffer, offset_bytes, size_bytes, data);
+}
+
+void TextureUploader::copyToTexture(const Texture &tex, std::size_t first_texel, std::size_t texel_count, std::size_t offset_bytes) {
+  assert(m_staging);
+
+  auto &buffer = m_slots[m_slot_index].buffer;
+  const std::size_t width = tex.width;
+  const std::size_t texel_size_bytes = getBytesPerPixel(tex.opts.internal_format);
+
+  assert(first_texel + texel_count <= width * tex.height);
+  assert(offset_bytes + texel_count * texel_size_bytes <= buffer.size_bytes);
+
+  // Up to three copies: the end of a partial first row, whole rows, then the start of a partial last row
+  while (texel_count > 0) {
+    const std::size_t x = first_texel % width;
+    const std::size_t y = first_texel / width;
+
+    std::size_t copy_width, copy_height;
+    if (x != 0 || texel_count < width) {
+      copy_width = std::min(width - x, texel_count);
+      copy_height = 1;
+    }
+    else {
+      copy_width = width;
+      copy_height = texel_count / width;
+    }
+
+    updateTextureFromBuffer(tex, buffer, offset_bytes, int(x), int(y), int(copy_width), int(copy_height));
+
+    const std::size_t copied_count = copy_width * copy_height;
+    first_texel += copied_count;
+    texel_count -= copied_count;
+    offset_bytes += copied_count * texel_size_bytes;
+  }
+}
+
+void TextureUploader::copyToTextureRegion(const Texture &tex, int x, int y, int width, int height, std::size_t offset_bytes) {
+  assert(m_staging);
+
+  auto &buffer = m_slots[m_slot_index].buffer;
+
+  assert(x >= 0 && y >= 0 && x + width <= tex.width && y + height <= tex.height);
+  assert(offset_bytes + std::size_t(width) * height * getBytesPerPixel(tex.opts.internal_format) <= buffer.size_bytes);
+
+  updateTextureFromBuffer(tex, buffer, offset_bytes, x, y, width, height);
+}
+
+void TextureUploader::end() {
+  assert(m_staging);
+
+  createFence(m_slots[m_slot_index].fence);
+  m_slot_index = (m_slot_index + 1) % RING_SIZE;
+  m_staging = false;
+}
+
+void TextureUploader::clear() {
+  for (auto &slot : m_slots) {
+    deleteFence(slot.fence);
+    deletePixelBufferDeferred(slot.buffer); // The last uploads may still be reading it
+  }
+  m_slot_index = 0;
+  m_staging = false;
+}
+
+} // namespace gl
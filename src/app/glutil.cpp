@@ -2,7 +2,9 @@
 #include "app/log.hpp"
 #include "app/util.hpp"
 
+#include <algorithm>
 #include <cstdarg>
+#include <cstring>
 #include <memory>
 
 #if !defined(PLATFORM_EMSCRIPTEN)
@@ -11,12 +13,20 @@
   #include "stb_image.h"
 #endif
 
+#if defined(PLATFORM_EMSCRIPTEN)
+// WebGL 2 has no buffer mapping, but Emscripten implements `getBufferSubData` under the ES name.
+extern "C" void glGetBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, void *data);
+#endif
+
 namespace gl {
 
 constexpr std::size_t ERROR_LOG_MAX_SIZE = 256;
 
 static std::vector<std::string> s_error_log;
 
+static MemoryStats s_memory_stats;
+static std::size_t s_memory_budget_bytes = 0;
+
 static void logError(std::string_view err) {
   if (s_error_log.size() == ERROR_LOG_MAX_SIZE) {
     std::copy(s_error_log.begin() + 1, s_error_log.end(), s_error_log.begin());
@@ -97,6 +107,33 @@ void printStats() {
 }
 
 
+void trackMemoryAllocation(MemoryCategory category, std::size_t size_bytes) {
+  s_memory_stats.live_bytes[category] += size_bytes;
+  s_memory_stats.live_count[category] += 1;
+  s_memory_stats.total_bytes += size_bytes;
+  s_memory_stats.peak_total_bytes = std::max(s_memory_stats.peak_total_bytes, s_memory_stats.total_bytes);
+}
+
+void trackMemoryDeallocation(MemoryCategory category, std::size_t size_bytes) {
+  assert(s_memory_stats.live_bytes[category] >= size_bytes && s_memory_stats.live_count[category] > 0);
+  s_memory_stats.live_bytes[category] -= size_bytes;
+  s_memory_stats.live_count[category] -= 1;
+  s_memory_stats.total_bytes -= size_bytes;
+}
+
+const MemoryStats &getMemoryStats() {
+  return s_memory_stats;
+}
+
+void setMemoryBudget(std::size_t budget_bytes) {
+  s_memory_budget_bytes = budget_bytes;
+}
+
+std::size_t getMemoryBudget() {
+  return s_memory_budget_bytes;
+}
+
+
 GLuint createShader(std::string_view shader_src, GLenum type, ShaderError *error) {
   auto shader = glCreateShader(type);
 
@@ -206,7 +243,7 @@ Program createProgram(std::string_view vert_shader_src, std::string_view frag_sh
 }
 
 bool createProgram(Program &prog, std::string_view vert_shader_src, std::string_view frag_shader_src, ProgramError *error) {
-  deleteProgram(prog);
+  deleteProgramDeferred(prog);
 
   ShaderError shaderError;
 
@@ -332,13 +369,17 @@ void uniformBlockBinding(Program &prog, std::string_view uniform_block_name, GLu
 
 
 void createUniformBuffer(UniformBuffer &ub, std::size_t uniform_data_size_bytes, const void *data, GLenum usage) {
-  deleteUniformBuffer(ub);
+  deleteUniformBufferDeferred(ub);
+
+  ub.size_bytes = uniform_data_size_bytes;
 
   glGenBuffers(1, &ub.id);
   glBindBuffer(GL_UNIFORM_BUFFER, ub.id);
   glBufferData(GL_UNIFORM_BUFFER, uniform_data_size_bytes, data, usage);
   glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
+  trackMemoryAllocation(MEMORY_CATEGORY_UNIFORM_BUFFER, ub.size_bytes);
+
   CHECK_GL_ERROR();
 }
 
@@ -356,12 +397,106 @@ void bindUniformBuffer(UniformBuffer &ub, GLuint uniform_block_binding) {
 
 void deleteUniformBuffer(UniformBuffer &ub) {
   if (ub.id) {
+    trackMemoryDeallocation(MEMORY_CATEGORY_UNIFORM_BUFFER, ub.size_bytes);
     glDeleteBuffers(1, &ub.id);
     ub.id = 0;
   }
 }
 
 
+std::size_t getBytesPerPixel(GLenum internal_format) {
+  switch (internal_format) {
+    case GL_ALPHA:
+    case GL_LUMINANCE:
+    case GL_R8:
+    case GL_R8I:
+    case GL_R8UI:
+    case GL_STENCIL_INDEX8:
+      return 1;
+    case GL_LUMINANCE_ALPHA:
+    case GL_RG8:
+    case GL_RG8I:
+    case GL_RG8UI:
+    case GL_R16F:
+    case GL_R16I:
+    case GL_R16UI:
+    case GL_RGB565:
+    case GL_RGBA4:
+    case GL_RGB5_A1:
+    case GL_DEPTH_COMPONENT16:
+      return 2;
+    case GL_RGB:
+    case GL_RGB8:
+    case GL_SRGB8:
+    case GL_DEPTH_COMPONENT24:
+      return 3;
+    case GL_RGBA:
+    case GL_RGBA8:
+    case GL_SRGB8_ALPHA8:
+    case GL_RGBA8I:
+    case GL_RGBA8UI:
+    case GL_RGB10_A2:
+    case GL_R11F_G11F_B10F:
+    case GL_RG16F:
+    case GL_RG16I:
+    case GL_RG16UI:
+    case GL_R32F:
+    case GL_R32I:
+    case GL_R32UI:
+    case GL_DEPTH24_STENCIL8:
+    case GL_DEPTH_COMPONENT32F:
+      return 4;
+    case GL_DEPTH32F_STENCIL8:
+      return 5;
+    case GL_RGB16F:
+    case GL_RGB16I:
+    case GL_RGB16UI:
+      return 6;
+    case GL_RGBA16F:
+    case GL_RGBA16I:
+    case GL_RGBA16UI:
+    case GL_RG32F:
+    case GL_RG32I:
+    case GL_RG32UI:
+      return 8;
+    case GL_RGB32F:
+    case GL_RGB32I:
+    case GL_RGB32UI:
+      return 12;
+    case GL_RGBA32F:
+    case GL_RGBA32I:
+    case GL_RGBA32UI:
+      return 16;
+    default:
+      return 4; // Unknown. Assume the most common size.
+  }
+}
+
+static bool isMipmapFilter(GLenum filter) {
+  return filter == GL_NEAREST_MIPMAP_NEAREST || filter == GL_LINEAR_MIPMAP_NEAREST ||
+         filter == GL_NEAREST_MIPMAP_LINEAR || filter == GL_LINEAR_MIPMAP_LINEAR;
+}
+
+std::size_t getTextureSizeBytes(const Texture &tex) {
+  const std::size_t size_bytes = std::size_t(tex.width) * tex.height * tex.depth * getBytesPerPixel(tex.opts.internal_format);
+  return isMipmapFilter(tex.opts.min_filter) ? size_bytes * 4 / 3 : size_bytes; // A full mip chain adds about a third
+}
+
+std::size_t getRenderbufferSizeBytes(const Renderbuffer &rb) {
+  return std::size_t(rb.width) * rb.height * getBytesPerPixel(rb.opts.format);
+}
+
+std::size_t getFramebufferSizeBytes(const Framebuffer &fb) {
+  std::size_t size_bytes = 0;
+  for (const auto &tex : fb.textures) {
+    size_bytes += getTextureSizeBytes(tex);
+  }
+  for (const auto &rb : fb.renderbuffers) {
+    size_bytes += getRenderbufferSizeBytes(rb);
+  }
+  return size_bytes;
+}
+
 Texture createTexture(int width, int height, const TextureOpts &opts) {
   Texture tex;
   createTexture(tex, width, height, opts);
@@ -375,15 +510,23 @@ Texture createTexture(const TextureData &data, const TextureOpts &opts) {
 }
 
 void createTexture(Texture &tex, int width, int height, const TextureOpts &opts) {
-  deleteTexture(tex);
+  deleteTextureDeferred(tex);
 
   tex.width = width;
   tex.height = height;
+  tex.depth = 1;
+  tex.opts = opts;
 
   glGenTextures(1, &tex.id);
   glBindTexture(opts.target, tex.id);
 
-  glTexImage2D(opts.target, 0, opts.internal_format, width, height, 0, opts.format, opts.component_type, nullptr);
+  if (opts.immutable) {
+    glTexStorage2D(opts.target, 1, opts.internal_format, width, height);
+  } else {
+    glTexImage2D(opts.target, 0, opts.internal_format, width, height, 0, opts.format, opts.component_type, nullptr);
+  }
+
+  trackMemoryAllocation(MEMORY_CATEGORY_TEXTURE, getTextureSizeBytes(tex));
 
   glTexParameteri(opts.target, GL_TEXTURE_MIN_FILTER, opts.min_filter);
   glTexParameteri(opts.target, GL_TEXTURE_MAG_FILTER, opts.mag_filter);
@@ -396,10 +539,11 @@ void createTexture(Texture &tex, int width, int height, const TextureOpts &opts)
 }
 
 void createTexture(Texture &tex, const TextureData &data, const TextureOpts &opts) {
-  deleteTexture(tex);
+  deleteTextureDeferred(tex);
 
   tex.width = data.width;
   tex.height = data.height;
+  tex.depth = 1;
   tex.opts = opts;
 
   glGenTextures(1, &tex.id);
@@ -408,13 +552,14 @@ void createTexture(Texture &tex, const TextureData &data, const TextureOpts &opt
   glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // Assume pixel rows are tightly packed
   glTexImage2D(opts.target, 0, opts.internal_format, data.width, data.height, 0, opts.format, opts.component_type, data.pixels.get());
 
+  trackMemoryAllocation(MEMORY_CATEGORY_TEXTURE, getTextureSizeBytes(tex));
+
   glTexParameteri(opts.target, GL_TEXTURE_MIN_FILTER, opts.min_filter);
   glTexParameteri(opts.target, GL_TEXTURE_MAG_FILTER, opts.mag_filter);
   glTexParameteri(opts.target, GL_TEXTURE_WRAP_S, opts.wrapS);
   glTexParameteri(opts.target, GL_TEXTURE_WRAP_T, opts.wrapT);
 
-  if (opts.min_filter == GL_NEAREST_MIPMAP_NEAREST || opts.min_filter == GL_LINEAR_MIPMAP_NEAREST ||
-      opts.min_filter == GL_NEAREST_MIPMAP_LINEAR || opts.min_filter == GL_LINEAR_MIPMAP_LINEAR) {
+  if (isMipmapFilter(opts.min_filter)) {
     glGenerateMipmap(opts.target);
   }
 
@@ -423,8 +568,64 @@ void createTexture(Texture &tex, const TextureData &data, const TextureOpts &opt
   CHECK_GL_ERROR();
 }
 
+static void createTextureWithDepth(Texture &tex, int width, int height, int depth, const TextureOpts &opts) {
+  deleteTextureDeferred(tex);
+
+  tex.width = width;
+  tex.height = height;
+  tex.depth = depth;
+  tex.opts = opts;
+
+  glGenTextures(1, &tex.id);
+  glBindTexture(opts.target, tex.id);
+
+  if (opts.immutable) {
+    glTexStorage3D(opts.target, 1, opts.internal_format, width, height, depth);
+  } else {
+    glTexImage3D(opts.target, 0, opts.internal_format, width, height, depth, 0, opts.format, opts.component_type, nullptr);
+  }
+
+  trackMemoryAllocation(MEMORY_CATEGORY_TEXTURE, getTextureSizeBytes(tex));
+
+  glTexParameteri(opts.target, GL_TEXTURE_MIN_FILTER, opts.min_filter);
+  glTexParameteri(opts.target, GL_TEXTURE_MAG_FILTER, opts.mag_filter);
+  glTexParameteri(opts.target, GL_TEXTURE_WRAP_S, opts.wrapS);
+  glTexParameteri(opts.target, GL_TEXTURE_WRAP_T, opts.wrapT);
+  if (opts.target == GL_TEXTURE_3D) {
+    glTexParameteri(opts.target, GL_TEXTURE_WRAP_R, opts.wrapR);
+  }
+
+  glBindTexture(opts.target, 0);
+
+  CHECK_GL_ERROR();
+}
+
+void createTextureArray(Texture &tex, int width, int height, int depth, const TextureOpts &opts) {
+  assert(opts.target == GL_TEXTURE_2D_ARRAY);
+  createTextureWithDepth(tex, width, height, depth, opts);
+}
+
+void createTexture3D(Texture &tex, int width, int height, int depth, const TextureOpts &opts) {
+  assert(opts.target == GL_TEXTURE_3D);
+  createTextureWithDepth(tex, width, height, depth, opts);
+}
+
+void updateTexture(const Texture &tex, const void *pixels) {
+  glBindTexture(tex.opts.target, tex.id);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  if (tex.opts.target == GL_TEXTURE_3D || tex.opts.target == GL_TEXTURE_2D_ARRAY) {
+    glTexSubImage3D(tex.opts.target, 0, 0, 0, 0, tex.width, tex.height, tex.depth, tex.opts.format, tex.opts.component_type, pixels);
+  } else {
+    glTexSubImage2D(tex.opts.target, 0, 0, 0, tex.width, tex.height, tex.opts.format, tex.opts.component_type, pixels);
+  }
+  glBindTexture(tex.opts.target, 0);
+
+  CHECK_GL_ERROR();
+}
+
 void deleteTexture(Texture &tex) noexcept {
   if (tex.id > 0) {
+    trackMemoryDeallocation(MEMORY_CATEGORY_TEXTURE, getTextureSizeBytes(tex));
     glDeleteTextures(1, &tex.id);
     tex.id = 0;
   }
@@ -438,19 +639,25 @@ Renderbuffer createRenderbuffer(int width, int height, const RenderbufferOpts &o
 }
 
 void createRenderbuffer(Renderbuffer &rb, int width, int height, const RenderbufferOpts &opts) {
+  deleteRenderbufferDeferred(rb);
+
   rb.width = width;
   rb.height = height;
+  rb.opts = opts;
 
   glGenRenderbuffers(1, &rb.id);
   glBindRenderbuffer(opts.target, rb.id);
   glRenderbufferStorage(opts.target, opts.format, width, height);
   glBindRenderbuffer(opts.target, 0);
 
+  trackMemoryAllocation(MEMORY_CATEGORY_RENDERBUFFER, getRenderbufferSizeBytes(rb));
+
   CHECK_GL_ERROR();
 }
 
 void deleteRenderbuffer(Renderbuffer &rb) noexcept {
   if (rb.id > 0) {
+    trackMemoryDeallocation(MEMORY_CATEGORY_RENDERBUFFER, getRenderbufferSizeBytes(rb));
     glDeleteRenderbuffers(1, &rb.id);
     rb.id = 0;
   }
@@ -474,10 +681,11 @@ Framebuffer createFramebuffer(int width, int height, const std::vector<Framebuff
 }
 
 void createFramebuffer(Framebuffer &fb, int width, int height, const std::vector<FramebufferTextureAttachment> &texture_attachments, const std::vector<FramebufferRenderbufferAttachment> &renderbuffer_attachments) {
-  deleteFramebuffer(fb);
+  deleteFramebufferDeferred(fb);
 
   fb.width = width;
   fb.height = height;
+  fb.layer_count = 1;
 
   glGenFramebuffers(1, &fb.id);
   glBindFramebuffer(GL_FRAMEBUFFER, fb.id);
@@ -515,6 +723,49 @@ void createFramebuffer(Framebuffer &fb, int width, int height, const std::vector
   CHECK_GL_ERROR();
 }
 
+void createLayeredFramebuffer(Framebuffer &fb, int width, int height, int layer_count, const std::vector<FramebufferTextureAttachment> &texture_attachments) {
+  deleteFramebufferDeferred(fb);
+
+  fb.width = width;
+  fb.height = height;
+  fb.layer_count = layer_count;
+
+  fb.textures.clear();
+  fb.textures.reserve(texture_attachments.size());
+
+  fb.buffers.clear();
+  fb.buffers.reserve(texture_attachments.size());
+
+  for (const auto &ta : texture_attachments) {
+    fb.buffers.emplace_back(ta.attachment);
+    fb.textures.emplace_back();
+    createTextureArray(fb.textures.back(), width, height, layer_count, ta.opts);
+  }
+
+  fb.renderbuffers.clear();
+  fb.layer_ids.assign(layer_count - 1, 0);
+
+  for (int layer = 0; layer < layer_count; ++layer) {
+    GLuint &id = layer == 0 ? fb.id : fb.layer_ids[layer - 1];
+    glGenFramebuffers(1, &id);
+    glBindFramebuffer(GL_FRAMEBUFFER, id);
+
+    for (std::size_t i = 0; i < fb.textures.size(); ++i) {
+      glFramebufferTextureLayer(GL_FRAMEBUFFER, fb.buffers[i], fb.textures[i].id, 0, layer);
+    }
+
+    auto status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+      logError(getFramebufferStatusString(status));
+      assert(0);
+    }
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  CHECK_GL_ERROR();
+}
+
 void deleteFramebuffer(Framebuffer &fb) noexcept {
   for (auto &tex : fb.textures) {
     deleteTexture(tex);
@@ -528,6 +779,352 @@ void deleteFramebuffer(Framebuffer &fb) noexcept {
     glDeleteFramebuffers(1, &fb.id);
     fb.id = 0;
   }
+
+  if (!fb.layer_ids.empty()) {
+    glDeleteFramebuffers(fb.layer_ids.size(), fb.layer_ids.data());
+    fb.layer_ids.clear();
+  }
+}
+
+void readFramebufferTexture(const Framebuffer &fb, std::size_t index, void *pixels) {
+  assert(index < fb.textures.size());
+
+  const auto &tex = fb.textures[index];
+
+  glBindFramebuffer(GL_FRAMEBUFFER, fb.id);
+  glReadBuffer(fb.buffers[index]);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, tex.width, tex.height, tex.opts.format, tex.opts.component_type, pixels);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  CHECK_GL_ERROR();
+}
+
+
+void createPixelBuffer(PixelBuffer &pb, std::size_t size_bytes, GLenum usage) {
+  deletePixelBufferDeferred(pb);
+
+  pb.size_bytes = size_bytes;
+
+  glGenBuffers(1, &pb.id);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pb.id);
+  glBufferData(GL_PIXEL_PACK_BUFFER, size_bytes, nullptr, usage);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  trackMemoryAllocation(MEMORY_CATEGORY_PIXEL_BUFFER, pb.size_bytes);
+
+  CHECK_GL_ERROR();
+}
+
+void deletePixelBuffer(PixelBuffer &pb) noexcept {
+  if (pb.id > 0) {
+    trackMemoryDeallocation(MEMORY_CATEGORY_PIXEL_BUFFER, pb.size_bytes);
+    glDeleteBuffers(1, &pb.id);
+    pb.id = 0;
+  }
+  pb.size_bytes = 0;
+}
+
+void readPixelsToBuffer(PixelBuffer &pb, std::size_t offset_bytes, int x, int y, int width, int height, GLenum format, GLenum type) {
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pb.id);
+  glReadPixels(x, y, width, height, format, type, reinterpret_cast<void *>(offset_bytes));
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  CHECK_GL_ERROR();
+}
+
+void getPixelBufferData(PixelBuffer &pb, std::size_t offset_bytes, std::size_t size_bytes, void *data) {
+  assert(offset_bytes + size_bytes <= pb.size_bytes);
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pb.id);
+#if defined(PLATFORM_EMSCRIPTEN)
+  glGetBufferSubData(GL_PIXEL_PACK_BUFFER, offset_bytes, size_bytes, data);
+#else
+  const auto mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, offset_bytes, size_bytes, GL_MAP_READ_BIT);
+  if (mapped) {
+    std::memcpy(data, mapped, size_bytes);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+#endif
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  CHECK_GL_ERROR();
+}
+
+void setPixelBufferData(PixelBuffer &pb, std::size_t offset_bytes, std::size_t size_bytes, const void *data) {
+  assert(offset_bytes + size_bytes <= pb.size_bytes);
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pb.id);
+  glBufferSubData(GL_PIXEL_UNPACK_BUFFER, offset_bytes, size_bytes, data);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  CHECK_GL_ERROR();
+}
+
+void updateTextureFromBuffer(const Texture &tex, PixelBuffer &pb, std::size_t offset_bytes, int x, int y, int width, int height) {
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pb.id);
+  glBindTexture(tex.opts.target, tex.id);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(tex.opts.target, 0, x, y, width, height, tex.opts.format, tex.opts.component_type, reinterpret_cast<const void *>(offset_bytes));
+  glBindTexture(tex.opts.target, 0);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  CHECK_GL_ERROR();
+}
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+const void *mapPixelBuffer(PixelBuffer &pb, std::size_t offset_bytes, std::size_t size_bytes) {
+  assert(offset_bytes + size_bytes <= pb.size_bytes);
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pb.id);
+  const auto mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, offset_bytes, size_bytes, GL_MAP_READ_BIT);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  CHECK_GL_ERROR();
+
+  return mapped;
+}
+
+void unmapPixelBuffer(PixelBuffer &pb) {
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pb.id);
+  glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+#endif
+
+
+void createFence(Fence &fence) {
+  deleteFence(fence);
+
+  fence.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool isFenceSignaled(const Fence &fence) {
+  if (!fence.sync) return true;
+
+  GLint status = GL_UNSIGNALED;
+  glGetSynciv(fence.sync, GL_SYNC_STATUS, 1, nullptr, &status);
+  return status == GL_SIGNALED;
+}
+
+GLenum waitFence(const Fence &fence, GLuint64 timeout_ns) {
+  if (!fence.sync) return GL_ALREADY_SIGNALED;
+
+#if defined(PLATFORM_EMSCRIPTEN)
+  // WebGL can't block on a fence (its max client wait timeout is 0), so this only polls
+  (void)timeout_ns;
+  return isFenceSignaled(fence) ? GL_ALREADY_SIGNALED : GL_TIMEOUT_EXPIRED;
+#else
+  return glClientWaitSync(fence.sync, GL_SYNC_FLUSH_COMMANDS_BIT, timeout_ns);
+#endif
+}
+
+void deleteFence(Fence &fence) noexcept {
+  if (fence.sync) {
+    glDeleteSync(fence.sync);
+    fence.sync = nullptr;
+  }
+}
+
+
+enum DeferredObjectType {
+  DEFERRED_OBJECT_PROGRAM,
+  DEFERRED_OBJECT_TEXTURE,
+  DEFERRED_OBJECT_RENDERBUFFER,
+  DEFERRED_OBJECT_FRAMEBUFFER,
+  DEFERRED_OBJECT_BUFFER
+};
+
+struct DeferredObject {
+  DeferredObjectType type;
+  GLuint id;
+
+  MemoryCategory category;
+  std::size_t size_bytes; // Still counted as live until actually deleted
+
+  bool recycle; // Streaming buffers are reused instead of deleted
+};
+
+struct DeferredObjectBatch {
+  Fence fence;
+  std::vector<DeferredObject> objects;
+};
+
+static std::vector<DeferredObject> s_unfenced_deferred_objects;
+static std::vector<DeferredObjectBatch> s_deferred_object_batches;
+static std::vector<DeferredObject> s_recycled_uniform_buffers;
+
+static void deferObject(DeferredObjectType type, GLuint id, MemoryCategory category, std::size_t size_bytes, bool recycle = false) {
+  s_unfenced_deferred_objects.push_back({ type, id, category, size_bytes, recycle });
+}
+
+static void deleteDeferredObject(const DeferredObject &obj) {
+  switch (obj.type) {
+    case DEFERRED_OBJECT_PROGRAM: glDeleteProgram(obj.id); return;
+    case DEFERRED_OBJECT_TEXTURE: glDeleteTextures(1, &obj.id); break;
+    case DEFERRED_OBJECT_RENDERBUFFER: glDeleteRenderbuffers(1, &obj.id); break;
+    case DEFERRED_OBJECT_FRAMEBUFFER: glDeleteFramebuffers(1, &obj.id); return;
+    case DEFERRED_OBJECT_BUFFER: glDeleteBuffers(1, &obj.id); break;
+  }
+  trackMemoryDeallocation(obj.category, obj.size_bytes);
+}
+
+void deleteProgramDeferred(Program &prog) noexcept {
+  if (prog.id) {
+    deferObject(DEFERRED_OBJECT_PROGRAM, prog.id, MEMORY_CATEGORY_COUNT, 0);
+
+    prog.id = 0;
+    prog.uniforms.clear();
+    prog.attributes.clear();
+  }
+}
+
+void deleteTextureDeferred(Texture &tex) noexcept {
+  if (tex.id > 0) {
+    deferObject(DEFERRED_OBJECT_TEXTURE, tex.id, MEMORY_CATEGORY_TEXTURE, getTextureSizeBytes(tex));
+    tex.id = 0;
+  }
+}
+
+void deleteRenderbufferDeferred(Renderbuffer &rb) noexcept {
+  if (rb.id > 0) {
+    deferObject(DEFERRED_OBJECT_RENDERBUFFER, rb.id, MEMORY_CATEGORY_RENDERBUFFER, getRenderbufferSizeBytes(rb));
+    rb.id = 0;
+  }
+}
+
+void deleteFramebufferDeferred(Framebuffer &fb) noexcept {
+  for (auto &tex : fb.textures) {
+    deleteTextureDeferred(tex);
+  }
+
+  for (auto &rb : fb.renderbuffers) {
+    deleteRenderbufferDeferred(rb);
+  }
+
+  if (fb.id > 0) {
+    deferObject(DEFERRED_OBJECT_FRAMEBUFFER, fb.id, MEMORY_CATEGORY_COUNT, 0);
+    fb.id = 0;
+  }
+
+  for (auto layer_id : fb.layer_ids) {
+    deferObject(DEFERRED_OBJECT_FRAMEBUFFER, layer_id, MEMORY_CATEGORY_COUNT, 0);
+  }
+  fb.layer_ids.clear();
+}
+
+void deleteUniformBufferDeferred(UniformBuffer &ub) noexcept {
+  if (ub.id) {
+    deferObject(DEFERRED_OBJECT_BUFFER, ub.id, MEMORY_CATEGORY_UNIFORM_BUFFER, ub.size_bytes);
+    ub.id = 0;
+  }
+}
+
+void deletePixelBufferDeferred(PixelBuffer &pb) noexcept {
+  if (pb.id > 0) {
+    deferObject(DEFERRED_OBJECT_BUFFER, pb.id, MEMORY_CATEGORY_PIXEL_BUFFER, pb.size_bytes);
+    pb.id = 0;
+  }
+  pb.size_bytes = 0;
+}
+
+void streamUniformBuffer(UniformBuffer &ub, std::size_t uniform_data_size_bytes, const void *data) {
+  // Retire the current buffer rather than writing into it while earlier draws may still read it
+  if (ub.id) {
+    deferObject(DEFERRED_OBJECT_BUFFER, ub.id, MEMORY_CATEGORY_UNIFORM_BUFFER, ub.size_bytes, true);
+    ub.id = 0;
+  }
+
+  auto it = std::find_if(s_recycled_uniform_buffers.begin(), s_recycled_uniform_buffers.end(), [&](const DeferredObject &obj) {
+    return obj.size_bytes == uniform_data_size_bytes;
+  });
+
+  if (it != s_recycled_uniform_buffers.end()) {
+    ub.id = it->id;
+    ub.size_bytes = it->size_bytes;
+    s_recycled_uniform_buffers.erase(it);
+
+    glBindBuffer(GL_UNIFORM_BUFFER, ub.id);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, uniform_data_size_bytes, data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    CHECK_GL_ERROR();
+  } else {
+    createUniformBuffer(ub, uniform_data_size_bytes, data, GL_STREAM_DRAW);
+  }
+}
+
+void fenceDeferredDeletions() {
+  if (s_unfenced_deferred_objects.empty()) {
+    return;
+  }
+
+  s_deferred_object_batches.emplace_back();
+  auto &batch = s_deferred_object_batches.back();
+  createFence(batch.fence);
+  batch.objects.swap(s_unfenced_deferred_objects);
+}
+
+void collectDeferredDeletions() {
+  // Fences signal in submission order, so stop at the first batch still in flight
+  auto batch_it = s_deferred_object_batches.begin();
+  for (; batch_it != s_deferred_object_batches.end() && isFenceSignaled(batch_it->fence); ++batch_it) {
+    for (const auto &obj : batch_it->objects) {
+      if (obj.recycle) {
+        s_recycled_uniform_buffers.push_back(obj);
+      } else {
+        deleteDeferredObject(obj);
+      }
+    }
+  }
+  s_deferred_object_batches.erase(s_deferred_object_batches.begin(), batch_it);
+}
+
+void flushDeferredDeletions() {
+  fenceDeferredDeletions();
+
+  for (const auto &batch : s_deferred_object_batches) {
+    for (const auto &obj : batch.objects) {
+      deleteDeferredObject(obj);
+    }
+  }
+  s_deferred_object_batches.clear();
+
+  for (const auto &obj : s_recycled_uniform_buffers) {
+    deleteDeferredObject(obj);
+  }
+  s_recycled_uniform_buffers.clear();
+}
+
+bool hasExtension(std::string_view name) {
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+  for (GLint i = 0; i < count; ++i) {
+    const auto ext = std::string_view(reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i)));
+
+    // Emscripten reports WebGL extensions with a "GL_" prefix.
+    if (ext == name || (ext.size() == name.size() + 3 && ext.substr(0, 3) == "GL_" && ext.substr(3) == name)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void multiDrawArrays(GLenum mode, const GLint *firsts, const GLsizei *counts, GLsizei draw_count) {
+#if defined(PLATFORM_EMSCRIPTEN) && defined(GL_WEBGL_multi_draw)
+  static const bool has_multi_draw = hasExtension("WEBGL_multi_draw");
+  if (has_multi_draw) {
+    glMultiDrawArraysWEBGL(mode, firsts, counts, draw_count);
+    return;
+  }
+#endif
+
+  for (GLsizei i = 0; i < draw_count; ++i) {
+    glDrawArrays(mode, firsts[i], counts[i]);
+  }
 }
 
 
@@ -536,6 +1133,12 @@ void bindFramebuffer(const Framebuffer &fb) {
   glDrawBuffers(fb.buffers.size(), fb.buffers.data());
 }
 
+void bindFramebuffer(const Framebuffer &fb, int layer) {
+  assert(layer >= 0 && layer < fb.layer_count);
+  glBindFramebuffer(GL_FRAMEBUFFER, layer == 0 ? fb.id : fb.layer_ids[layer - 1]);
+  glDrawBuffers(fb.buffers.size(), fb.buffers.data());
+}
+
 
 Program::Program(Program &&prog) noexcept
 : uniforms(std::move(prog.uniforms)), attributes(std::move(prog.attributes)) {
@@ -546,7 +1149,7 @@ Program::Program(Program &&prog) noexcept
 
 Program &Program::operator=(Program &&prog) noexcept {
   if (this != &prog) {
-    deleteProgram(*this);
+    deleteProgramDeferred(*this);
     id = prog.id;
 
     uniforms = std::move(prog.uniforms);
@@ -563,16 +1166,16 @@ Program::~Program() noexcept {
 
 
 UniformBuffer::UniformBuffer(UniformBuffer &&ub) noexcept
-: id(std::move(ub.id)) {
-  deleteUniformBuffer(*this);
+: size_bytes(std::move(ub.size_bytes)) {
   id = ub.id;
   ub.id = 0;
 }
 
 UniformBuffer &UniformBuffer::operator=(UniformBuffer &&ub) noexcept {
   if (this != &ub) {
-    deleteUniformBuffer(*this);
+    deleteUniformBufferDeferred(*this);
     id = ub.id;
+    size_bytes = std::move(ub.size_bytes);
     ub.id = 0;
   }
   return *this;
@@ -584,7 +1187,7 @@ UniformBuffer::~UniformBuffer() noexcept {
 
 
 Texture::Texture(Texture &&tex) noexcept
-: width(std::move(tex.width)), height(std::move(tex.height)), opts(std::move(tex.opts)) {
+: width(std::move(tex.width)), height(std::move(tex.height)), depth(std::move(tex.depth)), opts(std::move(tex.opts)) {
   deleteTexture(*this);
   id = tex.id;
   tex.id = 0;
@@ -592,11 +1195,12 @@ Texture::Texture(Texture &&tex) noexcept
 
 Texture &Texture::operator=(Texture &&tex) noexcept {
   if (this != &tex) {
-    deleteTexture(*this);
+    deleteTextureDeferred(*this);
     id = tex.id;
 
     width = std::move(tex.width);
     height = std::move(tex.height);
+    depth = std::move(tex.depth);
     opts = std::move(tex.opts);
 
     tex.id = 0;
@@ -610,7 +1214,7 @@ Texture::~Texture() noexcept {
 
 
 Renderbuffer::Renderbuffer(Renderbuffer &&rb) noexcept
-: width(std::move(rb.width)), height(std::move(rb.height)) {
+: width(std::move(rb.width)), height(std::move(rb.height)), opts(std::move(rb.opts)) {
   deleteRenderbuffer(*this);
   id = rb.id;
   rb.id = 0;
@@ -618,11 +1222,12 @@ Renderbuffer::Renderbuffer(Renderbuffer &&rb) noexcept
 
 Renderbuffer &Renderbuffer::operator=(Renderbuffer &&rb) noexcept {
   if (this != &rb) {
-    deleteRenderbuffer(*this);
+    deleteRenderbufferDeferred(*this);
     id = rb.id;
 
     width = std::move(rb.width);
     height = std::move(rb.height);
+    opts = std::move(rb.opts);
 
     rb.id = 0;
   }
@@ -635,19 +1240,20 @@ Renderbuffer::~Renderbuffer() noexcept {
 
 
 Framebuffer::Framebuffer(Framebuffer &&fb) noexcept
-: width(std::move(fb.width)), height(std::move(fb.height)), buffers(std::move(fb.buffers)) {
+: width(std::move(fb.width)), height(std::move(fb.height)), buffers(std::move(fb.buffers)), layer_count(fb.layer_count) {
   deleteFramebuffer(*this);
   id = fb.id;
 
   textures = std::move(fb.textures);
   renderbuffers = std::move(fb.renderbuffers);
+  layer_ids = std::move(fb.layer_ids);
 
   fb.id = 0;
 }
 
 Framebuffer &Framebuffer::operator=(Framebuffer &&fb) noexcept {
   if (this != &fb) {
-    deleteFramebuffer(*this);
+    deleteFramebufferDeferred(*this);
     id = fb.id;
 
     width = std::move(fb.width);
@@ -655,6 +1261,8 @@ Framebuffer &Framebuffer::operator=(Framebuffer &&fb) noexcept {
     textures = std::move(fb.textures);
     renderbuffers = std::move(fb.renderbuffers);
     buffers = std::move(fb.buffers);
+    layer_count = fb.layer_count;
+    layer_ids = std::move(fb.layer_ids);
 
     fb.id = 0;
   }
@@ -666,4 +1274,45 @@ Framebuffer::~Framebuffer() noexcept {
 }
 
 
+PixelBuffer::PixelBuffer(PixelBuffer &&pb) noexcept
+: id(pb.id), size_bytes(pb.size_bytes) {
+  pb.id = 0;
+  pb.size_bytes = 0;
+}
+
+PixelBuffer &PixelBuffer::operator=(PixelBuffer &&pb) noexcept {
+  if (this != &pb) {
+    deletePixelBufferDeferred(*this);
+    id = pb.id;
+    size_bytes = pb.size_bytes;
+    pb.id = 0;
+    pb.size_bytes = 0;
+  }
+  return *this;
+}
+
+PixelBuffer::~PixelBuffer() noexcept {
+  deletePixelBuffer(*this);
+}
+
+
+Fence::Fence(Fence &&fence) noexcept
+: sync(fence.sync) {
+  fence.sync = nullptr;
+}
+
+Fence &Fence::operator=(Fence &&fence) noexcept {
+  if (this != &fence) {
+    deleteFence(*this);
+    sync = fence.sync;
+    fence.sync = nullptr;
+  }
+  return *this;
+}
+
+Fence::~Fence() noexcept {
+  deleteFence(*this);
+}
+
+
 } // gl
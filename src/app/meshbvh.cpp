@@ -0,0 +1,332 @@
+#include "app/meshbvh.hpp"
+
+#include "app/log.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+static constexpr int MESH_BVH_BIN_COUNT{ 16 };
+static constexpr uint32_t MESH_BVH_MAX_LEAF_SIZE{ 8 };
+static constexpr int MESH_BVH_MAX_DEPTH{ 64 };
+static constexpr float MESH_BVH_TRAVERSAL_COST{ 1.0f }; // Relative to one triangle test
+
+static constexpr uint32_t MESH_BVH_MIN_SUBTREE_SIZE{ 4096 }; // Smaller subtrees aren't worth a task of their own
+static constexpr std::size_t MESH_BVH_BIN_TASK_SIZE{ 65536 };
+
+static constexpr uint32_t MESH_BVH_MAX_TRIANGLE_COUNT{ 1u << 24 }; // Indices stay exact in float texels
+
+struct MeshBvhTriangleRef {
+  gl::vec3 bounds_min;
+  gl::vec3 bounds_max;
+  gl::vec3 centroid;
+  uint32_t triangle;
+};
+
+struct MeshBvhBounds {
+  gl::vec3 min{ FLT_MAX };
+  gl::vec3 max{ -FLT_MAX };
+
+  void grow(const gl::vec3 &p) {
+    min = gl::min(min, p);
+    max = gl::max(max, p);
+  }
+  void grow(const MeshBvhBounds &b) {
+    min = gl::min(min, b.min);
+    max = gl::max(max, b.max);
+  }
+};
+
+struct MeshBvhBin {
+  MeshBvhBounds bounds;
+  uint32_t count = 0;
+};
+
+struct MeshBvhBins {
+  MeshBvhBin axes[3][MESH_BVH_BIN_COUNT];
+};
+
+struct MeshBvhBuildNode {
+  MeshBvhBounds bounds;
+  uint32_t first = 0, count = 0;   // Leaves: range of triangle refs
+  uint32_t children[2]{ 0, 0 };    // Inner nodes: indices in the same node list
+  int subtree = -1;                // Stands in for the root of a subtree built as its own task
+};
+
+struct MeshBvhBuilder {
+  ThreadPool *pool;
+  std::vector<MeshBvhTriangleRef> refs;
+
+  int subtree_depth; // Depth at which the top levels hand off to subtree tasks
+  std::vector<uint32_t> subtree_ranges; // first, count pairs
+  std::vector<std::vector<MeshBvhBuildNode>> subtrees;
+};
+
+static float halfSurfaceArea(const MeshBvhBounds &b) {
+  const auto e = gl::max(b.max - b.min, gl::vec3(0.0f));
+  return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+static int calcBinIndex(float centroid, float centroid_min, float bin_scale) {
+  return std::min(int((centroid - centroid_min) * bin_scale), MESH_BVH_BIN_COUNT - 1);
+}
+
+static void boundTriangleRefs(const MeshBvhTriangleRef *refs, uint32_t count, MeshBvhBounds &bounds, MeshBvhBounds &centroid_bounds) {
+  for (uint32_t i = 0; i < count; ++i) {
+    bounds.min = gl::min(bounds.min, refs[i].bounds_min);
+    bounds.max = gl::max(bounds.max, refs[i].bounds_max);
+    centroid_bounds.grow(refs[i].centroid);
+  }
+}
+
+static void binTriangleRefs(const MeshBvhTriangleRef *refs,
+                            uint32_t count,
+                            const MeshBvhBounds &centroid_bounds,
+                            const gl::vec3 &bin_scale,
+                            MeshBvhBins &bins) {
+  for (uint32_t i = 0; i < count; ++i) {
+    for (int axis = 0; axis < 3; ++axis) {
+      auto &bin = bins.axes[axis][calcBinIndex(refs[i].centroid[axis], centroid_bounds.min[axis], bin_scale[axis])];
+      bin.bounds.min = gl::min(bin.bounds.min, refs[i].bounds_min);
+      bin.bounds.max = gl::max(bin.bounds.max, refs[i].bounds_max);
+      ++bin.count;
+    }
+  }
+}
+
+// Finds the cheapest plane between bins by the surface area heuristic. Returns the children's summed area
+// times triangle count, or FLT_MAX when no plane leaves triangles on both sides.
+static float findSahSplit(const MeshBvhBins &bins, const gl::vec3 &bin_scale, int &out_axis, int &out_bin) {
+  float best_cost = FLT_MAX;
+
+  for (int axis = 0; axis < 3; ++axis) {
+    if (bin_scale[axis] <= 0.0f) {
+      continue;
+    }
+
+    // Sweep from the right first so the left sweep can price each plane as it goes
+    float right_costs[MESH_BVH_BIN_COUNT];
+    MeshBvhBounds right;
+    uint32_t right_count = 0;
+    for (int i = MESH_BVH_BIN_COUNT - 1; i > 0; --i) {
+      right.grow(bins.axes[axis][i].bounds);
+      right_count += bins.axes[axis][i].count;
+      right_costs[i] = right_count > 0 ? halfSurfaceArea(right) * float(right_count) : -1.0f;
+    }
+
+    MeshBvhBounds left;
+    uint32_t left_count = 0;
+    for (int i = 1; i < MESH_BVH_BIN_COUNT; ++i) {
+      left.grow(bins.axes[axis][i - 1].bounds);
+      left_count += bins.axes[axis][i - 1].count;
+      if (left_count == 0 || right_costs[i] < 0.0f) {
+        continue;
+      }
+
+      const float cost = halfSurfaceArea(left) * float(left_count) + right_costs[i];
+      if (cost < best_cost) {
+        best_cost = cost;
+        out_axis = axis;
+        out_bin = i;
+      }
+    }
+  }
+
+  return best_cost;
+}
+
+static uint32_t buildMeshBvhNode(MeshBvhBuilder &builder,
+                                 std::vector<MeshBvhBuildNode> &nodes,
+                                 uint32_t first,
+                                 uint32_t count,
+                                 int depth,
+                                 bool top_level) {
+  const auto index = uint32_t(nodes.size());
+  nodes.emplace_back();
+
+  MeshBvhTriangleRef *refs = builder.refs.data() + first;
+  const bool parallel = top_level && count > MESH_BVH_BIN_TASK_SIZE;
+
+  // Near the root every pass touches most of the mesh, so bounds and bins are gathered in parallel there
+  MeshBvhBounds bounds, centroid_bounds;
+  if (parallel) {
+    const std::size_t task_count = (count + MESH_BVH_BIN_TASK_SIZE - 1) / MESH_BVH_BIN_TASK_SIZE;
+    std::vector<MeshBvhBounds> task_bounds(task_count), task_centroid_bounds(task_count);
+    builder.pool->parallelFor(count, MESH_BVH_BIN_TASK_SIZE, [&](std::size_t begin, std::size_t end) {
+      const std::size_t task = begin / MESH_BVH_BIN_TASK_SIZE;
+      boundTriangleRefs(refs + begin, uint32_t(end - begin), task_bounds[task], task_centroid_bounds[task]);
+    });
+    for (std::size_t i = 0; i < task_count; ++i) {
+      bounds.grow(task_bounds[i]);
+      centroid_bounds.grow(task_centroid_bounds[i]);
+    }
+  }
+  else {
+    boundTriangleRefs(refs, count, bounds, centroid_bounds);
+  }
+  nodes[index].bounds = bounds;
+
+  if (top_level && depth >= builder.subtree_depth && count > MESH_BVH_MIN_SUBTREE_SIZE) {
+    nodes[index].subtree = int(builder.subtrees.size());
+    builder.subtrees.emplace_back();
+    builder.subtree_ranges.push_back(first);
+    builder.subtree_ranges.push_back(count);
+    return index;
+  }
+
+  gl::vec3 bin_scale;
+  for (int axis = 0; axis < 3; ++axis) {
+    const float extent = centroid_bounds.max[axis] - centroid_bounds.min[axis];
+    bin_scale[axis] = extent > 0.0f ? float(MESH_BVH_BIN_COUNT) / extent : 0.0f;
+  }
+
+  int split_axis = 0, split_bin = 0;
+  float split_cost = FLT_MAX;
+  if (count > 1 && depth < MESH_BVH_MAX_DEPTH - 1) {
+    MeshBvhBins bins;
+    if (parallel) {
+      std::vector<MeshBvhBins> task_bins((count + MESH_BVH_BIN_TASK_SIZE - 1) / MESH_BVH_BIN_TASK_SIZE);
+      builder.pool->parallelFor(count, MESH_BVH_BIN_TASK_SIZE, [&](std::size_t begin, std::size_t end) {
+        binTriangleRefs(refs + begin, uint32_t(end - begin), centroid_bounds, bin_scale, task_bins[begin / MESH_BVH_BIN_TASK_SIZE]);
+      });
+      for (const auto &task : task_bins) {
+        for (int axis = 0; axis < 3; ++axis) {
+          for (int i = 0; i < MESH_BVH_BIN_COUNT; ++i) {
+            bins.axes[axis][i].bounds.grow(task.axes[axis][i].bounds);
+            bins.axes[axis][i].count += task.axes[axis][i].count;
+          }
+        }
+      }
+    }
+    else {
+      binTriangleRefs(refs, count, centroid_bounds, bin_scale, bins);
+    }
+
+    split_cost = findSahSplit(bins, bin_scale, split_axis, split_bin);
+  }
+
+  // Both costs are scaled by this node's half area, which leaves the comparison unchanged
+  const float leaf_cost = float(count) * halfSurfaceArea(bounds);
+  const float inner_cost = MESH_BVH_TRAVERSAL_COST * halfSurfaceArea(bounds) + split_cost;
+  const bool can_leaf = count <= MESH_BVH_MAX_LEAF_SIZE || depth >= MESH_BVH_MAX_DEPTH - 1;
+
+  uint32_t middle;
+  if (split_cost == FLT_MAX || (can_leaf && leaf_cost <= inner_cost)) {
+    if (can_leaf) {
+      nodes[index].first = first;
+      nodes[index].count = count;
+      return index;
+    }
+    // Every centroid is in the same spot, so any split is as good as another
+    middle = count / 2;
+  }
+  else {
+    const float centroid_min = centroid_bounds.min[split_axis];
+    const float scale = bin_scale[split_axis];
+    middle = uint32_t(std::partition(refs, refs + count, [&](const MeshBvhTriangleRef &ref) {
+                        return calcBinIndex(ref.centroid[split_axis], centroid_min, scale) < split_bin;
+                      }) - refs);
+  }
+
+  const uint32_t left = buildMeshBvhNode(builder, nodes, first, middle, depth + 1, top_level);
+  const uint32_t right = buildMeshBvhNode(builder, nodes, first + middle, count - middle, depth + 1, top_level);
+  nodes[index].children[0] = left;
+  nodes[index].children[1] = right;
+  return index;
+}
+
+static void flattenMeshBvhNode(const MeshBvhBuilder &builder,
+                               const gl::DefaultTriangleMesh &mesh,
+                               const std::vector<MeshBvhBuildNode> &nodes,
+                               uint32_t index,
+                               MeshBvh &out_bvh) {
+  const auto &node = nodes[index];
+  if (node.subtree >= 0) {
+    flattenMeshBvhNode(builder, mesh, builder.subtrees[node.subtree], 0, out_bvh);
+    return;
+  }
+
+  const uint32_t flat_index = out_bvh.node_count++;
+  out_bvh.nodes.emplace_back(node.bounds.min, 0.0f);
+  out_bvh.nodes.emplace_back(node.bounds.max, -1.0f);
+
+  if (node.count > 0) {
+    out_bvh.nodes[flat_index * 2 + 1].w = float(out_bvh.triangle_count);
+
+    for (uint32_t i = 0; i < node.count; ++i) {
+      const auto &v = mesh.triangles[builder.refs[node.first + i].triangle].vertices;
+      out_bvh.triangles.emplace_back(v[0].position, i + 1 == node.count ? 1.0f : 0.0f);
+      out_bvh.triangles.emplace_back(v[1].position - v[0].position, 0.0f);
+      out_bvh.triangles.emplace_back(v[2].position - v[0].position, 0.0f);
+    }
+    out_bvh.triangle_count += node.count;
+  }
+  else {
+    // The stackless order is the same for every ray, so the bigger child goes first. It's the more likely to be
+    // hit, and an early hit there shortens the segment that the other child's box is tested against.
+    const auto *a = &nodes[node.children[0]], *b = &nodes[node.children[1]];
+    const bool swap = halfSurfaceArea(b->bounds) > halfSurfaceArea(a->bounds);
+    flattenMeshBvhNode(builder, mesh, nodes, node.children[swap ? 1 : 0], out_bvh);
+    flattenMeshBvhNode(builder, mesh, nodes, node.children[swap ? 0 : 1], out_bvh);
+  }
+
+  out_bvh.nodes[flat_index * 2].w = float(out_bvh.node_count);
+}
+
+bool buildMeshBvh(const gl::DefaultTriangleMesh &mesh, ThreadPool &pool, MeshBvh &out_bvh) {
+  const std::size_t triangle_count = mesh.triangles.size();
+  if (triangle_count == 0) {
+    PRINT_ERROR("Can't build a BVH over a mesh without triangles\n");
+    return false;
+  }
+  if (triangle_count > MESH_BVH_MAX_TRIANGLE_COUNT) {
+    PRINT_ERROR("Can't build a BVH over %zu triangles, the limit is %u\n", triangle_count, MESH_BVH_MAX_TRIANGLE_COUNT);
+    return false;
+  }
+
+  MeshBvhBuilder builder;
+  builder.pool = &pool;
+  builder.refs.resize(triangle_count);
+
+  pool.parallelFor(triangle_count, MESH_BVH_BIN_TASK_SIZE, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+      const auto &v = mesh.triangles[i].vertices;
+      auto &ref = builder.refs[i];
+      ref.bounds_min = gl::min(v[0].position, gl::min(v[1].position, v[2].position));
+      ref.bounds_max = gl::max(v[0].position, gl::max(v[1].position, v[2].position));
+      ref.centroid = (ref.bounds_min + ref.bounds_max) * 0.5f;
+      ref.triangle = uint32_t(i);
+    }
+  });
+
+  // Enough subtrees to keep every thread busy when they come out uneven
+  builder.subtree_depth = 0;
+  while ((std::size_t(1) << builder.subtree_depth) < (pool.getThreadCount() + 1) * 4) {
+    ++builder.subtree_depth;
+  }
+
+  std::vector<MeshBvhBuildNode> top_nodes;
+  buildMeshBvhNode(builder, top_nodes, 0, uint32_t(triangle_count), 0, true);
+
+  pool.parallelFor(builder.subtrees.size(), 1, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+      buildMeshBvhNode(builder, builder.subtrees[i], builder.subtree_ranges[i * 2], builder.subtree_ranges[i * 2 + 1], builder.subtree_depth, false);
+    }
+  });
+
+  out_bvh.nodes.clear();
+  out_bvh.triangles.clear();
+  out_bvh.node_count = 0;
+  out_bvh.triangle_count = 0;
+  out_bvh.triangles.reserve(triangle_count * 3);
+
+  flattenMeshBvhNode(builder, mesh, top_nodes, 0, out_bvh);
+
+  const auto padToRows = [](std::vector<gl::vec4> &texels) {
+    texels.resize((texels.size() + MESH_BVH_TEXTURE_WIDTH - 1) / MESH_BVH_TEXTURE_WIDTH * MESH_BVH_TEXTURE_WIDTH, gl::vec4(0.0f));
+  };
+  padToRows(out_bvh.nodes);
+  padToRows(out_bvh.triangles);
+
+  return true;
+}
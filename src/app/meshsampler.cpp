@@ -0,0 +1,263 @@
+#include "app/meshsampler.hpp"
+
+#include "app/log.hpp"
+#include "app/util.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// Sampling works on batches of this many samples, one step at a time across the batch, so that each step is a
+// short fixed-length loop over plain arrays that the compiler can vectorize.
+static constexpr std::size_t SAMPLE_BATCH_SIZE{ 8 };
+
+static inline uint32_t hashUint32(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
+}
+
+static inline float uint32ToUnitFloat(uint32_t x) {
+  return float(x >> 8) * (1.0f / 16777216.0f); // [0, 1)
+}
+
+bool MeshSurfaceSampler::build(const gl::DefaultTriangleMesh &mesh, ThreadPool &pool) {
+  const std::size_t triangle_count = mesh.triangles.size();
+
+  m_mesh = &mesh;
+  m_alias_probabilities.assign(triangle_count, 0.0f);
+  m_alias_indices.assign(triangle_count, 0);
+  m_surface_area = 0.0;
+
+  // Areas go into the probabilities for now. Each task also sums its own, so the total is independent of timing.
+  const std::size_t task_count = (triangle_count + TASK_SIZE - 1) / TASK_SIZE;
+  std::vector<double> task_areas(task_count, 0.0);
+
+  pool.parallelFor(triangle_count, TASK_SIZE, [&](std::size_t begin, std::size_t end) {
+    double area_sum = 0.0;
+    for (std::size_t i = begin; i < end; ++i) {
+      const auto &v = mesh.triangles[i].vertices;
+      const float area = 0.5f * gl::length(gl::cross(v[1].position - v[0].position, v[2].position - v[0].position));
+      m_alias_probabilities[i] = std::isfinite(area) ? area : 0.0f;
+      area_sum += m_alias_probabilities[i];
+    }
+    task_areas[begin / TASK_SIZE] = area_sum;
+  });
+
+  for (const auto area : task_areas) {
+    m_surface_area += area;
+  }
+
+  if (!(m_surface_area > 0.0)) {
+    PRINT_ERROR("Mesh has no surface area to sample\n");
+    m_mesh = nullptr;
+    return false;
+  }
+
+  // Vose's alias method. Scaled so the average bucket is 1, then every underfull bucket is topped up from an
+  // overfull one, which becomes its alias.
+  const double scale = double(triangle_count) / m_surface_area;
+
+  std::vector<uint32_t> small, large;
+  small.reserve(triangle_count);
+  large.reserve(triangle_count);
+
+  for (std::size_t i = 0; i < triangle_count; ++i) {
+    m_alias_probabilities[i] = float(m_alias_probabilities[i] * scale);
+    (m_alias_probabilities[i] < 1.0f ? small : large).push_back(uint32_t(i));
+  }
+
+  while (!small.empty() && !large.empty()) {
+    const uint32_t s = small.back();
+    small.pop_back();
+    const uint32_t l = large.back();
+
+    m_alias_indices[s] = l;
+    m_alias_probabilities[l] -= 1.0f - m_alias_probabilities[s];
+
+    if (m_alias_probabilities[l] < 1.0f) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+
+  // Whatever is left is full up to rounding error
+  for (const auto i : small) {
+    m_alias_probabilities[i] = 1.0f;
+  }
+  for (const auto i : large) {
+    m_alias_probabilities[i] = 1.0f;
+  }
+
+  return true;
+}
+
+void MeshSurfaceSampler::sample(std::size_t count, uint32_t seed, ThreadPool &pool, MeshSurfaceSamples &out_samples) const {
+  assert(m_mesh);
+
+  out_samples.positions.resize(count);
+  out_samples.texcoords.resize(count);
+  out_samples.normals.resize(count);
+
+  const auto &triangles = m_mesh->triangles;
+  const uint32_t triangle_count = uint32_t(triangles.size());
+  const float *probabilities = m_alias_probabilities.data();
+  const uint32_t *aliases = m_alias_indices.data();
+  const uint32_t seed_key = hashUint32(seed * 0x9e3779b9u + 1u);
+
+  pool.parallelFor(count, TASK_SIZE, [&](std::size_t begin, std::size_t end) {
+    uint32_t bucket[SAMPLE_BATCH_SIZE], triangle[SAMPLE_BATCH_SIZE];
+    float coin[SAMPLE_BATCH_SIZE], b1[SAMPLE_BATCH_SIZE], b2[SAMPLE_BATCH_SIZE];
+
+    for (std::size_t first = begin; first < end; first += SAMPLE_BATCH_SIZE) {
+      const std::size_t batch_size = std::min(SAMPLE_BATCH_SIZE, end - first);
+
+      for (std::size_t j = 0; j < SAMPLE_BATCH_SIZE; ++j) {
+        const uint32_t key = hashUint32(uint32_t(first + j) ^ seed_key);
+        bucket[j] = std::min(uint32_t(uint32ToUnitFloat(key) * float(triangle_count)), triangle_count - 1);
+        coin[j] = uint32ToUnitFloat(hashUint32(key + 1u));
+        b1[j] = uint32ToUnitFloat(hashUint32(key + 2u));
+        b2[j] = uint32ToUnitFloat(hashUint32(key + 3u));
+      }
+
+      for (std::size_t j = 0; j < SAMPLE_BATCH_SIZE; ++j) {
+        triangle[j] = coin[j] < probabilities[bucket[j]] ? bucket[j] : aliases[bucket[j]];
+      }
+
+      // Points past the diagonal of the unit square fold back into the triangle, keeping the density uniform
+      for (std::size_t j = 0; j < SAMPLE_BATCH_SIZE; ++j) {
+        const bool fold = b1[j] + b2[j] > 1.0f;
+        const float u = fold ? 1.0f - b1[j] : b1[j];
+        const float v = fold ? 1.0f - b2[j] : b2[j];
+        b1[j] = u;
+        b2[j] = v;
+      }
+
+      for (std::size_t j = 0; j < batch_size; ++j) {
+        const auto &v = triangles[triangle[j]].vertices;
+        const float b0 = 1.0f - b1[j] - b2[j];
+        const std::size_t index = first + j;
+
+        const auto position = b0 * v[0].position + b1[j] * v[1].position + b2[j] * v[2].position;
+        const auto texcoord = b0 * v[0].texcoord + b1[j] * v[1].texcoord + b2[j] * v[2].texcoord;
+        auto normal = b0 * v[0].normal + b1[j] * v[1].normal + b2[j] * v[2].normal;
+
+        // Meshes without vertex normals get the face normal
+        const float normal_length = gl::length(normal);
+        if (normal_length > 1e-6f) {
+          normal /= normal_length;
+        }
+        else {
+          normal = gl::normalize(gl::cross(v[1].position - v[0].position, v[2].position - v[0].position));
+        }
+
+        out_samples.positions[index] = gl::vec4(position, 1.0f);
+        out_samples.texcoords[index] = gl::vec4(texcoord, 0.0f, 1.0f);
+        out_samples.normals[index] = gl::vec4(normal, 0.0f);
+      }
+    }
+  });
+}
+
+uint64_t hashTriangleMesh(const gl::DefaultTriangleMesh &mesh, ThreadPool &pool) {
+  constexpr std::size_t task_size{ 65536 };
+
+  const std::size_t triangle_count = mesh.triangles.size();
+  std::vector<uint64_t> task_hashes((triangle_count + task_size - 1) / task_size);
+
+  pool.parallelFor(triangle_count, task_size, [&](std::size_t begin, std::size_t end) {
+    task_hashes[begin / task_size] = hashFnv1a64(mesh.triangles.data() + begin, (end - begin) * sizeof(mesh.triangles[0]));
+  });
+
+  uint64_t hash = hashFnv1a64(&triangle_count, sizeof(triangle_count));
+  return hashFnv1a64(task_hashes.data(), task_hashes.size() * sizeof(uint64_t), hash);
+}
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+
+// Mesh sample caches are this header followed by the positions, texcoords then normals of every sample.
+struct MeshSampleCacheHeader {
+  char magic[4];
+  uint32_t version;
+
+  uint64_t mesh_hash;
+  uint64_t sample_count;
+  uint32_t seed;
+
+  uint32_t _reserved[9];
+};
+
+static constexpr char MESH_SAMPLE_CACHE_MAGIC[4]{ 'P', 'S', 'T', 'M' };
+static constexpr uint32_t MESH_SAMPLE_CACHE_VERSION{ 1 };
+
+static_assert(sizeof(MeshSampleCacheHeader) == 64, "Sample data must stay aligned");
+
+bool writeMeshSampleCache(const char *path, const MeshSampleCacheKey &key, const MeshSurfaceSamples &samples) {
+  std::FILE *file = std::fopen(path, "wb");
+  if (file == nullptr) {
+    PRINT_ERROR("Failed to open mesh sample cache '%s' for writing\n", path);
+    return false;
+  }
+
+  MeshSampleCacheHeader header{};
+  std::memcpy(header.magic, MESH_SAMPLE_CACHE_MAGIC, sizeof(header.magic));
+  header.version = MESH_SAMPLE_CACHE_VERSION;
+  header.mesh_hash = key.mesh_hash;
+  header.sample_count = key.sample_count;
+  header.seed = key.seed;
+
+  const std::size_t count = samples.positions.size();
+  bool succeeded = count == key.sample_count && std::fwrite(&header, sizeof(header), 1, file) == 1;
+  for (const auto *attachment : { &samples.positions, &samples.texcoords, &samples.normals }) {
+    succeeded = succeeded && std::fwrite(attachment->data(), sizeof(gl::vec4), count, file) == count;
+  }
+
+  if (std::fclose(file) != 0 || !succeeded) {
+    PRINT_ERROR("Failed to write mesh sample cache '%s'\n", path);
+    std::remove(path);
+    return false;
+  }
+
+  return true;
+}
+
+bool openMeshSampleCache(MappedFile &file, const char *path, const MeshSampleCacheKey &key, const gl::vec4 *(&out_attachments)[3]) {
+  // A missing cache is expected the first time, so only try mapping files that exist
+  if (std::FILE *probe = std::fopen(path, "rb")) {
+    std::fclose(probe);
+  }
+  else {
+    return false;
+  }
+
+  if (!file.open(path)) {
+    return false;
+  }
+
+  MeshSampleCacheHeader header;
+  const std::size_t attachment_size_bytes = key.sample_count * sizeof(gl::vec4);
+  if (file.size() < sizeof(header) || (file.size() - sizeof(header)) / 3 < attachment_size_bytes) {
+    file.close();
+    return false;
+  }
+  std::memcpy(&header, file.data(), sizeof(header));
+
+  if (std::memcmp(header.magic, MESH_SAMPLE_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != MESH_SAMPLE_CACHE_VERSION ||
+      header.mesh_hash != key.mesh_hash || header.sample_count != key.sample_count || header.seed != key.seed) {
+    file.close();
+    return false;
+  }
+
+  for (std::size_t i = 0; i < 3; ++i) {
+    out_attachments[i] = reinterpret_cast<const gl::vec4 *>(file.data() + sizeof(header) + i * attachment_size_bytes);
+  }
+
+  return true;
+}
+
+#endif
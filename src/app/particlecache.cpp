@@ -0,0 +1,478 @@
+#include "app/particlecache.hpp"
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+
+#include "app/log.hpp"
+
+#include "gtc/packing.hpp"
+
+#include <cstring>
+
+struct ParticleCacheHeader {
+  char magic[4];
+  uint32_t version;
+
+  int32_t width;
+  int32_t height;
+  uint32_t texture_count;
+  uint32_t frame_count; // Written when the writer is closed
+  uint32_t keyframe_interval;
+
+  uint32_t _reserved;
+};
+
+enum ParticleCacheFrameFlags {
+  PARTICLE_CACHE_FRAME_KEYFRAME = 1 << 0 // Values are stored as is instead of relative to the previous frame
+};
+
+struct ParticleCacheFrameHeader {
+  uint32_t encoded_size_bytes;
+  uint32_t flags;
+
+  GLfloat time;
+  GLint frame;
+};
+
+static constexpr char PARTICLE_CACHE_MAGIC[4]{ 'P', 'S', 'T', 'C' };
+static constexpr uint32_t PARTICLE_CACHE_VERSION{ 1 };
+
+static constexpr GLuint64 READBACK_WAIT_TIMEOUT_NS{ 100000000 };
+
+// Each run is a count of zeros, a count of literals, then the literals
+static void encodeZeroRuns(const std::vector<uint16_t> &values, std::vector<uint16_t> &out_encoded) {
+  out_encoded.clear();
+
+  const size_t count = values.size();
+  size_t i = 0;
+  while (i < count) {
+    const size_t zeros_start = i;
+    while (i < count && values[i] == 0 && i - zeros_start < 0xffff) {
+      ++i;
+    }
+    const size_t literals_start = i;
+    while (i < count && values[i] != 0 && i - literals_start < 0xffff) {
+      ++i;
+    }
+
+    out_encoded.push_back(uint16_t(literals_start - zeros_start));
+    out_encoded.push_back(uint16_t(i - literals_start));
+    out_encoded.insert(out_encoded.end(), values.begin() + literals_start, values.begin() + i);
+  }
+}
+
+// Adds the encoded deltas onto `values`
+static bool decodeZeroRuns(const uint16_t *encoded, size_t encoded_count, std::vector<uint16_t> &values) {
+  const auto end = encoded + encoded_count;
+  size_t i = 0;
+  while (end - encoded >= 2) {
+    const size_t zeros = encoded[0];
+    const size_t literals = encoded[1];
+    encoded += 2;
+
+    i += zeros;
+    if (i + literals > values.size() || size_t(end - encoded) < literals) {
+      return false;
+    }
+    for (size_t j = 0; j < literals; ++j) {
+      values[i++] += encoded[j];
+    }
+    encoded += literals;
+  }
+  return encoded == end && i == values.size();
+}
+
+
+// Writer
+
+ParticleCacheWriter::~ParticleCacheWriter() {
+  close();
+}
+
+size_t ParticleCacheWriter::getFrameTexelCount() const {
+  return m_texture_count * m_width * m_height * 4;
+}
+
+bool ParticleCacheWriter::open(const char *path, int width, int height, size_t texture_count, uint32_t keyframe_interval) {
+  close();
+
+  m_file = std::fopen(path, "wb");
+  if (m_file == nullptr) {
+    PRINT_ERROR("Failed to open particle cache '%s' for writing\n", path);
+    return false;
+  }
+
+  m_width = width;
+  m_height = height;
+  m_texture_count = texture_count;
+  m_keyframe_interval = std::max(keyframe_interval, 1u);
+
+  m_frame_count = 0;
+  m_write_failed = false;
+  m_closing = false;
+
+  ParticleCacheHeader header{};
+  std::memcpy(header.magic, PARTICLE_CACHE_MAGIC, sizeof(header.magic));
+  header.version = PARTICLE_CACHE_VERSION;
+  header.width = m_width;
+  header.height = m_height;
+  header.texture_count = uint32_t(m_texture_count);
+  header.keyframe_interval = m_keyframe_interval;
+  std::fwrite(&header, sizeof(header), 1, m_file);
+
+  m_thread = std::thread([this]() { run(); });
+
+  return true;
+}
+
+bool ParticleCacheWriter::close() {
+  if (m_file == nullptr) {
+    return true;
+  }
+
+  // Oldest first, so frames stay in order
+  for (size_t i = 0; i < READBACK_COUNT; ++i) {
+    auto &readback = m_readbacks[(m_readback_index + i) % READBACK_COUNT];
+    if (readback.pending) {
+      finishReadback(readback);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_closing = true;
+  }
+  m_queue_changed.notify_all();
+  m_thread.join();
+
+  ParticleCacheHeader header{};
+  std::memcpy(header.magic, PARTICLE_CACHE_MAGIC, sizeof(header.magic));
+  header.version = PARTICLE_CACHE_VERSION;
+  header.width = m_width;
+  header.height = m_height;
+  header.texture_count = uint32_t(m_texture_count);
+  header.frame_count = m_frame_count;
+  header.keyframe_interval = m_keyframe_interval;
+  if (std::fseek(m_file, 0, SEEK_SET) != 0 || std::fwrite(&header, sizeof(header), 1, m_file) != 1) {
+    m_write_failed = true;
+  }
+
+  std::fclose(m_file);
+  m_file = nullptr;
+
+  for (auto &readback : m_readbacks) {
+    gl::deletePixelBuffer(readback.buffer);
+  }
+  m_free_texels.clear();
+
+  if (m_write_failed) {
+    PRINT_ERROR("Failed to write particle cache\n");
+  }
+
+  return !m_write_failed;
+}
+
+bool ParticleCacheWriter::capture(const gl::Framebuffer &fb, float time, int frame) {
+  if (m_file == nullptr) {
+    return false;
+  }
+
+  if (fb.width != m_width || fb.height != m_height || fb.textures.size() != m_texture_count) {
+    PRINT_ERROR("Particle framebuffer changed to %dx%d while baking a %dx%d cache\n", fb.width, fb.height, m_width, m_height);
+    return false;
+  }
+
+  // This readback was issued two frames ago, so its fence has almost certainly passed
+  auto &readback = m_readbacks[m_readback_index];
+  if (readback.pending) {
+    finishReadback(readback);
+  }
+
+  const size_t texture_size_bytes = m_width * m_height * 4 * sizeof(float);
+  if (readback.buffer.id == 0) {
+    gl::createPixelBuffer(readback.buffer, m_texture_count * texture_size_bytes);
+  }
+
+  gl::bindFramebuffer(fb);
+  for (size_t i = 0; i < m_texture_count; ++i) {
+    glReadBuffer(fb.buffers[i]);
+    gl::readPixelsToBuffer(readback.buffer, i * texture_size_bytes, 0, 0, m_width, m_height);
+  }
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  gl::unbindFramebuffer();
+
+  gl::createFence(readback.fence);
+  readback.time = time;
+  readback.frame = frame;
+  readback.pending = true;
+
+  m_readback_index = (m_readback_index + 1) % READBACK_COUNT;
+
+  return true;
+}
+
+void ParticleCacheWriter::finishReadback(Readback &readback) {
+  GLenum wait_status;
+  do {
+    wait_status = gl::waitFence(readback.fence, READBACK_WAIT_TIMEOUT_NS);
+  } while (wait_status == GL_TIMEOUT_EXPIRED);
+
+  gl::deleteFence(readback.fence);
+  readback.pending = false;
+
+  if (wait_status == GL_WAIT_FAILED) {
+    PRINT_ERROR("Particle cache readback of frame %d failed, the GL context may be lost\n", readback.frame);
+    return;
+  }
+
+  ParticleCacheFrame frame;
+  frame.time = readback.time;
+  frame.frame = readback.frame;
+
+  // Baking must not drop frames, so wait for the I/O thread if it has fallen behind
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_queue_changed.wait(lock, [this]() { return m_queued_frames.size() < MAX_QUEUED_FRAMES; });
+    if (!m_free_texels.empty()) {
+      frame.texels = std::move(m_free_texels.back());
+      m_free_texels.pop_back();
+    }
+  }
+
+  frame.texels.resize(getFrameTexelCount());
+  gl::getPixelBufferData(readback.buffer, 0, frame.texels.size() * sizeof(float), frame.texels.data());
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queued_frames.push_back(std::move(frame));
+  }
+  m_queue_changed.notify_all();
+}
+
+void ParticleCacheWriter::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;) {
+    m_queue_changed.wait(lock, [this]() { return m_closing || !m_queued_frames.empty(); });
+    if (m_queued_frames.empty()) {
+      break;
+    }
+
+    auto frame = std::move(m_queued_frames.front());
+    m_queued_frames.pop_front();
+
+    lock.unlock();
+    m_queue_changed.notify_all();
+
+    writeFrame(frame);
+
+    lock.lock();
+    m_free_texels.push_back(std::move(frame.texels));
+  }
+}
+
+void ParticleCacheWriter::writeFrame(const ParticleCacheFrame &frame) {
+  const size_t count = frame.texels.size();
+  const bool keyframe = m_frame_count % m_keyframe_interval == 0;
+
+  if (keyframe) {
+    m_previous_quantized.assign(count, 0);
+  }
+
+  m_deltas.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    const uint16_t quantized = glm::packHalf1x16(frame.texels[i]);
+    m_deltas[i] = uint16_t(quantized - m_previous_quantized[i]);
+    m_previous_quantized[i] = quantized;
+  }
+
+  encodeZeroRuns(m_deltas, m_encoded);
+
+  ParticleCacheFrameHeader header{};
+  header.encoded_size_bytes = uint32_t(m_encoded.size() * sizeof(uint16_t));
+  header.flags = keyframe ? PARTICLE_CACHE_FRAME_KEYFRAME : 0;
+  header.time = frame.time;
+  header.frame = frame.frame;
+
+  if (std::fwrite(&header, sizeof(header), 1, m_file) != 1 ||
+      std::fwrite(m_encoded.data(), sizeof(uint16_t), m_encoded.size(), m_file) != m_encoded.size()) {
+    m_write_failed = true;
+  }
+
+  ++m_frame_count;
+}
+
+
+// Reader
+
+ParticleCacheReader::~ParticleCacheReader() {
+  close();
+}
+
+size_t ParticleCacheReader::getFrameTexelCount() const {
+  return m_texture_count * m_width * m_height * 4;
+}
+
+bool ParticleCacheReader::open(const char *path, bool loop) {
+  close();
+
+  if (!m_file.open(path)) {
+    return false;
+  }
+
+  ParticleCacheHeader header;
+  if (m_file.size() < sizeof(header)) {
+    PRINT_ERROR("Particle cache '%s' is truncated\n", path);
+    m_file.close();
+    return false;
+  }
+  std::memcpy(&header, m_file.data(), sizeof(header));
+
+  if (std::memcmp(header.magic, PARTICLE_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != PARTICLE_CACHE_VERSION || header.frame_count == 0) {
+    PRINT_ERROR("Particle cache '%s' has an unsupported format or no frames\n", path);
+    m_file.close();
+    return false;
+  }
+
+  m_width = header.width;
+  m_height = header.height;
+  m_texture_count = header.texture_count;
+  m_frame_count = header.frame_count;
+  m_loop = loop;
+
+  m_offset = sizeof(header);
+  m_closing = false;
+  m_finished = false;
+
+  m_thread = std::thread([this]() { run(); });
+
+  return true;
+}
+
+void ParticleCacheReader::close() {
+  if (!m_file.isOpen()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_closing = true;
+  }
+  m_frames_changed.notify_all();
+  m_thread.join();
+
+  m_file.close();
+  m_ready_frames.clear();
+  m_free_frames.clear();
+}
+
+bool ParticleCacheReader::uploadNextFrame(gl::Framebuffer &fb, float *out_time, int *out_frame) {
+  if (fb.width != m_width || fb.height != m_height || fb.textures.size() != m_texture_count) {
+    PRINT_ERROR("Particle framebuffer changed to %dx%d while playing a %dx%d cache\n", fb.width, fb.height, m_width, m_height);
+    return false;
+  }
+
+  ParticleCacheFrame frame;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_frames_changed.wait(lock, [this]() { return !m_ready_frames.empty() || m_finished; });
+    if (m_ready_frames.empty()) {
+      return false;
+    }
+    frame = std::move(m_ready_frames.front());
+    m_ready_frames.pop_front();
+  }
+  m_frames_changed.notify_all();
+
+  const size_t texture_texel_count = m_width * m_height * 4;
+  for (size_t i = 0; i < m_texture_count; ++i) {
+    gl::updateTexture(fb.textures[i], frame.texels.data() + i * texture_texel_count);
+  }
+
+  if (out_time) *out_time = frame.time;
+  if (out_frame) *out_frame = frame.frame;
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_free_frames.push_back(std::move(frame));
+  }
+  m_frames_changed.notify_all();
+
+  return true;
+}
+
+void ParticleCacheReader::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;) {
+    m_frames_changed.wait(lock, [this]() { return m_closing || (!m_finished && m_ready_frames.size() < PREFETCH_FRAME_COUNT); });
+    if (m_closing) {
+      break;
+    }
+
+    ParticleCacheFrame frame;
+    if (!m_free_frames.empty()) {
+      frame = std::move(m_free_frames.back());
+      m_free_frames.pop_back();
+    }
+
+    lock.unlock();
+    const bool decoded = decodeNextFrame(frame);
+    lock.lock();
+
+    if (decoded) {
+      m_ready_frames.push_back(std::move(frame));
+    }
+    else {
+      m_finished = true;
+    }
+    m_frames_changed.notify_all();
+  }
+}
+
+bool ParticleCacheReader::decodeNextFrame(ParticleCacheFrame &frame) {
+  if (m_offset >= m_file.size()) {
+    if (!m_loop) {
+      return false;
+    }
+    m_offset = sizeof(ParticleCacheHeader);
+  }
+
+  ParticleCacheFrameHeader header;
+  if (m_file.size() - m_offset < sizeof(header)) {
+    PRINT_ERROR("Particle cache frame header is truncated\n");
+    return false;
+  }
+  std::memcpy(&header, m_file.data() + m_offset, sizeof(header));
+
+  const size_t payload_offset = m_offset + sizeof(header);
+  if (m_file.size() - payload_offset < header.encoded_size_bytes || header.encoded_size_bytes % sizeof(uint16_t) != 0) {
+    PRINT_ERROR("Particle cache frame %d is truncated\n", header.frame);
+    return false;
+  }
+
+  const size_t count = getFrameTexelCount();
+  if (header.flags & PARTICLE_CACHE_FRAME_KEYFRAME) {
+    m_quantized.assign(count, 0);
+  }
+  else if (m_quantized.size() != count) {
+    return false;
+  }
+
+  // Offsets stay 2 byte aligned within the mapping: headers are multiples of 4 and payloads of 2 bytes
+  const auto encoded = reinterpret_cast<const uint16_t *>(m_file.data() + payload_offset);
+  if (!decodeZeroRuns(encoded, header.encoded_size_bytes / sizeof(uint16_t), m_quantized)) {
+    PRINT_ERROR("Particle cache frame %d is malformed\n", header.frame);
+    return false;
+  }
+
+  frame.texels.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    frame.texels[i] = glm::unpackHalf1x16(m_quantized[i]);
+  }
+  frame.time = header.time;
+  frame.frame = header.frame;
+
+  m_offset = payload_offset + header.encoded_size_bytes;
+
+  return true;
+}
+
+#endif
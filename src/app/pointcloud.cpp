@@ -0,0 +1,545 @@
+#include "app/pointcloud.hpp"
+
+#include "app/log.hpp"
+#include "app/util.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+static constexpr std::size_t MAX_XYZ_FIELD_COUNT{ 32 };
+static constexpr std::size_t XYZ_COLOR_SAMPLE_LINE_COUNT{ 1024 };
+
+static bool isFieldSeparator(uint8_t c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == ',';
+}
+
+static bool isDigit(uint8_t c) {
+  return c >= '0' && c <= '9';
+}
+
+static const uint8_t *findLineEnd(const uint8_t *p, const uint8_t *end) {
+  auto line_end = static_cast<const uint8_t *>(std::memchr(p, '\n', end - p));
+  return line_end ? line_end : end;
+}
+
+static const uint8_t *findNextLine(const uint8_t *p, const uint8_t *end) {
+  const uint8_t *line_end = findLineEnd(p, end);
+  return line_end < end ? line_end + 1 : end;
+}
+
+static std::size_t parseFloats(const uint8_t *p, const uint8_t *end, float *out_values, std::size_t max_count) {
+  std::size_t count = 0;
+  while (count < max_count) {
+    while (p < end && isFieldSeparator(*p)) ++p;
+    if (!parseFloat(p, end, out_values[count])) {
+      break;
+    }
+    ++count;
+  }
+  return count;
+}
+
+// XYZ files sometimes start with a point count or other text, so only lines that start like a number and
+// have at least three fields hold points.
+static bool isXyzPointLine(const uint8_t *p, const uint8_t *end) {
+  while (p < end && isFieldSeparator(*p)) ++p;
+  if (p == end || !(isDigit(*p) || *p == '-' || *p == '+' || *p == '.')) {
+    return false;
+  }
+
+  int field_count = 0;
+  while (p < end && field_count < 3) {
+    ++field_count;
+    while (p < end && !isFieldSeparator(*p)) ++p;
+    while (p < end && isFieldSeparator(*p)) ++p;
+  }
+  return field_count >= 3;
+}
+
+static bool isBlankLine(const uint8_t *p, const uint8_t *end) {
+  while (p < end && isFieldSeparator(*p)) ++p;
+  return p == end;
+}
+
+static std::vector<std::string_view> splitHeaderLine(const uint8_t *p, const uint8_t *end) {
+  std::vector<std::string_view> words;
+  while (p < end) {
+    while (p < end && isFieldSeparator(*p)) ++p;
+    const uint8_t *word = p;
+    while (p < end && !isFieldSeparator(*p)) ++p;
+    if (p > word) {
+      words.emplace_back(reinterpret_cast<const char *>(word), p - word);
+    }
+  }
+  return words;
+}
+
+template <typename T>
+static T loadValue(const uint8_t *p, bool swap_bytes) {
+  uint8_t bytes[sizeof(T)];
+  std::memcpy(bytes, p, sizeof(T));
+  if (swap_bytes) {
+    std::reverse(bytes, bytes + sizeof(T));
+  }
+  T value;
+  std::memcpy(&value, bytes, sizeof(T));
+  return value;
+}
+
+static bool isHostLittleEndian() {
+  const uint16_t probe = 1;
+  uint8_t first_byte;
+  std::memcpy(&first_byte, &probe, 1);
+  return first_byte == 1;
+}
+
+PointCloudLoader::~PointCloudLoader() {
+  // Chunks still queued skip their work, but running ones have to finish before the data goes away
+  m_cancelled = true;
+  if (m_pool) {
+    m_pool->wait();
+  }
+}
+
+bool PointCloudLoader::open(const uint8_t *data, std::size_t size_bytes) {
+  assert(!m_data);
+
+  m_owned_data.assign(data, data + size_bytes);
+  m_data = m_owned_data.data();
+  m_size_bytes = m_owned_data.size();
+
+  return parseHeader();
+}
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+bool PointCloudLoader::open(const char *path) {
+  assert(!m_data);
+
+  if (!m_file.open(path)) {
+    PRINT_ERROR("Failed to open point cloud '%s'\n", path);
+    return false;
+  }
+  m_data = m_file.data();
+  m_size_bytes = m_file.size();
+
+  return parseHeader();
+}
+#endif
+
+bool PointCloudLoader::parseHeader() {
+  std::size_t body_offset = 0;
+
+  if (m_size_bytes >= 3 && std::memcmp(m_data, "ply", 3) == 0) {
+    if (!parsePlyHeader(body_offset)) {
+      return false;
+    }
+  }
+  else {
+    m_format = POINT_CLOUD_FORMAT_XYZ;
+    sampleXyzColorScale(body_offset);
+  }
+
+  if (!findChunks(body_offset)) {
+    return false;
+  }
+
+  if (m_point_count == 0) {
+    PRINT_ERROR("Point cloud has no points\n");
+    return false;
+  }
+
+  return true;
+}
+
+bool PointCloudLoader::parsePlyHeader(std::size_t &body_offset) {
+  const uint8_t *p = m_data;
+  const uint8_t *end = m_data + m_size_bytes;
+
+  bool has_format = false;
+  bool in_vertex_element = false;
+  bool seen_element = false;
+  std::size_t header_point_count = 0;
+
+  for (p = findNextLine(p, end); p < end; p = findNextLine(p, end)) {
+    const auto words = splitHeaderLine(p, findLineEnd(p, end));
+    if (words.empty() || words[0] == "comment" || words[0] == "obj_info") {
+      continue;
+    }
+
+    if (words[0] == "end_header") {
+      body_offset = findNextLine(p, end) - m_data;
+      break;
+    }
+    else if (words[0] == "format" && words.size() >= 2) {
+      if (words[1] == "ascii") {
+        m_format = POINT_CLOUD_FORMAT_PLY_ASCII;
+      }
+      else if (words[1] == "binary_little_endian") {
+        m_format = POINT_CLOUD_FORMAT_PLY_BINARY_LE;
+      }
+      else if (words[1] == "binary_big_endian") {
+        m_format = POINT_CLOUD_FORMAT_PLY_BINARY_BE;
+      }
+      else {
+        PRINT_ERROR("Unsupported PLY format '%.*s'\n", int(words[1].size()), words[1].data());
+        return false;
+      }
+      has_format = true;
+    }
+    else if (words[0] == "element" && words.size() >= 3) {
+      // Reading the vertices mustn't depend on walking other elements first
+      in_vertex_element = !seen_element && words[1] == "vertex";
+      if (!seen_element && !in_vertex_element) {
+        PRINT_ERROR("PLY files must list the vertex element first\n");
+        return false;
+      }
+      if (in_vertex_element) {
+        header_point_count = std::strtoull(std::string(words[2]).c_str(), nullptr, 10);
+      }
+      seen_element = true;
+    }
+    else if (words[0] == "property" && in_vertex_element) {
+      if (words.size() >= 2 && words[1] == "list") {
+        PRINT_ERROR("PLY vertex list properties are not supported\n");
+        return false;
+      }
+      if (words.size() < 3) {
+        continue;
+      }
+
+      const auto &type_name = words[1];
+      const auto &name = words[2];
+
+      static const struct {
+        std::string_view names[2];
+        PropertyType type;
+        std::size_t size_bytes;
+      } PROPERTY_TYPES[]{
+        { { "char", "int8" }, PROPERTY_INT8, 1 },
+        { { "uchar", "uint8" }, PROPERTY_UINT8, 1 },
+        { { "short", "int16" }, PROPERTY_INT16, 2 },
+        { { "ushort", "uint16" }, PROPERTY_UINT16, 2 },
+        { { "int", "int32" }, PROPERTY_INT32, 4 },
+        { { "uint", "uint32" }, PROPERTY_UINT32, 4 },
+        { { "float", "float32" }, PROPERTY_FLOAT32, 4 },
+        { { "double", "float64" }, PROPERTY_FLOAT64, 8 },
+      };
+
+      const auto property_type = std::find_if(std::begin(PROPERTY_TYPES), std::end(PROPERTY_TYPES), [&](const auto &t) {
+        return type_name == t.names[0] || type_name == t.names[1];
+      });
+      if (property_type == std::end(PROPERTY_TYPES)) {
+        PRINT_ERROR("Unsupported PLY property type '%.*s'\n", int(type_name.size()), type_name.data());
+        return false;
+      }
+
+      const int index = int(m_properties.size());
+      const bool is_binary = m_format != POINT_CLOUD_FORMAT_PLY_ASCII;
+      m_properties.push_back({ property_type->type, is_binary ? m_stride : m_properties.size() });
+      m_stride += property_type->size_bytes;
+
+      if (name == "x") {
+        m_position_properties[0] = index;
+      }
+      else if (name == "y") {
+        m_position_properties[1] = index;
+      }
+      else if (name == "z") {
+        m_position_properties[2] = index;
+      }
+      else if (name == "red" || name == "r" || name == "diffuse_red") {
+        m_color_properties[0] = index;
+      }
+      else if (name == "green" || name == "g" || name == "diffuse_green") {
+        m_color_properties[1] = index;
+      }
+      else if (name == "blue" || name == "b" || name == "diffuse_blue") {
+        m_color_properties[2] = index;
+      }
+    }
+  }
+
+  if (!has_format || body_offset == 0) {
+    PRINT_ERROR("PLY header is incomplete\n");
+    return false;
+  }
+  if (m_position_properties[0] < 0 || m_position_properties[1] < 0 || m_position_properties[2] < 0) {
+    PRINT_ERROR("PLY vertices have no x, y and z properties\n");
+    return false;
+  }
+
+  if (m_color_properties[0] < 0 || m_color_properties[1] < 0 || m_color_properties[2] < 0) {
+    m_color_properties[0] = m_color_properties[1] = m_color_properties[2] = -1;
+  }
+  else {
+    switch (m_properties[m_color_properties[0]].type) {
+      case PROPERTY_FLOAT32:
+      case PROPERTY_FLOAT64: m_color_scale = 1.0f; break;
+      case PROPERTY_INT16:
+      case PROPERTY_UINT16: m_color_scale = 1.0f / 65535.0f; break;
+      default: m_color_scale = 1.0f / 255.0f; break;
+    }
+  }
+
+  m_point_count = header_point_count;
+
+  return true;
+}
+
+void PointCloudLoader::sampleXyzColorScale(std::size_t body_offset) {
+  // Colors are stored as either 0-1 or 0-255. Look at the start of the file to tell which.
+  m_color_scale = 1.0f;
+
+  const uint8_t *end = m_data + m_size_bytes;
+  std::size_t sampled_line_count = 0;
+  for (const uint8_t *p = m_data + body_offset; p < end && sampled_line_count < XYZ_COLOR_SAMPLE_LINE_COUNT; p = findNextLine(p, end)) {
+    const uint8_t *line_end = findLineEnd(p, end);
+    if (!isXyzPointLine(p, line_end)) {
+      continue;
+    }
+    ++sampled_line_count;
+
+    float fields[MAX_XYZ_FIELD_COUNT];
+    const std::size_t field_count = parseFloats(p, line_end, fields, MAX_XYZ_FIELD_COUNT);
+    if (field_count >= 6 && std::max({ fields[field_count - 3], fields[field_count - 2], fields[field_count - 1] }) > 1.0f) {
+      m_color_scale = 1.0f / 255.0f;
+      return;
+    }
+  }
+}
+
+bool PointCloudLoader::findChunks(std::size_t body_offset) {
+  struct ChunkRange {
+    std::size_t begin, end, point_count;
+  };
+  std::vector<ChunkRange> ranges;
+
+  if (m_format == POINT_CLOUD_FORMAT_PLY_BINARY_LE || m_format == POINT_CLOUD_FORMAT_PLY_BINARY_BE) {
+    if (m_stride == 0) {
+      PRINT_ERROR("PLY vertices have no properties\n");
+      return false;
+    }
+
+    const std::size_t available_point_count = (m_size_bytes - body_offset) / m_stride;
+    if (available_point_count < m_point_count) {
+      PRINT_ERROR("PLY file is truncated: %zu of %zu points present\n", available_point_count, m_point_count);
+      m_point_count = available_point_count;
+    }
+
+    for (std::size_t first = 0; first < m_point_count; first += CHUNK_POINT_COUNT) {
+      const std::size_t count = std::min(CHUNK_POINT_COUNT, m_point_count - first);
+      const std::size_t begin = body_offset + first * m_stride;
+      ranges.push_back({ begin, begin + count * m_stride, count });
+    }
+  }
+  else {
+    // ASCII chunks end on line boundaries, so the whole body is scanned once up front
+    const bool is_ply = m_format == POINT_CLOUD_FORMAT_PLY_ASCII;
+    const std::size_t max_point_count = is_ply ? m_point_count : SIZE_MAX;
+
+    const uint8_t *end = m_data + m_size_bytes;
+    const uint8_t *p = m_data + body_offset;
+    std::size_t point_count = 0;
+
+    ChunkRange range{ body_offset, body_offset, 0 };
+    for (; p < end && point_count < max_point_count; p = findNextLine(p, end)) {
+      const uint8_t *line_end = findLineEnd(p, end);
+      if (is_ply ? isBlankLine(p, line_end) : !isXyzPointLine(p, line_end)) {
+        continue;
+      }
+
+      if (range.point_count == 0) {
+        range.begin = p - m_data;
+      }
+      range.end = findNextLine(p, end) - m_data;
+      ++range.point_count;
+      ++point_count;
+
+      if (range.point_count == CHUNK_POINT_COUNT) {
+        ranges.push_back(range);
+        range.point_count = 0;
+      }
+    }
+    if (range.point_count > 0) {
+      ranges.push_back(range);
+    }
+
+    if (is_ply && point_count < m_point_count) {
+      PRINT_ERROR("PLY file is truncated: %zu of %zu points present\n", point_count, m_point_count);
+    }
+    m_point_count = point_count;
+  }
+
+  m_chunk_count = ranges.size();
+  m_chunks = std::make_unique<Chunk[]>(m_chunk_count);
+
+  std::size_t first_point = 0;
+  for (std::size_t i = 0; i < m_chunk_count; ++i) {
+    auto &chunk = m_chunks[i];
+    chunk.begin = ranges[i].begin;
+    chunk.end = ranges[i].end;
+    chunk.first_point = first_point;
+    chunk.point_count = ranges[i].point_count;
+    first_point += chunk.point_count;
+  }
+
+  return true;
+}
+
+void PointCloudLoader::start(ThreadPool &pool, std::size_t max_point_count) {
+  assert(!m_pool);
+  m_pool = &pool;
+
+  std::size_t remaining_point_count = max_point_count;
+  for (std::size_t i = 0; i < m_chunk_count; ++i) {
+    if (remaining_point_count == 0) {
+      m_chunk_count = i;
+      break;
+    }
+    auto &chunk = m_chunks[i];
+    chunk.point_count = std::min(chunk.point_count, remaining_point_count);
+    remaining_point_count -= chunk.point_count;
+  }
+  m_point_count = std::min(m_point_count, max_point_count);
+
+  for (std::size_t i = 0; i < m_chunk_count; ++i) {
+    pool.submit([this, i]() {
+      auto &chunk = m_chunks[i];
+      if (!m_cancelled.load(std::memory_order_relaxed)) {
+        parseChunk(chunk);
+      }
+      chunk.parsed.store(true, std::memory_order_release);
+    });
+  }
+}
+
+void PointCloudLoader::parseChunk(Chunk &chunk) const {
+  chunk.positions.assign(chunk.point_count, gl::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+  chunk.colors.assign(chunk.point_count, gl::vec4(1.0f));
+
+  if (m_format == POINT_CLOUD_FORMAT_PLY_BINARY_LE || m_format == POINT_CLOUD_FORMAT_PLY_BINARY_BE) {
+    parseBinaryChunk(chunk);
+  }
+  else {
+    parseAsciiChunk(chunk);
+  }
+}
+
+void PointCloudLoader::parseAsciiChunk(Chunk &chunk) const {
+  const bool is_ply = m_format == POINT_CLOUD_FORMAT_PLY_ASCII;
+  const bool has_colors = m_color_properties[0] >= 0;
+
+  std::vector<float> fields(is_ply ? m_properties.size() : MAX_XYZ_FIELD_COUNT);
+
+  const uint8_t *end = m_data + chunk.end;
+  std::size_t point_index = 0;
+  for (const uint8_t *p = m_data + chunk.begin; p < end && point_index < chunk.point_count; p = findNextLine(p, end)) {
+    const uint8_t *line_end = findLineEnd(p, end);
+    if (is_ply ? isBlankLine(p, line_end) : !isXyzPointLine(p, line_end)) {
+      continue;
+    }
+
+    const std::size_t field_count = parseFloats(p, line_end, fields.data(), fields.size());
+    auto &position = chunk.positions[point_index];
+    auto &color = chunk.colors[point_index];
+
+    if (is_ply) {
+      for (int c = 0; c < 3; ++c) {
+        const std::size_t position_field = m_properties[m_position_properties[c]].offset;
+        position[c] = position_field < field_count ? fields[position_field] : 0.0f;
+        if (has_colors) {
+          const std::size_t color_field = m_properties[m_color_properties[c]].offset;
+          color[c] = color_field < field_count ? fields[color_field] * m_color_scale : 1.0f;
+        }
+      }
+    }
+    else {
+      // x y z first, then the last three fields are the color if there are at least six
+      for (int c = 0; c < 3; ++c) {
+        position[c] = fields[c];
+        if (field_count >= 6) {
+          color[c] = fields[field_count - 3 + c] * m_color_scale;
+        }
+      }
+    }
+
+    ++point_index;
+  }
+}
+
+void PointCloudLoader::parseBinaryChunk(Chunk &chunk) const {
+  const bool swap_bytes = (m_format == POINT_CLOUD_FORMAT_PLY_BINARY_LE) != isHostLittleEndian();
+  const bool has_colors = m_color_properties[0] >= 0;
+
+  const auto loadProperty = [&](const uint8_t *vertex, int index) -> float {
+    const auto &property = m_properties[index];
+    const uint8_t *p = vertex + property.offset;
+    switch (property.type) {
+      case PROPERTY_INT8: return float(loadValue<int8_t>(p, swap_bytes));
+      case PROPERTY_UINT8: return float(loadValue<uint8_t>(p, swap_bytes));
+      case PROPERTY_INT16: return float(loadValue<int16_t>(p, swap_bytes));
+      case PROPERTY_UINT16: return float(loadValue<uint16_t>(p, swap_bytes));
+      case PROPERTY_INT32: return float(loadValue<int32_t>(p, swap_bytes));
+      case PROPERTY_UINT32: return float(loadValue<uint32_t>(p, swap_bytes));
+      case PROPERTY_FLOAT32: return loadValue<float>(p, swap_bytes);
+      case PROPERTY_FLOAT64: return float(loadValue<double>(p, swap_bytes));
+    }
+    return 0.0f;
+  };
+
+  const uint8_t *vertex = m_data + chunk.begin;
+  for (std::size_t i = 0; i < chunk.point_count; ++i, vertex += m_stride) {
+    for (int c = 0; c < 3; ++c) {
+      chunk.positions[i][c] = loadProperty(vertex, m_position_properties[c]);
+      if (has_colors) {
+        chunk.colors[i][c] = loadProperty(vertex, m_color_properties[c]) * m_color_scale;
+      }
+    }
+  }
+}
+
+bool PointCloudLoader::peekParsedPoints(std::size_t max_count, PointCloudPiece &out_piece) {
+  if (isFinished() || max_count == 0) {
+    return false;
+  }
+
+  const auto &chunk = m_chunks[m_consumed_chunk];
+  if (!chunk.parsed.load(std::memory_order_acquire)) {
+    return false;
+  }
+
+  out_piece.first_point = chunk.first_point + m_consumed_in_chunk;
+  out_piece.count = std::min(max_count, chunk.point_count - m_consumed_in_chunk);
+  out_piece.positions = chunk.positions.data() + m_consumed_in_chunk;
+  out_piece.colors = chunk.colors.data() + m_consumed_in_chunk;
+
+  return true;
+}
+
+void PointCloudLoader::consumeParsedPoints(std::size_t count) {
+  assert(!isFinished());
+
+  auto &chunk = m_chunks[m_consumed_chunk];
+  assert(m_consumed_in_chunk + count <= chunk.point_count);
+
+  m_consumed_in_chunk += count;
+  m_consumed_point_count += count;
+
+  if (m_consumed_in_chunk == chunk.point_count) {
+    // Uploaded, so the parsed points can go
+    std::vector<gl::vec4>().swap(chunk.positions);
+    std::vector<gl::vec4>().swap(chunk.colors);
+
+    ++m_consumed_chunk;
+    m_consumed_in_chunk = 0;
+  }
+}
+
+float PointCloudLoader::getProgress() const {
+  return m_point_count > 0 ? float(m_consumed_point_count) / float(m_point_count) : 1.0f;
+}
@@ -0,0 +1,568 @@
+#include "app/pointoctree.hpp"
+
+#include "app/glgeom.hpp"
+#include "app/log.hpp"
+#include "app/pointcloud.hpp"
+#include "app/util.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+#include <random>
+#include <thread>
+#endif
+
+// Point octree files are this header, the points of every node in breadth-first order, then the node table.
+// Children of a node are consecutive in the table and always come after it.
+struct PointOctreeHeader {
+  char magic[4];
+  uint32_t version;
+
+  uint32_t node_count;
+  uint32_t node_capacity;
+  uint64_t point_count;
+  uint64_t node_table_offset;
+
+  float bounds_min[3];
+  float bounds_size; // Bounds are a cube
+
+  uint32_t _reserved[4];
+};
+
+struct PointOctreeFileNode {
+  float center[3];
+  float half_size;
+
+  float spacing; // Distance between neighboring points of the node's subsample
+  uint32_t point_count;
+  uint32_t first_child;
+  uint32_t child_count;
+
+  uint64_t data_offset;
+  uint32_t level;
+  uint32_t _reserved;
+};
+
+struct PointOctreePoint {
+  float position[3];
+  uint8_t color[4];
+};
+
+static constexpr char POINT_OCTREE_MAGIC[4]{ 'P', 'S', 'T', 'O' };
+static constexpr uint32_t POINT_OCTREE_VERSION{ 1 };
+
+static_assert(sizeof(PointOctreeHeader) == 64, "Point data must stay aligned");
+static_assert(sizeof(PointOctreeFileNode) == 48, "Node table layout changed");
+static_assert(sizeof(PointOctreePoint) == 16, "Point layout changed");
+
+// Cells per axis of the grid nodes subsample with, so a full grid holds exactly one node of points
+static constexpr int SUBSAMPLE_GRID_SIZE{ 16 };
+static_assert(SUBSAMPLE_GRID_SIZE * SUBSAMPLE_GRID_SIZE * SUBSAMPLE_GRID_SIZE == PointOctreeStreamer::NODE_CAPACITY, "Grid must match the node capacity");
+
+static constexpr uint32_t MAX_OCTREE_LEVEL{ 20 };
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+
+bool buildPointOctree(const char *input_path, const char *output_path, ThreadPool &pool) {
+  std::vector<PointOctreePoint> points;
+  gl::vec3 bounds_min(FLT_MAX);
+  gl::vec3 bounds_max(-FLT_MAX);
+
+  {
+    PointCloudLoader loader;
+    if (!loader.open(input_path)) {
+      return false;
+    }
+
+    points.reserve(loader.getPointCount());
+    loader.start(pool, loader.getPointCount());
+
+    PointCloudPiece piece;
+    while (!loader.isFinished()) {
+      if (!loader.peekParsedPoints(PointCloudLoader::CHUNK_POINT_COUNT, piece)) {
+        std::this_thread::yield();
+        continue;
+      }
+
+      for (std::size_t i = 0; i < piece.count; ++i) {
+        const auto &position = piece.positions[i];
+        const auto &color = piece.colors[i];
+
+        PointOctreePoint point;
+        for (int c = 0; c < 3; ++c) {
+          point.position[c] = position[c];
+        }
+        for (int c = 0; c < 4; ++c) {
+          point.color[c] = uint8_t(::clamp(color[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+        points.push_back(point);
+
+        bounds_min = gl::min(bounds_min, gl::vec3(position));
+        bounds_max = gl::max(bounds_max, gl::vec3(position));
+      }
+      loader.consumeParsedPoints(piece.count);
+    }
+  }
+
+  if (points.empty()) {
+    PRINT_ERROR("Point cloud '%s' has no points\n", input_path);
+    return false;
+  }
+
+  // Shuffled so that the first point to claim each subsample cell is a random one rather than the first in file order
+  std::shuffle(points.begin(), points.end(), std::mt19937(0));
+
+  // Padded so points on the max faces still land inside the last cell
+  const auto extent = bounds_max - bounds_min;
+  const float bounds_size = std::max(std::max(extent.x, extent.y), extent.z) * 1.0001f + 1e-6f;
+
+  std::FILE *file = std::fopen(output_path, "wb");
+  if (file == nullptr) {
+    PRINT_ERROR("Failed to open point octree '%s' for writing\n", output_path);
+    return false;
+  }
+
+  PointOctreeHeader header{};
+  bool write_failed = std::fwrite(&header, sizeof(header), 1, file) != 1;
+
+  struct PendingNode {
+    gl::vec3 min;
+    float size;
+    uint32_t level;
+    std::vector<uint32_t> points;
+  };
+
+  std::deque<PendingNode> pending;
+  pending.push_back({ bounds_min, bounds_size, 0, std::vector<uint32_t>(points.size()) });
+  for (uint32_t i = 0; i < points.size(); ++i) {
+    pending.back().points[i] = i;
+  }
+
+  std::vector<PointOctreeFileNode> nodes;
+  std::vector<PointOctreePoint> node_points;
+  std::vector<uint32_t> child_points[8];
+  std::vector<uint8_t> cell_taken(PointOctreeStreamer::NODE_CAPACITY);
+
+  uint64_t data_offset = sizeof(header);
+  uint32_t queued_node_count = 1;
+  std::size_t dropped_point_count = 0;
+
+  while (!pending.empty() && !write_failed) {
+    const auto node = std::move(pending.front());
+    pending.pop_front();
+
+    node_points.clear();
+    for (auto &child : child_points) {
+      child.clear();
+    }
+
+    if (node.points.size() <= PointOctreeStreamer::NODE_CAPACITY || node.level >= MAX_OCTREE_LEVEL) {
+      // Leaf. Past the last level only coincident points are left, so dropping the excess loses nothing visible.
+      const std::size_t count = std::min(node.points.size(), PointOctreeStreamer::NODE_CAPACITY);
+      for (std::size_t i = 0; i < count; ++i) {
+        node_points.push_back(points[node.points[i]]);
+      }
+      dropped_point_count += node.points.size() - count;
+    }
+    else {
+      // Keep the first point in each grid cell and pass the rest down to the child octant holding its cell
+      std::fill(cell_taken.begin(), cell_taken.end(), 0);
+      const float cell_scale = float(SUBSAMPLE_GRID_SIZE) / node.size;
+
+      for (const auto index : node.points) {
+        const auto &point = points[index];
+
+        int cell[3];
+        for (int c = 0; c < 3; ++c) {
+          cell[c] = ::clamp(int((point.position[c] - node.min[c]) * cell_scale), 0, SUBSAMPLE_GRID_SIZE - 1);
+        }
+
+        auto &taken = cell_taken[cell[0] + (cell[1] + cell[2] * SUBSAMPLE_GRID_SIZE) * SUBSAMPLE_GRID_SIZE];
+        if (!taken) {
+          taken = 1;
+          node_points.push_back(point);
+        }
+        else {
+          constexpr int half = SUBSAMPLE_GRID_SIZE / 2;
+          const int octant = (cell[0] >= half ? 1 : 0) | (cell[1] >= half ? 2 : 0) | (cell[2] >= half ? 4 : 0);
+          child_points[octant].push_back(index);
+        }
+      }
+    }
+
+    const float half_size = 0.5f * node.size;
+
+    PointOctreeFileNode record{};
+    for (int c = 0; c < 3; ++c) {
+      record.center[c] = node.min[c] + half_size;
+    }
+    record.half_size = half_size;
+    record.spacing = node.size / float(SUBSAMPLE_GRID_SIZE);
+    record.point_count = uint32_t(node_points.size());
+    record.first_child = queued_node_count;
+    record.data_offset = data_offset;
+    record.level = node.level;
+
+    // Breadth-first, so children queued together are also written together
+    for (int octant = 0; octant < 8; ++octant) {
+      if (child_points[octant].empty()) continue;
+
+      const auto offset = gl::vec3(octant & 1, (octant >> 1) & 1, (octant >> 2) & 1) * half_size;
+      pending.push_back({ node.min + offset, half_size, node.level + 1, std::move(child_points[octant]) });
+      ++record.child_count;
+      ++queued_node_count;
+    }
+
+    write_failed = std::fwrite(node_points.data(), sizeof(PointOctreePoint), node_points.size(), file) != node_points.size();
+    data_offset += node_points.size() * sizeof(PointOctreePoint);
+
+    nodes.push_back(record);
+  }
+
+  std::memcpy(header.magic, POINT_OCTREE_MAGIC, sizeof(header.magic));
+  header.version = POINT_OCTREE_VERSION;
+  header.node_count = uint32_t(nodes.size());
+  header.node_capacity = uint32_t(PointOctreeStreamer::NODE_CAPACITY);
+  header.point_count = points.size() - dropped_point_count;
+  header.node_table_offset = data_offset;
+  for (int c = 0; c < 3; ++c) {
+    header.bounds_min[c] = bounds_min[c];
+  }
+  header.bounds_size = bounds_size;
+
+  if (!write_failed) {
+    write_failed = std::fwrite(nodes.data(), sizeof(PointOctreeFileNode), nodes.size(), file) != nodes.size() ||
+                   std::fseek(file, 0, SEEK_SET) != 0 ||
+                   std::fwrite(&header, sizeof(header), 1, file) != 1;
+  }
+
+  if (std::fclose(file) != 0) {
+    write_failed = true;
+  }
+
+  if (write_failed) {
+    PRINT_ERROR("Failed to write point octree '%s'\n", output_path);
+    return false;
+  }
+
+  if (dropped_point_count > 0) {
+    PRINT_INFO("Point octree '%s' dropped %zu coincident points\n", output_path, dropped_point_count);
+  }
+
+  return true;
+}
+
+#endif
+
+PointOctreeStreamer::~PointOctreeStreamer() {
+  // Queued loads skip their work, but running ones have to finish before the data goes away
+  m_cancelled = true;
+  if (m_pool) {
+    m_pool->wait();
+  }
+}
+
+bool PointOctreeStreamer::open(const uint8_t *data, std::size_t size_bytes, ThreadPool &pool, int pool_page_count) {
+  assert(!m_data);
+
+  m_owned_data.assign(data, data + size_bytes);
+  m_data = m_owned_data.data();
+  m_size_bytes = m_owned_data.size();
+  m_pool = &pool;
+
+  return parse() && createPool(pool_page_count);
+}
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+bool PointOctreeStreamer::open(const char *path, ThreadPool &pool, int pool_page_count) {
+  assert(!m_data);
+
+  if (!m_file.open(path)) {
+    PRINT_ERROR("Failed to open point octree '%s'\n", path);
+    return false;
+  }
+  m_data = m_file.data();
+  m_size_bytes = m_file.size();
+  m_pool = &pool;
+
+  return parse() && createPool(pool_page_count);
+}
+#endif
+
+bool PointOctreeStreamer::parse() {
+  PointOctreeHeader header;
+  if (m_size_bytes < sizeof(header)) {
+    PRINT_ERROR("Point octree is truncated\n");
+    return false;
+  }
+  std::memcpy(&header, m_data, sizeof(header));
+
+  if (std::memcmp(header.magic, POINT_OCTREE_MAGIC, sizeof(header.magic)) != 0 || header.version != POINT_OCTREE_VERSION ||
+      header.node_capacity != NODE_CAPACITY || header.node_count == 0) {
+    PRINT_ERROR("Point octree has an unsupported format or no nodes\n");
+    return false;
+  }
+
+  if (header.node_table_offset > m_size_bytes ||
+      (m_size_bytes - header.node_table_offset) / sizeof(PointOctreeFileNode) < header.node_count) {
+    PRINT_ERROR("Point octree is truncated\n");
+    return false;
+  }
+
+  m_nodes.resize(header.node_count);
+  for (uint32_t i = 0; i < header.node_count; ++i) {
+    PointOctreeFileNode record;
+    std::memcpy(&record, m_data + header.node_table_offset + i * sizeof(record), sizeof(record));
+
+    // Children must come after their parent, which also rules out cycles
+    const bool valid_children = record.child_count == 0 ||
+                                (record.first_child > i && record.child_count <= 8 && record.first_child + record.child_count <= header.node_count);
+    const bool valid_points = record.point_count <= NODE_CAPACITY && record.data_offset <= header.node_table_offset &&
+                              record.point_count * sizeof(PointOctreePoint) <= header.node_table_offset - record.data_offset;
+    if (!valid_children || !valid_points) {
+      PRINT_ERROR("Point octree node %u is corrupt\n", i);
+      return false;
+    }
+
+    auto &node = m_nodes[i];
+    node.sphere = gl::vec4(record.center[0], record.center[1], record.center[2], record.half_size * std::sqrt(3.0f));
+    node.spacing = record.spacing;
+    node.point_count = record.point_count;
+    node.first_child = record.first_child;
+    node.child_count = record.child_count;
+    node.data_offset = record.data_offset;
+  }
+
+  m_node_pages.assign(m_nodes.size(), -1);
+  m_node_loading.assign(m_nodes.size(), 0);
+  m_stats.node_count = m_nodes.size();
+
+  return true;
+}
+
+bool PointOctreeStreamer::createPool(int pool_page_count) {
+  GLint max_texture_size;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+
+  const int max_pages_per_side = max_texture_size / PAGE_SIDE;
+  m_pool_page_count = ::clamp(pool_page_count, 1, max_pages_per_side * max_pages_per_side);
+  m_pool_pages_x = std::min(int(std::ceil(std::sqrt(float(m_pool_page_count)))), max_pages_per_side);
+  const int pool_pages_y = (m_pool_page_count + m_pool_pages_x - 1) / m_pool_pages_x;
+
+  const gl::TextureOpts position_opts{ GL_TEXTURE_2D, GL_RGBA32F, GL_RGBA, GL_FLOAT, GL_NEAREST, GL_NEAREST };
+  const gl::TextureOpts color_opts{ GL_TEXTURE_2D, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, GL_NEAREST, GL_NEAREST };
+  const gl::TextureOpts node_table_opts{ GL_TEXTURE_2D, GL_RGBA32I, GL_RGBA_INTEGER, GL_INT, GL_NEAREST, GL_NEAREST };
+
+  gl::createTexture(m_position_texture, m_pool_pages_x * PAGE_SIDE, pool_pages_y * PAGE_SIDE, position_opts);
+  gl::createTexture(m_color_texture, m_pool_pages_x * PAGE_SIDE, pool_pages_y * PAGE_SIDE, color_opts);
+
+  const int node_table_height = (m_pool_page_count + NODE_TABLE_WIDTH - 1) / NODE_TABLE_WIDTH;
+  gl::createTexture(m_node_table_texture, NODE_TABLE_WIDTH, node_table_height, node_table_opts);
+  m_node_table.assign(std::size_t(NODE_TABLE_WIDTH) * node_table_height, gl::ivec4(0));
+
+  m_page_nodes.assign(m_pool_page_count, NO_NODE);
+  m_page_last_used.assign(m_pool_page_count, 0);
+  m_free_pages.resize(m_pool_page_count);
+  for (int i = 0; i < m_pool_page_count; ++i) {
+    m_free_pages[i] = m_pool_page_count - 1 - i; // Handed out from the back, so page 0 goes first
+  }
+
+  return m_position_texture.id && m_color_texture.id && m_node_table_texture.id;
+}
+
+void PointOctreeStreamer::requestLoad(uint32_t node) {
+  m_node_loading[node] = 1;
+  ++m_pending_load_count;
+
+  m_pool->submit([this, node]() {
+    if (!m_cancelled.load(std::memory_order_relaxed)) {
+      LoadedNode loaded;
+      loadNode(node, loaded);
+
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_loaded_nodes.push_back(std::move(loaded));
+    }
+    --m_pending_load_count;
+  });
+}
+
+void PointOctreeStreamer::loadNode(uint32_t index, LoadedNode &out) const {
+  const auto &node = m_nodes[index];
+
+  out.node = index;
+  out.row_count = int((node.point_count + PAGE_SIDE - 1) / PAGE_SIDE);
+  out.positions.assign(std::size_t(out.row_count) * PAGE_SIDE, gl::vec4(0.0f));
+  out.colors.assign(std::size_t(out.row_count) * PAGE_SIDE, 0);
+
+  const uint8_t *src = m_data + node.data_offset;
+  for (uint32_t i = 0; i < node.point_count; ++i) {
+    PointOctreePoint point;
+    std::memcpy(&point, src + i * sizeof(point), sizeof(point));
+
+    out.positions[i] = gl::vec4(point.position[0], point.position[1], point.position[2], 1.0f);
+    std::memcpy(&out.colors[i], point.color, sizeof(point.color));
+  }
+}
+
+int PointOctreeStreamer::claimPage() {
+  if (!m_free_pages.empty()) {
+    const int page = m_free_pages.back();
+    m_free_pages.pop_back();
+    return page;
+  }
+
+  // Least recently drawn page that isn't needed for this update
+  int page = -1;
+  for (int i = 0; i < m_pool_page_count; ++i) {
+    if (m_page_last_used[i] != m_update_index && (page < 0 || m_page_last_used[i] < m_page_last_used[page])) {
+      page = i;
+    }
+  }
+  if (page >= 0) {
+    m_node_pages[m_page_nodes[page]] = -1;
+    m_page_nodes[page] = NO_NODE;
+  }
+  return page;
+}
+
+void PointOctreeStreamer::uploadLoadedNodes() {
+  bool staging = false;
+  std::size_t offset_bytes = 0;
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_loaded_nodes.empty()) {
+    const auto &next = m_loaded_nodes.front();
+    const std::size_t positions_size_bytes = next.positions.size() * sizeof(gl::vec4);
+    const std::size_t colors_size_bytes = next.colors.size() * sizeof(uint32_t);
+
+    if (staging && offset_bytes + positions_size_bytes + colors_size_bytes > m_uploader.getSlotSizeBytes()) {
+      m_uploader.end();
+      staging = false;
+    }
+    if (!staging) {
+      if (!m_uploader.begin()) {
+        break;
+      }
+      staging = true;
+      offset_bytes = 0;
+    }
+
+    const auto loaded = std::move(m_loaded_nodes.front());
+    m_loaded_nodes.pop_front();
+    lock.unlock();
+
+    m_node_loading[loaded.node] = 0;
+
+    // Without a page the load is dropped, and the node is requested again once it's selected and pages free up
+    const int page = loaded.row_count > 0 ? claimPage() : -1;
+    if (page >= 0) {
+      m_page_nodes[page] = loaded.node;
+      m_page_last_used[page] = m_update_index;
+      m_node_pages[loaded.node] = page;
+
+      const int x = (page % m_pool_pages_x) * PAGE_SIDE;
+      const int y = (page / m_pool_pages_x) * PAGE_SIDE;
+
+      m_uploader.write(offset_bytes, loaded.positions.data(), positions_size_bytes);
+      m_uploader.write(offset_bytes + positions_size_bytes, loaded.colors.data(), colors_size_bytes);
+      m_uploader.copyToTextureRegion(m_position_texture, x, y, PAGE_SIDE, loaded.row_count, offset_bytes);
+      m_uploader.copyToTextureRegion(m_color_texture, x, y, PAGE_SIDE, loaded.row_count, offset_bytes + positions_size_bytes);
+      offset_bytes += positions_size_bytes + colors_size_bytes;
+    }
+
+    lock.lock();
+  }
+  lock.unlock();
+
+  if (staging) {
+    m_uploader.end();
+  }
+}
+
+void PointOctreeStreamer::update(const gl::mat4 *model_view_projections, int view_count, const gl::vec3 &eye_position, float pixels_per_unit) {
+  assert(view_count >= 1 && view_count <= MAX_VIEWS);
+
+  ++m_update_index;
+
+  gl::vec4 planes[MAX_VIEWS][6];
+  for (int i = 0; i < view_count; ++i) {
+    gl::calcFrustumPlanes(model_view_projections[i], planes[i]);
+  }
+  const auto isVisible = [&](const Node &node) {
+    for (int i = 0; i < view_count; ++i) {
+      if (gl::isSphereInFrustum(planes[i], node.sphere)) return true;
+    }
+    return false;
+  };
+
+  const auto projectedSpacing = [&](const Node &node) {
+    const float distance = std::max(gl::distance(gl::vec3(node.sphere), eye_position) - node.sphere.w, 1e-3f);
+    return node.spacing * pixels_per_unit / distance;
+  };
+  const auto lessError = [](const std::pair<float, uint32_t> &a, const std::pair<float, uint32_t> &b) { return a.first < b.first; };
+
+  // Refine the visible node with the biggest error until it's under the threshold everywhere or the pool is full
+  m_selected_nodes.clear();
+  m_candidates.clear();
+  if (isVisible(m_nodes[0])) {
+    m_candidates.emplace_back(projectedSpacing(m_nodes[0]), 0);
+  }
+
+  while (!m_candidates.empty() && m_selected_nodes.size() < std::size_t(m_pool_page_count)) {
+    std::pop_heap(m_candidates.begin(), m_candidates.end(), lessError);
+    const auto candidate = m_candidates.back();
+    m_candidates.pop_back();
+
+    m_selected_nodes.push_back(candidate.second);
+    if (candidate.first <= m_error_threshold) continue;
+
+    const auto &node = m_nodes[candidate.second];
+    for (uint32_t i = node.first_child; i < node.first_child + node.child_count; ++i) {
+      if (isVisible(m_nodes[i])) {
+        m_candidates.emplace_back(projectedSpacing(m_nodes[i]), i);
+        std::push_heap(m_candidates.begin(), m_candidates.end(), lessError);
+      }
+    }
+  }
+
+  // Pin the selection before uploads evict anything, then queue what's missing, coarsest first
+  for (const auto node : m_selected_nodes) {
+    if (m_node_pages[node] >= 0) {
+      m_page_last_used[m_node_pages[node]] = m_update_index;
+    }
+  }
+  for (const auto node : m_selected_nodes) {
+    if (m_pending_load_count >= MAX_PENDING_LOADS) break;
+    if (m_node_pages[node] < 0 && !m_node_loading[node]) {
+      requestLoad(node);
+    }
+  }
+
+  uploadLoadedNodes();
+
+  std::size_t drawn_node_count = 0;
+  std::size_t drawn_point_count = 0;
+  for (const auto node : m_selected_nodes) {
+    const int page = m_node_pages[node];
+    if (page < 0) continue;
+
+    int32_t spacing_bits;
+    std::memcpy(&spacing_bits, &m_nodes[node].spacing, sizeof(spacing_bits));
+
+    m_node_table[drawn_node_count++] = gl::ivec4(page % m_pool_pages_x, page / m_pool_pages_x, int(m_nodes[node].point_count), spacing_bits);
+    drawn_point_count += m_nodes[node].point_count;
+  }
+  if (drawn_node_count > 0) {
+    gl::updateTexture(m_node_table_texture, m_node_table.data());
+  }
+
+  m_stats.resident_node_count = std::size_t(m_pool_page_count) - m_free_pages.size();
+  m_stats.drawn_node_count = drawn_node_count;
+  m_stats.drawn_point_count = drawn_point_count;
+  m_stats.pending_load_count = m_pending_load_count;
+}
@@ -0,0 +1,353 @@
+#include "app/recorder.hpp"
+
+#include "app/app.hpp"
+#include "app/file.hpp"
+#include "app/log.hpp"
+
+#include <cstring>
+#include <string>
+
+static constexpr char INPUT_LOG_MAGIC[4]{ 'P', 'S', 'T', 'I' };
+static constexpr uint32_t INPUT_LOG_VERSION{ 2 };
+
+// Magic, version, and the FrameInput size so logs from a build with a different layout are rejected
+static constexpr size_t INPUT_LOG_HEADER_SIZE{ sizeof(INPUT_LOG_MAGIC) + 2 * sizeof(uint32_t) };
+static constexpr size_t INPUT_EVENT_HEADER_SIZE{ sizeof(uint8_t) + sizeof(uint32_t) };
+
+static_assert(sizeof(float) == 4 && sizeof(double) == 8, "Input logs store IEEE floats");
+
+// Reads values out of an event payload. Reading past the end sets `failed` and returns zeros.
+struct PayloadReader {
+  const uint8_t *data;
+  uint32_t size;
+  uint32_t offset = 0;
+  bool failed = false;
+
+  void read(void *dest, size_t size_bytes) {
+    if (failed || size - offset < size_bytes) {
+      failed = true;
+      std::memset(dest, 0, size_bytes);
+      return;
+    }
+    std::memcpy(dest, data + offset, size_bytes);
+    offset += uint32_t(size_bytes);
+  }
+
+  template <typename T>
+  T read() {
+    T value;
+    read(&value, sizeof(T));
+    return value;
+  }
+
+  std::string_view readString() {
+    const auto length = read<uint32_t>();
+    if (failed || size - offset < length) {
+      failed = true;
+      return {};
+    }
+    std::string_view str(reinterpret_cast<const char *>(data + offset), length);
+    offset += length;
+    return str;
+  }
+};
+
+
+// Recorder
+
+void InputRecorder::start() {
+  m_data.clear();
+  m_frame_count = 0;
+  m_pause_depth = 0;
+  m_recording = true;
+
+  const uint32_t frame_input_size = sizeof(FrameInput);
+  write(INPUT_LOG_MAGIC, sizeof(INPUT_LOG_MAGIC));
+  write(INPUT_LOG_VERSION);
+  write(frame_input_size);
+}
+
+void InputRecorder::stop() {
+  m_recording = false;
+}
+
+void InputRecorder::pause() {
+  ++m_pause_depth;
+}
+
+void InputRecorder::resume() {
+  assert(m_pause_depth > 0);
+  --m_pause_depth;
+}
+
+void InputRecorder::beginEvent(InputEventType type, size_t payload_size_bytes) {
+  write(type);
+  write(uint32_t(payload_size_bytes));
+}
+
+void InputRecorder::write(const void *data, size_t size_bytes) {
+  const auto bytes = static_cast<const uint8_t *>(data);
+  m_data.insert(m_data.end(), bytes, bytes + size_bytes);
+}
+
+void InputRecorder::writeString(std::string_view str) {
+  write(uint32_t(str.size()));
+  write(str.data(), str.size());
+}
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+bool InputRecorder::save(const char *path) const {
+  return writeFile(path, m_data.data(), m_data.size());
+}
+#endif
+
+void InputRecorder::recordFrame(const FrameInput &input) {
+  if (!isRecording()) return;
+  beginEvent(INPUT_EVENT_FRAME, sizeof(FrameInput));
+  write(input);
+  ++m_frame_count;
+}
+
+void InputRecorder::recordBeginFrame() {
+  if (!isRecording()) return;
+  beginEvent(INPUT_EVENT_BEGIN_FRAME, 0);
+}
+
+void InputRecorder::recordEndFrame() {
+  if (!isRecording()) return;
+  beginEvent(INPUT_EVENT_END_FRAME, 0);
+  ++m_frame_count;
+}
+
+void InputRecorder::recordUpdate(int frame_id, double time_seconds, double time_delta_seconds) {
+  if (!isRecording()) return;
+  beginEvent(INPUT_EVENT_UPDATE, sizeof(int32_t) + 2 * sizeof(double));
+  write(int32_t(frame_id));
+  write(time_seconds);
+  write(time_delta_seconds);
+}
+
+void InputRecorder::recordSimulate(int display_width, int display_height) {
+  if (!isRecording()) return;
+  beginEvent(INPUT_EVENT_SIMULATE, 2 * sizeof(int32_t));
+  write(int32_t(display_width));
+  write(int32_t(display_height));
+}
+
+void InputRecorder::recordRender(int display_width, int display_height) {
+  if (!isRecording()) return;
+  beginEvent(INPUT_EVENT_RENDER, 2 * sizeof(int32_t));
+  write(int32_t(display_width));
+  write(int32_t(display_height));
+}
+
+void InputRecorder::recordViewAndProjectionMatrices(const float *view_matrix_values, const float *projection_matrix_values) {
+  if (!isRecording()) return;
+  beginEvent(INPUT_EVENT_VIEW_AND_PROJECTION, 32 * sizeof(float));
+  write(view_matrix_values, 16 * sizeof(float));
+  write(projection_matrix_values, 16 * sizeof(float));
+}
+
+void InputRecorder::recordController(int index,
+                                     const float *position_values,
+                                     const float *velocity_values,
+                                     const float *orientation_values,
+                                     const float *buttons_values) {
+  if (!isRecording()) return;
+  beginEvent(INPUT_EVENT_CONTROLLER, sizeof(int32_t) + 14 * sizeof(float));
+  write(int32_t(index));
+  write(position_values, 3 * sizeof(float));
+  write(velocity_values, 3 * sizeof(float));
+  write(orientation_values, 4 * sizeof(float));
+  write(buttons_values, 4 * sizeof(float));
+}
+
+void InputRecorder::recordUserShaderSource(int index, std::string_view shader_src) {
+  if (!isRecording()) return;
+  beginEvent(INPUT_EVENT_USER_SHADER_SOURCE, sizeof(int32_t) + sizeof(uint32_t) + shader_src.size());
+  write(int32_t(index));
+  writeString(shader_src);
+}
+
+void InputRecorder::recordCompileShaderPrograms() {
+  if (!isRecording()) return;
+  beginEvent(INPUT_EVENT_COMPILE_SHADER_PROGRAMS, 0);
+}
+
+void InputRecorder::recordUserParam(std::string_view name, float value) {
+  if (!isRecording()) return;
+  beginEvent(INPUT_EVENT_USER_PARAM, sizeof(uint32_t) + name.size() + sizeof(float));
+  writeString(name);
+  write(value);
+}
+
+void InputRecorder::recordShaderVariant(std::string_view name, std::string_view value) {
+  if (!isRecording()) return;
+  beginEvent(INPUT_EVENT_SHADER_VARIANT, 2 * sizeof(uint32_t) + name.size() + value.size());
+  writeString(name);
+  writeString(value);
+}
+
+
+// Replayer
+
+bool InputReplayer::load(const uint8_t *data, size_t size_bytes) {
+  m_data.clear();
+  rewind();
+
+  if (size_bytes < INPUT_LOG_HEADER_SIZE || std::memcmp(data, INPUT_LOG_MAGIC, sizeof(INPUT_LOG_MAGIC)) != 0) {
+    PRINT_ERROR("Input log has no valid header\n");
+    return false;
+  }
+
+  uint32_t version, frame_input_size;
+  std::memcpy(&version, data + sizeof(INPUT_LOG_MAGIC), sizeof(uint32_t));
+  std::memcpy(&frame_input_size, data + sizeof(INPUT_LOG_MAGIC) + sizeof(uint32_t), sizeof(uint32_t));
+  if (version != INPUT_LOG_VERSION || frame_input_size != sizeof(FrameInput)) {
+    PRINT_ERROR("Input log version %u (FrameInput size %u) is not supported\n", version, frame_input_size);
+    return false;
+  }
+
+  m_data.assign(data, data + size_bytes);
+  rewind();
+
+  return true;
+}
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+bool InputReplayer::load(const char *path) {
+  MappedFile file;
+  return file.open(path) && load(file.data(), file.size());
+}
+#endif
+
+void InputReplayer::rewind() {
+  m_offset = INPUT_LOG_HEADER_SIZE;
+  m_frame_index = 0;
+  m_failed = false;
+}
+
+bool InputReplayer::isFinished() const {
+  return m_failed || m_offset >= m_data.size();
+}
+
+bool InputReplayer::step(App &app) {
+  while (!isFinished()) {
+    if (m_data.size() - m_offset < INPUT_EVENT_HEADER_SIZE) {
+      m_failed = true;
+      break;
+    }
+
+    const auto type = InputEventType(m_data[m_offset]);
+    uint32_t payload_size;
+    std::memcpy(&payload_size, &m_data[m_offset + sizeof(uint8_t)], sizeof(uint32_t));
+
+    const size_t payload_offset = m_offset + INPUT_EVENT_HEADER_SIZE;
+    if (m_data.size() - payload_offset < payload_size) {
+      m_failed = true;
+      break;
+    }
+
+    m_offset = payload_offset + payload_size;
+
+    if (!replayEvent(app, type, m_data.data() + payload_offset, payload_size)) {
+      PRINT_ERROR("Malformed input log event %d at offset %zu\n", int(type), payload_offset);
+      m_failed = true;
+      break;
+    }
+
+    if (type == INPUT_EVENT_FRAME || type == INPUT_EVENT_END_FRAME) {
+      ++m_frame_index;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool InputReplayer::replayEvent(App &app, InputEventType type, const uint8_t *payload, uint32_t payload_size_bytes) {
+  PayloadReader reader{ payload, payload_size_bytes };
+
+  switch (type) {
+    case INPUT_EVENT_FRAME: {
+      if (payload_size_bytes != sizeof(FrameInput)) return false;
+      std::memcpy(app.getFrameInput(), payload, sizeof(FrameInput));
+      app.frame();
+      break;
+    }
+    case INPUT_EVENT_BEGIN_FRAME: {
+      app.beginFrame();
+      break;
+    }
+    case INPUT_EVENT_END_FRAME: {
+      app.endFrame();
+      break;
+    }
+    case INPUT_EVENT_UPDATE: {
+      const auto frame_id = reader.read<int32_t>();
+      const auto time_seconds = reader.read<double>();
+      const auto time_delta_seconds = reader.read<double>();
+      if (reader.failed) return false;
+      app.update(frame_id, time_seconds, time_delta_seconds);
+      break;
+    }
+    case INPUT_EVENT_SIMULATE:
+    case INPUT_EVENT_RENDER: {
+      const auto width = reader.read<int32_t>();
+      const auto height = reader.read<int32_t>();
+      if (reader.failed) return false;
+      if (type == INPUT_EVENT_SIMULATE) {
+        app.simulate(width, height);
+      }
+      else {
+        app.render(width, height);
+      }
+      break;
+    }
+    case INPUT_EVENT_VIEW_AND_PROJECTION: {
+      float values[32];
+      reader.read(values, sizeof(values));
+      if (reader.failed) return false;
+      app.setViewAndProjectionMatrices(&values[0], &values[16]);
+      break;
+    }
+    case INPUT_EVENT_CONTROLLER: {
+      const auto index = reader.read<int32_t>();
+      float values[14];
+      reader.read(values, sizeof(values));
+      if (reader.failed || index < 0 || index >= FrameInput::MAX_CONTROLLERS) return false;
+      app.setControllerAtIndex(index, &values[0], &values[3], &values[6], &values[10]);
+      break;
+    }
+    case INPUT_EVENT_USER_SHADER_SOURCE: {
+      const auto index = reader.read<int32_t>();
+      const auto shader_src = reader.readString();
+      if (reader.failed || index < 0 || index >= int(app.getUserShaderSourceCount())) return false;
+      app.setUserShaderSourceAtIndex(index, shader_src);
+      break;
+    }
+    case INPUT_EVENT_COMPILE_SHADER_PROGRAMS: {
+      app.tryCompileShaderPrograms();
+      break;
+    }
+    case INPUT_EVENT_USER_PARAM: {
+      const auto name = reader.readString();
+      const auto value = reader.read<float>();
+      if (reader.failed) return false;
+      app.setUserParam(name, value);
+      break;
+    }
+    case INPUT_EVENT_SHADER_VARIANT: {
+      const auto name = reader.readString();
+      const auto value = reader.readString();
+      if (reader.failed) return false;
+      app.setShaderVariant(name, value);
+      break;
+    }
+    default:
+      // Unknown events from newer builds are skipped
+      break;
+  }
+
+  return true;
+}
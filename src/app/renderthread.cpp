@@ -0,0 +1,170 @@
+#include "app/renderthread.hpp"
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+
+#include <algorithm>
+
+RenderThread::RenderThread(App &app)
+: m_app(app) {
+}
+
+RenderThread::~RenderThread() {
+  stop();
+}
+
+bool RenderThread::start(std::function<void()> make_context_current, std::function<void()> present) {
+  if (m_thread.joinable()) {
+    return false;
+  }
+
+  m_make_context_current = std::move(make_context_current);
+  m_present = std::move(present);
+
+  m_running.store(true, std::memory_order_release);
+  m_thread = std::thread([this] { run(); });
+
+  return true;
+}
+
+void RenderThread::stop() {
+  if (!m_thread.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_wake_mutex);
+    m_running.store(false, std::memory_order_release);
+  }
+  m_wake.notify_one();
+
+  m_thread.join();
+}
+
+bool RenderThread::push(RenderCommand &&command) {
+  const bool is_frame = command.type == RenderCommand::FRAME;
+  if (is_frame) {
+    m_frames_queued.fetch_add(1, std::memory_order_acq_rel);
+  }
+
+  if (!m_commands.push(std::move(command))) {
+    if (is_frame) {
+      m_frames_queued.fetch_sub(1, std::memory_order_acq_rel);
+    }
+    return false;
+  }
+
+  if (is_frame) {
+    std::lock_guard<std::mutex> lock(m_wake_mutex);
+  }
+  m_wake.notify_one();
+
+  return true;
+}
+
+void RenderThread::run() {
+  if (m_make_context_current) {
+    m_make_context_current();
+  }
+
+  m_app.init();
+
+  RenderCommand command;
+  while (m_running.load(std::memory_order_acquire)) {
+    if (m_commands.pop(command)) {
+      execute(command);
+      continue;
+    }
+
+    // Nothing queued. Frame pushes notify under the mutex, so a wakeup can't slip in between the check and the wait.
+    std::unique_lock<std::mutex> lock(m_wake_mutex);
+    m_wake.wait(lock, [this] { return !m_running.load(std::memory_order_acquire) || !m_commands.empty(); });
+  }
+
+  m_app.cleanup();
+}
+
+void RenderThread::execute(RenderCommand &command) {
+  switch (command.type) {
+    case RenderCommand::SET_VIEW_AND_PROJECTION:
+      m_app.setViewAndProjectionMatrices(&command.values[0], &command.values[16]);
+      break;
+
+    case RenderCommand::SET_CONTROLLER:
+      m_app.setControllerAtIndex(command.index, &command.values[0], &command.values[3], &command.values[6], &command.values[10]);
+      break;
+
+    case RenderCommand::SET_SHADER_SOURCE:
+      m_app.setUserShaderSourceAtIndex(command.index, command.text);
+      break;
+
+    case RenderCommand::COMPILE_SHADERS:
+      m_last_compile_succeeded.store(m_app.tryCompileShaderPrograms(), std::memory_order_release);
+      m_compile_count.fetch_add(1, std::memory_order_acq_rel);
+      break;
+
+    case RenderCommand::SET_USER_PARAM:
+      m_app.setUserParam(command.text, command.values[0]);
+      break;
+
+    case RenderCommand::FRAME:
+      *m_app.getFrameInput() = command.frame_input;
+      m_app.frame();
+
+      if (m_present) {
+        m_present();
+      }
+
+      m_frames_queued.fetch_sub(1, std::memory_order_acq_rel);
+      break;
+  }
+}
+
+bool RenderThread::setViewAndProjectionMatrices(const float *view_matrix_values, const float *projection_matrix_values) {
+  RenderCommand command;
+  command.type = RenderCommand::SET_VIEW_AND_PROJECTION;
+  std::copy_n(view_matrix_values, 16, &command.values[0]);
+  std::copy_n(projection_matrix_values, 16, &command.values[16]);
+  return push(std::move(command));
+}
+
+bool RenderThread::setControllerAtIndex(int index, const float *position_values, const float *velocity_values, const float *orientation_values, const float *buttons_values) {
+  RenderCommand command;
+  command.type = RenderCommand::SET_CONTROLLER;
+  command.index = index;
+  std::copy_n(position_values, 3, &command.values[0]);
+  std::copy_n(velocity_values, 3, &command.values[3]);
+  std::copy_n(orientation_values, 4, &command.values[6]);
+  std::copy_n(buttons_values, 4, &command.values[10]);
+  return push(std::move(command));
+}
+
+bool RenderThread::setUserShaderSourceAtIndex(int index, std::string_view shader_src) {
+  RenderCommand command;
+  command.type = RenderCommand::SET_SHADER_SOURCE;
+  command.index = index;
+  command.text = shader_src;
+  return push(std::move(command));
+}
+
+bool RenderThread::tryCompileShaderPrograms() {
+  RenderCommand command;
+  command.type = RenderCommand::COMPILE_SHADERS;
+  return push(std::move(command));
+}
+
+bool RenderThread::setUserParam(std::string_view name, float value) {
+  RenderCommand command;
+  command.type = RenderCommand::SET_USER_PARAM;
+  command.text = name;
+  command.values[0] = value;
+  return push(std::move(command));
+}
+
+bool RenderThread::pushFrame(const FrameInput &input) {
+  RenderCommand command;
+  command.type = RenderCommand::FRAME;
+  command.frame_input = input;
+  return push(std::move(command));
+}
+
+#endif
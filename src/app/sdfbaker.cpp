@@ -0,0 +1,359 @@
+#include "app/sdfbaker.hpp"
+
+#include "app/log.hpp"
+#include "app/util.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+struct SdfTriangle {
+  gl::vec3 a, b, c;
+};
+
+struct SdfBvhNode {
+  gl::vec3 min;
+  uint32_t first; // Leaves: first triangle. Inner nodes: right child, the left child directly follows the node.
+  gl::vec3 max;
+  uint32_t count; // Triangles in a leaf, 0 for inner nodes
+};
+
+struct SdfBvh {
+  std::vector<SdfTriangle> triangles; // In leaf order
+  std::vector<SdfBvhNode> nodes;
+};
+
+static constexpr uint32_t SDF_BVH_LEAF_SIZE{ 4 };
+static constexpr int SDF_BVH_MAX_DEPTH{ 64 }; // Bounds the traversal stacks, which hold at most one node per level plus one
+
+static float lengthSquared(const gl::vec3 &v) {
+  return gl::dot(v, v);
+}
+
+static uint32_t buildSdfBvhNode(SdfBvh &bvh,
+                                const std::vector<SdfTriangle> &triangles,
+                                const std::vector<gl::vec3> &centroids,
+                                std::vector<uint32_t> &order,
+                                uint32_t first,
+                                uint32_t count,
+                                int depth) {
+  const auto index = uint32_t(bvh.nodes.size());
+  bvh.nodes.emplace_back();
+
+  auto box_min = gl::vec3(FLT_MAX), box_max = gl::vec3(-FLT_MAX);
+  auto centroid_min = gl::vec3(FLT_MAX), centroid_max = gl::vec3(-FLT_MAX);
+  for (uint32_t i = first; i < first + count; ++i) {
+    const auto &t = triangles[order[i]];
+    box_min = gl::min(box_min, gl::min(t.a, gl::min(t.b, t.c)));
+    box_max = gl::max(box_max, gl::max(t.a, gl::max(t.b, t.c)));
+    centroid_min = gl::min(centroid_min, centroids[order[i]]);
+    centroid_max = gl::max(centroid_max, centroids[order[i]]);
+  }
+  bvh.nodes[index].min = box_min;
+  bvh.nodes[index].max = box_max;
+
+  const auto centroid_extent = centroid_max - centroid_min;
+  const int axis = centroid_extent.x > centroid_extent.y ? (centroid_extent.x > centroid_extent.z ? 0 : 2) : (centroid_extent.y > centroid_extent.z ? 1 : 2);
+
+  if (count <= SDF_BVH_LEAF_SIZE || depth >= SDF_BVH_MAX_DEPTH - 1 || centroid_extent[axis] <= 0.0f) {
+    bvh.nodes[index].first = first;
+    bvh.nodes[index].count = count;
+    return index;
+  }
+
+  // Median split along the widest spread of centroids
+  const uint32_t middle = first + count / 2;
+  std::nth_element(order.begin() + first, order.begin() + middle, order.begin() + first + count, [&](uint32_t a, uint32_t b) {
+    return centroids[a][axis] < centroids[b][axis];
+  });
+
+  buildSdfBvhNode(bvh, triangles, centroids, order, first, middle - first, depth + 1);
+  const uint32_t right = buildSdfBvhNode(bvh, triangles, centroids, order, middle, first + count - middle, depth + 1);
+
+  bvh.nodes[index].first = right;
+  bvh.nodes[index].count = 0;
+  return index;
+}
+
+static bool buildSdfBvh(const gl::DefaultTriangleMesh &mesh, SdfBvh &out_bvh) {
+  std::vector<SdfTriangle> triangles;
+  std::vector<gl::vec3> centroids;
+  triangles.reserve(mesh.triangles.size());
+  centroids.reserve(mesh.triangles.size());
+
+  // Zero area triangles have no closest point of their own and would only add NaNs
+  for (const auto &tri : mesh.triangles) {
+    const SdfTriangle t{ tri.vertices[0].position, tri.vertices[1].position, tri.vertices[2].position };
+    const float area_squared = lengthSquared(gl::cross(t.b - t.a, t.c - t.a));
+    if (area_squared > 0.0f && std::isfinite(area_squared)) {
+      triangles.push_back(t);
+      centroids.push_back((t.a + t.b + t.c) / 3.0f);
+    }
+  }
+
+  if (triangles.empty()) {
+    return false;
+  }
+
+  std::vector<uint32_t> order(triangles.size());
+  for (uint32_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+
+  out_bvh.nodes.clear();
+  out_bvh.nodes.reserve(2 * triangles.size() / SDF_BVH_LEAF_SIZE + 1);
+  buildSdfBvhNode(out_bvh, triangles, centroids, order, 0, uint32_t(triangles.size()), 0);
+
+  out_bvh.triangles.resize(triangles.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    out_bvh.triangles[i] = triangles[order[i]];
+  }
+
+  return true;
+}
+
+static float distanceSquaredToBox(const SdfBvhNode &node, const gl::vec3 &p) {
+  return lengthSquared(gl::max(gl::max(node.min - p, p - node.max), gl::vec3(0.0f)));
+}
+
+// Closest point on a triangle by Voronoi region, from Ericson's Real-Time Collision Detection
+static float distanceSquaredToTriangle(const SdfTriangle &t, const gl::vec3 &p) {
+  const auto ab = t.b - t.a;
+  const auto ac = t.c - t.a;
+
+  const auto ap = p - t.a;
+  const float d1 = gl::dot(ab, ap);
+  const float d2 = gl::dot(ac, ap);
+  if (d1 <= 0.0f && d2 <= 0.0f) return lengthSquared(ap);
+
+  const auto bp = p - t.b;
+  const float d3 = gl::dot(ab, bp);
+  const float d4 = gl::dot(ac, bp);
+  if (d3 >= 0.0f && d4 <= d3) return lengthSquared(bp);
+
+  const float vc = d1 * d4 - d3 * d2;
+  if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+    return lengthSquared(p - (t.a + ab * (d1 / (d1 - d3))));
+  }
+
+  const auto cp = p - t.c;
+  const float d5 = gl::dot(ab, cp);
+  const float d6 = gl::dot(ac, cp);
+  if (d6 >= 0.0f && d5 <= d6) return lengthSquared(cp);
+
+  const float vb = d5 * d2 - d1 * d6;
+  if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+    return lengthSquared(p - (t.a + ac * (d2 / (d2 - d6))));
+  }
+
+  const float va = d3 * d6 - d5 * d4;
+  if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+    return lengthSquared(p - (t.b + (t.c - t.b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)))));
+  }
+
+  const float denom = 1.0f / (va + vb + vc);
+  return lengthSquared(p - (t.a + ab * (vb * denom) + ac * (vc * denom)));
+}
+
+// Returns the smaller of `best_squared` and the squared distance to the closest triangle
+static float findClosestDistanceSquared(const SdfBvh &bvh, const gl::vec3 &p, float best_squared) {
+  uint32_t stack[SDF_BVH_MAX_DEPTH + 1];
+  int stack_size = 0;
+  stack[stack_size++] = 0;
+
+  while (stack_size > 0) {
+    const auto &node = bvh.nodes[stack[--stack_size]];
+    if (distanceSquaredToBox(node, p) >= best_squared) continue;
+
+    if (node.count > 0) {
+      for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+        best_squared = std::min(best_squared, distanceSquaredToTriangle(bvh.triangles[i], p));
+      }
+      continue;
+    }
+
+    // Visit the nearer child first so it tightens the bound for the other
+    const uint32_t left = uint32_t(&node - bvh.nodes.data()) + 1;
+    const uint32_t right = node.first;
+    const float left_distance = distanceSquaredToBox(bvh.nodes[left], p);
+    const float right_distance = distanceSquaredToBox(bvh.nodes[right], p);
+    const bool left_first = left_distance <= right_distance;
+
+    const float far_distance = left_first ? right_distance : left_distance;
+    const float near_distance = left_first ? left_distance : right_distance;
+    if (far_distance < best_squared) stack[stack_size++] = left_first ? right : left;
+    if (near_distance < best_squared) stack[stack_size++] = left_first ? left : right;
+  }
+
+  return best_squared;
+}
+
+// Collects the x of every crossing of the surface along the line parallel to x through (y, z)
+static void findRowCrossings(const SdfBvh &bvh, float y, float z, std::vector<float> &out_xs) {
+  out_xs.clear();
+
+  uint32_t stack[SDF_BVH_MAX_DEPTH + 1];
+  int stack_size = 0;
+  stack[stack_size++] = 0;
+
+  while (stack_size > 0) {
+    const auto &node = bvh.nodes[stack[--stack_size]];
+    if (y < node.min.y || y > node.max.y || z < node.min.z || z > node.max.z) continue;
+
+    if (node.count == 0) {
+      stack[stack_size++] = node.first;
+      stack[stack_size++] = uint32_t(&node - bvh.nodes.data()) + 1;
+      continue;
+    }
+
+    for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+      const auto &t = bvh.triangles[i];
+
+      // Barycentrics of (y, z) in the triangle projected onto the yz plane
+      const float e1y = t.b.y - t.a.y, e1z = t.b.z - t.a.z;
+      const float e2y = t.c.y - t.a.y, e2z = t.c.z - t.a.z;
+      const float det = e1y * e2z - e2y * e1z;
+      if (det == 0.0f) continue; // Edge on to the line
+
+      const float py = y - t.a.y, pz = z - t.a.z;
+      const float u = (py * e2z - e2y * pz) / det;
+      const float v = (e1y * pz - py * e1z) / det;
+      if (u < 0.0f || v < 0.0f || u + v > 1.0f) continue;
+
+      out_xs.push_back(t.a.x + u * (t.b.x - t.a.x) + v * (t.c.x - t.a.x));
+    }
+  }
+
+  std::sort(out_xs.begin(), out_xs.end());
+}
+
+static void allocateSignedDistanceVolume(const gl::vec3 &bounds_min, const gl::vec3 &bounds_max, int max_resolution, SignedDistanceVolume &out_volume) {
+  max_resolution = std::max(max_resolution, 2);
+
+  const auto extent = gl::max(bounds_max - bounds_min, gl::vec3(1e-6f));
+  const float voxel_size = std::max(std::max(extent.x, extent.y), extent.z) / float(max_resolution);
+
+  for (int i = 0; i < 3; ++i) {
+    out_volume.resolution[i] = ::clamp(int(std::ceil(extent[i] / voxel_size)), 2, max_resolution);
+  }
+
+  // Rounding up grows the bounds. Grow them evenly around the center.
+  const auto center = 0.5f * (bounds_min + bounds_max);
+  const auto size = gl::vec3(out_volume.resolution) * voxel_size;
+  out_volume.bounds_min = center - 0.5f * size;
+  out_volume.bounds_max = center + 0.5f * size;
+
+  out_volume.texels.assign(size_t(out_volume.resolution.x) * out_volume.resolution.y * out_volume.resolution.z, gl::vec4(0.0f));
+}
+
+// Central differences of the baked distances, one sided at the faces of the volume
+static void computeSignedDistanceGradients(ThreadPool &pool, SignedDistanceVolume &volume) {
+  const auto &res = volume.resolution;
+  const gl::ivec3 stride(1, res.x, res.x * res.y);
+
+  pool.parallelFor(size_t(res.z), 1, [&](size_t z_begin, size_t z_end) {
+    for (int z = int(z_begin); z < int(z_end); ++z) {
+      for (int y = 0; y < res.y; ++y) {
+        for (int x = 0; x < res.x; ++x) {
+          const gl::ivec3 coord(x, y, z);
+          auto &texel = volume.texels[x + y * stride.y + z * stride.z];
+
+          gl::vec3 gradient;
+          for (int axis = 0; axis < 3; ++axis) {
+            const int lo = std::max(coord[axis] - 1, 0);
+            const int hi = std::min(coord[axis] + 1, res[axis] - 1);
+            const size_t base = size_t(x * stride.x + y * stride.y + z * stride.z) - size_t(coord[axis] * stride[axis]);
+            gradient[axis] = (volume.texels[base + hi * stride[axis]].w - volume.texels[base + lo * stride[axis]].w) / float(hi - lo);
+          }
+
+          const float length = gl::length(gradient);
+          texel = gl::vec4(length > 0.0f ? gradient / length : gl::vec3(0.0f), texel.w);
+        }
+      }
+    }
+  });
+}
+
+bool bakeMeshSignedDistance(const gl::DefaultTriangleMesh &mesh,
+                            int max_resolution,
+                            float padding,
+                            ThreadPool &pool,
+                            SignedDistanceVolume &out_volume) {
+  SdfBvh bvh;
+  if (!buildSdfBvh(mesh, bvh)) {
+    PRINT_ERROR("Mesh has no triangles to bake a signed distance field from\n");
+    return false;
+  }
+
+  const auto &root = bvh.nodes[0];
+  allocateSignedDistanceVolume(root.min - gl::vec3(padding), root.max + gl::vec3(padding), max_resolution, out_volume);
+
+  const auto &res = out_volume.resolution;
+  const auto voxel_size = (out_volume.bounds_max - out_volume.bounds_min) / gl::vec3(res);
+
+  // Rays run slightly off the voxel centers so they don't graze the shared edges of axis aligned meshes
+  const gl::vec2 ray_offset = gl::vec2(0.0001237f, 0.0000791f) * gl::vec2(voxel_size.y, voxel_size.z);
+
+  pool.parallelFor(size_t(res.z), 1, [&](size_t z_begin, size_t z_end) {
+    std::vector<float> crossings;
+
+    for (int z = int(z_begin); z < int(z_end); ++z) {
+      for (int y = 0; y < res.y; ++y) {
+        const auto row_start = out_volume.bounds_min + (gl::vec3(0, y, z) + 0.5f) * voxel_size;
+        findRowCrossings(bvh, row_start.y + ray_offset.x, row_start.z + ray_offset.y, crossings);
+
+        size_t crossed_count = 0;
+        float previous_distance = -1.0f;
+
+        for (int x = 0; x < res.x; ++x) {
+          const auto p = gl::vec3(row_start.x + float(x) * voxel_size.x, row_start.y, row_start.z);
+
+          // Distance changes by at most one voxel between neighbors, which bounds the search from the start
+          float best_squared = FLT_MAX;
+          if (previous_distance >= 0.0f) {
+            const float bound = (previous_distance + voxel_size.x) * 1.0001f + 1e-6f;
+            best_squared = bound * bound;
+          }
+          const float distance = std::sqrt(findClosestDistanceSquared(bvh, p, best_squared));
+          previous_distance = distance;
+
+          while (crossed_count < crossings.size() && crossings[crossed_count] < p.x) {
+            ++crossed_count;
+          }
+          const bool inside = (crossed_count & 1) != 0;
+
+          out_volume.texels[x + (y + size_t(z) * res.y) * res.x].w = inside ? -distance : distance;
+        }
+      }
+    }
+  });
+
+  computeSignedDistanceGradients(pool, out_volume);
+
+  return true;
+}
+
+void bakeFunctionSignedDistance(const std::function<float(const gl::vec3 &)> &distance,
+                                const gl::vec3 &bounds_min,
+                                const gl::vec3 &bounds_max,
+                                int max_resolution,
+                                ThreadPool &pool,
+                                SignedDistanceVolume &out_volume) {
+  allocateSignedDistanceVolume(bounds_min, bounds_max, max_resolution, out_volume);
+
+  const auto &res = out_volume.resolution;
+  const auto voxel_size = (out_volume.bounds_max - out_volume.bounds_min) / gl::vec3(res);
+
+  pool.parallelFor(size_t(res.z), 1, [&](size_t z_begin, size_t z_end) {
+    for (int z = int(z_begin); z < int(z_end); ++z) {
+      for (int y = 0; y < res.y; ++y) {
+        for (int x = 0; x < res.x; ++x) {
+          const auto p = out_volume.bounds_min + (gl::vec3(x, y, z) + 0.5f) * voxel_size;
+          out_volume.texels[x + (y + size_t(z) * res.y) * res.x].w = distance(p);
+        }
+      }
+    }
+  });
+
+  computeSignedDistanceGradients(pool, out_volume);
+}
@@ -0,0 +1,94 @@
+#include "app/threadpool.hpp"
+
+#include <algorithm>
+
+void ThreadPool::parallelFor(size_t count, size_t task_size, const std::function<void(size_t begin, size_t end)> &task) {
+  for (size_t begin = 0; begin < count; begin += task_size) {
+    const size_t end = std::min(begin + task_size, count);
+    submit([&task, begin, end]() { task(begin, end); });
+  }
+  wait();
+}
+
+#if defined(PLATFORM_EMSCRIPTEN)
+
+ThreadPool::ThreadPool(size_t) {}
+
+ThreadPool::~ThreadPool() {}
+
+void ThreadPool::submit(std::function<void()> task) {
+  task();
+}
+
+void ThreadPool::wait() {}
+
+size_t ThreadPool::getThreadCount() const {
+  return 0;
+}
+
+#else
+
+ThreadPool::ThreadPool(size_t thread_count) {
+  if (thread_count == 0) {
+    thread_count = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+  }
+
+  m_threads.reserve(thread_count);
+  for (size_t i = 0; i < thread_count; ++i) {
+    m_threads.emplace_back([this]() { run(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_task_available.notify_all();
+
+  for (auto &thread : m_threads) {
+    thread.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tasks.push_back(std::move(task));
+  }
+  m_task_available.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_tasks_done.wait(lock, [this]() { return m_tasks.empty() && m_running_count == 0; });
+}
+
+size_t ThreadPool::getThreadCount() const {
+  return m_threads.size();
+}
+
+void ThreadPool::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;) {
+    m_task_available.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+    if (m_tasks.empty()) {
+      break;
+    }
+
+    auto task = std::move(m_tasks.front());
+    m_tasks.pop_front();
+    ++m_running_count;
+
+    lock.unlock();
+    task();
+    lock.lock();
+
+    --m_running_count;
+    if (m_tasks.empty() && m_running_count == 0) {
+      m_tasks_done.notify_all();
+    }
+  }
+}
+
+#endif
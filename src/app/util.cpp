@@ -3,6 +3,7 @@
 #include "app/platform.hpp"
 
 #include <algorithm>
+#include <cmath>
 #include <random>
 
 
@@ -51,6 +52,33 @@ bool randChance(int denom) {
 }
 
 
+static uint32_t mortonSpreadBits(uint32_t x) {
+  x &= 0x0000ffff;
+  x = (x | (x << 8)) & 0x00ff00ff;
+  x = (x | (x << 4)) & 0x0f0f0f0f;
+  x = (x | (x << 2)) & 0x33333333;
+  x = (x | (x << 1)) & 0x55555555;
+  return x;
+}
+
+static uint32_t mortonCompactBits(uint32_t x) {
+  x &= 0x55555555;
+  x = (x | (x >> 1)) & 0x33333333;
+  x = (x | (x >> 2)) & 0x0f0f0f0f;
+  x = (x | (x >> 4)) & 0x00ff00ff;
+  x = (x | (x >> 8)) & 0x0000ffff;
+  return x;
+}
+
+uint32_t mortonEncode2(uint32_t x, uint32_t y) {
+  return mortonSpreadBits(x) | (mortonSpreadBits(y) << 1);
+}
+
+gl::uvec2 mortonDecode2(uint32_t code) {
+  return gl::uvec2(mortonCompactBits(code), mortonCompactBits(code >> 1));
+}
+
+
 constexpr uint32_t packColor32(const gl::vec4 &color) {
   return uint32_t(color.a * 255.0f) << 24
        | uint32_t(color.r * 255.0f) << 16
@@ -96,6 +124,84 @@ bool stringsEqualCaseInsensitive(std::string_view s1, std::string_view s2) {
 }
 
 
+static bool isAsciiDigit(uint8_t c) {
+  return c >= '0' && c <= '9';
+}
+
+bool parseFloat(const uint8_t *&p, const uint8_t *end, float &out_value) {
+  static const double POWERS_OF_TEN[]{ 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                       1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+  const uint8_t *start = p;
+
+  bool negative = false;
+  if (p < end && (*p == '+' || *p == '-')) {
+    negative = *p == '-';
+    ++p;
+  }
+
+  double mantissa = 0.0;
+  int exponent = 0;
+  bool has_digits = false;
+  for (; p < end && isAsciiDigit(*p); ++p) {
+    mantissa = mantissa * 10.0 + (*p - '0');
+    has_digits = true;
+  }
+  if (p < end && *p == '.') {
+    for (++p; p < end && isAsciiDigit(*p); ++p) {
+      mantissa = mantissa * 10.0 + (*p - '0');
+      --exponent;
+      has_digits = true;
+    }
+  }
+  if (!has_digits) {
+    p = start;
+    return false;
+  }
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const uint8_t *q = p + 1;
+    bool exponent_negative = false;
+    if (q < end && (*q == '+' || *q == '-')) {
+      exponent_negative = *q == '-';
+      ++q;
+    }
+    if (q < end && isAsciiDigit(*q)) {
+      int exponent_value = 0;
+      for (; q < end && isAsciiDigit(*q); ++q) {
+        exponent_value = std::min(exponent_value * 10 + (*q - '0'), 9999);
+      }
+      exponent += exponent_negative ? -exponent_value : exponent_value;
+      p = q;
+    }
+  }
+
+  double value = mantissa;
+  if (exponent != 0) {
+    const int abs_exponent = std::abs(exponent);
+    const double scale = abs_exponent < int(arraySize(POWERS_OF_TEN)) ? POWERS_OF_TEN[abs_exponent] : std::pow(10.0, abs_exponent);
+    value = exponent < 0 ? value / scale : value * scale;
+  }
+
+  out_value = float(negative ? -value : value);
+  return true;
+}
+
+
+uint64_t hashFnv1a64(const void *data, size_t size_bytes, uint64_t hash) {
+  const auto bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size_bytes; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+uint64_t hashFnv1a64(std::string_view str, uint64_t hash) {
+  return hashFnv1a64(str.data(), str.size(), hash);
+}
+
+
 std::string formatString(const char *fmt, ...) {
   va_list args;
   va_start(args, fmt);
@@ -0,0 +1,254 @@
+#include "app/vectorfield.hpp"
+
+#include "app/log.hpp"
+#include "app/util.hpp"
+
+#include "gtc/packing.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+struct VectorFieldHeader {
+  char magic[4];
+  uint32_t version;
+
+  int32_t resolution[3];
+  uint32_t component_type; // GL_FLOAT or GL_HALF_FLOAT
+
+  float bounds_min[3];
+  float bounds_max[3];
+
+  uint32_t _reserved[4];
+};
+
+static constexpr char VECTOR_FIELD_MAGIC[4]{ 'P', 'S', 'T', 'V' };
+static constexpr uint32_t VECTOR_FIELD_VERSION{ 1 };
+
+static_assert(sizeof(VectorFieldHeader) == 64, "Texels must stay aligned");
+
+static constexpr int MAX_VECTOR_FIELD_RESOLUTION{ 4096 };
+static constexpr std::size_t FGA_PARSE_CHUNK_SIZE{ 1 << 20 }; // Bytes of text per pool task
+
+static std::size_t getComponentSizeBytes(GLenum component_type) {
+  return component_type == GL_HALF_FLOAT ? sizeof(uint16_t) : sizeof(float);
+}
+
+// 64 bit since size_t is 32 on the web, where a field within the resolution limit can still wrap it
+static uint64_t getVoxelCount(const gl::ivec3 &resolution) {
+  return uint64_t(resolution.x) * resolution.y * resolution.z;
+}
+
+static bool isValidResolution(const gl::ivec3 &resolution) {
+  for (int i = 0; i < 3; ++i) {
+    if (resolution[i] <= 0 || resolution[i] > MAX_VECTOR_FIELD_RESOLUTION) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool isFgaSeparator(uint8_t c) {
+  return c == ',' || c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static const uint8_t *skipFgaSeparators(const uint8_t *p, const uint8_t *end) {
+  while (p < end && isFgaSeparator(*p)) ++p;
+  return p;
+}
+
+static bool parseBinaryVectorField(const uint8_t *data, std::size_t size_bytes, VectorField &out_field) {
+  VectorFieldHeader header;
+  std::memcpy(&header, data, sizeof(header));
+
+  const gl::ivec3 resolution(header.resolution[0], header.resolution[1], header.resolution[2]);
+  if (header.version != VECTOR_FIELD_VERSION || !isValidResolution(resolution) ||
+      (header.component_type != GL_FLOAT && header.component_type != GL_HALF_FLOAT)) {
+    PRINT_ERROR("Vector field header is invalid or from an unsupported version\n");
+    return false;
+  }
+
+  const uint64_t texels_size_bytes = getVoxelCount(resolution) * 4 * getComponentSizeBytes(header.component_type);
+  if (texels_size_bytes > size_bytes - sizeof(header)) {
+    PRINT_ERROR("Vector field is truncated\n");
+    return false;
+  }
+
+  out_field.resolution = resolution;
+  out_field.bounds_min = gl::vec3(header.bounds_min[0], header.bounds_min[1], header.bounds_min[2]);
+  out_field.bounds_max = gl::vec3(header.bounds_max[0], header.bounds_max[1], header.bounds_max[2]);
+  out_field.component_type = header.component_type;
+  out_field.texels = data + sizeof(header);
+  out_field.parsed_texels.clear();
+
+  return true;
+}
+
+static bool parseFgaVectorField(const uint8_t *data, std::size_t size_bytes, ThreadPool &pool, VectorField &out_field) {
+  const uint8_t *p = data;
+  const uint8_t *end = data + size_bytes;
+
+  float header[9];
+  for (auto &value : header) {
+    p = skipFgaSeparators(p, end);
+    if (!parseFloat(p, end, value)) {
+      PRINT_ERROR("Vector field is neither FGA nor binary\n");
+      return false;
+    }
+  }
+
+  for (int i = 0; i < 3; ++i) {
+    if (!(header[i] >= 1.0f && header[i] <= float(MAX_VECTOR_FIELD_RESOLUTION)) || header[i] != std::floor(header[i])) {
+      PRINT_ERROR("FGA vector field has an invalid resolution of %gx%gx%g\n", header[0], header[1], header[2]);
+      return false;
+    }
+  }
+  const gl::ivec3 resolution(header[0], header[1], header[2]);
+
+  // Every value takes at least a byte of text, and the parsed texels have to be addressable
+  const uint64_t voxel_count = getVoxelCount(resolution);
+  const uint64_t value_count = voxel_count * 3;
+  if (value_count > uint64_t(end - p) || voxel_count > std::numeric_limits<std::size_t>::max() / sizeof(gl::vec4)) {
+    PRINT_ERROR("FGA vector field of %dx%dx%d is larger than its file\n", resolution.x, resolution.y, resolution.z);
+    return false;
+  }
+
+  // Chunks end on a separator so no number is split between two of them
+  const std::size_t chunk_count = std::max<std::size_t>((end - p + FGA_PARSE_CHUNK_SIZE - 1) / FGA_PARSE_CHUNK_SIZE, 1);
+  std::vector<const uint8_t *> chunk_bounds(chunk_count + 1);
+  chunk_bounds[0] = p;
+  chunk_bounds[chunk_count] = end;
+  for (std::size_t i = 1; i < chunk_count; ++i) {
+    const uint8_t *bound = std::max(p + i * FGA_PARSE_CHUNK_SIZE, chunk_bounds[i - 1]);
+    while (bound < end && !isFgaSeparator(*bound)) ++bound;
+    chunk_bounds[i] = bound;
+  }
+
+  // Count the numbers in each chunk first, so every chunk knows which value it starts at
+  std::vector<std::size_t> chunk_starts(chunk_count + 1, 0);
+  pool.parallelFor(chunk_count, 1, [&](std::size_t begin, std::size_t finish) {
+    for (std::size_t i = begin; i < finish; ++i) {
+      std::size_t count = 0;
+      bool in_separator = true;
+      for (const uint8_t *q = chunk_bounds[i]; q < chunk_bounds[i + 1]; ++q) {
+        const bool separator = isFgaSeparator(*q);
+        count += in_separator && !separator;
+        in_separator = separator;
+      }
+      chunk_starts[i + 1] = count;
+    }
+  });
+  for (std::size_t i = 0; i < chunk_count; ++i) {
+    chunk_starts[i + 1] += chunk_starts[i];
+  }
+
+  if (chunk_starts[chunk_count] < value_count) {
+    PRINT_ERROR("FGA vector field has %zu values, %zu expected\n", chunk_starts[chunk_count], std::size_t(value_count));
+    return false;
+  }
+
+  out_field.parsed_texels.assign(std::size_t(voxel_count), gl::vec4(0.0f));
+
+  std::vector<uint8_t> chunk_failed(chunk_count, 0);
+  pool.parallelFor(chunk_count, 1, [&](std::size_t begin, std::size_t finish) {
+    for (std::size_t i = begin; i < finish; ++i) {
+      const uint8_t *q = chunk_bounds[i];
+      const uint8_t *chunk_end = chunk_bounds[i + 1];
+
+      std::size_t voxel = chunk_starts[i] / 3;
+      int component = int(chunk_starts[i] % 3);
+      for (std::size_t k = chunk_starts[i]; k < std::min(chunk_starts[i + 1], std::size_t(value_count)); ++k) {
+        q = skipFgaSeparators(q, chunk_end);
+        if (!parseFloat(q, chunk_end, out_field.parsed_texels[voxel][component])) {
+          chunk_failed[i] = 1;
+          break;
+        }
+        if (++component == 3) {
+          component = 0;
+          ++voxel;
+        }
+      }
+    }
+  });
+
+  if (std::find(chunk_failed.begin(), chunk_failed.end(), 1) != chunk_failed.end()) {
+    PRINT_ERROR("FGA vector field has values that aren't numbers\n");
+    out_field.parsed_texels.clear();
+    return false;
+  }
+
+  out_field.resolution = resolution;
+  out_field.bounds_min = gl::vec3(header[3], header[4], header[5]);
+  out_field.bounds_max = gl::vec3(header[6], header[7], header[8]);
+  out_field.component_type = GL_FLOAT;
+  out_field.texels = out_field.parsed_texels.data();
+
+  return true;
+}
+
+bool parseVectorField(const uint8_t *data, std::size_t size_bytes, ThreadPool &pool, VectorField &out_field) {
+  if (size_bytes >= sizeof(VectorFieldHeader) && std::memcmp(data, VECTOR_FIELD_MAGIC, sizeof(VECTOR_FIELD_MAGIC)) == 0) {
+    return parseBinaryVectorField(data, size_bytes, out_field);
+  }
+  return parseFgaVectorField(data, size_bytes, pool, out_field);
+}
+
+#if !defined(PLATFORM_EMSCRIPTEN)
+
+bool writeVectorField(const char *path, const VectorField &field, GLenum component_type) {
+  assert(field.texels != nullptr);
+  assert(component_type == GL_FLOAT || component_type == GL_HALF_FLOAT);
+
+  std::FILE *file = std::fopen(path, "wb");
+  if (file == nullptr) {
+    PRINT_ERROR("Failed to open vector field '%s' for writing\n", path);
+    return false;
+  }
+
+  VectorFieldHeader header{};
+  std::memcpy(header.magic, VECTOR_FIELD_MAGIC, sizeof(header.magic));
+  header.version = VECTOR_FIELD_VERSION;
+  header.component_type = component_type;
+  for (int i = 0; i < 3; ++i) {
+    header.resolution[i] = field.resolution[i];
+    header.bounds_min[i] = field.bounds_min[i];
+    header.bounds_max[i] = field.bounds_max[i];
+  }
+
+  bool succeeded = std::fwrite(&header, sizeof(header), 1, file) == 1;
+
+  const std::size_t component_count = std::size_t(getVoxelCount(field.resolution) * 4);
+  if (component_type == field.component_type) {
+    succeeded = succeeded && std::fwrite(field.texels, getComponentSizeBytes(component_type), component_count, file) == component_count;
+  }
+  else {
+    // Converted a slice at a time to keep the staging buffer small
+    const std::size_t slice_component_count = std::size_t(field.resolution.x) * field.resolution.y * 4;
+    std::vector<uint8_t> slice(slice_component_count * getComponentSizeBytes(component_type));
+
+    for (std::size_t first = 0; succeeded && first < component_count; first += slice_component_count) {
+      for (std::size_t i = 0; i < slice_component_count; ++i) {
+        if (component_type == GL_HALF_FLOAT) {
+          reinterpret_cast<uint16_t *>(slice.data())[i] = glm::packHalf1x16(static_cast<const float *>(field.texels)[first + i]);
+        }
+        else {
+          reinterpret_cast<float *>(slice.data())[i] = glm::unpackHalf1x16(static_cast<const uint16_t *>(field.texels)[first + i]);
+        }
+      }
+      succeeded = std::fwrite(slice.data(), 1, slice.size(), file) == slice.size();
+    }
+  }
+
+  if (std::fclose(file) != 0 || !succeeded) {
+    PRINT_ERROR("Failed to write vector field '%s'\n", path);
+    std::remove(path);
+    return false;
+  }
+
+  return true;
+}
+
+#endif
@@ -1,10 +1,13 @@
 #include "app/app.hpp"
 #include "app/log.hpp"
+#include "app/recorder.hpp"
 
 #include <emscripten.h>
 #include <emscripten/html5.h>
 
 static App g_app;
+static InputReplayer g_input_replayer;
+static std::vector<uint8_t> g_particle_snapshot;
 
 extern "C" {
 
@@ -13,6 +16,26 @@ void init() {
   g_app.init();
 }
 
+EMSCRIPTEN_KEEPALIVE
+FrameInput *getFrameInput() {
+  return g_app.getFrameInput();
+}
+
+EMSCRIPTEN_KEEPALIVE
+void frame() {
+  g_app.frame();
+}
+
+EMSCRIPTEN_KEEPALIVE
+void beginFrame() {
+  g_app.beginFrame();
+}
+
+EMSCRIPTEN_KEEPALIVE
+void endFrame() {
+  g_app.endFrame();
+}
+
 EMSCRIPTEN_KEEPALIVE
 void update(int frame_id, double time_seconds, double time_delta_seconds) {
   g_app.update(frame_id, time_seconds, time_delta_seconds);
@@ -61,9 +84,326 @@ void setControllerAtIndex(int index, const float *position_values, const float *
   g_app.setControllerAtIndex(index, position_values, velocity_values, orientation_values, buttons_values);
 }
 
+EMSCRIPTEN_KEEPALIVE
+bool setShaderVariant(const char *name, const char *value) {
+  return g_app.setShaderVariant(name, value);
+}
+
+EMSCRIPTEN_KEEPALIVE
+int getShaderVariantCount() {
+  return g_app.getShaderVariantCount();
+}
+
+EMSCRIPTEN_KEEPALIVE
+const char *getShaderVariantNameAtIndex(int index) {
+  return g_app.getShaderVariantAtIndex(index).name.c_str();
+}
+
+EMSCRIPTEN_KEEPALIVE
+const char *getShaderVariantValueAtIndex(int index) {
+  const auto &variant = g_app.getShaderVariantAtIndex(index);
+  return variant.values[variant.selected].c_str();
+}
+
+EMSCRIPTEN_KEEPALIVE
+bool setUserParam(const char *name, float value) {
+  return g_app.setUserParam(name, value);
+}
+
+EMSCRIPTEN_KEEPALIVE
+int getUserParamCount() {
+  return g_app.getUserParamCount();
+}
+
+EMSCRIPTEN_KEEPALIVE
+const char *getUserParamNameAtIndex(int index) {
+  return g_app.getUserParamAtIndex(index).name.c_str();
+}
+
+EMSCRIPTEN_KEEPALIVE
+float getUserParamValueAtIndex(int index) {
+  return g_app.getUserParamAtIndex(index).value;
+}
+
+EMSCRIPTEN_KEEPALIVE
+float getUserParamDefaultAtIndex(int index) {
+  return g_app.getUserParamAtIndex(index).default_value;
+}
+
+EMSCRIPTEN_KEEPALIVE
+float getUserParamMinAtIndex(int index) {
+  return g_app.getUserParamAtIndex(index).min_value;
+}
+
+EMSCRIPTEN_KEEPALIVE
+float getUserParamMaxAtIndex(int index) {
+  return g_app.getUserParamAtIndex(index).max_value;
+}
+
+EMSCRIPTEN_KEEPALIVE
+void latchPoses() {
+  g_app.latchPoses();
+}
+
 EMSCRIPTEN_KEEPALIVE
 double getAverageFramesPerSecond() {
   return g_app.getAverageFramesPerSecond();
 }
 
+EMSCRIPTEN_KEEPALIVE
+void startInputRecording() {
+  g_app.startInputRecording();
+}
+
+EMSCRIPTEN_KEEPALIVE
+void stopInputRecording() {
+  g_app.stopInputRecording();
+}
+
+EMSCRIPTEN_KEEPALIVE
+const uint8_t *getInputRecordingData() {
+  return g_app.getInputRecorder().getData().data();
+}
+
+EMSCRIPTEN_KEEPALIVE
+int getInputRecordingSize() {
+  return g_app.getInputRecorder().getData().size();
+}
+
+EMSCRIPTEN_KEEPALIVE
+int getInputRecordingFrameCount() {
+  return g_app.getInputRecorder().getFrameCount();
+}
+
+EMSCRIPTEN_KEEPALIVE
+bool loadInputReplay(const uint8_t *data, int size_bytes) {
+  return g_input_replayer.load(data, size_bytes);
+}
+
+EMSCRIPTEN_KEEPALIVE
+bool stepInputReplay() {
+  return g_input_replayer.step(g_app);
+}
+
+EMSCRIPTEN_KEEPALIVE
+int getInputReplayFrameIndex() {
+  return g_input_replayer.getFrameIndex();
+}
+
+// Takes a snapshot into memory owned by the module. Read it with getParticleSnapshotData/Size.
+EMSCRIPTEN_KEEPALIVE
+bool saveParticleSnapshot() {
+  return g_app.saveParticleSnapshot(g_particle_snapshot);
+}
+
+EMSCRIPTEN_KEEPALIVE
+const uint8_t *getParticleSnapshotData() {
+  return g_particle_snapshot.data();
+}
+
+EMSCRIPTEN_KEEPALIVE
+int getParticleSnapshotSize() {
+  return g_particle_snapshot.size();
+}
+
+EMSCRIPTEN_KEEPALIVE
+bool restoreParticleSnapshot(const uint8_t *data, int size_bytes) {
+  return g_app.restoreParticleSnapshot(data, size_bytes);
+}
+
+// The data is copied, so it can be freed as soon as this returns. Points upload over the following frames.
+EMSCRIPTEN_KEEPALIVE
+bool importPointCloud(const uint8_t *data, int size_bytes) {
+  return g_app.importPointCloud(data, size_bytes);
+}
+
+EMSCRIPTEN_KEEPALIVE
+float getPointCloudImportProgress() {
+  return g_app.getPointCloudImportProgress();
+}
+
+// `vertices` holds 3 vertices per triangle of 8 floats each: position xyz, normal xyz, texcoord uv
+static void unpackTriangleMesh(const float *vertices, int triangle_count, gl::DefaultTriangleMesh &out_mesh) {
+  out_mesh.triangles.resize(triangle_count);
+  for (auto &triangle : out_mesh.triangles) {
+    for (auto &vertex : triangle.vertices) {
+      vertex.position = gl::vec3(vertices[0], vertices[1], vertices[2]);
+      vertex.normal = gl::vec3(vertices[3], vertices[4], vertices[5]);
+      vertex.texcoord = gl::vec2(vertices[6], vertices[7]);
+      vertices += 8;
+    }
+  }
+}
+
+EMSCRIPTEN_KEEPALIVE
+bool emitFromMesh(const float *vertices, int triangle_count, int particle_count, int seed) {
+  if (particle_count <= 0) {
+    PRINT_ERROR("Mesh emitters need a positive particle count, got %d\n", particle_count);
+    return false;
+  }
+
+  gl::DefaultTriangleMesh mesh;
+  unpackTriangleMesh(vertices, triangle_count, mesh);
+  return g_app.emitFromMesh(mesh, particle_count, seed);
+}
+
+EMSCRIPTEN_KEEPALIVE
+bool bakeSignedDistanceField(const float *vertices, int triangle_count, int max_resolution, float padding) {
+  gl::DefaultTriangleMesh mesh;
+  unpackTriangleMesh(vertices, triangle_count, mesh);
+  return g_app.bakeSignedDistanceField(mesh, max_resolution, padding);
+}
+
+EMSCRIPTEN_KEEPALIVE
+void clearSignedDistanceField() {
+  g_app.clearSignedDistanceField();
+}
+
+EMSCRIPTEN_KEEPALIVE
+bool setCollisionMesh(const float *vertices, int triangle_count) {
+  gl::DefaultTriangleMesh mesh;
+  unpackTriangleMesh(vertices, triangle_count, mesh);
+  return g_app.setCollisionMesh(mesh);
+}
+
+EMSCRIPTEN_KEEPALIVE
+void clearCollisionMesh() {
+  g_app.clearCollisionMesh();
+}
+
+// The field is uploaded before this returns, so `data` can be freed right after
+EMSCRIPTEN_KEEPALIVE
+bool loadVectorField(const uint8_t *data, int size_bytes) {
+  return g_app.loadVectorField(data, size_bytes);
+}
+
+EMSCRIPTEN_KEEPALIVE
+void clearVectorField() {
+  g_app.clearVectorField();
+}
+
+// The octree file is copied, so it can be freed as soon as this returns
+EMSCRIPTEN_KEEPALIVE
+bool openPointOctree(const uint8_t *data, int size_bytes, int pool_page_count) {
+  return g_app.openPointOctree(data, size_bytes, pool_page_count);
+}
+
+EMSCRIPTEN_KEEPALIVE
+void closePointOctree() {
+  g_app.closePointOctree();
+}
+
+EMSCRIPTEN_KEEPALIVE
+void setPointOctreeErrorThreshold(float pixels) {
+  g_app.setPointOctreeErrorThreshold(pixels);
+}
+
+EMSCRIPTEN_KEEPALIVE
+int getPointOctreeDrawnPointCount() {
+  return g_app.getPointOctreeStats().drawn_point_count;
+}
+
+// Results are handed to `Module.onParticleReadback(texelsPtr, texelCount, width, height, attachmentMask, frame)`
+// while they're valid, in request order.
+EMSCRIPTEN_KEEPALIVE
+bool requestParticleReadback(int attachment_mask) {
+  return g_app.requestParticleReadback(attachment_mask, [](const ParticleReadbackData &data) {
+    int attachment_count = 0;
+    for (int i = 0; i < ParticleReadbackData::MAX_ATTACHMENTS; ++i) {
+      attachment_count += (data.attachment_mask >> i) & 1;
+    }
+    const int texel_count = attachment_count * data.width * data.height * 4;
+
+    EM_ASM({ Module["onParticleReadback"]($0, $1, $2, $3, $4, $5); },
+           data.texels, texel_count, data.width, data.height, data.attachment_mask, data.frame);
+  });
+}
+
+EMSCRIPTEN_KEEPALIVE
+float getSimulationTime() {
+  return g_app.getSimulationTime();
+}
+
+EMSCRIPTEN_KEEPALIVE
+int getSimulationFrame() {
+  return g_app.getSimulationFrame();
+}
+
+EMSCRIPTEN_KEEPALIVE
+void setMaxFramesInFlight(int count) {
+  g_app.setMaxFramesInFlight(count);
+}
+
+EMSCRIPTEN_KEEPALIVE
+double getFrameCpuTimeMs() {
+  return g_app.getFramePacerStats().average_cpu_time_ms;
+}
+
+EMSCRIPTEN_KEEPALIVE
+double getFrameFenceWaitMs() {
+  return g_app.getFramePacerStats().average_fence_wait_ms;
+}
+
+EMSCRIPTEN_KEEPALIVE
+double getFrameLatencyMs() {
+  return g_app.getFramePacerStats().average_frame_latency_ms;
+}
+
+EMSCRIPTEN_KEEPALIVE
+bool isFrameGpuBound() {
+  return g_app.getFramePacerStats().gpu_bound;
+}
+
+EMSCRIPTEN_KEEPALIVE
+void setResourcePoolBudget(double budget_bytes) {
+  g_app.setResourcePoolBudget(size_t(budget_bytes));
+}
+
+EMSCRIPTEN_KEEPALIVE
+double getResourcePoolHitCount() {
+  return g_app.getResourcePoolStats().hits;
+}
+
+EMSCRIPTEN_KEEPALIVE
+double getResourcePoolMissCount() {
+  return g_app.getResourcePoolStats().misses;
+}
+
+EMSCRIPTEN_KEEPALIVE
+double getResourcePoolSizeBytes() {
+  return g_app.getResourcePoolStats().pooled_bytes;
+}
+
+EMSCRIPTEN_KEEPALIVE
+void setMemoryBudget(double budget_bytes) {
+  g_app.setMemoryBudget(size_t(budget_bytes));
+}
+
+EMSCRIPTEN_KEEPALIVE
+double getMemoryTotalBytes() {
+  return g_app.getMemoryStats().total_bytes;
+}
+
+EMSCRIPTEN_KEEPALIVE
+double getMemoryPeakTotalBytes() {
+  return g_app.getMemoryStats().peak_total_bytes;
+}
+
+// Category indices follow `gl::MemoryCategory`: texture, renderbuffer, uniform buffer, vertex buffer, pixel buffer
+EMSCRIPTEN_KEEPALIVE
+double getMemoryCategoryBytes(int category) {
+  if (category < 0 || category >= gl::MEMORY_CATEGORY_COUNT) {
+    return 0.0;
+  }
+  return g_app.getMemoryStats().live_bytes[category];
+}
+
+EMSCRIPTEN_KEEPALIVE
+double getMemoryCategoryCount(int category) {
+  if (category < 0 || category >= gl::MEMORY_CATEGORY_COUNT) {
+    return 0.0;
+  }
+  return g_app.getMemoryStats().live_count[category];
+}
+
 } // extern "C"
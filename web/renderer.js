@@ -6,6 +6,15 @@ import ParticleRenderer from "./particle-renderer.js";
 
 const DEG_TO_RAD = Math.PI / 180;
 
+// Mirrors `FrameInput` in include/app/app.hpp
+const FRAME_INPUT_VIEWS_OFFSET = 40;
+const FRAME_INPUT_VIEW_SIZE = 144;
+const FRAME_INPUT_CONTROLLERS_OFFSET = 328;
+const FRAME_INPUT_CONTROLLER_SIZE = 64;
+const FRAME_INPUT_LATCHED_CONTROLLER_MASK_OFFSET = 456;
+const FRAME_INPUT_LATCHED_CONTROLLERS_OFFSET = 472;
+const FRAME_INPUT_SIMULATE = 1;
+
 class Camera {
   constructor() {
     this.position = vec3.create();
@@ -68,6 +77,8 @@ export class ParticleRendererElement extends HTMLElement {
     this.isReady = false;
 
     this.module = ParticleRenderer();
+    this.module.onParticleReadback = (...args) => this._onParticleReadback(...args);
+    this._particleReadbackRequests = [];
     this.module.onRuntimeInitialized = () => {
       this._webglContextHandle = this.module.GL.registerContext(this.webglContext, contextAttribs);
 
@@ -122,6 +133,22 @@ export class ParticleRendererElement extends HTMLElement {
     this.vrDisplay.requestAnimationFrame(onVRFrame);
   }
 
+  _startReplayAnimation(onFinished) {
+    const onReplayFrame = () => {
+      if (this._animationFrameCallback === onReplayFrame) {
+        this.module.GL.makeContextCurrent(this._webglContextHandle);
+        if (this.module._stepInputReplay()) {
+          window.requestAnimationFrame(onReplayFrame);
+        }
+        else {
+          onFinished();
+        }
+      }
+    };
+    this._animationFrameCallback = onReplayFrame;
+    window.requestAnimationFrame(onReplayFrame);
+  }
+
   _updateFrame(timestamp) {
     const deltaTime = this._prevFrameTimeMillis === 0 ? 0 : timestamp - this._prevFrameTimeMillis;
     this._prevFrameTimeMillis = timestamp;
@@ -132,58 +159,111 @@ export class ParticleRendererElement extends HTMLElement {
       quat.rotateZ(this._cameraRollQuat, this._cameraRollQuat, this._cameraRollDirection * 0.02);
       quat.mul(this.camera.orientation, this._cameraRollQuat, this.camera.orientation);
       this.camera.updateMatrices();
-      this._setViewAndProjectionMatrices(this.camera.viewMatrix, this.camera.projectionMatrix);
     }
 
-    if (navigator.getGamepads) {
-      const gamepads = navigator.getGamepads();
-      const controllerLeft = Array.prototype.find.call(gamepads, gp => gp && gp.hand === "left");
-      if (controllerLeft) {
-        this.setControllerAtIndex(0, controllerLeft);
-      }
-      const controllerRight = Array.prototype.find.call(gamepads, gp => gp && gp.hand === "right");
-      if (controllerRight) {
-        this.setControllerAtIndex(1, controllerRight);
-      }
-    }
+    const input = this._getFrameInput();
+    input.ints[5] = 0; // Controller mask
+    input.latchedControllerMask[0] = 0;
 
-    if (!this.timeIsPaused || this.stepOneFrame) {
-      this.module.GL.makeContextCurrent(this._webglContextHandle);
+    this._updateControllers();
 
+    if (!this.timeIsPaused || this.stepOneFrame) {
       this.timeMillis += deltaTime;
-      this.module._update(this.frameId, this.timeMillis / 1000.0, deltaTime);
-      this.module._simulate(this.canvasElem.width, this.canvasElem.height);
+
+      input.doubles[0] = this.timeMillis / 1000.0;
+      input.doubles[1] = deltaTime;
+      input.ints[0] = this.frameId;
+      input.ints[1] = FRAME_INPUT_SIMULATE;
 
       this.frameId++;
 
       this.stepOneFrame = false;
     }
+    else {
+      input.ints[1] = 0;
+    }
+
+    input.ints[2] = this.canvasElem.width;
+    input.ints[3] = this.canvasElem.height;
   }
 
-  _renderFrame() {
-    this.module.GL.makeContextCurrent(this._webglContextHandle);
+  _getFrameInput() {
+    // Typed array views are detached whenever the heap grows, so recreate them when the buffer changes
+    const heap = this.module.HEAPU8.buffer;
+    if (this._frameInputHeap !== heap) {
+      const ptr = this.module._getFrameInput();
+      this._frameInputHeap = heap;
+      this._frameInput = {
+        doubles: new Float64Array(heap, ptr, 2),
+        ints: new Int32Array(heap, ptr + 16, 6),
+        views: [0, 1].map(i => {
+          const offset = ptr + FRAME_INPUT_VIEWS_OFFSET + i * FRAME_INPUT_VIEW_SIZE;
+          return {
+            viewMatrix: new Float32Array(heap, offset, 16),
+            projectionMatrix: new Float32Array(heap, offset + 64, 16),
+            viewport: new Int32Array(heap, offset + 128, 4),
+          };
+        }),
+        controllers: [0, 1].map(i => this._createFrameInputController(heap, ptr + FRAME_INPUT_CONTROLLERS_OFFSET + i * FRAME_INPUT_CONTROLLER_SIZE)),
+        latchedControllerMask: new Int32Array(heap, ptr + FRAME_INPUT_LATCHED_CONTROLLER_MASK_OFFSET, 1),
+        latchedControllers: [0, 1].map(i => this._createFrameInputController(heap, ptr + FRAME_INPUT_LATCHED_CONTROLLERS_OFFSET + i * FRAME_INPUT_CONTROLLER_SIZE)),
+      };
+    }
+    return this._frameInput;
+  }
 
-    const gl = this.webglContext;
-    gl.viewport(0, 0, this.canvasElem.width, this.canvasElem.height);
-    gl.clearColor(0, 0, 0, 1);
-    gl.clear(gl.COLOR_BUFFER_BIT | gl.DEPTH_BUFFER_BIT);
+  _createFrameInputController(heap, offset) {
+    return {
+      position: new Float32Array(heap, offset, 4),
+      velocity: new Float32Array(heap, offset + 16, 4),
+      orientation: new Float32Array(heap, offset + 32, 4),
+      buttons: new Float32Array(heap, offset + 48, 4),
+    };
+  }
 
-    this.module._render(this.canvasElem.width, this.canvasElem.height);
+  _setFrameInputView(index, viewMatrix, projectionMatrix, x, y, width, height) {
+    const view = this._getFrameInput().views[index];
+    view.viewMatrix.set(viewMatrix);
+    view.projectionMatrix.set(projectionMatrix);
+    view.viewport[0] = x;
+    view.viewport[1] = y;
+    view.viewport[2] = width;
+    view.viewport[3] = height;
   }
 
-  _renderVRFrame() {
+  _updateControllers(latched = false) {
+    if (navigator.getGamepads) {
+      const gamepads = navigator.getGamepads();
+      const controllerLeft = Array.prototype.find.call(gamepads, gp => gp && gp.hand === "left");
+      if (controllerLeft) {
+        this._setFrameInputController(0, controllerLeft, latched);
+      }
+      const controllerRight = Array.prototype.find.call(gamepads, gp => gp && gp.hand === "right");
+      if (controllerRight) {
+        this._setFrameInputController(1, controllerRight, latched);
+      }
+    }
+  }
+
+  _renderFrame() {
+    const input = this._getFrameInput();
+    input.ints[4] = 1; // View count
+    this._setFrameInputView(0, this.camera.viewMatrix, this.camera.projectionMatrix, 0, 0, this.canvasElem.width, this.canvasElem.height);
+
     this.module.GL.makeContextCurrent(this._webglContextHandle);
+    this.module._frame();
+  }
 
+  _renderVRFrame() {
     const width = this.canvasElem.width;
     const height = this.canvasElem.height;
 
-    const gl = this.webglContext;
-    gl.viewport(0, 0, width, height);
-    gl.clearColor(0, 0, 0, 1);
-    gl.clear(gl.COLOR_BUFFER_BIT | gl.DEPTH_BUFFER_BIT);
-
     this.vrDisplay.getFrameData(this.vrFrameData);
 
+    // Polled again into the latched controllers, which the app applies after simulating and before drawing
+    // the views. `#pragma lateLatch` particles are resimulated with them.
+    this._updateControllers(true);
+
     if (false) { // this.vrDisplay.stageParameters) {
       mat4.mul(this._leftViewMatrix, this.vrFrameData.leftViewMatrix, this.vrDisplay.stageParameters.sittingToStandingTransform);
       mat4.mul(this._rightViewMatrix, this.vrFrameData.rightViewMatrix, this.vrDisplay.stageParameters.sittingToStandingTransform);
@@ -193,13 +273,13 @@ export class ParticleRendererElement extends HTMLElement {
       mat4.copy(this._rightViewMatrix, this.vrFrameData.rightViewMatrix);
     }
 
-    gl.viewport(0, 0, width * 0.5, height);
-    this._setViewAndProjectionMatrices(this._leftViewMatrix, this.vrFrameData.leftProjectionMatrix);
-    this.module._render(width * 0.5, height);
+    const input = this._getFrameInput();
+    input.ints[4] = 2; // View count
+    this._setFrameInputView(0, this._leftViewMatrix, this.vrFrameData.leftProjectionMatrix, 0, 0, width * 0.5, height);
+    this._setFrameInputView(1, this._rightViewMatrix, this.vrFrameData.rightProjectionMatrix, width * 0.5, 0, width * 0.5, height);
 
-    gl.viewport(width * 0.5, 0, width * 0.5, height);
-    this._setViewAndProjectionMatrices(this._rightViewMatrix, this.vrFrameData.rightProjectionMatrix);
-    this.module._render(width * 0.5, height);
+    this.module.GL.makeContextCurrent(this._webglContextHandle);
+    this.module._frame();
 
     this.vrDisplay.submitFrame();
   }
@@ -283,19 +363,6 @@ export class ParticleRendererElement extends HTMLElement {
     }
   }
 
-  _setViewAndProjectionMatrices(viewMatrixF32, projectionMatrixF32) {
-    const viewMatrixOffset = this.module._malloc(16 * Float32Array.BYTES_PER_ELEMENT);
-    this.module.HEAPF32.set(viewMatrixF32, viewMatrixOffset / Float32Array.BYTES_PER_ELEMENT);
-
-    const projectionMatrixOffset = this.module._malloc(16 * Float32Array.BYTES_PER_ELEMENT);
-    this.module.HEAPF32.set(projectionMatrixF32, projectionMatrixOffset / Float32Array.BYTES_PER_ELEMENT);
-
-    this.module._setViewAndProjectionMatrices(viewMatrixOffset, projectionMatrixOffset);
-
-    this.module._free(viewMatrixOffset);
-    this.module._free(projectionMatrixOffset);
-  }
-
   rewind() {
     this._prevFrameTimeMillis = 0;
     this.timeMillis = 0;
@@ -372,6 +439,202 @@ export class ParticleRendererElement extends HTMLElement {
     }
   }
 
+  startInputRecording() {
+    this.module._startInputRecording();
+  }
+
+  // Returns a copy of the recorded input log
+  stopInputRecording() {
+    this.module._stopInputRecording();
+    const ptr = this.module._getInputRecordingData();
+    const size = this.module._getInputRecordingSize();
+    return this.module.HEAPU8.slice(ptr, ptr + size);
+  }
+
+  // Drives the renderer from an input log, one recorded frame per animation frame, then resumes normal
+  // animation. Resolves with the number of frames replayed and the wall time they took.
+  replayInputRecording(data) {
+    const ptr = this.module._malloc(data.byteLength);
+    this.module.HEAPU8.set(data, ptr);
+    const loaded = this.module._loadInputReplay(ptr, data.byteLength);
+    this.module._free(ptr);
+
+    if (!loaded) {
+      return Promise.reject(new Error("Invalid input recording"));
+    }
+
+    return new Promise((resolve) => {
+      const startTime = performance.now();
+      this._startReplayAnimation(() => {
+        const durationMillis = performance.now() - startTime;
+        this._prevFrameTimeMillis = 0;
+        this._startAnimation();
+        resolve({ frameCount: this.module._getInputReplayFrameIndex(), durationMillis });
+      });
+    });
+  }
+
+  // Returns a copy of the current particle state, or null if nothing has been simulated yet
+  saveParticleSnapshot() {
+    this.module.GL.makeContextCurrent(this._webglContextHandle);
+    if (!this.module._saveParticleSnapshot()) {
+      return null;
+    }
+    const ptr = this.module._getParticleSnapshotData();
+    const size = this.module._getParticleSnapshotSize();
+    return this.module.HEAPU8.slice(ptr, ptr + size);
+  }
+
+  // Restores particle state saved by `saveParticleSnapshot`, and continues time from where it was taken
+  restoreParticleSnapshot(data) {
+    const ptr = this.module._malloc(data.byteLength);
+    this.module.HEAPU8.set(data, ptr);
+    this.module.GL.makeContextCurrent(this._webglContextHandle);
+    const restored = this.module._restoreParticleSnapshot(ptr, data.byteLength);
+    this.module._free(ptr);
+
+    if (restored) {
+      this._prevFrameTimeMillis = 0;
+      this.timeMillis = this.module._getSimulationTime() * 1000.0;
+      this.frameId = this.module._getSimulationFrame() + 1;
+    }
+    return !!restored;
+  }
+
+  // Replaces the particles with the points of a PLY or XYZ file (an ArrayBuffer or typed array). The
+  // particle count follows the point count. Points keep arriving over the next frames, see
+  // `getPointCloudImportProgress`.
+  importPointCloud(data) {
+    const bytes = data instanceof Uint8Array ? data : new Uint8Array(data.buffer || data, data.byteOffset || 0, data.byteLength);
+    const ptr = this.module._malloc(bytes.byteLength);
+    this.module.HEAPU8.set(bytes, ptr);
+    this.module.GL.makeContextCurrent(this._webglContextHandle);
+    const imported = this.module._importPointCloud(ptr, bytes.byteLength);
+    this.module._free(ptr);
+    return !!imported;
+  }
+
+  getPointCloudImportProgress() {
+    return this.module._getPointCloudImportProgress();
+  }
+
+  // Replaces the particles with `particleCount` points spread evenly over a mesh. `vertices` is a
+  // Float32Array of 3 vertices per triangle, each position xyz, normal xyz, texcoord uv. Positions land in
+  // attachment 0, texcoords in attachment 1 and normals in attachment 2.
+  emitFromMesh(vertices, particleCount, seed = 0) {
+    const ptr = this.module._malloc(vertices.byteLength);
+    this.module.HEAPF32.set(vertices, ptr / Float32Array.BYTES_PER_ELEMENT);
+    this.module.GL.makeContextCurrent(this._webglContextHandle);
+    const emitted = this.module._emitFromMesh(ptr, vertices.length / 24, particleCount, seed);
+    this.module._free(ptr);
+    return !!emitted;
+  }
+
+  // Bakes a closed mesh, in the same layout as `emitFromMesh`, into a signed distance field that shaders can
+  // read with sdfDistance() and sdfNormal(). `maxResolution` is the voxel count along the longest side and
+  // `padding` grows the bounds on every side so particles feel the surface before reaching it.
+  bakeSignedDistanceField(vertices, maxResolution = 64, padding = 0.1) {
+    const ptr = this.module._malloc(vertices.byteLength);
+    this.module.HEAPF32.set(vertices, ptr / Float32Array.BYTES_PER_ELEMENT);
+    this.module.GL.makeContextCurrent(this._webglContextHandle);
+    const baked = this.module._bakeSignedDistanceField(ptr, vertices.length / 24, maxResolution, padding);
+    this.module._free(ptr);
+    return !!baked;
+  }
+
+  clearSignedDistanceField() {
+    this.module.GL.makeContextCurrent(this._webglContextHandle);
+    this.module._clearSignedDistanceField();
+  }
+
+  // Uploads a mesh, in the same layout as `emitFromMesh`, for simulation shaders to collide particles with
+  // exactly through meshIntersectSegment().
+  setCollisionMesh(vertices) {
+    const ptr = this.module._malloc(vertices.byteLength);
+    this.module.HEAPF32.set(vertices, ptr / Float32Array.BYTES_PER_ELEMENT);
+    this.module.GL.makeContextCurrent(this._webglContextHandle);
+    const set = this.module._setCollisionMesh(ptr, vertices.length / 24);
+    this.module._free(ptr);
+    return !!set;
+  }
+
+  clearCollisionMesh() {
+    this.module.GL.makeContextCurrent(this._webglContextHandle);
+    this.module._clearCollisionMesh();
+  }
+
+  // Loads a vector field for shaders to advect particles with vectorFieldSample(). `data` holds an FGA file
+  // or the binary format written natively by writeVectorField.
+  loadVectorField(data) {
+    const bytes = data instanceof Uint8Array ? data : new Uint8Array(data.buffer || data, data.byteOffset || 0, data.byteLength);
+    const ptr = this.module._malloc(bytes.byteLength);
+    this.module.HEAPU8.set(bytes, ptr);
+    this.module.GL.makeContextCurrent(this._webglContextHandle);
+    const loaded = this.module._loadVectorField(ptr, bytes.byteLength);
+    this.module._free(ptr);
+    return !!loaded;
+  }
+
+  clearVectorField() {
+    this.module.GL.makeContextCurrent(this._webglContextHandle);
+    this.module._clearVectorField();
+  }
+
+  // Draws a point octree file (built natively with App::buildPointOctree) alongside the particles, streaming
+  // nodes to the GPU as the view needs them. At most `poolPageCount` nodes of 4096 points stay resident.
+  openPointOctree(data, poolPageCount = 256) {
+    const bytes = data instanceof Uint8Array ? data : new Uint8Array(data.buffer || data, data.byteOffset || 0, data.byteLength);
+    const ptr = this.module._malloc(bytes.byteLength);
+    this.module.HEAPU8.set(bytes, ptr);
+    this.module.GL.makeContextCurrent(this._webglContextHandle);
+    const opened = this.module._openPointOctree(ptr, bytes.byteLength, poolPageCount);
+    this.module._free(ptr);
+    return !!opened;
+  }
+
+  closePointOctree() {
+    this.module.GL.makeContextCurrent(this._webglContextHandle);
+    this.module._closePointOctree();
+  }
+
+  setPointOctreeErrorThreshold(pixels) {
+    this.module._setPointOctreeErrorThreshold(pixels);
+  }
+
+  getPointOctreeDrawnPointCount() {
+    return this.module._getPointOctreeDrawnPointCount();
+  }
+
+  // Resolves with a copy of the requested attachments (an array of indices) of the latest particle state, a
+  // frame or two later. Rejects if nothing has been simulated yet or too many readbacks are in flight.
+  requestParticleReadback(attachments) {
+    const mask = attachments.reduce((mask, index) => mask | (1 << index), 0);
+
+    this.module.GL.makeContextCurrent(this._webglContextHandle);
+    if (!this.module._requestParticleReadback(mask)) {
+      return Promise.reject(new Error("Particle readback unavailable"));
+    }
+
+    return new Promise((resolve) => this._particleReadbackRequests.push(resolve));
+  }
+
+  _onParticleReadback(texelsPtr, texelCount, width, height, attachmentMask, frame) {
+    const texels = this.module.HEAPF32.slice(texelsPtr / Float32Array.BYTES_PER_ELEMENT, texelsPtr / Float32Array.BYTES_PER_ELEMENT + texelCount);
+    const attachments = {};
+    let offset = 0;
+    for (let i = 0; i < 32; ++i) {
+      if (attachmentMask & (1 << i)) {
+        attachments[i] = texels.subarray(offset, offset + width * height * 4);
+        offset += width * height * 4;
+      }
+    }
+
+    const resolve = this._particleReadbackRequests.shift();
+    if (resolve) {
+      resolve({ width, height, frame, attachments });
+    }
+  }
+
   getShaderSourceAtIndex(index) {
     return this.module.UTF8ToString(this.module._getUserShaderSourceAtIndex(index));
   }
@@ -392,23 +655,67 @@ export class ParticleRendererElement extends HTMLElement {
     }
   }
 
+  getShaderVariants() {
+    const variants = [];
+    const count = this.module._getShaderVariantCount();
+    for (let i = 0; i < count; ++i) {
+      variants.push({
+        name: this.module.UTF8ToString(this.module._getShaderVariantNameAtIndex(i)),
+        value: this.module.UTF8ToString(this.module._getShaderVariantValueAtIndex(i)),
+      });
+    }
+    return variants;
+  }
+
+  setShaderVariant(name, value) {
+    const nameOffset = this.module.allocateUTF8(name);
+    const valueOffset = this.module.allocateUTF8(String(value));
+    const success = this.module._setShaderVariant(nameOffset, valueOffset);
+    this.module._free(nameOffset);
+    this.module._free(valueOffset);
+    return !!success;
+  }
+
+  getUserParams() {
+    const params = [];
+    const count = this.module._getUserParamCount();
+    for (let i = 0; i < count; ++i) {
+      params.push({
+        name: this.module.UTF8ToString(this.module._getUserParamNameAtIndex(i)),
+        value: this.module._getUserParamValueAtIndex(i),
+        defaultValue: this.module._getUserParamDefaultAtIndex(i),
+        min: this.module._getUserParamMinAtIndex(i),
+        max: this.module._getUserParamMaxAtIndex(i),
+      });
+    }
+    return params;
+  }
+
+  setUserParam(name, value) {
+    const offset = this.module.allocateUTF8(name);
+    const found = this.module._setUserParam(offset, value);
+    this.module._free(offset);
+    return !!found;
+  }
+
   setControllerAtIndex(index, controller) {
-    const positionOffset = this.module._malloc(3 * Float32Array.BYTES_PER_ELEMENT);
+    this._setFrameInputController(index, controller, false);
+  }
+
+  _setFrameInputController(index, controller, latched) {
+    const input = this._getFrameInput();
+    const dest = latched ? input.latchedControllers[index] : input.controllers[index];
+
     if (controller.pose.position) {
-      this.module.HEAPF32.set(controller.pose.position, positionOffset / Float32Array.BYTES_PER_ELEMENT);
+      dest.position.set(controller.pose.position);
     }
-
-    const velocityOffset = this.module._malloc(3 * Float32Array.BYTES_PER_ELEMENT);
     if (controller.pose.linearVelocity) {
-      this.module.HEAPF32.set(controller.pose.linearVelocity, velocityOffset / Float32Array.BYTES_PER_ELEMENT);
+      dest.velocity.set(controller.pose.linearVelocity);
     }
-
-    const orientationOffset = this.module._malloc(4 * Float32Array.BYTES_PER_ELEMENT);
     if (controller.pose.orientation) {
-      this.module.HEAPF32.set(controller.pose.orientation, orientationOffset / Float32Array.BYTES_PER_ELEMENT);
+      dest.orientation.set(controller.pose.orientation);
     }
 
-    const buttonsOffset = this.module._malloc(4 * Float32Array.BYTES_PER_ELEMENT);
     if (controller.buttons) {
       if (controller.id.startsWith("Oculus Touch")) {
         for (let i = 0; i < 4; ++i) {
@@ -421,14 +728,14 @@ export class ParticleRendererElement extends HTMLElement {
         this._controllerButtons[2] = controller.buttons[0].value;
         this._controllerButtons[3] = controller.buttons[3].value;
       }
-      this.module.HEAPF32.set(this._controllerButtons, buttonsOffset / Float32Array.BYTES_PER_ELEMENT);
+      dest.buttons.set(this._controllerButtons);
     }
 
-    this.module._setControllerAtIndex(index, positionOffset, velocityOffset, orientationOffset, buttonsOffset);
-
-    this.module._free(positionOffset);
-    this.module._free(velocityOffset);
-    this.module._free(orientationOffset);
-    this.module._free(buttonsOffset);
+    if (latched) {
+      input.latchedControllerMask[0] |= 1 << index;
+    }
+    else {
+      input.ints[5] |= 1 << index;
+    }
   }
 }